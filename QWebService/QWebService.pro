@@ -10,7 +10,7 @@ TARGET   = QWebService
 
 TEMPLATE = lib
 
-CONFIG   += dll
+CONFIG   += dll c++11
 
 DEFINES  += QWEBSERVICE_LIBRARY
 
@@ -25,6 +25,13 @@ SOURCES  += \
     sources/qwebservicemethod.cpp \
     sources/qwsdl.cpp \
     sources/qwebservice.cpp \
+    sources/qwebtrace.cpp \
+    sources/qwebdispatcher.cpp \
+    sources/qwebreply.cpp \
+    sources/qwebscheduler.cpp \
+    sources/qwebconnectionpool.cpp \
+    sources/qwebbalancer.cpp \
+    sources/qwebmirror.cpp \
 
 HEADERS  += headers/QWebService_global.h \
     headers/QWebService \
@@ -32,10 +39,21 @@ HEADERS  += headers/QWebService_global.h \
     headers/qwebservicemethod.h \
     headers/qwsdl.h \
     headers/qwebservice.h \
+    headers/qwebtrace.h \
+    headers/qwebdispatcher.h \
+    headers/qwebreply.h \
+    headers/qwebconnectionpool.h \
     headers/qwebmethod_p.h \
     headers/qwebservicemethod_p.h \
     headers/qwebservice_p.h \
     headers/qwsdl_p.h \
+    headers/qwebtrace_p.h \
+    headers/qwebdispatcher_p.h \
+    headers/qwebreply_p.h \
+    headers/qwebscheduler_p.h \
+    headers/qwebconnectionpool_p.h \
+    headers/qwebbalancer_p.h \
+    headers/qwebmirror_p.h \
     headers/QtWebServiceQml.h
 
 INSTALLS += target
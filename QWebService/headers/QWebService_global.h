@@ -5,6 +5,9 @@
 #include <QtCore/qdebug.h>
 #include <QtCore/qcoreapplication.h>
 
+// Also used on some private classes (QWebMethodPrivate, QWsdlPrivate...),
+// so that benchmarks and tests, linked against the shared library, can
+// reach the internals.
 #if defined(QWEBSERVICE_LIBRARY)
 #define QWEBSERVICESHARED_EXPORT Q_DECL_EXPORT
 #else
@@ -0,0 +1,106 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#ifndef QWEBBALANCER_P_H
+#define QWEBBALANCER_P_H
+
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qmap.h>
+#include <QtCore/qurl.h>
+#include <QtCore/qvector.h>
+#include <QtNetwork/qnetworkreply.h>
+#include "qwebservice.h"
+
+/*
+  Spreads calls of QWebService over endpoints (usually all port
+  addresses found in WSDL), using one of QWebService::LoadBalancing
+  policies. Consistent hashing places each endpoint on a ring
+  VirtualNodes times, so that adding or removing an endpoint moves only
+  keys of that endpoint.
+
+  Health is checked passively: an endpoint which fails ejectionFailures
+  calls in a row (connection errors, 502, 503, 504) is ejected, that is
+  not picked, for ejectionTime multiplied by number of its ejections so
+  far. The last available endpoint is never ejected.
+  */
+class QWEBSERVICESHARED_EXPORT QWebBalancer
+{
+public:
+    QWebBalancer();
+
+    void setEndpoints(const QList<QUrl> &urls);
+    QList<QUrl> endpoints() const;
+
+    QUrl pick(const QByteArray &key = QByteArray());
+    QUrl pickOther(const QUrl &excluded) const;
+    void callStarted(quint64 callId, const QUrl &endpoint, QWebMethod *method);
+    void callFinished(quint64 callId, QNetworkReply::NetworkError error, int httpStatus);
+    void callCancelled(quint64 callId);
+    void forgetMethod(QWebMethod *method);
+
+    QList<QWebEndpointStats> stats() const;
+    static bool isFailure(QNetworkReply::NetworkError error, int httpStatus);
+    static quint32 hash(const QByteArray &data);
+
+    // Longest ejection is MaxEjectionFactor times ejectionTime.
+    enum { VirtualNodes = 64, MaxEjectionFactor = 10 };
+
+    QWebService::LoadBalancing policy;
+    int ejectionFailures;
+    // Base ejection time, in milliseconds.
+    int ejectionTime;
+
+private:
+    struct Endpoint
+    {
+        Endpoint() : outstanding(0), completed(0), failed(0), consecutiveFailures(0),
+            ejections(0), ejectedUntil(0) {}
+
+        QUrl url;
+        int outstanding;
+        qint64 completed;
+        qint64 failed;
+        int consecutiveFailures;
+        int ejections;
+        // In milliseconds of clock.
+        qint64 ejectedUntil;
+    };
+
+    bool isAvailable(const Endpoint &endpoint, qint64 now) const;
+    int availableCount(qint64 now) const;
+    int indexOf(const QUrl &url) const;
+    int pickRoundRobin(qint64 now);
+    int pickLeastOutstanding(qint64 now);
+    int pickConsistentHash(const QByteArray &key, qint64 now);
+
+    QVector<Endpoint> m_endpoints;
+    // Points of consistent hashing ring, and their endpoint indexes.
+    QMap<quint32, int> m_ring;
+    struct Call
+    {
+        QUrl endpoint;
+        QWebMethod *method;
+    };
+
+    // Calls in flight.
+    QHash<quint64, Call> m_calls;
+    int m_next;
+    QElapsedTimer m_clock;
+};
+
+#endif // QWEBBALANCER_P_H
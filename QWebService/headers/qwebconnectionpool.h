@@ -0,0 +1,71 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#ifndef QWEBCONNECTIONPOOL_H
+#define QWEBCONNECTIONPOOL_H
+
+#include <QtCore/qobject.h>
+#include <QtCore/qurl.h>
+#include "QWebService_global.h"
+
+class QWebConnectionPoolPrivate;
+
+struct QWebConnectionStats
+{
+    QWebConnectionStats() : endpoints(0), open(0), idle(0), inFlight(0), evicted(0) {}
+
+    // Network access managers (one per thread, host and lane).
+    int endpoints;
+    // Estimated sockets: open, and open but not used by any call.
+    int open;
+    int idle;
+    int inFlight;
+    // Sockets closed by the pool (budget or idle timeout), in total.
+    qint64 evicted;
+};
+
+class QWEBSERVICESHARED_EXPORT QWebConnectionPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QWebConnectionPool(QObject *parent = 0);
+    ~QWebConnectionPool();
+
+    static QWebConnectionPool *globalInstance();
+
+    int maxSockets() const;
+    void setMaxSockets(int count);
+    int idleTimeout() const;
+    void setIdleTimeout(int msecs);
+    int minimumConnections(const QUrl &host) const;
+    void setMinimumConnections(const QUrl &host, int count);
+
+    QWebConnectionStats stats() const;
+
+public slots:
+    void evictIdle();
+
+protected:
+    QWebConnectionPoolPrivate *d_ptr;
+
+private:
+    Q_DISABLE_COPY(QWebConnectionPool)
+    Q_DECLARE_PRIVATE(QWebConnectionPool)
+};
+
+#endif // QWEBCONNECTIONPOOL_H
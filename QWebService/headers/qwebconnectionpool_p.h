@@ -0,0 +1,92 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#ifndef QWEBCONNECTIONPOOL_P_H
+#define QWEBCONNECTIONPOOL_P_H
+
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qpointer.h>
+#include <QtCore/qtimer.h>
+#include <QtNetwork/qnetworkaccessmanager.h>
+#include "qwebconnectionpool.h"
+
+/*
+  Shares network access managers between all web methods (and dispatcher
+  threads) of a thread: one manager per host and connection lane, so that
+  connections of a host are reused, and can be closed together.
+
+  QNetworkAccessManager does not report its sockets, so they are
+  estimated: an endpoint is assumed to keep as many connections open as
+  calls it had in flight at once (up to ConnectionsPerHost), until it is
+  evicted. Evicting clears manager's connection cache, which closes its
+  idle connections; it is only done while the endpoint has no call in
+  flight.
+
+  All members are guarded by the mutex; managers are only used in their
+  own thread.
+  */
+class QWebConnectionPoolPrivate
+{
+    Q_DECLARE_PUBLIC(QWebConnectionPool)
+
+public:
+    QWebConnectionPoolPrivate(QWebConnectionPool *q) :
+        q_ptr(q), maxSockets(0), idleTimeout(0), evicted(0), reapTimer(0) {}
+    QWebConnectionPool *q_ptr;
+
+    static QWebConnectionPoolPrivate *get(QWebConnectionPool *q) { return q->d_func(); }
+
+    QNetworkAccessManager *acquire(const QUrl &url, const QString &lane);
+    bool release(QNetworkAccessManager *manager);
+
+    enum { ConnectionsPerHost = 6 };
+
+    struct Endpoint
+    {
+        Endpoint() : thread(0), inFlight(0), open(0), lastUsed(0) {}
+
+        QPointer<QNetworkAccessManager> manager;
+        QThread *thread;
+        QString host;
+        int inFlight;
+        int open;
+        qint64 lastUsed;
+    };
+
+    void enforceBudget();
+    void reap(bool all);
+    bool isProtected(const Endpoint &endpoint) const;
+    void evict(Endpoint &endpoint);
+    void forget(QNetworkAccessManager *manager);
+    static void clearIfIdle(QWebConnectionPool *pool, QNetworkAccessManager *manager);
+
+    mutable QMutex mutex;
+    // By thread, host and lane.
+    QHash<QString, Endpoint> endpoints;
+    QHash<QNetworkAccessManager *, QString> keys;
+    // Minimum connections kept warm, by host (see QWebScheduler::hostKey()).
+    QHash<QString, int> minimums;
+    int maxSockets;
+    int idleTimeout;
+    qint64 evicted;
+    QElapsedTimer clock;
+    QTimer *reapTimer;
+};
+
+#endif // QWEBCONNECTIONPOOL_P_H
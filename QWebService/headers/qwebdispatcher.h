@@ -0,0 +1,48 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#ifndef QWEBDISPATCHER_H
+#define QWEBDISPATCHER_H
+
+#include <QtCore/qobject.h>
+#include "QWebService_global.h"
+
+class QWebDispatcherPrivate;
+
+class QWEBSERVICESHARED_EXPORT QWebDispatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QWebDispatcher(int threadCount = 0, QObject *parent = 0);
+    ~QWebDispatcher();
+
+    static QWebDispatcher *globalInstance();
+
+    int threadCount() const;
+    int pendingCalls() const;
+
+protected:
+    QWebDispatcherPrivate *d_ptr;
+
+private:
+    Q_DISABLE_COPY(QWebDispatcher)
+    Q_DECLARE_PRIVATE(QWebDispatcher)
+};
+
+#endif // QWEBDISPATCHER_H
@@ -0,0 +1,151 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#ifndef QWEBDISPATCHER_P_H
+#define QWEBDISPATCHER_P_H
+
+#include <QtCore/qatomic.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qobject.h>
+#include <QtCore/qthread.h>
+#include <QtCore/qvector.h>
+#include <QtNetwork/qnetworkaccessmanager.h>
+#include <QtNetwork/qnetworkreply.h>
+#include <QtNetwork/qnetworkrequest.h>
+#include "qwebdispatcher.h"
+
+#include <functional>
+
+struct QWebCallResult;
+
+/*
+  A single request, as handed over to a network thread. Everything needed
+  to send it is copied, so that the submitting object is not touched
+  from the network thread.
+  */
+struct QWebCall
+{
+    QWebCall() : id(0), context(0) {}
+
+    quint64 id;
+    QString methodName;
+    QNetworkRequest request;
+    QByteArray verb;
+    QByteArray data;
+    // Connection lane (see QWebMethod::setLane()). Calls of different
+    // lanes never share connections.
+    QString lane;
+    // Completion is delivered in the thread of context. If context
+    // is 0, completion runs directly in the network thread.
+    QObject *context;
+    std::function<void (const QWebCallResult &)> completion;
+};
+
+/*
+  Outcome of a call, delivered to QWebCall::completion.
+  */
+struct QWebCallResult
+{
+    QWebCallResult() : id(0), error(QNetworkReply::NoError), httpStatus(0) {}
+
+    quint64 id;
+    QByteArray data;
+    QNetworkReply::NetworkError error;
+    QString errorString;
+    int httpStatus;
+};
+
+class QWebDispatcherPrivate;
+
+/*
+  Lives in one network thread. Takes network access managers of that
+  thread from the global QWebConnectionPool, so that each worker keeps
+  its own connections.
+  Calls are submitted from any thread into a mutex-protected queue; only
+  the first submission after a drain wakes the thread up. Load (calls
+  queued or in flight) is counted atomically, for QWebDispatcherPrivate::
+  workerFor().
+  */
+class QWebNetworkWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QWebNetworkWorker(QWebDispatcherPrivate *dispatcher);
+
+    void submit(const QWebCall &call);
+    void abort(quint64 callId);
+    int load() const { return m_load.loadAcquire(); }
+
+private slots:
+    void drainQueue();
+    void abortCall(quint64 callId);
+    void replyFinished();
+
+private:
+    QWebDispatcherPrivate *m_dispatcher;
+
+    QMutex m_queueMutex;
+    QVector<QWebCall> m_queue;
+    bool m_wakeUpPending;
+    QAtomicInt m_load;
+
+    QHash<QNetworkReply *, QWebCall> m_inFlight;
+    // Replies in flight, by call id (for abortCall()).
+    QHash<quint64, QNetworkReply *> m_replies;
+};
+
+class QWebDispatcherPrivate
+{
+    Q_DECLARE_PUBLIC(QWebDispatcher)
+
+public:
+    QWebDispatcherPrivate(QWebDispatcher *q) : q_ptr(q) {}
+    QWebDispatcher *q_ptr;
+
+    static QWebDispatcherPrivate *get(QWebDispatcher *q) { return q->d_func(); }
+
+    void init(int threadCount);
+    void shutdown();
+
+    void submit(const QWebCall &call);
+    QWebCallResult callBlocking(QWebCall call, int timeout);
+    void cancelCall(quint64 callId);
+    void cancelCalls(QObject *context);
+    void complete(const QWebCall &call, const QWebCallResult &result);
+    QWebNetworkWorker *workerFor();
+
+    QVector<QThread *> threads;
+    QVector<QWebNetworkWorker *> workers;
+    // Where workerFor() starts looking, so that ties are spread.
+    QAtomicInt nextWorker;
+
+    struct PendingCall
+    {
+        QObject *context;
+        QWebNetworkWorker *worker;
+    };
+
+    // Calls that were submitted, and not completed or cancelled yet.
+    QMutex callsMutex;
+    QHash<quint64, PendingCall> calls;
+    QAtomicInt pendingCount;
+};
+
+#endif // QWEBDISPATCHER_P_H
@@ -31,8 +31,25 @@
 #include <QtCore/qdatetime.h>
 #include <QtCore/qcoreapplication.h>
 #include "QWebService_global.h"
+#include "qwebreply.h"
 
 class QWebMethodPrivate;
+class QWebDispatcher;
+class QWebConnectionPool;
+class QThreadPool;
+
+struct QWebHedgingStats
+{
+    QWebHedgingStats() : calls(0), hedged(0), wins(0), delay(-1) {}
+
+    // Calls made with hedging on, duplicates sent, and duplicates
+    // which replied first.
+    qint64 calls;
+    qint64 hedged;
+    qint64 wins;
+    // Current hedging delay, in milliseconds. Negative: not hedging yet.
+    int delay;
+};
 
 class QWEBSERVICESHARED_EXPORT QWebMethod : public QObject
 {
@@ -115,7 +132,20 @@ public:
     void setHttpMethod(HttpMethod method);
     bool setHttpMethod(const QString &newMethod);
 
+    QWebDispatcher *dispatcher() const;
+    void setDispatcher(QWebDispatcher *dispatcher);
+    QThreadPool *decodePool() const;
+    void setDecodePool(QThreadPool *pool);
+    QWebConnectionPool *connectionPool() const;
+    void setConnectionPool(QWebConnectionPool *pool);
+    QString lane() const;
+    void setLane(const QString &lane);
+    bool isHedging() const;
+    void setHedging(int delay, int maxExtraLoad = 10, int percentile = 0);
+    QWebHedgingStats hedgingStats() const;
+
     Q_INVOKABLE bool invokeMethod(const QByteArray &requestData = QByteArray());
+    QFuture<QWebReply> invokeMethodAsync(const QByteArray &requestData = QByteArray());
     QVariant replyReadParsed();
     QByteArray replyReadRaw();
     Q_INVOKABLE QString replyRead();
@@ -28,9 +28,38 @@
 #include <QtCore/qvariant.h>
 #include <QtCore/qmap.h>
 #include <QtCore/qbytearray.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qfutureinterface.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qpointer.h>
+#include <QtCore/qrunnable.h>
+#include <QtCore/qsharedpointer.h>
+#include <QtCore/qthreadpool.h>
+#include <QtCore/qvector.h>
 #include "qwebmethod.h"
+#include "qwebconnectionpool.h"
+#include "qwebdispatcher.h"
+#include "qwebreply.h"
+#include "qwebservice.h"
 
-class QWebMethodPrivate
+struct QWebCall;
+struct QWebCallResult;
+
+/*
+  Shared between a web method and its decode tasks. Tasks post results
+  back only while the method is alive; the method clears the flag (under
+  the mutex) when it is destroyed.
+  */
+struct QWebDecodeQueue
+{
+    QWebDecodeQueue() : alive(true) {}
+
+    QMutex mutex;
+    bool alive;
+};
+
+class QWEBSERVICESHARED_EXPORT QWebMethodPrivate
 {
     Q_DECLARE_PUBLIC(QWebMethod)
 
@@ -39,9 +68,51 @@ public:
     QWebMethodPrivate(QWebMethod *q) : q_ptr(q) {}
     QWebMethod *q_ptr;
 
+    static QWebMethodPrivate *get(QWebMethod *q) { return q->d_func(); }
+
     void init();
+    static quint64 nextCallId();
+    quint64 invoke(const QByteArray &requestData, const QString &laneName,
+                   const QUrl &endpoint = QUrl());
     void prepareRequestData();
-    QString convertReplyToUtf(const QString &textToConvert);
+    QByteArray requestData(const QMap<QString, QVariant> &params) const;
+    QNetworkRequest buildRequest(const QUrl &target = QUrl()) const;
+    bool usesOwnConnections() const;
+    bool releaseConnection(QNetworkReply *netReply);
+    QNetworkAccessManager *managerFor(const QString &laneName);
+    QNetworkReply *send(quint64 callId, const QNetworkRequest &request,
+                        const QByteArray &body, const QString &laneName);
+    int hedgeDelay() const;
+    void hedge(quint64 callId);
+    bool settleHedge(quint64 callId, QNetworkReply *netReply);
+    void finishAttempt(quint64 attemptId, QNetworkReply *netReply);
+    void cancelAttempt(quint64 attemptId);
+    void abandon(QNetworkReply *netReply);
+    QByteArray httpVerb() const;
+    QWebCall makeCall(quint64 callId, const QByteArray &requestData,
+                      const QUrl &target = QUrl()) const;
+    void callCompleted(const QWebCallResult &result);
+    void finishCall(quint64 callId, QNetworkReply::NetworkError error,
+                    const QString &errorString, int httpStatus);
+    void releaseCall(quint64 callId, QNetworkReply::NetworkError error, int httpStatus);
+    void decodeFinished(quint64 sequence, const QWebReply &result);
+    static void decodeReply(QWebReply &result, QWebMethod::Protocol protocol,
+                            const QMap<QString, QVariant> &returnValues);
+    static void fulfill(QFutureInterface<QWebReply> &promise, const QWebReply &result);
+    QWebReply deletedReply() const;
+    static QWebReply failedReply(const QString &methodName,
+                                 QNetworkReply::NetworkError error,
+                                 const QString &errorString);
+    static QFuture<QWebReply> failedCall(const QString &methodName,
+                                         QNetworkReply::NetworkError error,
+                                         const QString &errorString);
+    QVariant parseReply(const QString &replyString) const;
+    static QVariant parseReply(const QString &replyString, QWebMethod::Protocol protocol,
+                               const QString &methodName,
+                               const QMap<QString, QVariant> &returnValues);
+    static QString convertReplyToUtf(const QString &textToConvert);
+    static int indexOfTag(const QString &text, const char *prefix,
+                          const QString &name, int from);
     bool enterErrorState(const QString &errMessage = QString());
 
     bool errorState;
@@ -60,8 +131,93 @@ public:
     QByteArray reply;
     QMap<QString, QVariant> parameters;
     QMap<QString, QVariant> returnValue;
+    // Own managers of the default lane (0 until used) and of other lanes,
+    // see usesOwnConnections().
     QNetworkAccessManager *manager;
+    QString lane;
+    QHash<QString, QNetworkAccessManager *> laneManagers;
+    // If set, calls without credentials share managers of this pool.
+    // Pool of each reply sent through one, so that it is released there.
+    QPointer<QWebConnectionPool> connectionPool;
+    QHash<QNetworkReply *, QPointer<QWebConnectionPool> > pooledReplies;
     QByteArray data;
+    // Ids of calls, used by QWebTrace.
+    QHash<QNetworkReply *, quint64> pendingCalls;
+    quint64 replyCallId;
+    // If set, calls are sent from dispatcher's network threads.
+    QPointer<QWebDispatcher> dispatcher;
+    // Futures returned by invokeMethodAsync(), by call id.
+    QHash<quint64, QFutureInterface<QWebReply> > promises;
+    // If set, replies for futures are decoded in this pool.
+    QPointer<QThreadPool> decodePool;
+    QSharedPointer<QWebDecodeQueue> decodeQueue;
+    struct PendingDecode
+    {
+        PendingDecode() : done(false) {}
+
+        QFutureInterface<QWebReply> promise;
+        QWebReply result;
+        bool done;
+    };
+    // Replies being decoded, by sequence number. They are delivered
+    // in sequence order, which is the order in which calls finished.
+    QMap<quint64, PendingDecode> decoding;
+    quint64 decodeSequence;
+    quint64 deliverySequence;
+    // Service this method belongs to, if any (batch delivery,
+    // admission control).
+    QPointer<QWebService> service;
+
+    // Hedging (QWebMethod::setHedging()). Credit is in hundredths of
+    // a duplicate call: each call earns hedgeMaxExtraLoad.
+    enum { HedgeWindow = 100, HedgeMinSamples = 20, HedgeBurst = 3 };
+    struct HedgedCall
+    {
+        HedgedCall() : started(0), duplicate(0), duplicateId(0) {}
+
+        QNetworkRequest request;
+        QByteArray body;
+        QString lane;
+        qint64 started;
+        QNetworkReply *duplicate;
+        // Id of the duplicate in admission control and load balancing.
+        quint64 duplicateId;
+    };
+    int hedgeFixedDelay;
+    int hedgePercentile;
+    int hedgeMaxExtraLoad;
+    int hedgeCredit;
+    // Calls which may still be hedged, or are, by call id.
+    QHash<quint64, HedgedCall> hedgedCalls;
+    // Latencies (ms) of recent successful calls, used as a ring.
+    QVector<qint64> hedgeLatencies;
+    int hedgeLatencyIndex;
+    QWebHedgingStats hedgeStats;
+    QElapsedTimer hedgeClock;
+};
+
+/*
+  Decodes a single reply in a decode pool thread, then posts it back
+  to the web method.
+  */
+class QWebDecodeTask : public QRunnable
+{
+public:
+    QWebDecodeTask(QWebMethod *method, const QSharedPointer<QWebDecodeQueue> &queue,
+                   quint64 sequence, quint64 callId, const QWebReply &result,
+                   QWebMethod::Protocol protocol,
+                   const QMap<QString, QVariant> &returnValues);
+
+    void run();
+
+private:
+    QWebMethod *m_method;
+    QSharedPointer<QWebDecodeQueue> m_queue;
+    quint64 m_sequence;
+    quint64 m_callId;
+    QWebReply m_result;
+    QWebMethod::Protocol m_protocol;
+    QMap<QString, QVariant> m_returnValues;
 };
 
 #endif // QWEBMETHOD_P_H
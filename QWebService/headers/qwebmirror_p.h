@@ -0,0 +1,103 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#ifndef QWEBMIRROR_P_H
+#define QWEBMIRROR_P_H
+
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qset.h>
+#include <QtCore/qurl.h>
+#include <QtNetwork/qnetworkreply.h>
+#include <QtNetwork/qnetworkrequest.h>
+#include "qwebservice.h"
+
+/*
+  Sends copies of calls of QWebService to a shadow endpoint
+  (QWebService::setMirror()), and compares their replies and latencies
+  with those of the original calls. Mirrored calls are never seen by
+  callers: their replies are only counted, and a mirror which is slow or
+  failing does not delay anything but other mirrored calls.
+
+  Lives in the thread of its service. Network replies are watched
+  through the service object (context).
+  */
+class QWebMirror
+{
+public:
+    QWebMirror();
+
+    void setTarget(const QUrl &target, double sampleRate, int maxInFlight);
+    QUrl target() const { return m_target; }
+    void abort();
+
+    void callStarted(quint64 callId, QWebMethod *method, const QNetworkRequest &request,
+                     const QByteArray &verb, const QByteArray &body);
+    void callFinished(quint64 callId, const QByteArray &body,
+                      QNetworkReply::NetworkError error);
+    void forgetMethod(QWebMethod *method);
+
+    QList<QWebMirrorStats> stats() const;
+
+    QObject *context;
+
+private:
+    struct Pair
+    {
+        Pair() : method(0), started(0), primaryDone(false), mirrorDone(false),
+            primaryError(QNetworkReply::NoError), mirrorError(QNetworkReply::NoError),
+            primaryLatency(0), mirrorLatency(0) {}
+
+        QString methodName;
+        QWebMethod *method;
+        // In nanoseconds of clock.
+        qint64 started;
+        bool primaryDone;
+        bool mirrorDone;
+        QByteArray primaryBody;
+        QByteArray mirrorBody;
+        QNetworkReply::NetworkError primaryError;
+        QNetworkReply::NetworkError mirrorError;
+        // In microseconds.
+        qint64 primaryLatency;
+        qint64 mirrorLatency;
+    };
+
+    struct MethodStats
+    {
+        MethodStats() : primaryLatencySum(0), mirrorLatencySum(0) {}
+
+        QWebMirrorStats stats;
+        qint64 primaryLatencySum;
+        qint64 mirrorLatencySum;
+    };
+
+    QUrl mirrorUrl(const QUrl &url) const;
+    void mirrorFinished(QNetworkReply *reply, quint64 callId);
+    void compare(const Pair &pair);
+
+    QUrl m_target;
+    double m_sampleRate;
+    int m_maxInFlight;
+    // Calls waiting for the primary or the mirrored reply, by call id.
+    QHash<quint64, Pair> m_pairs;
+    QSet<QNetworkReply *> m_replies;
+    QHash<QString, MethodStats> m_stats;
+    QElapsedTimer m_clock;
+};
+
+#endif // QWEBMIRROR_P_H
@@ -0,0 +1,125 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#ifndef QWEBREPLY_H
+#define QWEBREPLY_H
+
+#include <QtCore/qbytearray.h>
+#include <QtCore/qfuture.h>
+#include <QtCore/qshareddata.h>
+#include <QtCore/qstring.h>
+#include <QtCore/qvariant.h>
+#include <QtNetwork/qnetworkreply.h>
+#include "QWebService_global.h"
+
+#ifndef QT_NO_EXCEPTIONS
+#include <QtCore/qexception.h>
+#endif
+
+class QWebReplyData;
+
+class QWEBSERVICESHARED_EXPORT QWebReply
+{
+public:
+    QWebReply();
+    QWebReply(const QWebReply &other);
+    QWebReply &operator=(const QWebReply &other);
+    ~QWebReply();
+
+    bool isError() const;
+    QNetworkReply::NetworkError error() const;
+    QString errorString() const;
+    int httpStatus() const;
+
+    QString methodName() const;
+    QByteArray data() const;
+    QString text() const;
+    QVariant value() const;
+
+private:
+    friend class QWebMethodPrivate;
+    QSharedDataPointer<QWebReplyData> d;
+};
+
+Q_DECLARE_METATYPE(QWebReply)
+
+#ifndef QT_NO_EXCEPTIONS
+class QWEBSERVICESHARED_EXPORT QWebReplyException : public QException
+{
+public:
+    explicit QWebReplyException(const QWebReply &reply) : m_reply(reply) {}
+
+    QWebReply reply() const { return m_reply; }
+
+    void raise() const { throw *this; }
+    QWebReplyException *clone() const { return new QWebReplyException(*this); }
+
+private:
+    QWebReply m_reply;
+};
+#endif
+
+#if defined(__cpp_impl_coroutine) && (__cpp_impl_coroutine >= 201902L)
+#include <coroutine>
+#include <QtCore/qabstracteventdispatcher.h>
+#include <QtCore/qfuturewatcher.h>
+
+/*
+  Makes QFuture<QWebReply> awaitable from C++20 coroutines:
+  QWebReply reply = co_await method->invokeMethodAsync();
+  Coroutine is resumed in the awaiting thread, by its event loop. Watcher
+  of the future is owned by the event dispatcher of that thread, so it is
+  freed even if the future is never finished. A thread without event
+  dispatcher can not be resumed later: it waits for the future instead.
+  */
+class QWebReplyAwaiter
+{
+public:
+    explicit QWebReplyAwaiter(const QFuture<QWebReply> &future) : m_future(future) {}
+
+    bool await_ready() const { return m_future.isFinished(); }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        QAbstractEventDispatcher *dispatcher = QAbstractEventDispatcher::instance();
+        if (!dispatcher) {
+            m_future.waitForFinished();
+            return false;
+        }
+
+        QFutureWatcher<QWebReply> *watcher = new QFutureWatcher<QWebReply>(dispatcher);
+        QObject::connect(watcher, &QFutureWatcherBase::finished, [watcher, handle]() {
+            watcher->deleteLater();
+            handle.resume();
+        });
+        watcher->setFuture(m_future);
+        return true;
+    }
+
+    QWebReply await_resume() { return m_future.result(); }
+
+private:
+    QFuture<QWebReply> m_future;
+};
+
+inline QWebReplyAwaiter operator co_await(const QFuture<QWebReply> &future)
+{
+    return QWebReplyAwaiter(future);
+}
+#endif
+
+#endif // QWEBREPLY_H
@@ -0,0 +1,38 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#ifndef QWEBREPLY_P_H
+#define QWEBREPLY_P_H
+
+#include <QtCore/qshareddata.h>
+#include "qwebreply.h"
+
+class QWebReplyData : public QSharedData
+{
+public:
+    QWebReplyData() : error(QNetworkReply::NoError), httpStatus(0) {}
+
+    QNetworkReply::NetworkError error;
+    QString errorString;
+    int httpStatus;
+    QString methodName;
+    QByteArray data;
+    QString text;
+    QVariant value;
+};
+
+#endif // QWEBREPLY_P_H
@@ -0,0 +1,158 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#ifndef QWEBSCHEDULER_P_H
+#define QWEBSCHEDULER_P_H
+
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qfutureinterface.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qmap.h>
+#include <QtCore/qpointer.h>
+#include <QtCore/qqueue.h>
+#include <functional>
+#include <QtNetwork/qnetworkreply.h>
+#include "qwebmethod.h"
+#include "qwebreply.h"
+#include "qwebservice.h"
+
+/*
+  Per-host admission control for QWebService. Calls above the current
+  in-flight limit of their host wait in a queue. The limit is adjusted
+  with AIMD: it grows by 1/limit for every fast reply while the limit is
+  in use, and shrinks multiplicatively (at most once per round trip) on
+  slow replies and overload errors. "Slow" means more than
+  LatencyTolerance times the lowest latency recently seen.
+
+  Each host has a queue per priority class (QWebService::Priority).
+  Free slots always go to the most important class first. Queues are
+  bounded per class, and total queue depth of each class is watched
+  against low and high watermarks (backpressure).
+
+  Within a class, calls are queued per connection lane (QWebMethod::lane()).
+  A lane may have a budget of calls in flight per host; calls of a lane
+  that is at its budget do not hold back calls of other lanes.
+  */
+class QWEBSERVICESHARED_EXPORT QWebScheduler
+{
+public:
+    QWebScheduler();
+
+    bool submit(QWebMethod *method, const QByteArray &data,
+                QWebService::Priority priority = QWebService::NormalPriority,
+                QFutureInterface<QWebReply> *promise = 0,
+                const QUrl &endpoint = QUrl());
+    bool admit(quint64 callId, QWebMethod *method, const QUrl &url, const QString &lane);
+    void callFinished(quint64 callId, QNetworkReply::NetworkError error, int httpStatus);
+    void callCancelled(quint64 callId);
+    void forgetMethod(QWebMethod *method);
+    void flush();
+    void setLaneBudget(const QString &lane, int connections);
+    int laneBudget(const QString &lane) const;
+
+    void adjustLimit(const QString &host, qint64 latency, bool overloaded, qint64 now);
+    static bool isOverload(QNetworkReply::NetworkError error, int httpStatus);
+    static QString hostKey(const QUrl &url);
+
+    QWebHostStats stats(const QString &host) const;
+    QList<QWebHostStats> stats() const;
+    int queued(QWebService::Priority priority) const;
+
+    enum { PriorityCount = QWebService::BulkPriority + 1 };
+
+    bool enabled;
+    int initialLimit;
+    int minLimit;
+    int maxLimit;
+    // Per host and priority class. Negative: unlimited.
+    int maxQueueLength[PriorityCount];
+    // Total queue depth of a class, across hosts. High 0: no watermarks.
+    int lowWatermark;
+    int highWatermark;
+    // Called when a class crosses high (true) or low (false) watermark.
+    std::function<void (QWebService::Priority, bool)> watermarkCrossed;
+
+    static const double LatencyTolerance;
+    static const double BackoffRatio;
+    static const int LatencyWindow = 256;
+
+private:
+    struct Pending
+    {
+        Pending() : async(false) {}
+
+        QPointer<QWebMethod> method;
+        QString methodName;
+        QString lane;
+        // Chosen by load balancing. Empty: URL of the method.
+        QUrl endpoint;
+        QByteArray data;
+        bool async;
+        QFutureInterface<QWebReply> promise;
+    };
+
+    struct Host
+    {
+        Host() : limit(1), inFlight(0), rejected(0), completed(0), minLatency(0),
+            windowMinLatency(0), windowSamples(0), lastLatency(0), lastDecrease(0) {}
+
+        typedef QMap<QString, QQueue<Pending> > LaneQueues;
+
+        int queued() const;
+        int queued(int priority) const;
+
+        double limit;
+        int inFlight;
+        // Queues by class, then by lane. Empty lane queues are removed.
+        LaneQueues queues[PriorityCount];
+        QHash<QString, int> laneInFlight;
+        qint64 rejected;
+        qint64 completed;
+        // Latencies, in microseconds.
+        qint64 minLatency;
+        qint64 windowMinLatency;
+        int windowSamples;
+        qint64 lastLatency;
+        // Time of last decrease, in nanoseconds of clock.
+        qint64 lastDecrease;
+    };
+
+    struct Call
+    {
+        QString host;
+        QString lane;
+        QWebMethod *method;
+        qint64 started;
+    };
+
+    Host &host(const QString &key);
+    void dispatch(const QString &key, const Pending &pending);
+    void drain(const QString &key);
+    bool laneAvailable(const Host &h, const QString &lane) const;
+    void queuedChanged(int priority, int delta);
+    static void drop(Pending &pending);
+
+    QHash<QString, Host> m_hosts;
+    QHash<quint64, Call> m_calls;
+    // Calls in flight allowed per host and lane. Missing: unlimited.
+    QHash<QString, int> m_laneBudgets;
+    int m_queued[PriorityCount];
+    bool m_aboveHigh[PriorityCount];
+    QElapsedTimer m_clock;
+};
+
+#endif // QWEBSCHEDULER_P_H
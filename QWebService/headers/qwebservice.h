@@ -25,6 +25,55 @@
 
 class QWebServicePrivate;
 
+struct QWebHostStats
+{
+    QWebHostStats() : limit(0), inFlight(0), queued(0), rejected(0), completed(0),
+        minLatency(0), lastLatency(0) {}
+
+    QString host;
+    int limit;
+    int inFlight;
+    int queued;
+    qint64 rejected;
+    qint64 completed;
+    // Latencies, in microseconds.
+    qint64 minLatency;
+    qint64 lastLatency;
+};
+
+struct QWebEndpointStats
+{
+    QWebEndpointStats() : outstanding(0), completed(0), failed(0), ejections(0),
+        ejected(false) {}
+
+    QUrl url;
+    int outstanding;
+    qint64 completed;
+    qint64 failed;
+    // Number of times the endpoint was ejected, and whether it is now.
+    int ejections;
+    bool ejected;
+};
+
+struct QWebMirrorStats
+{
+    QWebMirrorStats() : mirrored(0), dropped(0), compared(0), mismatches(0),
+        mirrorErrors(0), primaryLatency(0), mirrorLatency(0) {}
+
+    QString methodName;
+    // Calls sent to the mirror, and sampled calls skipped because too many
+    // mirrored calls were in flight.
+    qint64 mirrored;
+    qint64 dropped;
+    // Calls with both replies received, and those with different outcomes.
+    qint64 compared;
+    qint64 mismatches;
+    qint64 mirrorErrors;
+    // Mean latencies of compared calls, in microseconds.
+    qint64 primaryLatency;
+    qint64 mirrorLatency;
+};
+
 class QWEBSERVICESHARED_EXPORT QWebService : public QObject
 {
     Q_OBJECT
@@ -35,6 +84,24 @@ class QWEBSERVICESHARED_EXPORT QWebService : public QObject
     Q_PROPERTY(QStringList methodNames READ methodNames NOTIFY methodNamesChanged)
 
 public:
+    enum Priority
+    {
+        InteractivePriority = 0,
+        NormalPriority      = 1,
+        BulkPriority        = 2
+    };
+    // Also registers the metatype, used by signal arguments.
+    Q_ENUM(Priority)
+
+    enum LoadBalancing
+    {
+        NoLoadBalancing               = 0,
+        RoundRobinBalancing           = 1,
+        LeastOutstandingBalancing     = 2,
+        ConsistentHashBalancing       = 3
+    };
+    Q_ENUM(LoadBalancing)
+
     QWebService(QObject *parent = 0);
     QWebService(QWsdl *wsdl, QObject *parent = 0);
     QWebService(const QString &host, QObject *parent = 0);
@@ -53,14 +120,61 @@ public:
     void addMethod(QWebMethod *newMethod);
     void addMethod(const QString &methodName, QWebMethod *newMethod);
     void removeMethod(const QString &methodName);
-    Q_INVOKABLE bool invokeMethod(const QString &methodName, const QByteArray &data = 0);
+    Q_INVOKABLE bool invokeMethod(const QString &methodName, const QByteArray &data = 0,
+                                  Priority priority = NormalPriority);
+    bool invokeMethod(const QString &methodName, const QByteArray &data,
+                      const QByteArray &balancingKey, Priority priority = NormalPriority);
+    QFuture<QWebReply> invokeMethodAsync(const QString &methodName,
+                                         const QByteArray &data = QByteArray(),
+                                         Priority priority = NormalPriority);
+    QFuture<QWebReply> invokeMethodAsync(const QString &methodName, const QByteArray &data,
+                                         const QByteArray &balancingKey,
+                                         Priority priority = NormalPriority);
     Q_INVOKABLE QString replyRead(const QString &methodName);
+    QByteArray invokeMethodBlocking(const QString &methodName,
+                                    const QMap<QString, QVariant> &params,
+                                    int timeout = 30000,
+                                    QString *errorMessage = 0) const;
 
     QUrl hostUrl() const;
     QString host() const;
     void setHost(const QString &host);
     void setHost(const QUrl &hostUrl);
 
+    QWebDispatcher *dispatcher() const;
+    void setDispatcher(QWebDispatcher *dispatcher);
+    QThreadPool *decodePool() const;
+    void setDecodePool(QThreadPool *pool);
+    QWebConnectionPool *connectionPool() const;
+    void setConnectionPool(QWebConnectionPool *pool);
+
+    bool isBatchDelivery() const;
+    void setBatchDelivery(bool enabled, int maxLatency = 0);
+
+    bool isAdaptiveConcurrency() const;
+    void setAdaptiveConcurrency(bool enabled);
+    void setConcurrencyLimits(int initialLimit, int minLimit = 1, int maxLimit = 1000);
+    int maxQueueLength(Priority priority = NormalPriority) const;
+    void setMaxQueueLength(int length);
+    void setMaxQueueLength(Priority priority, int length);
+    void setQueueWatermarks(int low, int high);
+    int queuedCalls(Priority priority) const;
+    int laneConnections(const QString &lane) const;
+    void setLaneConnections(const QString &lane, int connections);
+    QList<QWebHostStats> hostStats() const;
+    QWebHostStats hostStats(const QUrl &host) const;
+
+    LoadBalancing loadBalancing() const;
+    void setLoadBalancing(LoadBalancing policy);
+    QList<QUrl> endpoints() const;
+    void setEndpoints(const QList<QUrl> &endpoints);
+    void setEndpointEjection(int consecutiveFailures, int ejectionTime = 30000);
+    QList<QWebEndpointStats> endpointStats() const;
+
+    QUrl mirrorUrl() const;
+    void setMirror(const QUrl &target, double sampleRate = 1.0, int maxInFlight = 8);
+    QList<QWebMirrorStats> mirrorStats() const;
+
 //    QString wsdl();
     Q_INVOKABLE void setWsdl(QWsdl *newWsdl);
     void resetWsdl(QWsdl *newWsdl = 0);
@@ -71,6 +185,9 @@ public:
 signals:
     void errorEncountered(const QString &errMessage);
     void replyReady(const QByteArray &reply, const QString &methodName);
+    void repliesReady(const QList<QWebReply> &replies);
+    void queueHighWatermark(QWebService::Priority priority);
+    void queueLowWatermark(QWebService::Priority priority);
 
     // For QObject properties:
     void hostChanged();
@@ -84,6 +201,7 @@ protected:
 
 protected slots:
     void receiveReply(const QByteArray &reply);
+    void deliverBatch();
 
 private:
     Q_DECLARE_PRIVATE(QWebService)
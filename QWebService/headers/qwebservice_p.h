@@ -18,9 +18,20 @@
 #ifndef QWEBSERVICE_P_H
 #define QWEBSERVICE_P_H
 
+#include <QtCore/qmutex.h>
+#include <QtCore/qpointer.h>
+#include <QtCore/qset.h>
+#include <QtCore/qthreadpool.h>
+#include <QtCore/qtimer.h>
 #include "qwebservice.h"
 #include "qwebmethod.h"
 #include "qwsdl.h"
+#include "qwebconnectionpool.h"
+#include "qwebdispatcher.h"
+#include "qwebreply.h"
+#include "qwebscheduler_p.h"
+#include "qwebbalancer_p.h"
+#include "qwebmirror_p.h"
 
 class QWebServicePrivate
 {
@@ -28,12 +39,24 @@ class QWebServicePrivate
     Q_DECLARE_PUBLIC(QWebService)
 
 public:
-    QWebServicePrivate() {}
-    QWebServicePrivate(QWebService *q) : q_ptr(q) {}
+    QWebServicePrivate() :
+        q_ptr(0), wsdl(0), batchDelivery(false), batchLatency(0), batchTimer(0) {}
+    QWebServicePrivate(QWebService *q) :
+        q_ptr(q), wsdl(0), batchDelivery(false), batchLatency(0), batchTimer(0) {}
     QWebService *q_ptr;
 
+    static QWebServicePrivate *get(QWebService *q) { return q->d_func(); }
+
     void init();
     bool enterErrorState(const QString &errMessage = QString());
+    void adoptMethod(QWebMethod *method) const;
+    void releaseMethod(QWebMethod *method);
+    // Const, as getters of QWebService create WSDL methods on first use.
+    QWebMethod *method(const QString &methodName) const;
+    void materializeMethods();
+    void watchWsdl(QWsdl *previous);
+    void wsdlChanged();
+    void addToBatch(const QWebReply &reply);
 
     bool errorState;
     QString errorMessage;
@@ -41,7 +64,31 @@ public:
     QUrl m_hostUrl;
     QWsdl *wsdl;
     // This is general, but should work for custom classes.
+    // Methods, pending methods, and settings applied to methods (below)
+    // are guarded by the mutex, as invokeMethodBlocking() reads them from
+    // other threads. They are modified in the thread of the service only.
     QMap<QString, QWebMethod *> *methods;
+    // Methods of WSDL which were not used yet (created by method()).
+    mutable QSet<QString> pendingMethods;
+    // Methods created from the WSDL by method(). They are released, and
+    // become pending again, when the WSDL file changes (wsdlChanged()).
+    mutable QSet<QString> wsdlMethods;
+    mutable QMutex methodsMutex;
+    // Applied to all methods, if set.
+    QPointer<QWebDispatcher> dispatcher;
+    QPointer<QThreadPool> decodePool;
+    QPointer<QWebConnectionPool> connectionPool;
+    // Batch delivery (repliesReady()). Timer is created on first use.
+    bool batchDelivery;
+    int batchLatency;
+    QTimer *batchTimer;
+    QList<QWebReply> batch;
+    // Per-host admission control (setAdaptiveConcurrency()).
+    QWebScheduler scheduler;
+    // Spreads calls over endpoints (setLoadBalancing()).
+    QWebBalancer balancer;
+    // Copies calls to a shadow endpoint (setMirror()).
+    QWebMirror mirror;
 };
 
 #endif // QWEBSERVICE_P_H
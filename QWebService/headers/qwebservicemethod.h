@@ -53,7 +53,8 @@ public:
                                   const QMap<QString, QVariant> &params,
                                   Protocol protocol = Soap12,
                                   HttpMethod httpMethod = Post,
-                                  QObject *parent = 0);
+                                  QObject *parent = 0,
+                                  int timeout = 30000);
 
 protected:
     QWebServiceMethod(QWebServiceMethodPrivate &d,
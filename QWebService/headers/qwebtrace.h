@@ -0,0 +1,57 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#ifndef QWEBTRACE_H
+#define QWEBTRACE_H
+
+#include <QtCore/qstring.h>
+#include <QtCore/qbytearray.h>
+#include "QWebService_global.h"
+
+class QWEBSERVICESHARED_EXPORT QWebTrace
+{
+public:
+    enum Event
+    {
+        Enqueue     = 0,
+        Send        = 1,
+        Headers     = 2,
+        FirstByte   = 3,
+        Finish      = 4,
+        Decode      = 5,
+        Deliver     = 6
+    };
+
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+
+    static void setCapacity(int maxEvents);
+    static int capacity();
+
+    static int eventCount();
+    static void clear();
+
+    static void record(Event event, quint64 callId, const QString &name);
+
+    static QByteArray toChromeTraceJson();
+    static bool dumpChromeTrace(const QString &fileName);
+
+private:
+    QWebTrace() {}
+};
+
+#endif // QWEBTRACE_H
@@ -0,0 +1,64 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#ifndef QWEBTRACE_P_H
+#define QWEBTRACE_P_H
+
+#include <QtCore/qatomic.h>
+#include <QtCore/qobject.h>
+#include <QtNetwork/qnetworkreply.h>
+#include "qwebtrace.h"
+
+// Checked inline before any trace work is done, so that a disabled
+// trace costs one relaxed load per hook.
+extern QBasicAtomicInt qwebtrace_enabled;
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+#  define QWEBTRACE_ENABLED() (qwebtrace_enabled.loadRelaxed() != 0)
+#else
+#  define QWEBTRACE_ENABLED() (qwebtrace_enabled.load() != 0)
+#endif
+
+#define QWEBTRACE(event, callId, name) \
+    do { \
+        if (QWEBTRACE_ENABLED()) \
+            QWebTrace::record(QWebTrace::event, callId, name); \
+    } while (0)
+
+/*
+  Records Headers and FirstByte events for a single reply. Created only
+  when tracing is enabled, lives as a child of the reply it watches.
+  */
+class QWebTraceReplyWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    QWebTraceReplyWatcher(QNetworkReply *reply, quint64 callId,
+                          const QString &name);
+
+private slots:
+    void metaDataChanged();
+    void readyRead();
+
+private:
+    quint64 m_callId;
+    QString m_name;
+    bool m_headersSeen;
+};
+
+#endif // QWEBTRACE_P_H
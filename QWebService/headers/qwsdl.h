@@ -50,34 +50,48 @@ public:
     void resetWsdl(const QString &newWsdl);
 
     QMap<QString, QWebMethod *> *methods();
+    QWebMethod *method(const QString &methodName);
     QStringList methodNames() const;
 
     QString webServiceName() const;
     QString host() const;
     QUrl hostUrl() const;    
+    QList<QUrl> endpoints() const;
     QString targetNamespace() const;
 
     QString errorInfo() const;
     bool isErrorState() const;
 
+    QString cacheDirectory() const;
+    void setCacheDirectory(const QString &directory);
+    static QString defaultCacheDirectory();
+    static void setDefaultCacheDirectory(const QString &directory);
+    int cacheMaxAge() const;
+    void setCacheMaxAge(int seconds);
+    static int defaultCacheMaxAge();
+    static void setDefaultCacheMaxAge(int seconds);
+    bool isLoadedFromCache() const;
+    static void clearSchemaCache();
+
+    int refreshInterval() const;
+    void setRefreshInterval(int msecs);
+
     bool parse();
 
+public slots:
+    bool refresh();
+
 signals:
     void errorEncountered(const QString &errMessage);
 
     // For QObject properties:
     void wsdlFileChanged();
 
-protected slots:
-    void fileReplyFinished(QNetworkReply *rply);
-
 protected:
     QWsdl(QWsdlPrivate &d, QObject *parent = 0);
     QWsdlPrivate *d_ptr;
 
 private:
-    void prepareFile(); // temp - problems in PIMPL
-
     Q_DECLARE_PRIVATE(QWsdl)
 
 };
@@ -19,51 +19,372 @@
 #define QWSDL_P_H
 
 #include <QtCore/QXmlStreamReader>
+#include <QtCore/qcryptographichash.h>
+#include <QtCore/qdatastream.h>
+#include <QtCore/qiodevice.h>
 #include <QtCore/qfile.h>
+#include <QtCore/qhash.h>
 #include <QtCore/qmap.h>
+#include <QtCore/qrunnable.h>
+#include <QtCore/qsemaphore.h>
+#include <QtCore/qsharedpointer.h>
 #include <QtCore/qstring.h>
 #include <QtCore/qstringlist.h>
+#include <QtCore/qvector.h>
 #include <QtCore/qdatetime.h>
 #include "qwebservicemethod.h"
 #include "qwsdl.h"
 
-class QWsdlPrivate
+class QTimer;
+
+/*
+  Sequential device reading a remote WSDL file while it is downloaded,
+  so that QXmlStreamReader can parse it as data arrives, without a copy
+  of the whole document. Reads wait (running a local event loop) until
+  more data arrives, or the download is finished; once reply() is
+  finished, they never wait. HTML-escaped markup
+  (&lt; and &gt;), which some servers send, is unescaped on the fly.
+  */
+class QWsdlDownload : public QIODevice
+{
+public:
+    QWsdlDownload(const QUrl &url, const QByteArray &eTag = QByteArray(),
+                  const QByteArray &lastModified = QByteArray());
+    ~QWsdlDownload();
+
+    bool isSequential() const { return true; }
+    qint64 bytesAvailable() const;
+
+    void waitForHeaders();
+    int httpStatus() const;
+    QByteArray eTag() const;
+    QByteArray lastModified() const;
+    QNetworkReply::NetworkError error() const;
+    QString replyErrorString() const;
+    QByteArray contentHash() const;
+    QNetworkReply *reply() const { return m_reply; }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    bool waitForData();
+
+    QNetworkReply *m_reply;
+    // Unescaped data not read yet, and possible start of an escape
+    // sequence split between two pieces of data.
+    QByteArray m_pending;
+    QByteArray m_tail;
+    QCryptographicHash m_hash;
+};
+
+/*
+  Schema types, as flat tables: each type refers to its fields by a range
+  of indexes, each field refers to its type by index, and all names are
+  interned (stored once, referred to by index). Fields are kept in order
+  of declaration. Built-in XSD types come first (anyType is type 0).
+  Types are named by namespace and local name ("{namespace}name"), field
+  names are local. Types referred to before (or without) being declared
+  are Unresolved, until a declaration is found.
+  */
+struct QWEBSERVICESHARED_EXPORT QWsdlTypeTable
+{
+    enum Kind {
+        Unresolved,
+        AnyType,
+        String,
+        Boolean,
+        Int,
+        // Any other integral type (long, short, unsignedInt...).
+        Integer,
+        Float,
+        Double,
+        Decimal,
+        DateTime,
+        Date,
+        Time,
+        Char,
+        Binary,
+        Complex
+    };
+
+    struct Type
+    {
+        // Index in names, -1 for anonymous types.
+        qint32 name;
+        qint32 kind;
+        qint32 firstField;
+        qint32 fieldCount;
+        // Type extended by this one (its fields come first), -1 if none.
+        qint32 base;
+    };
+
+    struct Field
+    {
+        // Index in names, -1 if element has no name.
+        qint32 name;
+        qint32 type;
+        qint32 minOccurs;
+        // -1 if unbounded.
+        qint32 maxOccurs;
+    };
+
+    QWsdlTypeTable();
+
+    static QString expandedName(const QString &namespaceUri, const QString &localName);
+    static QString localName(const QString &expandedName);
+    static bool isBuiltIn(const QString &localName);
+
+    int intern(const QString &name);
+    int reference(const QString &expandedName);
+    int addType(int name, Kind kind,
+                const QVector<Field> &typeFields = QVector<Field>(), int base = -1);
+    void merge(const QWsdlTypeTable &other, QVector<int> *typeMap);
+    void swap(QWsdlTypeTable &other);
+    void save(QDataStream &stream) const;
+    bool load(QDataStream &stream);
+
+    QVector<Field> allFields(int type) const;
+    bool isArray(int type) const;
+    QVariant marker(int type) const;
+    QMap<QString, QVariant> parameters(int type) const;
+
+    QStringList names;
+    QVector<Type> types;
+    QVector<Field> fields;
+    // Type of each top-level element (in order of element list),
+    // -1 if it has none.
+    QVector<qint32> elementTypes;
+    // Indexes of names, and of named types by name index.
+    QHash<QString, int> nameIndexes;
+    QHash<int, int> namedTypes;
+
+private:
+    int appendType(int name, Kind kind);
+};
+
+/*
+  Types read from an imported document (wsdl:import, xsd:import or
+  xsd:include). Parsed once, and shared by all QWsdl objects through
+  a cache keyed by document URL. Never modified after it is parsed;
+  a changed document replaces it in the cache.
+  */
+struct QWsdlSchemaDocument
+{
+    QWsdlSchemaDocument() : size(-1) {}
+
+    QStringList elements;
+    QWsdlTypeTable types;
+    // Absolute URLs of documents imported by this one.
+    QList<QUrl> imports;
+    // Modification time of a local file, when it was read.
+    QDateTime modified;
+    // Validators of a remote file (ETag and Last-Modified headers).
+    QByteArray eTag;
+    QByteArray lastModified;
+    // Size and SHA-1 hash of content.
+    qint64 size;
+    QByteArray hash;
+};
+
+/*
+  Parsed WSDL: everything needed to describe the service and create its
+  web methods. Never modified once published: all QWsdl objects reading
+  the same file share one model (through a registry of live models), so
+  that memory grows with the number of distinct WSDL files, not objects.
+  */
+struct QWsdlModel
+{
+    QWsdlModel() : fileSize(-1) {}
+
+    struct Operation
+    {
+        QString name;
+        // Indexes of request and response elements in elements.
+        int request;
+        int response;
+    };
+
+    // Document imported by the WSDL, as it was when it was read.
+    struct Import
+    {
+        QUrl url;
+        QDateTime modified;
+        qint64 size;
+        QByteArray hash;
+    };
+
+    QString webServiceName;
+    QString targetNamespace;
+    QUrl hostUrl;
+    // All addresses of service's ports, in order, without duplicates.
+    QList<QUrl> endpoints;
+    QStringList elements;
+    QWsdlTypeTable types;
+    // Parameters of each element, as QVariant markers of their types
+    // (see QWsdlTypeTable::marker()), for QWebMethod.
+    QMap<int, QMap<QString, QVariant> > parameters;
+    // Operations found by prepareMethods(), and their indexes by name.
+    QVector<Operation> operations;
+    QHash<QString, int> operationIndexes;
+    // Validators of a remote file (refresh()).
+    QByteArray eTag;
+    QByteArray lastModified;
+    // Modification time and size of a local file, when it was read.
+    QDateTime fileModified;
+    qint64 fileSize;
+    // All documents imported (directly or not), so that a model can be
+    // dropped when one of local ones changes.
+    QVector<Import> imports;
+};
+
+class QWEBSERVICESHARED_EXPORT QWsdlPrivate
 {
     Q_DECLARE_PUBLIC(QWsdl)
 
 public:
-    QWsdlPrivate() {}
-    QWsdlPrivate(QWsdl *q) : q_ptr(q) {}
+    // Parsers of imported documents have no public object; init() is not
+    // called for them.
+    explicit QWsdlPrivate(QWsdl *q = 0)
+        : q_ptr(q), errorState(false), cacheMaxAge(0), cacheValidated(0),
+          loadedFromCache(false), refreshInterval(0), refreshTimer(0), pendingRefresh(0),
+          fileSize(-1), workMethodList(0), workMethodParameters(0), methodsMap(0) {}
     QWsdl *q_ptr;
 
+    static QWsdlPrivate *get(QWsdl *q) { return q->d_func(); }
+
     void init();
+    void clearModel();
+    bool load(bool useCache);
+    void readDocument(QIODevice *device);
+    bool finishParse(QWsdlDownload *download, const QString &cacheKey);
 //    bool parse();
-//    void prepareFile();
     void prepareMethods();
+    QWebMethod *materializeMethod(int operation);
+    static int firstIndexOf(const QHash<QString, int> &indexes,
+                            const QString &first, const QString &second);
     void readDefinitions();
     void readTypes();
+    void readSchema();
     void readTypeSchemaElement();
+    int readComplexType(int name);
+    void readComplexContent(QVector<QWsdlTypeTable::Field> *fields, int *base);
+    QWsdlTypeTable::Field readField();
+    int readSimpleType(int name);
+    void declareNamespaces();
+    int typeName(const QString &localName);
+    QString expandedTypeName(const QString &qualifiedName) const;
+    void buildParameters();
+    void addImport(const QString &location);
+    bool resolveImports();
+    QVector<QSharedPointer<const QWsdlSchemaDocument> > fetchImports(const QList<QUrl> &urls);
+    void mergeImport(const QWsdlSchemaDocument &document);
+    void readImportedDocument();
+    static QSharedPointer<const QWsdlSchemaDocument> parseImport(
+            const QUrl &url, const QByteArray &data, QString *errorMessage,
+            const QByteArray &eTag = QByteArray(),
+            const QByteArray &lastModified = QByteArray());
     void readPorts();
     void readMessages();
     void readBindings();
     void readService();
     void readDocumentation();
-    QString convertReplyToUtf(const QString &textToConvert);
+    bool isRemote() const;
+    QString cacheKey() const;
+    QString cacheFilePath(const QString &key) const;
+    QByteArray contentHash() const;
+    static bool importsChanged(const QVector<QWsdlModel::Import> &stamps);
+    enum Revalidation { NotModified, Reloaded, ReloadFailed, Unreachable };
+    Revalidation revalidate(const QString &key, QString *reason);
+    bool reload(QWsdlDownload *download, const QString &key);
+    void restoreModel(const QSharedPointer<const QWsdlModel> &previous,
+                      const QMap<QString, QWebMethod *> &methods);
+    void startRefresh();
+    void finishRefresh();
+    void cancelRefresh();
+    bool loadCache(const QString &key, const QByteArray &hash);
+    void saveCache(const QString &key, const QByteArray &hash);
+    bool isCacheFresh() const;
+    void touchCache(const QString &key);
+    QSharedPointer<const QWsdlModel> sharedModel(const QString &key) const;
+    void publishModel(const QString &key);
     bool enterErrorState(const QString &errMessage = QString());
 
+    // Version of cache file format. Files of other versions are ignored.
+    enum { CacheMagic = 0x51575343, CacheVersion = 6 };
+
     bool errorState;
-    bool replyReceived;
-    QUrl m_hostUrl;
+    // Binary model cache (setCacheDirectory()), empty if off.
+    QString cacheDirectory;
+    // Seconds a cached remote model is used without asking the server
+    // (setCacheMaxAge()), and when the loaded one was last confirmed by
+    // the server (msecs since epoch).
+    int cacheMaxAge;
+    qint64 cacheValidated;
+    bool loadedFromCache;
+    int refreshInterval;
+    QTimer *refreshTimer;
+    // Download of automatic refresh in progress (remote file only), or 0.
+    QWsdlDownload *pendingRefresh;
     QString errorMessage;
     QString m_wsdlFilePath;
+    // Current model, never null (empty, if nothing was read).
+    QSharedPointer<const QWsdlModel> model;
+
+    // Model being read; moved to a new shared model by publishModel().
+    QUrl m_hostUrl;
+    QList<QUrl> m_endpoints;
     QString m_webServiceName;
     QString m_targetNamespace;
+    QByteArray eTag;
+    QByteArray lastModified;
+    QDateTime fileModified;
+    qint64 fileSize;
     QXmlStreamReader xmlReader;
+    // URL of document being read (base of relative import locations),
+    // and absolute URLs of documents it imports.
+    QUrl documentUrl;
+    QList<QUrl> imports;
+    // All documents merged into the model, by resolveImports().
+    QVector<QWsdlModel::Import> importStamps;
+
+    typedef QWsdlModel::Operation Operation;
 
     QStringList *workMethodList;
+    QWsdlTypeTable typeTable;
+    // Namespace prefixes declared on definitions and schema tags, and
+    // target namespace of the schema being read (of types it declares).
+    QHash<QString, QString> namespacePrefixes;
+    QString schemaNamespace;
     // Param if one, QList if many.
     QMap<int, QMap<QString, QVariant> > *workMethodParameters;
+    QVector<Operation> operations;
+    QHash<QString, int> operationIndexes;
+    // Web methods of this object created so far (on first use of each
+    // operation). Not shared: web methods can be modified.
     QMap<QString, QWebMethod *> *methodsMap;
 };
 
+/*
+  Reads and parses a local imported document in a thread pool thread,
+  so that local imports of one level are read at once (like remote
+  ones are downloaded). Stores the result (or error message), then
+  releases the semaphore.
+  */
+class QWsdlImportTask : public QRunnable
+{
+public:
+    QWsdlImportTask(const QUrl &url, QSharedPointer<const QWsdlSchemaDocument> *document,
+                    QString *errorMessage, QSemaphore *done);
+
+    void run();
+
+private:
+    QUrl m_url;
+    QSharedPointer<const QWsdlSchemaDocument> *m_document;
+    QString *m_errorMessage;
+    QSemaphore *m_done;
+};
+
 #endif // QWSDL_P_H
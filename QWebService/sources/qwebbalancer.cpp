@@ -0,0 +1,390 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include "../headers/qwebbalancer_p.h"
+
+#include <limits>
+
+/*!
+    \internal
+
+    Constructs balancer without endpoints: calls go to URLs of their
+    web methods. Endpoints are ejected after 5 failures in a row, for
+    (at first) 30 seconds.
+  */
+QWebBalancer::QWebBalancer() :
+    policy(QWebService::NoLoadBalancing), ejectionFailures(5), ejectionTime(30000),
+    m_next(0)
+{
+    m_clock.start();
+}
+
+/*!
+    \internal
+
+    Returns 32-bit hash of \a data, stable across processes and platforms
+    (FNV-1a, with a final avalanche step).
+  */
+quint32 QWebBalancer::hash(const QByteArray &data)
+{
+    quint32 result = 2166136261u;
+    for (int i = 0; i < data.size(); ++i) {
+        result ^= quint8(data.at(i));
+        result *= 16777619u;
+    }
+
+    result ^= result >> 16;
+    result *= 0x85ebca6bu;
+    result ^= result >> 13;
+    result *= 0xc2b2ae35u;
+    result ^= result >> 16;
+    return result;
+}
+
+/*!
+    \internal
+
+    Returns true if a call which ended with \a error and \a httpStatus
+    means that its endpoint is unhealthy. Errors caused by the call itself
+    (including SOAP faults, sent with status 500) do not count.
+  */
+bool QWebBalancer::isFailure(QNetworkReply::NetworkError error, int httpStatus)
+{
+    if (httpStatus == 502 || httpStatus == 503 || httpStatus == 504)
+        return true;
+
+    switch (error) {
+    case QNetworkReply::ConnectionRefusedError:
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::HostNotFoundError:
+    case QNetworkReply::TimeoutError:
+    case QNetworkReply::TemporaryNetworkFailureError:
+    case QNetworkReply::NetworkSessionFailedError:
+    case QNetworkReply::UnknownNetworkError:
+    case QNetworkReply::ServiceUnavailableError:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*!
+    \internal
+
+    Replaces endpoints with \a urls (duplicates are skipped). Endpoints
+    present before keep their state, including ejection.
+  */
+void QWebBalancer::setEndpoints(const QList<QUrl> &urls)
+{
+    QVector<Endpoint> endpoints;
+    foreach (const QUrl &url, urls) {
+        bool duplicate = false;
+        foreach (const Endpoint &endpoint, endpoints)
+            duplicate = duplicate || (endpoint.url == url);
+        if (duplicate)
+            continue;
+
+        const int old = indexOf(url);
+        Endpoint endpoint = (old >= 0) ? m_endpoints.at(old) : Endpoint();
+        endpoint.url = url;
+        endpoints.append(endpoint);
+    }
+
+    m_endpoints = endpoints;
+    m_next = 0;
+    m_ring.clear();
+    for (int i = 0; i < m_endpoints.size(); ++i) {
+        const QByteArray name = m_endpoints.at(i).url.toEncoded() + '#';
+        for (int node = 0; node < VirtualNodes; ++node)
+            m_ring.insert(hash(name + QByteArray::number(node)), i);
+    }
+}
+
+/*!
+    \internal
+  */
+QList<QUrl> QWebBalancer::endpoints() const
+{
+    QList<QUrl> result;
+    foreach (const Endpoint &endpoint, m_endpoints)
+        result.append(endpoint.url);
+    return result;
+}
+
+/*!
+    \internal
+
+    Returns index of endpoint with \a url, or -1.
+  */
+int QWebBalancer::indexOf(const QUrl &url) const
+{
+    for (int i = 0; i < m_endpoints.size(); ++i) {
+        if (m_endpoints.at(i).url == url)
+            return i;
+    }
+    return -1;
+}
+
+/*!
+    \internal
+
+    Returns true if \a endpoint is not ejected at \a now.
+  */
+bool QWebBalancer::isAvailable(const Endpoint &endpoint, qint64 now) const
+{
+    return endpoint.ejectedUntil <= now;
+}
+
+/*!
+    \internal
+  */
+int QWebBalancer::availableCount(qint64 now) const
+{
+    int result = 0;
+    foreach (const Endpoint &endpoint, m_endpoints) {
+        if (isAvailable(endpoint, now))
+            ++result;
+    }
+    return result;
+}
+
+/*!
+    \internal
+
+    Returns endpoint for the next call, or empty URL if balancing is off
+    or there are no endpoints (the call should use URL of its method).
+    \a key is used by consistent hashing: calls with the same key go to
+    the same endpoint, as long as it is available. Without a key,
+    consistent hashing falls back to round robin.
+  */
+QUrl QWebBalancer::pick(const QByteArray &key)
+{
+    if (policy == QWebService::NoLoadBalancing || m_endpoints.isEmpty())
+        return QUrl();
+
+    // If all endpoints are ejected (which happens only when endpoints
+    // are replaced), all of them are used.
+    qint64 now = m_clock.elapsed();
+    if (availableCount(now) == 0)
+        now = std::numeric_limits<qint64>::max();
+
+    int index = 0;
+    if (policy == QWebService::LeastOutstandingBalancing)
+        index = pickLeastOutstanding(now);
+    else if (policy == QWebService::ConsistentHashBalancing && !key.isEmpty())
+        index = pickConsistentHash(key, now);
+    else
+        index = pickRoundRobin(now);
+
+    return m_endpoints.at(index).url;
+}
+
+/*!
+    \internal
+
+    Returns an available endpoint other than \a excluded (starting from
+    the next one in turn, which is not advanced), or empty URL if
+    balancing is off or there is none. Used for hedged calls.
+  */
+QUrl QWebBalancer::pickOther(const QUrl &excluded) const
+{
+    if (policy == QWebService::NoLoadBalancing)
+        return QUrl();
+
+    const qint64 now = m_clock.elapsed();
+    const int count = m_endpoints.size();
+    for (int i = 0; i < count; ++i) {
+        const Endpoint &endpoint = m_endpoints.at((m_next + i) % count);
+        if (endpoint.url != excluded && isAvailable(endpoint, now))
+            return endpoint.url;
+    }
+    return QUrl();
+}
+
+/*!
+    \internal
+
+    Returns next available endpoint, in turn.
+  */
+int QWebBalancer::pickRoundRobin(qint64 now)
+{
+    const int count = m_endpoints.size();
+    for (int i = 0; i < count; ++i) {
+        const int index = (m_next + i) % count;
+        if (isAvailable(m_endpoints.at(index), now)) {
+            m_next = (index + 1) % count;
+            return index;
+        }
+    }
+    return 0;
+}
+
+/*!
+    \internal
+
+    Returns available endpoint with fewest calls in flight. Ties are
+    broken in turn, so that idle endpoints share the load.
+  */
+int QWebBalancer::pickLeastOutstanding(qint64 now)
+{
+    const int count = m_endpoints.size();
+    const int start = m_next % count;
+    int result = -1;
+
+    for (int i = 0; i < count; ++i) {
+        const int index = (start + i) % count;
+        const Endpoint &endpoint = m_endpoints.at(index);
+        if (!isAvailable(endpoint, now))
+            continue;
+        if (result < 0 || endpoint.outstanding < m_endpoints.at(result).outstanding)
+            result = index;
+    }
+
+    m_next = (start + 1) % count;
+    return qMax(result, 0);
+}
+
+/*!
+    \internal
+
+    Returns first available endpoint at or after hash of \a key
+    on the ring.
+  */
+int QWebBalancer::pickConsistentHash(const QByteArray &key, qint64 now)
+{
+    QMap<quint32, int>::const_iterator it = m_ring.lowerBound(hash(key));
+    for (int i = 0; i < m_ring.size(); ++i, ++it) {
+        if (it == m_ring.constEnd())
+            it = m_ring.constBegin();
+        if (isAvailable(m_endpoints.at(it.value()), now))
+            return it.value();
+    }
+    return 0;
+}
+
+/*!
+    \internal
+
+    Counts call \a callId of \a method, sent to \a endpoint, as
+    outstanding. Calls to URLs which are not endpoints are ignored.
+  */
+void QWebBalancer::callStarted(quint64 callId, const QUrl &endpoint, QWebMethod *method)
+{
+    const int index = indexOf(endpoint);
+    if (index < 0)
+        return;
+
+    ++m_endpoints[index].outstanding;
+    Call call;
+    call.endpoint = endpoint;
+    call.method = method;
+    m_calls.insert(callId, call);
+}
+
+/*!
+    \internal
+
+    Records result (\a error and \a httpStatus) of call \a callId, and
+    ejects its endpoint after too many failures in a row.
+  */
+void QWebBalancer::callFinished(quint64 callId, QNetworkReply::NetworkError error,
+                                int httpStatus)
+{
+    const int index = indexOf(m_calls.take(callId).endpoint);
+    if (index < 0)
+        return;
+
+    const qint64 now = m_clock.elapsed();
+    Endpoint &endpoint = m_endpoints[index];
+    endpoint.outstanding = qMax(endpoint.outstanding - 1, 0);
+    ++endpoint.completed;
+
+    if (!isFailure(error, httpStatus)) {
+        endpoint.consecutiveFailures = 0;
+        return;
+    }
+
+    ++endpoint.failed;
+    ++endpoint.consecutiveFailures;
+    if (ejectionFailures <= 0 || endpoint.consecutiveFailures < ejectionFailures
+            || !isAvailable(endpoint, now) || availableCount(now) <= 1) {
+        return;
+    }
+
+    ++endpoint.ejections;
+    endpoint.consecutiveFailures = 0;
+    endpoint.ejectedUntil = now + qint64(ejectionTime)
+            * qMin(endpoint.ejections, int(MaxEjectionFactor));
+}
+
+/*!
+    \internal
+
+    Forgets call \a callId, which was cancelled, without counting
+    its result.
+  */
+void QWebBalancer::callCancelled(quint64 callId)
+{
+    const int index = indexOf(m_calls.take(callId).endpoint);
+    if (index >= 0)
+        m_endpoints[index].outstanding = qMax(m_endpoints[index].outstanding - 1, 0);
+}
+
+/*!
+    \internal
+
+    Forgets calls of \a method (which is being destroyed, or removed
+    from the service), without counting them as failed.
+  */
+void QWebBalancer::forgetMethod(QWebMethod *method)
+{
+    QHash<quint64, Call>::iterator it = m_calls.begin();
+    while (it != m_calls.end()) {
+        if (it.value().method != method) {
+            ++it;
+            continue;
+        }
+
+        const int index = indexOf(it.value().endpoint);
+        if (index >= 0)
+            m_endpoints[index].outstanding = qMax(m_endpoints[index].outstanding - 1, 0);
+        it = m_calls.erase(it);
+    }
+}
+
+/*!
+    \internal
+
+    Returns state of all endpoints.
+  */
+QList<QWebEndpointStats> QWebBalancer::stats() const
+{
+    const qint64 now = m_clock.elapsed();
+    QList<QWebEndpointStats> result;
+
+    foreach (const Endpoint &endpoint, m_endpoints) {
+        QWebEndpointStats stats;
+        stats.url = endpoint.url;
+        stats.outstanding = endpoint.outstanding;
+        stats.completed = endpoint.completed;
+        stats.failed = endpoint.failed;
+        stats.ejections = endpoint.ejections;
+        stats.ejected = !isAvailable(endpoint, now);
+        result.append(stats);
+    }
+    return result;
+}
@@ -0,0 +1,438 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include "../headers/qwebconnectionpool_p.h"
+#include "../headers/qwebscheduler_p.h"
+
+#include <QtCore/qcoreapplication.h>
+#include <QtCore/qthread.h>
+
+/*!
+    \class QWebConnectionPool
+    \brief Bounds the number of sockets used by all web methods.
+
+    Web methods using a pool (QWebMethod::setConnectionPool(),
+    QWebService::setConnectionPool()) do not open connections on their own.
+    Calls made from the same thread to the same host (and connection lane,
+    see QWebMethod::setLane()) share a QNetworkAccessManager of the pool,
+    and with it, its keep-alive connections. This keeps the number of open
+    sockets proportional to the number of hosts, not web methods. Shared
+    managers also share cookies and caches: methods which must not share
+    a session (for example, of different tenants) need separate pools.
+
+    For processes talking to many hosts, the pool can also close idle
+    connections: when more than maxSockets() are open (least recently
+    used hosts go first), and when a host was not used for idleTimeout()
+    milliseconds. Hosts given a minimum (setMinimumConnections()) keep
+    their warm connections. Connections of a host are closed together,
+    and never while a call to it is in progress; managers of hosts idle
+    for idleTimeout() are deleted. stats() reports open, idle and evicted
+    sockets.
+
+    QNetworkAccessManager does not report its sockets, so the numbers are
+    estimates: a host is assumed to hold as many connections as calls it
+    had in flight at once (at most 6), until the pool closes them.
+
+    Web methods with credentials or authentication (QWebMethod::setCredentials(),
+    QWebMethod::authenticate()) keep their own connections.
+
+    The shared globalInstance() is also used to download WSDL files,
+    by QWebDispatcher and by mirrored calls (QWebService::setMirror()).
+  */
+
+/*!
+    Constructs the pool, using \a parent.
+  */
+QWebConnectionPool::QWebConnectionPool(QObject *parent) :
+    QObject(parent), d_ptr(new QWebConnectionPoolPrivate(this))
+{
+    Q_D(QWebConnectionPool);
+    d->clock.start();
+    d->reapTimer = new QTimer(this);
+    connect(d->reapTimer, &QTimer::timeout, [d]() {
+        QMutexLocker locker(&d->mutex);
+        d->reap(false);
+    });
+}
+
+/*!
+    Deletes managers of the current thread. Managers of other threads are
+    deleted together with their threads.
+  */
+QWebConnectionPool::~QWebConnectionPool()
+{
+    Q_D(QWebConnectionPool);
+    QList<QNetworkAccessManager *> own;
+
+    {
+        QMutexLocker locker(&d->mutex);
+        foreach (const QWebConnectionPoolPrivate::Endpoint &endpoint, d->endpoints) {
+            if (!endpoint.manager)
+                continue;
+
+            disconnect(endpoint.manager, 0, this, 0);
+            if (endpoint.thread == QThread::currentThread())
+                own.append(endpoint.manager);
+        }
+
+        d->endpoints.clear();
+        d->keys.clear();
+    }
+
+    qDeleteAll(own);
+    delete d_ptr;
+}
+
+static QMutex globalPoolMutex;
+static QWebConnectionPool *globalPool = 0;
+
+static void deleteGlobalPool()
+{
+    QMutexLocker locker(&globalPoolMutex);
+    delete globalPool;
+    globalPool = 0;
+}
+
+/*!
+    Returns shared pool, used by all web methods, creating it on first
+    use. It lives in the main thread, and is destroyed together with
+    QCoreApplication.
+  */
+QWebConnectionPool *QWebConnectionPool::globalInstance()
+{
+    QMutexLocker locker(&globalPoolMutex);
+    if (!globalPool) {
+        globalPool = new QWebConnectionPool;
+        if (QCoreApplication::instance())
+            globalPool->moveToThread(QCoreApplication::instance()->thread());
+        qAddPostRoutine(deleteGlobalPool);
+    }
+    return globalPool;
+}
+
+/*!
+    Returns maximum number of open sockets, or 0 if unlimited (default).
+  */
+int QWebConnectionPool::maxSockets() const
+{
+    Q_D(const QWebConnectionPool);
+    QMutexLocker locker(&d->mutex);
+    return d->maxSockets;
+}
+
+/*!
+    Sets maximum number of open sockets to \a count (0: unlimited). When
+    it is exceeded, idle connections of least recently used hosts are
+    closed. The budget is soft: connections in use are never closed, so
+    it can be exceeded while many calls are in flight.
+  */
+void QWebConnectionPool::setMaxSockets(int count)
+{
+    Q_D(QWebConnectionPool);
+    QMutexLocker locker(&d->mutex);
+    d->maxSockets = qMax(count, 0);
+    d->enforceBudget();
+}
+
+/*!
+    Returns time (in milliseconds) after which idle connections are
+    closed, or 0 if they are left to QNetworkAccessManager (default).
+  */
+int QWebConnectionPool::idleTimeout() const
+{
+    Q_D(const QWebConnectionPool);
+    QMutexLocker locker(&d->mutex);
+    return d->idleTimeout;
+}
+
+/*!
+    Makes the pool close connections of hosts not used for \a msecs
+    milliseconds (0: never), and delete their managers. Checked a few
+    times per timeout period, in the thread of the pool.
+  */
+void QWebConnectionPool::setIdleTimeout(int msecs)
+{
+    Q_D(QWebConnectionPool);
+    {
+        QMutexLocker locker(&d->mutex);
+        d->idleTimeout = qMax(msecs, 0);
+    }
+
+    // The timer lives in the pool's thread.
+    if (msecs > 0) {
+        QMetaObject::invokeMethod(d->reapTimer, "start", Qt::QueuedConnection,
+                                  Q_ARG(int, qBound(10, msecs / 4, 10000)));
+    } else {
+        QMetaObject::invokeMethod(d->reapTimer, "stop", Qt::QueuedConnection);
+    }
+}
+
+/*!
+    Returns minimum number of connections kept for \a host.
+  */
+int QWebConnectionPool::minimumConnections(const QUrl &host) const
+{
+    Q_D(const QWebConnectionPool);
+    QMutexLocker locker(&d->mutex);
+    return d->minimums.value(QWebScheduler::hostKey(host));
+}
+
+/*!
+    Keeps up to \a count idle connections of \a host (scheme, host and
+    port) open: while the host holds no more than that, its connections
+    are not closed because of the socket budget or idle timeout. Use it
+    for hot hosts, to avoid reconnecting. Pass 0 to remove the minimum.
+  */
+void QWebConnectionPool::setMinimumConnections(const QUrl &host, int count)
+{
+    Q_D(QWebConnectionPool);
+    QMutexLocker locker(&d->mutex);
+    if (count > 0)
+        d->minimums.insert(QWebScheduler::hostKey(host), count);
+    else
+        d->minimums.remove(QWebScheduler::hostKey(host));
+}
+
+/*!
+    Returns number of endpoints, estimated open, idle and in-flight
+    sockets, and number of sockets closed by the pool so far.
+  */
+QWebConnectionStats QWebConnectionPool::stats() const
+{
+    Q_D(const QWebConnectionPool);
+    QMutexLocker locker(&d->mutex);
+    QWebConnectionStats result;
+
+    foreach (const QWebConnectionPoolPrivate::Endpoint &endpoint, d->endpoints) {
+        const int busy = qMin(endpoint.inFlight, int(QWebConnectionPoolPrivate::ConnectionsPerHost));
+        ++result.endpoints;
+        result.open += endpoint.open;
+        result.idle += qMax(endpoint.open - busy, 0);
+        result.inFlight += endpoint.inFlight;
+    }
+
+    result.evicted = d->evicted;
+    return result;
+}
+
+/*!
+    Closes all idle connections, including ones of hosts with a minimum,
+    and deletes their managers.
+  */
+void QWebConnectionPool::evictIdle()
+{
+    Q_D(QWebConnectionPool);
+    QMutexLocker locker(&d->mutex);
+    d->reap(true);
+}
+
+/*!
+    \internal
+
+    Returns manager for a call to \a url through \a lane, to be used in the
+    current thread, and counts the call as in flight. Must be followed by
+    release() when the call is finished.
+  */
+QNetworkAccessManager *QWebConnectionPoolPrivate::acquire(const QUrl &url, const QString &lane)
+{
+    Q_Q(QWebConnectionPool);
+    QThread *thread = QThread::currentThread();
+    const QString host = QWebScheduler::hostKey(url);
+    const QString key = QString::number(quintptr(thread), 16) + QLatin1Char(' ')
+            + host + QLatin1Char(' ') + lane;
+
+    QMutexLocker locker(&mutex);
+    Endpoint &endpoint = endpoints[key];
+    if (!endpoint.manager) {
+        QNetworkAccessManager *manager = new QNetworkAccessManager;
+        endpoint.manager = manager;
+        endpoint.thread = thread;
+        endpoint.host = host;
+        keys.insert(manager, key);
+
+        QObject::connect(thread, SIGNAL(finished()), manager, SLOT(deleteLater()));
+        QObject::connect(manager, &QObject::destroyed, q, [this, manager]() {
+            forget(manager);
+        }, Qt::DirectConnection);
+    }
+
+    ++endpoint.inFlight;
+    endpoint.open = qMax(endpoint.open, qMin(endpoint.inFlight, int(ConnectionsPerHost)));
+    endpoint.lastUsed = clock.elapsed();
+
+    QNetworkAccessManager *result = endpoint.manager;
+    enforceBudget();
+    return result;
+}
+
+/*!
+    \internal
+
+    Counts a call made with \a manager (from acquire()) as finished.
+    Returns false (and does nothing) if \a manager does not belong
+    to the pool.
+  */
+bool QWebConnectionPoolPrivate::release(QNetworkAccessManager *manager)
+{
+    QMutexLocker locker(&mutex);
+    QHash<QNetworkAccessManager *, QString>::const_iterator key = keys.constFind(manager);
+    if (key == keys.constEnd())
+        return false;
+
+    Endpoint &endpoint = endpoints[key.value()];
+    endpoint.inFlight = qMax(endpoint.inFlight - 1, 0);
+    endpoint.lastUsed = clock.elapsed();
+    enforceBudget();
+    return true;
+}
+
+/*!
+    \internal
+
+    Removes endpoint of \a manager, which is being destroyed.
+  */
+void QWebConnectionPoolPrivate::forget(QNetworkAccessManager *manager)
+{
+    QMutexLocker locker(&mutex);
+    const QString key = keys.take(manager);
+    if (!key.isEmpty())
+        endpoints.remove(key);
+}
+
+/*!
+    \internal
+
+    Returns true if \a endpoint holds no more connections than minimum
+    of its host.
+  */
+bool QWebConnectionPoolPrivate::isProtected(const Endpoint &endpoint) const
+{
+    return endpoint.open <= minimums.value(endpoint.host);
+}
+
+/*!
+    \internal
+
+    Closes idle connections of least recently used endpoints, until
+    estimated number of open sockets fits in the budget, or nothing more
+    can be closed. Mutex must be locked.
+  */
+void QWebConnectionPoolPrivate::enforceBudget()
+{
+    if (maxSockets <= 0)
+        return;
+
+    int open = 0;
+    foreach (const Endpoint &endpoint, endpoints)
+        open += endpoint.open;
+
+    while (open > maxSockets) {
+        QHash<QString, Endpoint>::iterator oldest = endpoints.end();
+        QHash<QString, Endpoint>::iterator it = endpoints.begin();
+        for (; it != endpoints.end(); ++it) {
+            const Endpoint &endpoint = it.value();
+            if (endpoint.inFlight > 0 || endpoint.open == 0 || isProtected(endpoint))
+                continue;
+            if (oldest == endpoints.end() || endpoint.lastUsed < oldest.value().lastUsed)
+                oldest = it;
+        }
+
+        if (oldest == endpoints.end())
+            return;
+
+        open -= oldest.value().open;
+        evict(oldest.value());
+    }
+}
+
+/*!
+    \internal
+
+    Removes endpoints idle for longer than idle timeout (or all idle
+    endpoints, if \a all is true). Their managers are deleted, which closes
+    their connections; the next call to the host creates a new one.
+    Mutex must be locked.
+  */
+void QWebConnectionPoolPrivate::reap(bool all)
+{
+    const qint64 now = clock.elapsed();
+    QHash<QString, Endpoint>::iterator it = endpoints.begin();
+    while (it != endpoints.end()) {
+        const Endpoint &endpoint = it.value();
+        const bool expired = (idleTimeout > 0 && now - endpoint.lastUsed >= idleTimeout
+                              && !isProtected(endpoint));
+        if (endpoint.inFlight > 0 || !(all || expired)) {
+            ++it;
+            continue;
+        }
+
+        evicted += endpoint.open;
+        if (endpoint.manager) {
+            // Deleted in its own thread; forget() finds nothing to remove.
+            keys.remove(endpoint.manager);
+            endpoint.manager->deleteLater();
+        }
+        it = endpoints.erase(it);
+    }
+}
+
+/*!
+    \internal
+
+    Closes idle connections of \a endpoint. Mutex must be locked.
+  */
+void QWebConnectionPoolPrivate::evict(Endpoint &endpoint)
+{
+    Q_Q(QWebConnectionPool);
+    evicted += endpoint.open;
+    endpoint.open = 0;
+
+    QNetworkAccessManager *manager = endpoint.manager;
+    if (!manager)
+        return;
+
+    if (endpoint.thread == QThread::currentThread()) {
+        manager->clearConnectionCache();
+        return;
+    }
+
+    // Checked again in manager's thread: a call may have been
+    // started there in the meantime.
+    QPointer<QWebConnectionPool> pool(q);
+    QMetaObject::invokeMethod(manager, [pool, manager]() {
+        if (pool)
+            clearIfIdle(pool, manager);
+    }, Qt::QueuedConnection);
+}
+
+/*!
+    \internal
+
+    Clears connection cache of \a manager of \a pool, unless a call was
+    started with it after it was evicted. Runs in manager's thread.
+  */
+void QWebConnectionPoolPrivate::clearIfIdle(QWebConnectionPool *pool,
+                                            QNetworkAccessManager *manager)
+{
+    QWebConnectionPoolPrivate *d = get(pool);
+    QMutexLocker locker(&d->mutex);
+    const QString key = d->keys.value(manager);
+    if (key.isEmpty() || d->endpoints.value(key).inFlight > 0)
+        return;
+
+    manager->clearConnectionCache();
+}
@@ -0,0 +1,465 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#include "../headers/qwebdispatcher_p.h"
+#include "../headers/qwebconnectionpool_p.h"
+#include "../headers/qwebtrace_p.h"
+
+#include <QtCore/qcoreapplication.h>
+#include <QtCore/qdeadlinetimer.h>
+#include <QtCore/qsharedpointer.h>
+#include <QtCore/qwaitcondition.h>
+
+/*!
+    \class QWebDispatcher
+    \brief Runs web method transports on dedicated network threads.
+
+    By default, QWebMethod sends requests and receives replies in the thread
+    it lives in - usually the GUI thread. When a dispatcher is set
+    (QWebMethod::setDispatcher(), QWebService::setDispatcher()), requests
+    are handed over to one of dispatcher's network threads instead. Each
+    thread takes its network access managers from the global
+    QWebConnectionPool. Each call goes to the thread with fewest calls
+    queued or in flight, so that calls to a single host are spread over
+    all threads, too; each thread keeps its own connections to the host.
+
+    Completed calls are posted back to the thread of the calling object:
+    replyReady() signals are still emitted in that thread, and no locking
+    is needed in user code.
+
+    Example:
+    \code
+    QWebDispatcher dispatcher(4);
+    QWebMethod method(QUrl("http://example.com/service.asmx"));
+    method.setDispatcher(&dispatcher);
+    method.invokeMethod();
+    \endcode
+
+    A shared, process-wide instance is available through globalInstance().
+  */
+
+/*!
+    Constructs the dispatcher with \a threadCount network threads (if 0,
+    QThread::idealThreadCount() is used), using \a parent.
+  */
+QWebDispatcher::QWebDispatcher(int threadCount, QObject *parent) :
+    QObject(parent), d_ptr(new QWebDispatcherPrivate(this))
+{
+    Q_D(QWebDispatcher);
+    d->init(threadCount);
+}
+
+/*!
+    Stops network threads. Calls still in progress are abandoned, their
+    completions are never delivered.
+  */
+QWebDispatcher::~QWebDispatcher()
+{
+    Q_D(QWebDispatcher);
+    d->shutdown();
+    delete d_ptr;
+}
+
+static QMutex globalDispatcherMutex;
+static QWebDispatcher *globalDispatcher = 0;
+
+static void deleteGlobalDispatcher()
+{
+    QMutexLocker locker(&globalDispatcherMutex);
+    delete globalDispatcher;
+    globalDispatcher = 0;
+}
+
+/*!
+    Returns shared dispatcher, creating it on first use. It is destroyed
+    together with QCoreApplication.
+  */
+QWebDispatcher *QWebDispatcher::globalInstance()
+{
+    QMutexLocker locker(&globalDispatcherMutex);
+    if (!globalDispatcher) {
+        globalDispatcher = new QWebDispatcher;
+        qAddPostRoutine(deleteGlobalDispatcher);
+    }
+    return globalDispatcher;
+}
+
+/*!
+    Returns number of network threads.
+  */
+int QWebDispatcher::threadCount() const
+{
+    Q_D(const QWebDispatcher);
+    return d->threads.size();
+}
+
+/*!
+    Returns number of calls submitted, but not completed yet. Thread-safe.
+  */
+int QWebDispatcher::pendingCalls() const
+{
+    Q_D(const QWebDispatcher);
+    return d->pendingCount.loadAcquire();
+}
+
+/*!
+    \internal
+
+    Starts \a threadCount network threads.
+  */
+void QWebDispatcherPrivate::init(int threadCount)
+{
+    if (threadCount <= 0)
+        threadCount = qMax(QThread::idealThreadCount(), 1);
+
+    for (int i = 0; i < threadCount; ++i) {
+        QThread *thread = new QThread;
+        thread->setObjectName(QString(QLatin1String("QWebDispatcher %1")).arg(i));
+
+        QWebNetworkWorker *worker = new QWebNetworkWorker(this);
+        worker->moveToThread(thread);
+        QObject::connect(thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+
+        threads.append(thread);
+        workers.append(worker);
+        thread->start();
+    }
+}
+
+/*!
+    \internal
+
+    Drops all pending calls, stops and deletes network threads.
+  */
+void QWebDispatcherPrivate::shutdown()
+{
+    {
+        QMutexLocker locker(&callsMutex);
+        calls.clear();
+        pendingCount.storeRelease(0);
+    }
+
+    foreach (QThread *thread, threads) {
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+
+    threads.clear();
+    workers.clear();
+}
+
+/*!
+    \internal
+
+    Returns worker with fewest calls queued or in flight. Workers are
+    checked starting from the next one in turn, so that idle workers
+    get calls in round-robin order.
+  */
+QWebNetworkWorker *QWebDispatcherPrivate::workerFor()
+{
+    const int count = workers.size();
+    const int start = int(uint(nextWorker.fetchAndAddRelaxed(1)) % uint(count));
+    QWebNetworkWorker *result = workers.at(start);
+    int lowest = result->load();
+
+    for (int i = 1; i < count && lowest > 0; ++i) {
+        QWebNetworkWorker *worker = workers.at((start + i) % count);
+        const int load = worker->load();
+        if (load < lowest) {
+            result = worker;
+            lowest = load;
+        }
+    }
+    return result;
+}
+
+/*!
+    \internal
+
+    Registers \a call and queues it in a network thread.
+    Can be called from any thread.
+  */
+void QWebDispatcherPrivate::submit(const QWebCall &call)
+{
+    QWebNetworkWorker *worker = workerFor();
+
+    {
+        QMutexLocker locker(&callsMutex);
+        PendingCall pending;
+        pending.context = call.context;
+        pending.worker = worker;
+        calls.insert(call.id, pending);
+    }
+
+    pendingCount.ref();
+    worker->submit(call);
+}
+
+namespace {
+/*
+  Shared between a thread blocked in callBlocking() and the network
+  thread. Kept alive by both, so that a late completion after a timeout
+  is harmless.
+  */
+struct BlockingCallState
+{
+    BlockingCallState() : done(false) {}
+
+    QMutex mutex;
+    QWaitCondition finished;
+    bool done;
+    QWebCallResult result;
+};
+}
+
+/*!
+    \internal
+
+    Sends \a call and blocks the calling thread until it is finished,
+    or until \a timeout milliseconds pass (negative: no timeout). Does not
+    need (nor run) an event loop, so it can be used from any thread
+    other than the dispatcher's own network threads.
+
+    On timeout, the call is aborted and OperationCanceledError is returned.
+  */
+QWebCallResult QWebDispatcherPrivate::callBlocking(QWebCall call, int timeout)
+{
+    QSharedPointer<BlockingCallState> state(new BlockingCallState);
+
+    // No context: completion runs directly in the network thread.
+    call.context = 0;
+    call.completion = [state](const QWebCallResult &result) {
+        QMutexLocker locker(&state->mutex);
+        state->result = result;
+        state->done = true;
+        state->finished.wakeAll();
+    };
+
+    submit(call);
+
+    // Negative timeout gives a deadline that never expires.
+    const QDeadlineTimer deadline(timeout);
+    QMutexLocker locker(&state->mutex);
+    while (!state->done) {
+        if (!state->finished.wait(&state->mutex, deadline) && !state->done) {
+            locker.unlock();
+            cancelCall(call.id);
+
+            QWebCallResult result;
+            result.id = call.id;
+            result.error = QNetworkReply::OperationCanceledError;
+            result.errorString = QLatin1String("Timed out");
+            return result;
+        }
+    }
+
+    return state->result;
+}
+
+/*!
+    \internal
+
+    Forgets call with \a callId, and aborts it. Its completion
+    will not be delivered.
+  */
+void QWebDispatcherPrivate::cancelCall(quint64 callId)
+{
+    QMutexLocker locker(&callsMutex);
+    QHash<quint64, PendingCall>::iterator it = calls.find(callId);
+    if (it == calls.end())
+        return;
+
+    it.value().worker->abort(callId);
+    calls.erase(it);
+    pendingCount.deref();
+}
+
+/*!
+    \internal
+
+    Forgets all calls made on behalf of \a context, and aborts them.
+    After this returns, no completion for \a context will be posted.
+    Must be called before \a context is destroyed.
+  */
+void QWebDispatcherPrivate::cancelCalls(QObject *context)
+{
+    QMutexLocker locker(&callsMutex);
+    QHash<quint64, PendingCall>::iterator it = calls.begin();
+
+    while (it != calls.end()) {
+        if (it.value().context == context) {
+            it.value().worker->abort(it.key());
+            it = calls.erase(it);
+            pendingCount.deref();
+        } else {
+            ++it;
+        }
+    }
+}
+
+/*!
+    \internal
+
+    Called in a network thread when \a call is finished. Delivers
+    \a result, unless the call was cancelled in the meantime.
+  */
+void QWebDispatcherPrivate::complete(const QWebCall &call,
+                                     const QWebCallResult &result)
+{
+    QMutexLocker locker(&callsMutex);
+    if (calls.remove(call.id) == 0)
+        return;
+
+    pendingCount.deref();
+
+    if (call.context) {
+        // Posted while holding the lock, so that cancelCalls() can not
+        // return (and the context can not be destroyed) in between.
+        std::function<void (const QWebCallResult &)> completion = call.completion;
+        QMetaObject::invokeMethod(call.context, [completion, result]() {
+            completion(result);
+        }, Qt::QueuedConnection);
+    } else {
+        locker.unlock();
+        call.completion(result);
+    }
+}
+
+/*!
+    \internal
+  */
+QWebNetworkWorker::QWebNetworkWorker(QWebDispatcherPrivate *dispatcher) :
+    QObject(0), m_dispatcher(dispatcher), m_wakeUpPending(false), m_load(0)
+{
+}
+
+/*!
+    \internal
+
+    Queues \a call. Thread will be woken up only if it is not
+    about to drain the queue already.
+  */
+void QWebNetworkWorker::submit(const QWebCall &call)
+{
+    bool wakeUp = false;
+    m_load.ref();
+
+    {
+        QMutexLocker locker(&m_queueMutex);
+        m_queue.append(call);
+        wakeUp = !m_wakeUpPending;
+        m_wakeUpPending = true;
+    }
+
+    if (wakeUp)
+        QMetaObject::invokeMethod(this, "drainQueue", Qt::QueuedConnection);
+}
+
+/*!
+    \internal
+
+    Requests abortion of call with \a callId. Can be called from any thread.
+  */
+void QWebNetworkWorker::abort(quint64 callId)
+{
+    QMetaObject::invokeMethod(this, "abortCall", Qt::QueuedConnection,
+                              Q_ARG(quint64, callId));
+}
+
+/*!
+    \internal
+
+    Sends all queued calls.
+  */
+void QWebNetworkWorker::drainQueue()
+{
+    QVector<QWebCall> queue;
+
+    {
+        QMutexLocker locker(&m_queueMutex);
+        queue.swap(m_queue);
+        m_wakeUpPending = false;
+    }
+
+    QWebConnectionPoolPrivate *pool = QWebConnectionPoolPrivate::get(
+                QWebConnectionPool::globalInstance());
+
+    foreach (const QWebCall &call, queue) {
+        QNetworkAccessManager *transport = pool->acquire(call.request.url(), call.lane);
+        QNetworkReply *reply = 0;
+
+        if (call.verb == "GET")
+            reply = transport->get(call.request);
+        else if (call.verb == "PUT")
+            reply = transport->put(call.request, call.data);
+        else if (call.verb == "DELETE")
+            reply = transport->deleteResource(call.request);
+        else
+            reply = transport->post(call.request, call.data);
+
+        QWEBTRACE(Send, call.id, call.methodName);
+        if (QWebTrace::isEnabled())
+            new QWebTraceReplyWatcher(reply, call.id, call.methodName);
+
+        m_inFlight.insert(reply, call);
+        m_replies.insert(call.id, reply);
+        connect(reply, SIGNAL(finished()), this, SLOT(replyFinished()));
+    }
+}
+
+/*!
+    \internal
+  */
+void QWebNetworkWorker::abortCall(quint64 callId)
+{
+    QNetworkReply *reply = m_replies.value(callId);
+    if (reply)
+        reply->abort();
+}
+
+/*!
+    \internal
+
+    Collects the reply, and hands it over to the dispatcher.
+  */
+void QWebNetworkWorker::replyFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    if (!reply || !m_inFlight.contains(reply))
+        return;
+
+    const QWebCall call = m_inFlight.take(reply);
+    m_replies.remove(call.id);
+    m_load.deref();
+    QWEBTRACE(Finish, call.id, call.methodName);
+
+    QWebCallResult result;
+    result.id = call.id;
+    result.data = reply->readAll();
+    result.error = reply->error();
+    if (result.error != QNetworkReply::NoError)
+        result.errorString = reply->errorString();
+    result.httpStatus = reply->attribute(
+                QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    QWebConnectionPoolPrivate::get(QWebConnectionPool::globalInstance())
+            ->release(reply->manager());
+    reply->deleteLater();
+
+    m_dispatcher->complete(call, result);
+}
@@ -16,8 +16,15 @@
 ****************************************************************************/
 
 #include "../headers/qwebmethod_p.h"
+#include "../headers/qwebtrace_p.h"
+#include "../headers/qwebdispatcher_p.h"
+#include "../headers/qwebreply_p.h"
+#include "../headers/qwebservice_p.h"
+#include "../headers/qwebconnectionpool_p.h"
 
 #include <QUrlQuery>
+#include <QtCore/qtimer.h>
+#include <algorithm>
 
 /*!
     \class QWebMethod
@@ -180,7 +187,7 @@
     \sa setParameters(), setProtocol(), invokeMethod()
   */
 QWebMethod::QWebMethod(QObject *parent, Protocol protocol, HttpMethod method) :
-    QObject(parent), d_ptr(new QWebMethodPrivate)
+    QObject(parent), d_ptr(new QWebMethodPrivate(this))
 {
     Q_D(QWebMethod);
     d->init();
@@ -197,7 +204,7 @@ QWebMethod::QWebMethod(QObject *parent, Protocol protocol, HttpMethod method) :
   */
 QWebMethod::QWebMethod(const QUrl &url, Protocol protocol,
                        HttpMethod method, QObject *parent) :
-    QObject(parent), d_ptr(new QWebMethodPrivate)
+    QObject(parent), d_ptr(new QWebMethodPrivate(this))
 {
     Q_D(QWebMethod);
     d->init();
@@ -216,6 +223,7 @@ QWebMethod::QWebMethod(QWebMethodPrivate &dd, Protocol protocol,
     QObject(parent), d_ptr(&dd)
 {
     Q_D(QWebMethod);
+    d->q_ptr = this;
     d->init();
     setProtocol(protocol);
     setHttpMethod(httpMethod);
@@ -227,6 +235,39 @@ QWebMethod::QWebMethod(QWebMethodPrivate &dd, Protocol protocol,
 QWebMethod::~QWebMethod()
 {
     Q_D(QWebMethod);
+    if (d->dispatcher)
+        QWebDispatcherPrivate::get(d->dispatcher)->cancelCalls(this);
+    if (d->service) {
+        QWebServicePrivate::get(d->service)->scheduler.forgetMethod(this);
+        QWebServicePrivate::get(d->service)->balancer.forgetMethod(this);
+        QWebServicePrivate::get(d->service)->mirror.forgetMethod(this);
+    }
+
+    // Nobody will complete these anymore.
+    foreach (QFutureInterface<QWebReply> promise, d->promises)
+        QWebMethodPrivate::fulfill(promise, d->deletedReply());
+
+    {
+        QMutexLocker locker(&d->decodeQueue->mutex);
+        d->decodeQueue->alive = false;
+    }
+
+    foreach (QWebMethodPrivate::PendingDecode pending, d->decoding) {
+        QWebMethodPrivate::fulfill(pending.promise, pending.done ? pending.result
+                                                                 : d->deletedReply());
+    }
+
+    // Replies of shared managers are not deleted with this object.
+    foreach (QNetworkReply *netReply, d->pendingCalls.keys()) {
+        if (!d->releaseConnection(netReply))
+            continue;
+
+        disconnect(netReply, 0, this, 0);
+        netReply->abort();
+        netReply->deleteLater();
+    }
+
+    qDeleteAll(d->laneManagers);
     delete d->manager;
 }
 
@@ -433,10 +474,9 @@ bool QWebMethod::authenticate(const QUrl &customAuthString)
 
     d->authenticationPerformed = true;
     d->authenticationReplyReceived = false;
-    connect(d->manager, SIGNAL(finished(QNetworkReply*)),
-            this, SLOT(authReplyFinished(QNetworkReply*)));
-    connect(d->manager, SIGNAL(authenticationRequired(QNetworkReply*,QAuthenticator*)),
-            this, SLOT(authenticationSlot(QNetworkReply*,QAuthenticator*)));
+    QNetworkAccessManager *manager = d->managerFor(QString());
+    connect(manager, SIGNAL(finished(QNetworkReply*)),
+            this, SLOT(authReplyFinished(QNetworkReply*)), Qt::UniqueConnection);
 
     QNetworkRequest rqst(QUrl::fromUserInput(
                              QString(QLatin1String("http://")
@@ -448,7 +488,7 @@ bool QWebMethod::authenticate(const QUrl &customAuthString)
     QByteArray paramBytes = customAuthString.toString().mid(1).toLatin1();
     paramBytes.replace("/", "%2F");
 //    qDebug() << paramBytes;
-    d->manager->post(rqst, paramBytes);
+    manager->post(rqst, paramBytes);
     return true;
 }
 
@@ -628,8 +668,9 @@ bool QWebMethod::setProtocol(Protocol prot)
     allowedCombinations << 0x21 << 0x22 << 0x24 << 0x26 << 0x28 << 0x30;
 
     if (allowedCombinations.contains(prot)) {
-        if (prot & Soap)
-            d->protocolUsed = Soap12;
+        // Plain "Soap" aggregator means SOAP 1.2. Soap10 has to be kept.
+        if ((prot & Soap) == Soap)
+            d->protocolUsed = Protocol(prot & ~Soap10);
         else
             d->protocolUsed = prot;
 
@@ -800,74 +841,214 @@ bool QWebMethod::setHttpMethod(const QString &newMethod)
 bool QWebMethod::invokeMethod(const QByteArray &requestData)
 {
     Q_D(QWebMethod);
-    connect(d->manager, SIGNAL(authenticationRequired(QNetworkReply*,QAuthenticator*)),
-            this, SLOT(authenticationSlot(QNetworkReply*,QAuthenticator*)));
+    d->invoke(requestData, d->lane);
+    return true;
+}
 
-    if ((d->authenticationPerformed == true)
-            && (d->authenticationReplyReceived == false)) {
-        forever {
-            if (d->authenticationReplyReceived) {
-                disconnect(d->manager, SIGNAL(finished(QNetworkReply*)),
-                           this, SLOT(authReplyFinished(QNetworkReply*)));
-                break;
-            } else {
-                QCoreApplication::instance()->processEvents();
-            }
-        }
-    } else if ((d->authenticationPerformed == true)
-               && (d->authenticationReplyReceived == true)) {
-        disconnect(d->manager, SIGNAL(finished(QNetworkReply*)),
-                   this, SLOT(authReplyFinished(QNetworkReply*)));
-    }
+/*!
+    Invokes the web method, like invokeMethod(), and returns a future
+    that is fulfilled with the reply. \a requestData is used the same way
+    as in invokeMethod().
 
-    connect(d->manager, SIGNAL(finished(QNetworkReply*)),
-            this, SLOT(replyFinished(QNetworkReply*)));
+    The future is completed in this object's thread. Failed calls complete
+    it with QWebReplyException. Each call gets its own QWebReply, so calls
+    can be chained and combined without reading shared reply state:
+    replyReady() is still emitted, but does not have to be used.
 
-    QNetworkRequest request;
-    request.setUrl(d->m_hostUrl);
+    If this object is deleted before the reply arrives, the future fails
+    with QNetworkReply::OperationCanceledError.
 
-    if (d->protocolUsed & Soap) {
-        request.setHeader(QNetworkRequest::ContentTypeHeader,
-                          QVariant(QLatin1String("application/soap+xml; charset=utf-8")));
-    } else if (d->protocolUsed & Json) {
-        request.setHeader(QNetworkRequest::ContentTypeHeader,
-                          QVariant(QLatin1String("application/json; charset=utf-8")));
-    } else if (d->protocolUsed & Http) {
-        request.setHeader(QNetworkRequest::ContentTypeHeader,
-                          QVariant(QLatin1String("Content-Type: application/x-www-form-urlencoded")));
-    } else if (d->protocolUsed & Xml) {
-        request.setHeader(QNetworkRequest::ContentTypeHeader,
-                          QVariant(QLatin1String("application/xml; charset=utf-8")));
-    }
+    \sa QWebReply, invokeMethod()
+  */
+QFuture<QWebReply> QWebMethod::invokeMethodAsync(const QByteArray &requestData)
+{
+    Q_D(QWebMethod);
+    QFutureInterface<QWebReply> promise;
+    promise.reportStarted();
 
-    if (d->protocolUsed & Soap10)
-        request.setRawHeader(QByteArray("SOAPAction"),
-                             QByteArray(d->m_hostUrl.toString().toLatin1()));
+    // Completion is always delivered later, from the event loop, so
+    // the promise can be registered after sending.
+    d->promises.insert(d->invoke(requestData, d->lane), promise);
+    return promise.future();
+}
 
-    if (requestData.isNull() || requestData.isEmpty())
-        d->prepareRequestData();
-    else
-        d->data = requestData;
+/*!
+    Returns dispatcher used to send calls, or 0 if calls are sent from
+    this object's thread.
 
-    // OPTIONAL - FOR TESTING:
-//    qDebug() << request.url().toString();
-//    qDebug() << QString(d->data);
-    // ENDOF: OPTIONAL - FOR TESTING
+    \sa setDispatcher()
+  */
+QWebDispatcher *QWebMethod::dispatcher() const
+{
+    Q_D(const QWebMethod);
+    return d->dispatcher;
+}
 
-    if (d->protocolUsed & Rest) {
-        if (d->httpMethodUsed == Post)
-            d->manager->post(request, d->data);
-        else if (d->httpMethodUsed == Get)
-            d->manager->get(request);
-        else if (d->httpMethodUsed == Put)
-            d->manager->put(request, d->data);
-        else if (d->httpMethodUsed == Delete)
-            d->manager->deleteResource(request);
-    } else {
-        d->manager->post(request, d->data);
-    }
+/*!
+    Makes invokeMethod() send requests from network threads of
+    \a dispatcher, instead of this object's thread. replyReady() is still
+    emitted in this object's thread. Pass 0 to go back to the default.
 
-    return true;
+    Calls already in progress are not affected. Authentication
+    (authenticate()) always uses this object's thread.
+
+    \sa QWebDispatcher, dispatcher()
+  */
+void QWebMethod::setDispatcher(QWebDispatcher *dispatcher)
+{
+    Q_D(QWebMethod);
+    d->dispatcher = dispatcher;
+}
+
+/*!
+    Returns thread pool used to decode replies, or 0 if they are decoded
+    in this object's thread.
+
+    \sa setDecodePool()
+  */
+QThreadPool *QWebMethod::decodePool() const
+{
+    Q_D(const QWebMethod);
+    return d->decodePool;
+}
+
+/*!
+    Makes replies of invokeMethodAsync() calls be decoded (converted and
+    parsed into QWebReply::text() and QWebReply::value()) in \a pool,
+    instead of this object's thread. This keeps the event loop responsive
+    when large replies arrive in bursts. Futures are still completed in
+    this object's thread, in the order in which calls finished. Size of
+    the stage is controlled with QThreadPool::setMaxThreadCount().
+    Pass 0 to decode in this object's thread again.
+
+    replyRead() and replyReadParsed() are not affected.
+
+    \sa invokeMethodAsync(), decodePool()
+  */
+void QWebMethod::setDecodePool(QThreadPool *pool)
+{
+    Q_D(QWebMethod);
+    d->decodePool = pool;
+}
+
+/*!
+    Returns connection pool used to send calls, or 0 if this method uses
+    its own connections (default).
+
+    \sa setConnectionPool()
+  */
+QWebConnectionPool *QWebMethod::connectionPool() const
+{
+    Q_D(const QWebMethod);
+    return d->connectionPool;
+}
+
+/*!
+    Makes calls share network access managers (and with them, connections)
+    of \a pool with other methods calling the same host from the same
+    thread. Pass 0 to go back to this method's own connections (default).
+
+    Managers of a pool also share cookies, authentication cache and HTTP
+    cache, so only methods which may share a session should use the same
+    pool; use separate pools to keep them apart (for example, one per
+    tenant). Calls with credentials (setCredentials(), authenticate())
+    always use own connections. The pool has to outlive this method.
+
+    \sa QWebConnectionPool, connectionPool()
+  */
+void QWebMethod::setConnectionPool(QWebConnectionPool *pool)
+{
+    Q_D(QWebMethod);
+    d->connectionPool = pool;
+}
+
+/*!
+    Returns connection lane of this method; empty for the default lane.
+
+    \sa setLane()
+  */
+QString QWebMethod::lane() const
+{
+    Q_D(const QWebMethod);
+    return d->lane;
+}
+
+/*!
+    Sends following calls through connection \a lane. Calls in different
+    lanes never share a connection, so that a large upload or download
+    does not hold back small calls to the same host that would otherwise
+    wait for its keep-alive connection. The lane is read when a call is
+    made, so it can also be changed per call. Empty name selects
+    the default lane.
+
+    QWebService can give each lane a connection budget
+    (QWebService::setLaneConnections()).
+  */
+void QWebMethod::setLane(const QString &lane)
+{
+    Q_D(QWebMethod);
+    d->lane = lane;
+}
+
+/*!
+    Returns true if calls of this method are hedged.
+
+    \sa setHedging()
+  */
+bool QWebMethod::isHedging() const
+{
+    Q_D(const QWebMethod);
+    return (d->hedgeFixedDelay > 0) || (d->hedgePercentile > 0);
+}
+
+/*!
+    Turns on hedging, which cuts tail latency of read-only calls: if a call
+    gets no reply within \a delay milliseconds, a duplicate is sent - to
+    another endpoint, if the method belongs to a QWebService balancing its
+    calls (QWebService::setLoadBalancing()), or to the same URL otherwise.
+    The reply which arrives first is used, and the other call is cancelled.
+    A failed reply is only used if the other call fails, too.
+
+    If \a percentile (1 - 99) is given, delay follows the latency of recent
+    calls instead: for example, with 95, duplicates are sent for calls
+    slower than 95% of recent ones. \a delay is used until enough calls
+    were made (if it is 0, calls are not hedged until then).
+
+    Duplicates are limited to \a maxExtraLoad percent of calls (with short
+    bursts of up to 3 calls allowed). Pass 0 as \a delay and
+    \a percentile to turn hedging off.
+
+    In a QWebService, a duplicate counts for the endpoint it was sent to
+    (QWebService::endpointStats()), and needs a free slot of adaptive
+    concurrency (QWebService::setAdaptiveConcurrency()) of its host; it
+    is not sent if there is none. The cancelled call counts for neither.
+
+    Use it only for idempotent operations: a hedged call may be executed
+    by the server twice. Calls sent through a dispatcher
+    (setDispatcher()) are not hedged.
+
+    \sa hedgingStats()
+  */
+void QWebMethod::setHedging(int delay, int maxExtraLoad, int percentile)
+{
+    Q_D(QWebMethod);
+    d->hedgeFixedDelay = qMax(delay, 0);
+    d->hedgePercentile = qBound(0, percentile, 99);
+    d->hedgeMaxExtraLoad = qBound(0, maxExtraLoad, 100);
+}
+
+/*!
+    Returns number of hedged calls, duplicates sent and duplicates which
+    won, and current hedging delay.
+
+    \sa setHedging()
+  */
+QWebHedgingStats QWebMethod::hedgingStats() const
+{
+    Q_D(const QWebMethod);
+    QWebHedgingStats result = d->hedgeStats;
+    result.delay = isHedging() ? d->hedgeDelay() : -1;
+    return result;
 }
 
 /*!
@@ -890,6 +1071,7 @@ QString QWebMethod::replyRead()
     d->replyReceived = false;
     QString replyString(d->reply);
     replyString = d->convertReplyToUtf(replyString);
+    QWEBTRACE(Decode, d->replyCallId, d->m_methodName);
     // OPTIONAL - FOR TESTING:
 //    qDebug() << replyString;
     // ENDOF: OPTIONAL - FOR TESTING
@@ -918,102 +1100,9 @@ QVariant QWebMethod::replyReadParsed()
     Q_D(QWebMethod);
     // Clears reply received bool.
     d->replyReceived = false;
-    QVariant result;
-    QByteArray replyBytes = d->reply;
-    QString replyString = d->convertReplyToUtf(replyBytes);
-
-    // It's not done properly, anyway.
-    // Should return type specified in replyValue.
-    if (d->protocolUsed & Soap || d->protocolUsed & Xml) {
-        QString tempBegin = QString(QLatin1String("<")
-                                    + d->m_methodName);
-//                                    + QLatin1String("Result>"));
-        int replyBeginIndex = replyString.indexOf(tempBegin, 0,
-                                                  Qt::CaseSensitive);
-        replyBeginIndex += tempBegin.length();
-
-        QString tempFinish = QString(QLatin1String("</")
-                                     + d->m_methodName);
-//                                     + QLatin1String("Result>"));
-        int replyFinishIndex = replyString.indexOf(tempFinish,
-                                                   replyBeginIndex,
-                                                   Qt::CaseSensitive);
-
-        if (replyBeginIndex == -1)
-            replyBytes = 0;
-        if (replyFinishIndex == -1)
-            replyFinishIndex = replyString.length();
-
-        if (d->returnValue.isEmpty()) {
-            result = (QVariant) replyString.mid(replyBeginIndex,
-                                                replyFinishIndex - replyBeginIndex);
-        } else {
-            // This attempts to prepare a complete list of replies, if enough data is
-            // specified in returnValue QMap.
-            QString replyCore = replyString.mid(replyBeginIndex,
-                                                replyFinishIndex - replyBeginIndex);
-
-            // Need to add replyCore splitting into specific return values.
-            QList<QVariant> parsedReturns;
-            QStringList returnsSplitted;
-            // This is an optimistic algorithm, it assumes that
-            // returnValue QMap is right.
-            foreach (QString s, d->returnValue.keys()) {
-                if (replyCore.contains(s)) {
-                    // Get tag beginning index.
-                    int tempIndex = replyCore.indexOf(s, 0, Qt::CaseSensitive);
-                    // Get tag ending index.
-                    int tempBeginIndex = replyCore.indexOf(">", tempIndex, Qt::CaseSensitive) + 1;
-                    // Get closing tag index.
-                    tempIndex = replyCore.indexOf("</", tempBeginIndex, Qt::CaseSensitive);
-
-                    QString value = replyCore.mid(tempBeginIndex, tempBeginIndex - tempIndex).trimmed();
-                    returnsSplitted.append(value);
-                }
-            }
-
-            int i = 0;
-            foreach (QString s, d->returnValue.keys()) {
-                QString type = d->returnValue.value(s).typeName();
-
-                if (type == QLatin1String("int")) {
-                    parsedReturns.append(QVariant(returnsSplitted.at(i).toInt()));
-                } else if (type == QLatin1String("float")) {
-                    parsedReturns.append(QVariant(returnsSplitted.at(i).toFloat()));
-                } else if (type == QLatin1String("double")) {
-                    parsedReturns.append(QVariant(returnsSplitted.at(i).toDouble()));
-                } else if (type == QLatin1String("bool")) {
-                    if (returnsSplitted.at(i).toLower() == QLatin1String("true"))
-                        parsedReturns.append(QVariant(true));
-                    else if (returnsSplitted.at(i).toLower() == QLatin1String("false"))
-                        parsedReturns.append(QVariant(true));
-                } else if (type == QLatin1String("QDateTime")) {
-                    ;
-                } else if ((type == QLatin1String("QString"))
-                           || (type == QLatin1String("QChar"))) {
-                    parsedReturns.append(QVariant(returnsSplitted.at(i)));
-                } else if (type == QLatin1String("QStringList")) {
-                    // Prepare QStringLists
-                } else {
-                    parsedReturns.append(returnsSplitted.at(i));
-                }
-
-                i++;
-            }
-
-            if (parsedReturns.size() > 1)
-                result = parsedReturns;
-            else
-                result = parsedReturns.first();
-        }
-    } else if (d->protocolUsed & Json) {
-        // Parse JSON if you dare. Qt5 will have JSON parser, I could implement that then.. maybe.
-        // Writing own parser right now seems pointless.
-    } else { // Fallback - return QString. Will also be used for HTTP, which is bad.
-        result = replyString;
-    }
-
-    return replyBytes;
+    QString replyString = d->convertReplyToUtf(QString::fromUtf8(d->reply));
+    QWEBTRACE(Decode, d->replyCallId, d->m_methodName);
+    return d->parseReply(replyString);
 }
 
 /*!
@@ -1074,9 +1163,29 @@ bool QWebMethod::isReplyReady() const
 void QWebMethod::replyFinished(QNetworkReply *netReply)
 {
     Q_D(QWebMethod);
+    if (netReply->property("_q_hedgeAbandoned").toBool())
+        return;
+
+    const quint64 callId = d->pendingCalls.take(netReply);
+    d->releaseConnection(netReply);
+
+    if (d->hedgedCalls.contains(callId) && !d->settleHedge(callId, netReply)) {
+        netReply->deleteLater();
+        return;
+    }
+
+    d->replyCallId = callId;
+    QWEBTRACE(Finish, d->replyCallId, d->m_methodName);
     d->reply = netReply->readAll();
     d->replyReceived = true;
+    QWEBTRACE(Deliver, d->replyCallId, d->m_methodName);
     emit replyReady(d->reply);
+    d->finishCall(d->replyCallId, netReply->error(),
+                  (netReply->error() == QNetworkReply::NoError) ?
+                      QString() : netReply->errorString(),
+                  netReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    d->releaseCall(d->replyCallId, netReply->error(),
+                   netReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
     netReply->deleteLater();
 }
 
@@ -1136,116 +1245,980 @@ void QWebMethodPrivate::init()
     errorState = false;
     authenticationError = false;
     authenticationPerformed = false;
+    replyCallId = 0;
+    decodeQueue = QSharedPointer<QWebDecodeQueue>(new QWebDecodeQueue);
+    decodeSequence = 0;
+    deliverySequence = 0;
+    hedgeFixedDelay = 0;
+    hedgePercentile = 0;
+    hedgeMaxExtraLoad = 0;
+    hedgeCredit = 0;
+    hedgeLatencyIndex = 0;
+    hedgeClock.start();
+
+    // Created on first use (managerFor()), not needed with a connection pool.
+    manager = 0;
+}
+
+/*!
+    \internal
 
-    manager = new QNetworkAccessManager;
+    Returns a new, process-wide unique call id.
+  */
+quint64 QWebMethodPrivate::nextCallId()
+{
+    static QAtomicInteger<quint64> counter(0);
+    return counter.fetchAndAddRelaxed(1) + 1;
 }
 
 /*!
-    Private function, invoked by invokeMethod(). Modifies QByteArray data,
-    so that it is consistent with protocol and HTTP method specification.
-    It uses QMap<QString, QVariant> parameters to fill data object's body.
-    Can be overriden by creating custom QByteArray and passing it to
-    sendMessage().
+    \internal
 
-    \sa invokeMethod()
+    Sends a call (see QWebMethod::invokeMethod()) through connection lane
+    \a laneName, and returns its id. The call goes to \a endpoint (picked
+    by load balancing of the service), or to host URL if it is empty.
   */
-void QWebMethodPrivate::prepareRequestData()
+quint64 QWebMethodPrivate::invoke(const QByteArray &requestData, const QString &laneName,
+                                  const QUrl &endpoint)
 {
-    data.clear();
-    QString header, body, footer;
-    // Replace with something OS-independent, or seriously rethink.
-    QString endl = QLatin1String("\r\n");
+    Q_Q(QWebMethod);
+    const quint64 callId = QWebMethodPrivate::nextCallId();
+    const QUrl target = endpoint.isEmpty() ? m_hostUrl : endpoint;
+    QWEBTRACE(Enqueue, callId, m_methodName);
 
-    if (protocolUsed & QWebMethod::Soap) {
-        if (protocolUsed & QWebMethod::Soap12) {
-            header = QString(QLatin1String("<?xml version=\"1.0\" encoding=\"utf-8\"?> ")
-                     + endl + QLatin1String(" <soap12:Envelope "
-                     "xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
-                     "xmlns:xsd=\"http://www.w3.org/2001/XMLSchema\" "
-                     "xmlns:soap12=\"http://www.w3.org/2003/05/soap-envelope\"> ") + endl +
-                     QLatin1String(" <soap12:Body> ") + endl);
-
-            footer = QString(QLatin1String("</soap12:Body> ")
-                             + endl
-                             + QLatin1String("</soap12:Envelope>"));
-        } else if (protocolUsed & QWebMethod::Soap10) {
-            header = QString(QLatin1String("<?xml version=\"1.0\" encoding=\"utf-8\"?> ")
-                     + endl + QLatin1String(" <soap:Envelope "
-                     "xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
-                     "xmlns:xsd=\"http://www.w3.org/2001/XMLSchema\" "
-                     "xmlns:soap=\"http://www.w3.org/2003/05/soap-envelope\"> ") + endl +
-                     QLatin1String(" <soap:Body> ") + endl);
-
-            footer = QString(QLatin1String("</soap:Body> ")
-                             + endl
-                             + QLatin1String("</soap:Envelope>"));
+    if (service && !endpoint.isEmpty())
+        QWebServicePrivate::get(service)->balancer.callStarted(callId, endpoint, q);
+
+    if ((authenticationPerformed == true)
+            && (authenticationReplyReceived == false)) {
+        forever {
+            if (authenticationReplyReceived) {
+                QObject::disconnect(manager, SIGNAL(finished(QNetworkReply*)),
+                                    q, SLOT(authReplyFinished(QNetworkReply*)));
+                break;
+            } else {
+                QCoreApplication::instance()->processEvents();
+            }
         }
+    } else if ((authenticationPerformed == true)
+               && (authenticationReplyReceived == true)) {
+        QObject::disconnect(manager, SIGNAL(finished(QNetworkReply*)),
+                            q, SLOT(authReplyFinished(QNetworkReply*)));
+    }
 
-        body = QString(QLatin1String("\t<") + m_methodName
-                       + QLatin1String(" xmlns=\"")
-                       + m_targetNamespace
-                       + QLatin1String("\"> ") + endl);
+    QNetworkRequest request = buildRequest(target);
 
-        foreach (const QString currentKey, parameters.keys()) {
-            QVariant qv = parameters.value(currentKey);
-            // Currently, this does not handle nested lists
-            body += QString(QLatin1String("\t\t<") + currentKey
-                            + QLatin1String(">")
-                            + qv.toString()
-                            + QLatin1String("</") + currentKey
-                            + QLatin1String("> ") + endl);
-        }
+    if (requestData.isNull() || requestData.isEmpty())
+        prepareRequestData();
+    else
+        data = requestData;
 
-        body += QString(QLatin1String("\t</")
-                        + m_methodName
-                        + QLatin1String("> ") + endl);
-    } else if (protocolUsed & QWebMethod::Http) {
-        foreach (const QString currentKey, parameters.keys()) {
-            QVariant qv = parameters.value(currentKey);
-            // Currently, this does not handle nested lists
-            body += QString(currentKey + QLatin1String("=")
-                            + qv.toString() + QLatin1String("&"));
-        }
-        body.chop(1);
-    } else if (protocolUsed & QWebMethod::Json) {
-        body += QString(QLatin1String("{") + endl);
-        foreach (const QString currentKey, parameters.keys()) {
-            QVariant qv = parameters.value(currentKey);
-            // Currently, this does not handle nested lists
-            body += QString(QLatin1String("{") + endl
-                            + QLatin1String("\t\"") + currentKey
-                            + QLatin1String("\" : \"")
-                            + qv.toString()
-                            + QLatin1String("\"") + endl);
+    // OPTIONAL - FOR TESTING:
+//    qDebug() << request.url().toString();
+//    qDebug() << QString(data);
+    // ENDOF: OPTIONAL - FOR TESTING
+
+    if (service) {
+        QWebServicePrivate::get(service)->mirror.callStarted(callId, q, request,
+                                                             httpVerb(), data);
+    }
+
+    if (dispatcher) {
+        QWebCall call = makeCall(callId, data, target);
+        call.lane = laneName;
+        call.context = q;
+        // Runs in this object's thread. Dispatcher guarantees that no
+        // completion is delivered after the destructor has run.
+        call.completion = [q](const QWebCallResult &result) {
+            QWebMethodPrivate::get(q)->callCompleted(result);
+        };
+
+        QWebDispatcherPrivate::get(dispatcher)->submit(call);
+        return callId;
+    }
+
+    QNetworkReply *netReply = send(callId, request, data, laneName);
+    if (netReply && (hedgeFixedDelay > 0 || hedgePercentile > 0)) {
+        HedgedCall call;
+        call.request = request;
+        call.body = data;
+        call.lane = laneName;
+        call.started = hedgeClock.elapsed();
+        hedgedCalls.insert(callId, call);
+        ++hedgeStats.calls;
+        hedgeCredit = qMin(hedgeCredit + hedgeMaxExtraLoad, int(HedgeBurst) * 100);
+
+        const int delay = hedgeDelay();
+        if (delay >= 0) {
+            QTimer::singleShot(delay, q, [q, callId]() {
+                QWebMethodPrivate::get(q)->hedge(callId);
+            });
         }
-        body += QLatin1String("}");
-    } else if (protocolUsed & QWebMethod::Xml) {
-        foreach (const QString currentKey, parameters.keys()) {
-            QVariant qv = parameters.value(currentKey);
-            // Currently, this does not handle nested lists
-            body += QString(QLatin1String("\t\t<") + currentKey
-                            + QLatin1String(">") + qv.toString()
-                            + QLatin1String("</") + currentKey
-                            + QLatin1String("> ") + endl);
+    }
+
+    return callId;
+}
+
+/*!
+    \internal
+
+    Sends \a request with \a body for call \a callId, through connection
+    lane \a laneName, and returns the network reply (0 on failure).
+  */
+QNetworkReply *QWebMethodPrivate::send(quint64 callId, const QNetworkRequest &request,
+                                       const QByteArray &body, const QString &laneName)
+{
+    Q_Q(QWebMethod);
+    const bool shared = !usesOwnConnections();
+    QNetworkAccessManager *transport = 0;
+    if (shared) {
+        transport = QWebConnectionPoolPrivate::get(connectionPool)
+                ->acquire(request.url(), laneName);
+    } else {
+        transport = managerFor(laneName);
+        QObject::connect(transport, SIGNAL(finished(QNetworkReply*)),
+                         q, SLOT(replyFinished(QNetworkReply*)), Qt::UniqueConnection);
+    }
+
+    QNetworkReply *netReply = 0;
+    const QByteArray verb = httpVerb();
+    if (verb == "GET")
+        netReply = transport->get(request);
+    else if (verb == "PUT")
+        netReply = transport->put(request, body);
+    else if (verb == "DELETE")
+        netReply = transport->deleteResource(request);
+    else
+        netReply = transport->post(request, body);
+
+    if (netReply) {
+        // Shared managers serve other methods, too: only this reply is watched.
+        if (shared) {
+            pooledReplies.insert(netReply, connectionPool);
+            QObject::connect(netReply, &QNetworkReply::finished, q, [q, netReply]() {
+                q->replyFinished(netReply);
+            });
         }
+
+        pendingCalls.insert(netReply, callId);
+        QWEBTRACE(Send, callId, m_methodName);
+        if (QWebTrace::isEnabled())
+            new QWebTraceReplyWatcher(netReply, callId, m_methodName);
     }
 
-    data.append(QString(header + body + footer).toLatin1());
+    return netReply;
 }
 
 /*!
     \internal
 
-    Changes the encoding of the reply, in a rather crude fashion.
+    Returns delay (in milliseconds) after which a call is hedged: the
+    configured percentile of recent latencies, or fixed delay until
+    enough latencies are known. Returns -1 if calls should not be hedged.
   */
-QString QWebMethodPrivate::convertReplyToUtf(const QString &textToConvert)
+int QWebMethodPrivate::hedgeDelay() const
 {
-    QString result = textToConvert;
+    if (hedgePercentile <= 0 || hedgeLatencies.size() < HedgeMinSamples)
+        return (hedgeFixedDelay > 0) ? hedgeFixedDelay : -1;
 
-    result.replace(QLatin1String("&lt;"), QLatin1String("<"));
-    result.replace(QLatin1String("&gt;"), QLatin1String(">"));
+    QVector<qint64> latencies = hedgeLatencies;
+    const int index = (latencies.size() - 1) * hedgePercentile / 100;
+    std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+    return int(qMax(latencies.at(index), qint64(1)));
+}
 
-    return result;
+/*!
+    \internal
+
+    Sends a duplicate of call \a callId, if it is still waiting for its
+    reply and hedging budget allows. The duplicate goes to another
+    endpoint of the service, if load balancing has one, or to the same
+    URL otherwise.
+
+    In a service, the duplicate is tracked as a call of its own (with its
+    own id), so that load balancing counts it for the endpoint it went to.
+    It needs a free slot of adaptive concurrency, like any other call;
+    if its host has none, it is not sent.
+  */
+void QWebMethodPrivate::hedge(quint64 callId)
+{
+    Q_Q(QWebMethod);
+    QHash<quint64, HedgedCall>::iterator it = hedgedCalls.find(callId);
+    if (it == hedgedCalls.end() || it.value().duplicate || hedgeCredit < 100)
+        return;
+
+    QNetworkRequest request = it.value().request;
+    const quint64 duplicateId = QWebMethodPrivate::nextCallId();
+    if (service) {
+        QWebServicePrivate *s = QWebServicePrivate::get(service);
+        const QUrl other = s->balancer.pickOther(request.url());
+        if (!other.isEmpty())
+            request.setUrl(other);
+
+        if (!s->scheduler.admit(duplicateId, q, request.url(), it.value().lane))
+            return;
+        s->balancer.callStarted(duplicateId, request.url(), q);
+    }
+
+    hedgeCredit -= 100;
+    QNetworkReply *duplicate = send(callId, request, it.value().body, it.value().lane);
+    if (duplicate) {
+        it.value().duplicate = duplicate;
+        it.value().duplicateId = duplicateId;
+        ++hedgeStats.hedged;
+    } else {
+        cancelAttempt(duplicateId);
+    }
+}
+
+/*!
+    \internal
+
+    Decides whether \a netReply (already taken from pending calls)
+    completes hedged call \a callId. The first successful reply does, and
+    the other one is cancelled. A failed reply does only if there is no
+    other one still in progress. Returns false if \a netReply is to be
+    ignored.
+
+    Result of the duplicate, and of an original which failed while the
+    duplicate is still in progress, is reported here (releaseCall()
+    reports the original otherwise). The cancelled one is not counted
+    as a failure.
+  */
+bool QWebMethodPrivate::settleHedge(quint64 callId, QNetworkReply *netReply)
+{
+    const HedgedCall &current = hedgedCalls[callId];
+    const bool isDuplicate = (current.duplicate && netReply == current.duplicate);
+    const bool failed = (netReply->error() != QNetworkReply::NoError);
+    QNetworkReply *sibling = pendingCalls.key(callId, 0);
+    if (isDuplicate || (failed && sibling))
+        finishAttempt(isDuplicate ? current.duplicateId : callId, netReply);
+
+    if (sibling && failed)
+        return false;
+
+    const HedgedCall call = hedgedCalls.take(callId);
+    if (netReply->error() == QNetworkReply::NoError) {
+        const qint64 latency = hedgeClock.elapsed() - call.started;
+        if (hedgeLatencies.size() < HedgeWindow) {
+            hedgeLatencies.append(latency);
+        } else {
+            hedgeLatencies[hedgeLatencyIndex] = latency;
+            hedgeLatencyIndex = (hedgeLatencyIndex + 1) % HedgeWindow;
+        }
+    }
+
+    if (isDuplicate)
+        ++hedgeStats.wins;
+
+    if (sibling) {
+        pendingCalls.remove(sibling);
+        cancelAttempt((sibling == call.duplicate) ? call.duplicateId : callId);
+        abandon(sibling);
+    }
+    return true;
+}
+
+/*!
+    \internal
+
+    Reports result of \a netReply, sent as call (or duplicate) \a attemptId,
+    to admission control and load balancing of the service.
+  */
+void QWebMethodPrivate::finishAttempt(quint64 attemptId, QNetworkReply *netReply)
+{
+    if (!service)
+        return;
+
+    QWebServicePrivate *s = QWebServicePrivate::get(service);
+    const int httpStatus = netReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    s->scheduler.callFinished(attemptId, netReply->error(), httpStatus);
+    s->balancer.callFinished(attemptId, netReply->error(), httpStatus);
+}
+
+/*!
+    \internal
+
+    Gives back slot and endpoint of call (or duplicate) \a attemptId,
+    which was cancelled, without counting its result.
+  */
+void QWebMethodPrivate::cancelAttempt(quint64 attemptId)
+{
+    if (!service)
+        return;
+
+    QWebServicePrivate *s = QWebServicePrivate::get(service);
+    s->scheduler.callCancelled(attemptId);
+    s->balancer.callCancelled(attemptId);
+}
+
+/*!
+    \internal
+
+    Cancels \a netReply, which lost the race of a hedged call.
+  */
+void QWebMethodPrivate::abandon(QNetworkReply *netReply)
+{
+    Q_Q(QWebMethod);
+    // Own managers report all their replies: this one has to be
+    // recognized, and skipped, in replyFinished().
+    netReply->setProperty("_q_hedgeAbandoned", true);
+    QObject::disconnect(netReply, 0, q, 0);
+    releaseConnection(netReply);
+    netReply->abort();
+    netReply->deleteLater();
+}
+
+/*!
+    \internal
+
+    Returns true if calls have to use this method's own network access
+    managers: when no connection pool is set, or calls carry credentials
+    or an authenticated session.
+  */
+bool QWebMethodPrivate::usesOwnConnections() const
+{
+    return !connectionPool || authenticationPerformed
+            || !m_username.isEmpty() || !m_password.isEmpty();
+}
+
+/*!
+    \internal
+
+    Counts the call of \a netReply as finished in the connection pool it
+    was sent through. Returns false if it was sent with own managers.
+  */
+bool QWebMethodPrivate::releaseConnection(QNetworkReply *netReply)
+{
+    QHash<QNetworkReply *, QPointer<QWebConnectionPool> >::iterator it
+            = pooledReplies.find(netReply);
+    if (it == pooledReplies.end())
+        return false;
+
+    if (it.value())
+        QWebConnectionPoolPrivate::get(it.value())->release(netReply->manager());
+    pooledReplies.erase(it);
+    return true;
+}
+
+/*!
+    \internal
+
+    Returns this method's own network access manager of connection lane
+    \a laneName (the default one for empty name), creating it on first use.
+  */
+QNetworkAccessManager *QWebMethodPrivate::managerFor(const QString &laneName)
+{
+    Q_Q(QWebMethod);
+    // Children of the method, so that they follow it to other threads.
+    QNetworkAccessManager *&result = laneName.isEmpty() ? manager : laneManagers[laneName];
+    if (!result) {
+        result = new QNetworkAccessManager(q);
+        QObject::connect(result, SIGNAL(authenticationRequired(QNetworkReply*,QAuthenticator*)),
+                         q, SLOT(authenticationSlot(QNetworkReply*,QAuthenticator*)));
+    }
+    return result;
+}
+
+/*!
+    \internal
+
+    Returns request for a call to \a target (host URL, if empty): URL and
+    headers matching the protocol.
+  */
+QNetworkRequest QWebMethodPrivate::buildRequest(const QUrl &target) const
+{
+    QNetworkRequest request;
+    request.setUrl(target.isEmpty() ? m_hostUrl : target);
+
+    if (protocolUsed & QWebMethod::Soap) {
+        request.setHeader(QNetworkRequest::ContentTypeHeader,
+                          QVariant(QLatin1String("application/soap+xml; charset=utf-8")));
+    } else if (protocolUsed & QWebMethod::Json) {
+        request.setHeader(QNetworkRequest::ContentTypeHeader,
+                          QVariant(QLatin1String("application/json; charset=utf-8")));
+    } else if (protocolUsed & QWebMethod::Http) {
+        request.setHeader(QNetworkRequest::ContentTypeHeader,
+                          QVariant(QLatin1String("Content-Type: application/x-www-form-urlencoded")));
+    } else if (protocolUsed & QWebMethod::Xml) {
+        request.setHeader(QNetworkRequest::ContentTypeHeader,
+                          QVariant(QLatin1String("application/xml; charset=utf-8")));
+    }
+
+    if (protocolUsed & QWebMethod::Soap10)
+        request.setRawHeader(QByteArray("SOAPAction"),
+                             QByteArray(m_hostUrl.toString().toLatin1()));
+
+    return request;
+}
+
+/*!
+    \internal
+
+    Returns HTTP verb used for a call. Only REST calls use verbs
+    other than POST.
+  */
+QByteArray QWebMethodPrivate::httpVerb() const
+{
+    if (!(protocolUsed & QWebMethod::Rest))
+        return QByteArray("POST");
+
+    switch (httpMethodUsed) {
+    case QWebMethod::Get:
+        return QByteArray("GET");
+    case QWebMethod::Put:
+        return QByteArray("PUT");
+    case QWebMethod::Delete:
+        return QByteArray("DELETE");
+    default:
+        return QByteArray("POST");
+    }
+}
+
+/*!
+    \internal
+
+    Returns call with \a callId and body \a requestData, to \a target
+    (host URL, if empty), ready to be submitted to a dispatcher. Context
+    and completion are left unset.
+  */
+QWebCall QWebMethodPrivate::makeCall(quint64 callId, const QByteArray &requestData,
+                                     const QUrl &target) const
+{
+    QWebCall call;
+    call.id = callId;
+    call.methodName = m_methodName;
+    call.lane = lane;
+    call.request = buildRequest(target);
+    call.verb = httpVerb();
+    call.data = requestData;
+    return call;
+}
+
+/*!
+    \internal
+
+    Parses \a replyString (already converted) into typed value(s),
+    as described in QWebMethod::replyReadParsed(). Does not modify the object.
+  */
+QVariant QWebMethodPrivate::parseReply(const QString &replyString) const
+{
+    return parseReply(replyString, protocolUsed, m_methodName, returnValue);
+}
+
+/*!
+    \internal
+
+    \overload parseReply()
+
+    Parses \a replyString of method \a methodName using \a protocol and
+    expected \a returnValues. Safe to call from any thread.
+  */
+QVariant QWebMethodPrivate::parseReply(const QString &replyString,
+                                       QWebMethod::Protocol protocol,
+                                       const QString &methodName,
+                                       const QMap<QString, QVariant> &returnValues)
+{
+    QVariant result;
+
+    // It's not done properly, anyway.
+    // Should return type specified in replyValue.
+    if (protocol & QWebMethod::Soap || protocol & QWebMethod::Xml) {
+        // Tags are searched in place, without building temporary strings.
+        int replyBeginIndex = QWebMethodPrivate::indexOfTag(replyString, "<",
+                                                           methodName, 0);
+        if (replyBeginIndex == -1)
+            replyBeginIndex = 0;
+        else
+            replyBeginIndex += methodName.length() + 1;
+
+        int replyFinishIndex = QWebMethodPrivate::indexOfTag(replyString, "</",
+                                                            methodName,
+                                                            replyBeginIndex);
+        if (replyFinishIndex == -1)
+            replyFinishIndex = replyString.length();
+
+        if (returnValues.isEmpty()) {
+            result = QVariant(replyString.mid(replyBeginIndex,
+                                              replyFinishIndex - replyBeginIndex));
+        } else {
+            // This attempts to prepare a complete list of replies, if enough data is
+            // specified in returnValues QMap.
+            QList<QVariant> parsedReturns;
+            // This is an optimistic algorithm, it assumes that
+            // returnValues QMap is right.
+            QMap<QString, QVariant>::const_iterator it = returnValues.constBegin();
+            for (; it != returnValues.constEnd(); ++it) {
+                QString value;
+                // Get tag beginning index.
+                int tagIndex = replyString.indexOf(it.key(), replyBeginIndex,
+                                                   Qt::CaseSensitive);
+
+                if ((tagIndex != -1) && (tagIndex < replyFinishIndex)) {
+                    // Get tag ending index.
+                    int valueBeginIndex = replyString.indexOf(QLatin1Char('>'), tagIndex) + 1;
+                    // Get closing tag index.
+                    int valueEndIndex = replyString.indexOf(QLatin1String("</"),
+                                                            valueBeginIndex);
+
+                    if ((valueEndIndex == -1) || (valueEndIndex > replyFinishIndex))
+                        valueEndIndex = replyFinishIndex;
+
+                    if (valueBeginIndex > 0) {
+                        value = replyString.mid(valueBeginIndex,
+                                                valueEndIndex - valueBeginIndex).trimmed();
+                    }
+                }
+
+                switch (it.value().userType()) {
+                case QMetaType::Int:
+                    parsedReturns.append(QVariant(value.toInt()));
+                    break;
+                case QMetaType::Float:
+                    parsedReturns.append(QVariant(value.toFloat()));
+                    break;
+                case QMetaType::Double:
+                    parsedReturns.append(QVariant(value.toDouble()));
+                    break;
+                case QMetaType::Bool:
+                    if (value.compare(QLatin1String("true"), Qt::CaseInsensitive) == 0)
+                        parsedReturns.append(QVariant(true));
+                    else if (value.compare(QLatin1String("false"), Qt::CaseInsensitive) == 0)
+                        parsedReturns.append(QVariant(false));
+                    break;
+                case QMetaType::QDateTime:
+                case QMetaType::QStringList:
+                    // Not supported yet.
+                    break;
+                default:
+                    parsedReturns.append(QVariant(value));
+                }
+            }
+
+            if (parsedReturns.size() > 1)
+                result = parsedReturns;
+            else if (!parsedReturns.isEmpty())
+                result = parsedReturns.first();
+        }
+    } else if (protocol & QWebMethod::Json) {
+        // Parse JSON if you dare. Qt5 will have JSON parser, I could implement that then.. maybe.
+        // Writing own parser right now seems pointless.
+    } else { // Fallback - return QString. Will also be used for HTTP, which is bad.
+        result = replyString;
+    }
+
+    return result;
+}
+
+/*!
+    \internal
+
+    Delivers \a result of a call sent through a dispatcher. Runs
+    in the thread of the web method.
+  */
+void QWebMethodPrivate::callCompleted(const QWebCallResult &result)
+{
+    Q_Q(QWebMethod);
+    replyCallId = result.id;
+    reply = result.data;
+    replyReceived = true;
+    QWEBTRACE(Deliver, replyCallId, m_methodName);
+    emit q->replyReady(reply);
+    finishCall(result.id, result.error, result.errorString, result.httpStatus);
+    releaseCall(result.id, result.error, result.httpStatus);
+}
+
+/*!
+    \internal
+
+    Tells the service (if any) that call \a callId finished with \a error
+    and \a httpStatus, so that its slot can be given to a queued call,
+    health of its endpoint updated, and its reply compared with
+    the mirrored one.
+  */
+void QWebMethodPrivate::releaseCall(quint64 callId, QNetworkReply::NetworkError error,
+                                    int httpStatus)
+{
+    if (!service)
+        return;
+
+    QWebServicePrivate *s = QWebServicePrivate::get(service);
+    s->scheduler.callFinished(callId, error, httpStatus);
+    s->balancer.callFinished(callId, error, httpStatus);
+    s->mirror.callFinished(callId, reply, error);
+}
+
+/*!
+    \internal
+
+    Completes future of call \a callId (if it was made with
+    invokeMethodAsync()) with current reply, or with \a error,
+    \a errorString and \a httpStatus. In batch delivery mode, also
+    hands the reply over to the batching web service.
+  */
+void QWebMethodPrivate::finishCall(quint64 callId, QNetworkReply::NetworkError error,
+                                   const QString &errorString, int httpStatus)
+{
+    QHash<quint64, QFutureInterface<QWebReply> >::iterator it = promises.find(callId);
+    const bool hasPromise = (it != promises.end());
+    QWebService *batchService = 0;
+    if (service && QWebServicePrivate::get(service)->batchDelivery)
+        batchService = service;
+
+    if (!hasPromise && !batchService)
+        return;
+
+    QWebReply result;
+    result.d->error = error;
+    result.d->errorString = errorString;
+    result.d->httpStatus = httpStatus;
+    result.d->methodName = m_methodName;
+    result.d->data = reply;
+
+    if (batchService) {
+        decodeReply(result, protocolUsed, returnValue);
+        QWebServicePrivate::get(batchService)->addToBatch(result);
+    }
+
+    if (!hasPromise)
+        return;
+
+    QFutureInterface<QWebReply> promise = it.value();
+    promises.erase(it);
+
+    if (batchService) {
+        fulfill(promise, result);
+        return;
+    }
+
+    if (decodePool) {
+        Q_Q(QWebMethod);
+        const quint64 sequence = decodeSequence++;
+        decoding[sequence].promise = promise;
+        decodePool->start(new QWebDecodeTask(q, decodeQueue, sequence, callId, result,
+                                             protocolUsed, returnValue));
+        return;
+    }
+
+    decodeReply(result, protocolUsed, returnValue);
+    fulfill(promise, result);
+}
+
+/*!
+    \internal
+
+    Called in the thread of the web method when decode task number
+    \a sequence has produced \a result. Delivers all replies that
+    are ready, in order.
+  */
+void QWebMethodPrivate::decodeFinished(quint64 sequence, const QWebReply &result)
+{
+    QMap<quint64, PendingDecode>::iterator it = decoding.find(sequence);
+    if (it == decoding.end())
+        return;
+
+    it.value().result = result;
+    it.value().done = true;
+
+    for (it = decoding.find(deliverySequence);
+         it != decoding.end() && it.value().done;
+         it = decoding.find(deliverySequence)) {
+        PendingDecode pending = it.value();
+        decoding.erase(it);
+        ++deliverySequence;
+        fulfill(pending.promise, pending.result);
+    }
+}
+
+/*!
+    \internal
+
+    Fills text and value of \a result from its raw data, using
+    \a protocol and \a returnValues. Safe to call from any thread.
+  */
+void QWebMethodPrivate::decodeReply(QWebReply &result, QWebMethod::Protocol protocol,
+                                    const QMap<QString, QVariant> &returnValues)
+{
+    result.d->text = convertReplyToUtf(QString::fromUtf8(result.d->data));
+    result.d->value = parseReply(result.d->text, protocol, result.d->methodName,
+                                 returnValues);
+}
+
+/*!
+    \internal
+
+    Completes \a promise with \a result (or with QWebReplyException,
+    if \a result is an error).
+  */
+void QWebMethodPrivate::fulfill(QFutureInterface<QWebReply> &promise,
+                                const QWebReply &result)
+{
+#ifndef QT_NO_EXCEPTIONS
+    if (result.isError())
+        promise.reportException(QWebReplyException(result));
+    else
+        promise.reportResult(result);
+#else
+    promise.reportResult(result);
+#endif
+    promise.reportFinished();
+}
+
+/*!
+    \internal
+  */
+QWebDecodeTask::QWebDecodeTask(QWebMethod *method,
+                               const QSharedPointer<QWebDecodeQueue> &queue,
+                               quint64 sequence, quint64 callId,
+                               const QWebReply &result,
+                               QWebMethod::Protocol protocol,
+                               const QMap<QString, QVariant> &returnValues) :
+    m_method(method), m_queue(queue), m_sequence(sequence), m_callId(callId),
+    m_result(result), m_protocol(protocol), m_returnValues(returnValues)
+{
+}
+
+/*!
+    \internal
+  */
+void QWebDecodeTask::run()
+{
+    QWebMethodPrivate::decodeReply(m_result, m_protocol, m_returnValues);
+    QWEBTRACE(Decode, m_callId, m_result.methodName());
+
+    QMutexLocker locker(&m_queue->mutex);
+    if (!m_queue->alive)
+        return;
+
+    // Posted while holding the lock, so that the method can not be
+    // destroyed in between.
+    QWebMethod *method = m_method;
+    const quint64 sequence = m_sequence;
+    const QWebReply result = m_result;
+    QMetaObject::invokeMethod(method, [method, sequence, result]() {
+        QWebMethodPrivate::get(method)->decodeFinished(sequence, result);
+    }, Qt::QueuedConnection);
+}
+
+/*!
+    \internal
+
+    Returns reply used to fail futures of a web method being destroyed.
+  */
+QWebReply QWebMethodPrivate::deletedReply() const
+{
+    return failedReply(m_methodName, QNetworkReply::OperationCanceledError,
+                       QLatin1String("Web method deleted"));
+}
+
+/*!
+    \internal
+
+    Returns reply of call \a methodName, failed with \a error and
+    \a errorString.
+  */
+QWebReply QWebMethodPrivate::failedReply(const QString &methodName,
+                                         QNetworkReply::NetworkError error,
+                                         const QString &errorString)
+{
+    QWebReply result;
+    result.d->error = error;
+    result.d->errorString = errorString;
+    result.d->methodName = methodName;
+    return result;
+}
+
+/*!
+    \internal
+
+    Returns already failed future, for calls that could not be made.
+  */
+QFuture<QWebReply> QWebMethodPrivate::failedCall(const QString &methodName,
+                                                 QNetworkReply::NetworkError error,
+                                                 const QString &errorString)
+{
+    QFutureInterface<QWebReply> promise;
+    promise.reportStarted();
+    fulfill(promise, failedReply(methodName, error, errorString));
+    return promise.future();
+}
+
+/*!
+    Private function, invoked by invokeMethod(). Modifies QByteArray data,
+    so that it is consistent with protocol and HTTP method specification.
+    It uses QMap<QString, QVariant> parameters to fill data object's body.
+    Can be overriden by creating custom QByteArray and passing it to
+    sendMessage().
+
+    \sa invokeMethod()
+  */
+void QWebMethodPrivate::prepareRequestData()
+{
+    data = requestData(parameters);
+}
+
+/*!
+    \internal
+
+    Returns request body for \a params, using protocol, method name and
+    target namespace of this method. Does not modify the object, so
+    it can be called from many threads at once.
+  */
+QByteArray QWebMethodPrivate::requestData(const QMap<QString, QVariant> &params) const
+{
+    // Replace with something OS-independent, or seriously rethink.
+    const QLatin1String endl("\r\n");
+
+    // Whole request is built in one, preallocated string. This keeps
+    // the number of allocations per call independent from the number
+    // of parameters (apart from non-string values' conversion).
+    int estimatedSize = 512 + (2 * m_methodName.size()) + m_targetNamespace.size();
+    QMap<QString, QVariant>::const_iterator it = params.constBegin();
+    for (; it != params.constEnd(); ++it) {
+        estimatedSize += (2 * it.key().size()) + 16;
+        estimatedSize += (it.value().userType() == QMetaType::QString) ?
+                    it.value().toString().size() : 24;
+    }
+
+    QString request;
+    request.reserve(estimatedSize);
+
+    if (protocolUsed & QWebMethod::Soap) {
+        const QLatin1String prefix((protocolUsed & QWebMethod::Soap12) ?
+                                       "soap12" : "soap");
+
+        request += QLatin1String("<?xml version=\"1.0\" encoding=\"utf-8\"?> ");
+        request += endl;
+        request += QLatin1String(" <");
+        request += prefix;
+        request += QLatin1String(":Envelope "
+                                 "xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
+                                 "xmlns:xsd=\"http://www.w3.org/2001/XMLSchema\" "
+                                 "xmlns:");
+        request += prefix;
+        request += QLatin1String("=\"http://www.w3.org/2003/05/soap-envelope\"> ");
+        request += endl;
+        request += QLatin1String(" <");
+        request += prefix;
+        request += QLatin1String(":Body> ");
+        request += endl;
+
+        request += QLatin1String("\t<");
+        request += m_methodName;
+        request += QLatin1String(" xmlns=\"");
+        request += m_targetNamespace;
+        request += QLatin1String("\"> ");
+        request += endl;
+
+        for (it = params.constBegin(); it != params.constEnd(); ++it) {
+            // Currently, this does not handle nested lists
+            request += QLatin1String("\t\t<");
+            request += it.key();
+            request += QLatin1Char('>');
+            request += it.value().toString();
+            request += QLatin1String("</");
+            request += it.key();
+            request += QLatin1String("> ");
+            request += endl;
+        }
+
+        request += QLatin1String("\t</");
+        request += m_methodName;
+        request += QLatin1String("> ");
+        request += endl;
+
+        request += QLatin1String("</");
+        request += prefix;
+        request += QLatin1String(":Body> ");
+        request += endl;
+        request += QLatin1String("</");
+        request += prefix;
+        request += QLatin1String(":Envelope>");
+    } else if (protocolUsed & QWebMethod::Http) {
+        for (it = params.constBegin(); it != params.constEnd(); ++it) {
+            // Currently, this does not handle nested lists
+            request += it.key();
+            request += QLatin1Char('=');
+            request += it.value().toString();
+            request += QLatin1Char('&');
+        }
+        request.chop(1);
+    } else if (protocolUsed & QWebMethod::Json) {
+        request += QLatin1Char('{');
+        request += endl;
+        for (it = params.constBegin(); it != params.constEnd(); ++it) {
+            // Currently, this does not handle nested lists
+            request += QLatin1Char('{');
+            request += endl;
+            request += QLatin1String("\t\"");
+            request += it.key();
+            request += QLatin1String("\" : \"");
+            request += it.value().toString();
+            request += QLatin1Char('"');
+            request += endl;
+        }
+        request += QLatin1Char('}');
+    } else if (protocolUsed & QWebMethod::Xml) {
+        for (it = params.constBegin(); it != params.constEnd(); ++it) {
+            // Currently, this does not handle nested lists
+            request += QLatin1String("\t\t<");
+            request += it.key();
+            request += QLatin1Char('>');
+            request += it.value().toString();
+            request += QLatin1String("</");
+            request += it.key();
+            request += QLatin1String("> ");
+            request += endl;
+        }
+    }
+
+    return request.toLatin1();
+}
+
+/*!
+    \internal
+
+    Changes the encoding of the reply, in a rather crude fashion.
+  */
+QString QWebMethodPrivate::convertReplyToUtf(const QString &textToConvert)
+{
+    // Most replies contain no entities: return a shared copy then.
+    if (!textToConvert.contains(QLatin1Char('&')))
+        return textToConvert;
+
+    QString result = textToConvert;
+
+    result.replace(QLatin1String("&lt;"), QLatin1String("<"));
+    result.replace(QLatin1String("&gt;"), QLatin1String(">"));
+
+    return result;
+}
+
+/*!
+    \internal
+
+    Returns index of first "<name" (for \a prefix "<") or "</name" (for
+    \a prefix "</") tag in \a text, starting at \a from, or -1 if there is
+    none. Does not allocate.
+  */
+int QWebMethodPrivate::indexOfTag(const QString &text, const char *prefix,
+                                  const QString &name, int from)
+{
+    const int prefixLength = int(qstrlen(prefix));
+    int index = text.indexOf(name, from + prefixLength, Qt::CaseSensitive);
+
+    while (index != -1) {
+        bool match = true;
+        for (int i = 0; match && (i < prefixLength); ++i)
+            match = (text.at(index - prefixLength + i) == QLatin1Char(prefix[i]));
+
+        if (match)
+            return index - prefixLength;
+
+        index = text.indexOf(name, index + 1, Qt::CaseSensitive);
+    }
+
+    return -1;
 }
 
 /*!
@@ -0,0 +1,267 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include "../headers/qwebmirror_p.h"
+#include "../headers/qwebconnectionpool_p.h"
+
+#include <QtCore/qrandom.h>
+#include <QtNetwork/qnetworkaccessmanager.h>
+
+/*!
+    \internal
+
+    Constructs mirror without a target: nothing is mirrored.
+  */
+QWebMirror::QWebMirror() :
+    context(0), m_sampleRate(1.0), m_maxInFlight(8)
+{
+    m_clock.start();
+}
+
+/*!
+    \internal
+
+    Mirrors \a sampleRate (0.0 - 1.0) of calls to \a target, with at most
+    \a maxInFlight mirrored calls at a time. Empty \a target turns
+    mirroring off; mirrored calls still in flight are finished and counted.
+  */
+void QWebMirror::setTarget(const QUrl &target, double sampleRate, int maxInFlight)
+{
+    m_target = target;
+    m_sampleRate = qBound(0.0, sampleRate, 1.0);
+    m_maxInFlight = qMax(maxInFlight, 0);
+}
+
+/*!
+    \internal
+
+    Aborts all mirrored calls, and forgets calls waiting for comparison.
+    Must be called before context is destroyed.
+  */
+void QWebMirror::abort()
+{
+    QWebConnectionPoolPrivate *pool = QWebConnectionPoolPrivate::get(
+                QWebConnectionPool::globalInstance());
+
+    foreach (QNetworkReply *reply, m_replies) {
+        reply->disconnect(context);
+        pool->release(reply->manager());
+        reply->abort();
+        reply->deleteLater();
+    }
+
+    m_replies.clear();
+    m_pairs.clear();
+}
+
+/*!
+    \internal
+
+    Returns \a url of a call, redirected to the target. Target without
+    a path keeps path and query of \a url.
+  */
+QUrl QWebMirror::mirrorUrl(const QUrl &url) const
+{
+    if (!m_target.path().isEmpty())
+        return m_target;
+
+    QUrl result(url);
+    result.setScheme(m_target.scheme());
+    result.setHost(m_target.host());
+    result.setPort(m_target.port());
+    return result;
+}
+
+/*!
+    \internal
+
+    Called when \a method sends call \a callId (\a request, with \a body,
+    using HTTP \a verb). If the call is sampled, and there is room for
+    it, sends its copy to the target. Otherwise, the call is counted as
+    dropped.
+  */
+void QWebMirror::callStarted(quint64 callId, QWebMethod *method,
+                             const QNetworkRequest &request,
+                             const QByteArray &verb, const QByteArray &body)
+{
+    if (m_target.isEmpty() || !context)
+        return;
+
+    if (m_sampleRate < 1.0
+            && QRandomGenerator::global()->generateDouble() >= m_sampleRate) {
+        return;
+    }
+
+    const QString methodName = method->methodName();
+    MethodStats &methodStats = m_stats[methodName];
+    methodStats.stats.methodName = methodName;
+
+    if (m_replies.size() >= m_maxInFlight) {
+        ++methodStats.stats.dropped;
+        return;
+    }
+
+    QNetworkRequest mirrored(request);
+    mirrored.setUrl(mirrorUrl(request.url()));
+
+    QNetworkAccessManager *transport = QWebConnectionPoolPrivate::get(
+                QWebConnectionPool::globalInstance())->acquire(mirrored.url(), QString());
+    QNetworkReply *reply = 0;
+
+    if (verb == "GET")
+        reply = transport->get(mirrored);
+    else if (verb == "PUT")
+        reply = transport->put(mirrored, body);
+    else if (verb == "DELETE")
+        reply = transport->deleteResource(mirrored);
+    else
+        reply = transport->post(mirrored, body);
+
+    ++methodStats.stats.mirrored;
+    m_replies.insert(reply);
+
+    Pair pair;
+    pair.methodName = methodName;
+    pair.method = method;
+    pair.started = m_clock.nsecsElapsed();
+    m_pairs.insert(callId, pair);
+
+    QObject::connect(reply, &QNetworkReply::finished, context, [this, reply, callId]() {
+        mirrorFinished(reply, callId);
+    });
+}
+
+/*!
+    \internal
+
+    Called when original call \a callId is finished, with reply \a body
+    and \a error.
+  */
+void QWebMirror::callFinished(quint64 callId, const QByteArray &body,
+                              QNetworkReply::NetworkError error)
+{
+    QHash<quint64, Pair>::iterator it = m_pairs.find(callId);
+    if (it == m_pairs.end() || it.value().primaryDone)
+        return;
+
+    Pair &pair = it.value();
+    pair.primaryDone = true;
+    pair.primaryBody = body;
+    pair.primaryError = error;
+    pair.primaryLatency = (m_clock.nsecsElapsed() - pair.started) / 1000;
+
+    if (pair.mirrorDone) {
+        compare(pair);
+        m_pairs.erase(it);
+    }
+}
+
+/*!
+    \internal
+
+    Collects mirrored \a reply of call \a callId.
+  */
+void QWebMirror::mirrorFinished(QNetworkReply *reply, quint64 callId)
+{
+    if (!m_replies.remove(reply))
+        return;
+
+    const QByteArray body = reply->readAll();
+    const QNetworkReply::NetworkError error = reply->error();
+    QWebConnectionPoolPrivate::get(QWebConnectionPool::globalInstance())
+            ->release(reply->manager());
+    reply->deleteLater();
+
+    QHash<quint64, Pair>::iterator it = m_pairs.find(callId);
+    if (it == m_pairs.end())
+        return;
+
+    Pair &pair = it.value();
+    pair.mirrorDone = true;
+    pair.mirrorBody = body;
+    pair.mirrorError = error;
+    pair.mirrorLatency = (m_clock.nsecsElapsed() - pair.started) / 1000;
+
+    if (error != QNetworkReply::NoError)
+        ++m_stats[pair.methodName].stats.mirrorErrors;
+
+    if (pair.primaryDone) {
+        compare(pair);
+        m_pairs.erase(it);
+    }
+}
+
+/*!
+    \internal
+
+    Records latencies of both calls of \a pair, and whether their
+    outcomes differ: one of them failed, or reply bodies (without
+    surrounding whitespace) are not the same.
+  */
+void QWebMirror::compare(const Pair &pair)
+{
+    MethodStats &methodStats = m_stats[pair.methodName];
+    ++methodStats.stats.compared;
+    methodStats.primaryLatencySum += pair.primaryLatency;
+    methodStats.mirrorLatencySum += pair.mirrorLatency;
+
+    bool mismatch = (pair.primaryError == QNetworkReply::NoError)
+            != (pair.mirrorError == QNetworkReply::NoError);
+    if (!mismatch && pair.primaryError == QNetworkReply::NoError)
+        mismatch = pair.primaryBody.trimmed() != pair.mirrorBody.trimmed();
+
+    if (mismatch)
+        ++methodStats.stats.mismatches;
+}
+
+/*!
+    \internal
+
+    Forgets calls of \a method (which is being removed or destroyed)
+    waiting for comparison. Their mirrored calls are still counted.
+  */
+void QWebMirror::forgetMethod(QWebMethod *method)
+{
+    QHash<quint64, Pair>::iterator it = m_pairs.begin();
+    while (it != m_pairs.end()) {
+        if (it.value().method == method)
+            it = m_pairs.erase(it);
+        else
+            ++it;
+    }
+}
+
+/*!
+    \internal
+
+    Returns statistics of all mirrored methods, with mean latencies.
+  */
+QList<QWebMirrorStats> QWebMirror::stats() const
+{
+    QList<QWebMirrorStats> result;
+
+    foreach (const MethodStats &methodStats, m_stats) {
+        QWebMirrorStats stats = methodStats.stats;
+        if (stats.compared > 0) {
+            stats.primaryLatency = methodStats.primaryLatencySum / stats.compared;
+            stats.mirrorLatency = methodStats.mirrorLatencySum / stats.compared;
+        }
+        result.append(stats);
+    }
+
+    return result;
+}
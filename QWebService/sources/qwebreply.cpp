@@ -0,0 +1,151 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include "../headers/qwebreply_p.h"
+
+/*!
+    \class QWebReply
+    \brief Result of a single web method call.
+
+    Returned (wrapped in QFuture) by QWebMethod::invokeMethodAsync() and
+    QWebService::invokeMethodAsync(). It is a small, implicitly shared
+    value: it can be copied cheaply, passed between threads, and kept
+    after the web method object is gone. Unlike QWebMethod::replyRead(),
+    it does not depend on state of the web method, so many calls of the
+    same method can be in flight at once.
+
+    Dependent calls can be chained with QFutureWatcher, or, with C++20
+    coroutines:
+    \code
+    QWebReply reply = co_await method->invokeMethodAsync();
+    \endcode
+
+    The coroutine is resumed in the awaiting thread, by its event loop.
+    In a thread without an event dispatcher, co_await blocks until the
+    call is finished (so the call must not be made from that thread).
+
+    Failed calls (network or HTTP errors, including SOAP faults) complete
+    the future with QWebReplyException, which carries the QWebReply.
+    If exceptions are disabled, the reply is reported as a normal result,
+    and isError() has to be checked.
+  */
+
+/*!
+    \class QWebReplyException
+    \brief Exception used to fail QFuture<QWebReply>. Holds the reply().
+  */
+
+/*!
+    Constructs an empty reply.
+  */
+QWebReply::QWebReply() : d(new QWebReplyData)
+{
+}
+
+/*!
+    Constructs a copy of \a other.
+  */
+QWebReply::QWebReply(const QWebReply &other) : d(other.d)
+{
+}
+
+/*!
+    Assigns \a other to this reply.
+  */
+QWebReply &QWebReply::operator=(const QWebReply &other)
+{
+    d = other.d;
+    return *this;
+}
+
+/*!
+    Destroys the reply.
+  */
+QWebReply::~QWebReply()
+{
+}
+
+/*!
+    Returns true if the call has failed.
+  */
+bool QWebReply::isError() const
+{
+    return d->error != QNetworkReply::NoError;
+}
+
+/*!
+    Returns network error of the call (QNetworkReply::NoError on success).
+  */
+QNetworkReply::NetworkError QWebReply::error() const
+{
+    return d->error;
+}
+
+/*!
+    Returns human readable description of error(), or empty string.
+  */
+QString QWebReply::errorString() const
+{
+    return d->errorString;
+}
+
+/*!
+    Returns HTTP status code of the reply, or 0 if none was received.
+  */
+int QWebReply::httpStatus() const
+{
+    return d->httpStatus;
+}
+
+/*!
+    Returns name of the web method that was called.
+  */
+QString QWebReply::methodName() const
+{
+    return d->methodName;
+}
+
+/*!
+    Returns raw reply data, as received from server.
+
+    \sa QWebMethod::replyReadRaw()
+  */
+QByteArray QWebReply::data() const
+{
+    return d->data;
+}
+
+/*!
+    Returns reply converted to text.
+
+    \sa QWebMethod::replyRead()
+  */
+QString QWebReply::text() const
+{
+    return d->text;
+}
+
+/*!
+    Returns reply parsed into typed value(s), according to return value
+    set in the web method.
+
+    \sa QWebMethod::replyReadParsed()
+  */
+QVariant QWebReply::value() const
+{
+    return d->value;
+}
@@ -0,0 +1,559 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include "../headers/qwebscheduler_p.h"
+#include "../headers/qwebmethod_p.h"
+
+const double QWebScheduler::LatencyTolerance = 2.0;
+const double QWebScheduler::BackoffRatio = 0.9;
+
+/*!
+    \internal
+
+    Constructs disabled scheduler: calls are sent at once.
+  */
+QWebScheduler::QWebScheduler() :
+    enabled(false), initialLimit(4), minLimit(1), maxLimit(1000),
+    lowWatermark(0), highWatermark(0)
+{
+    for (int i = 0; i < PriorityCount; ++i) {
+        maxQueueLength[i] = -1;
+        m_queued[i] = 0;
+        m_aboveHigh[i] = false;
+    }
+    m_clock.start();
+}
+
+/*!
+    \internal
+
+    Returns key used to group calls to \a url: scheme, host and port.
+  */
+QString QWebScheduler::hostKey(const QUrl &url)
+{
+    return url.scheme() + QLatin1String("://") + url.host()
+            + QLatin1Char(':') + QString::number(url.port(0));
+}
+
+/*!
+    \internal
+
+    Returns true if \a error and \a httpStatus mean that the server (or
+    the network) can not keep up, as opposed to errors caused by the call
+    itself.
+  */
+bool QWebScheduler::isOverload(QNetworkReply::NetworkError error, int httpStatus)
+{
+    if (httpStatus == 429 || httpStatus == 503 || httpStatus == 504)
+        return true;
+
+    switch (error) {
+    case QNetworkReply::ConnectionRefusedError:
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::TimeoutError:
+    case QNetworkReply::TemporaryNetworkFailureError:
+    case QNetworkReply::NetworkSessionFailedError:
+    case QNetworkReply::ServiceUnavailableError:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*!
+    \internal
+  */
+QWebScheduler::Host &QWebScheduler::host(const QString &key)
+{
+    QHash<QString, Host>::iterator it = m_hosts.find(key);
+    if (it == m_hosts.end()) {
+        it = m_hosts.insert(key, Host());
+        it.value().limit = qBound(minLimit, initialLimit, maxLimit);
+    }
+    return it.value();
+}
+
+/*!
+    \internal
+
+    Returns number of calls queued for this host, in all classes.
+  */
+int QWebScheduler::Host::queued() const
+{
+    int result = 0;
+    for (int i = 0; i < PriorityCount; ++i)
+        result += queued(i);
+    return result;
+}
+
+/*!
+    \internal
+
+    Returns number of calls of class \a priority queued for this host.
+  */
+int QWebScheduler::Host::queued(int priority) const
+{
+    int result = 0;
+    foreach (const QQueue<Pending> &queue, queues[priority])
+        result += queue.size();
+    return result;
+}
+
+/*!
+    \internal
+
+    Returns true if another call of \a lane can be sent to host \a h.
+  */
+bool QWebScheduler::laneAvailable(const Host &h, const QString &lane) const
+{
+    QHash<QString, int>::const_iterator it = m_laneBudgets.constFind(lane);
+    return (it == m_laneBudgets.constEnd()) || (h.laneInFlight.value(lane) < it.value());
+}
+
+/*!
+    \internal
+
+    Allows at most \a connections calls of \a lane in flight per host
+    (0 or less: unlimited). Calls already queued are sent if the new
+    budget allows.
+  */
+void QWebScheduler::setLaneBudget(const QString &lane, int connections)
+{
+    if (connections > 0)
+        m_laneBudgets.insert(lane, connections);
+    else
+        m_laneBudgets.remove(lane);
+
+    foreach (const QString &key, m_hosts.keys())
+        drain(key);
+}
+
+/*!
+    \internal
+
+    Returns budget of \a lane, or -1 if it is unlimited.
+  */
+int QWebScheduler::laneBudget(const QString &lane) const
+{
+    return m_laneBudgets.value(lane, -1);
+}
+
+/*!
+    \internal
+
+    Returns number of calls of \a priority queued for all hosts.
+  */
+int QWebScheduler::queued(QWebService::Priority priority) const
+{
+    return m_queued[priority];
+}
+
+/*!
+    \internal
+
+    Updates queue depth of class \a priority by \a delta, and reports
+    crossed watermarks. The callback must not call the scheduler
+    synchronously (QWebService queues its signals).
+  */
+void QWebScheduler::queuedChanged(int priority, int delta)
+{
+    m_queued[priority] += delta;
+    if (highWatermark <= 0)
+        return;
+
+    if (!m_aboveHigh[priority] && m_queued[priority] >= highWatermark) {
+        m_aboveHigh[priority] = true;
+        if (watermarkCrossed)
+            watermarkCrossed(QWebService::Priority(priority), true);
+    } else if (m_aboveHigh[priority] && m_queued[priority] <= lowWatermark) {
+        m_aboveHigh[priority] = false;
+        if (watermarkCrossed)
+            watermarkCrossed(QWebService::Priority(priority), false);
+    }
+}
+
+/*!
+    \internal
+
+    Sends call of \a method with \a data now, or queues it (in the queue of
+    \a priority class and lane of the method) if its host is at its limit,
+    or its lane at its budget. If \a promise is given,
+    it is completed with the reply (see QWebMethod::invokeMethodAsync()).
+    If \a endpoint is not empty, the call is sent there, instead of URL
+    of the method.
+    Returns false if the queue is full, and the call was rejected.
+  */
+bool QWebScheduler::submit(QWebMethod *method, const QByteArray &data,
+                           QWebService::Priority priority,
+                           QFutureInterface<QWebReply> *promise,
+                           const QUrl &endpoint)
+{
+    Pending pending;
+    pending.method = method;
+    pending.methodName = method->methodName();
+    pending.lane = method->lane();
+    pending.endpoint = endpoint;
+    pending.data = data;
+    if (promise) {
+        pending.async = true;
+        pending.promise = *promise;
+    }
+
+    if (!enabled) {
+        dispatch(QString(), pending);
+        return true;
+    }
+
+    const QString key = hostKey(endpoint.isEmpty() ? QWebMethodPrivate::get(method)->m_hostUrl
+                                                   : endpoint);
+    Host &h = host(key);
+
+    // Nothing queued can be sent (drain() would have sent it), so a free
+    // slot in this lane means that no call of this lane is waiting.
+    if (h.inFlight < int(h.limit) && laneAvailable(h, pending.lane)) {
+        dispatch(key, pending);
+        return true;
+    }
+
+    if (maxQueueLength[priority] >= 0 && h.queued(priority) >= maxQueueLength[priority]) {
+        ++h.rejected;
+        return false;
+    }
+
+    h.queues[priority][pending.lane].enqueue(pending);
+    queuedChanged(priority, 1);
+    return true;
+}
+
+/*!
+    \internal
+
+    Sends \a pending call. Calls are tracked only if \a key is not empty.
+  */
+void QWebScheduler::dispatch(const QString &key, const Pending &pending)
+{
+    QWebMethodPrivate *d = QWebMethodPrivate::get(pending.method);
+    const quint64 callId = d->invoke(pending.data, pending.lane, pending.endpoint);
+    if (pending.async)
+        d->promises.insert(callId, pending.promise);
+
+    if (key.isEmpty())
+        return;
+
+    Call call;
+    call.host = key;
+    call.lane = pending.lane;
+    call.method = pending.method;
+    call.started = m_clock.nsecsElapsed();
+    m_calls.insert(callId, call);
+    // Looked up again: invoke() may process events.
+    Host &h = host(key);
+    ++h.inFlight;
+    ++h.laneInFlight[pending.lane];
+}
+
+/*!
+    \internal
+
+    Sends queued calls of host \a key, as long as its limit allows. More
+    important classes go first; within a class and lane, calls are sent
+    in order. Lanes at their budget are skipped.
+  */
+void QWebScheduler::drain(const QString &key)
+{
+    forever {
+        Host &h = host(key);
+        if (h.inFlight >= int(h.limit))
+            return;
+
+        Pending pending;
+        int priority = -1;
+        for (int i = 0; i < PriorityCount && priority < 0; ++i) {
+            Host::LaneQueues::iterator lane = h.queues[i].begin();
+            for (; lane != h.queues[i].end(); ++lane) {
+                if (!laneAvailable(h, lane.key()))
+                    continue;
+
+                pending = lane.value().dequeue();
+                if (lane.value().isEmpty())
+                    h.queues[i].erase(lane);
+                priority = i;
+                break;
+            }
+        }
+
+        if (priority < 0)
+            return;
+
+        queuedChanged(priority, -1);
+        if (!pending.method) {
+            drop(pending);
+            continue;
+        }
+
+        dispatch(key, pending);
+    }
+}
+
+/*!
+    \internal
+
+    Fails queued call \a pending, which will never be sent.
+  */
+void QWebScheduler::drop(Pending &pending)
+{
+    if (!pending.async)
+        return;
+
+    QWebMethodPrivate::fulfill(pending.promise, QWebMethodPrivate::failedReply(
+                                   pending.methodName, QNetworkReply::OperationCanceledError,
+                                   QLatin1String("Web method removed")));
+}
+
+/*!
+    \internal
+
+    Takes a slot of the host of \a url for call \a callId of \a method,
+    sent outside of the queues (a hedged duplicate, in \a lane). Returns
+    false if the host has no free slot, or calls are waiting for one;
+    the call must not be sent then. Always succeeds if scheduling is off.
+  */
+bool QWebScheduler::admit(quint64 callId, QWebMethod *method, const QUrl &url,
+                          const QString &lane)
+{
+    if (!enabled)
+        return true;
+
+    const QString key = hostKey(url);
+    Host &h = host(key);
+    if (h.inFlight >= int(h.limit) || !laneAvailable(h, lane) || h.queued() > 0)
+        return false;
+
+    Call call;
+    call.host = key;
+    call.lane = lane;
+    call.method = method;
+    call.started = m_clock.nsecsElapsed();
+    m_calls.insert(callId, call);
+    ++h.inFlight;
+    ++h.laneInFlight[lane];
+    return true;
+}
+
+/*!
+    \internal
+
+    Records completion of call \a callId, with \a error and \a httpStatus,
+    adjusts limit of its host and sends queued calls.
+  */
+void QWebScheduler::callFinished(quint64 callId, QNetworkReply::NetworkError error,
+                                 int httpStatus)
+{
+    QHash<quint64, Call>::iterator it = m_calls.find(callId);
+    if (it == m_calls.end())
+        return;
+
+    const qint64 now = m_clock.nsecsElapsed();
+    const QString key = it.value().host;
+    const qint64 latency = (now - it.value().started) / 1000;
+    Host &h = host(key);
+    --h.inFlight;
+    --h.laneInFlight[it.value().lane];
+    ++h.completed;
+    m_calls.erase(it);
+
+    adjustLimit(key, latency, isOverload(error, httpStatus), now);
+    drain(key);
+}
+
+/*!
+    \internal
+
+    Gives back slot of call \a callId, which was cancelled. Its latency
+    does not count, and queued calls are sent.
+  */
+void QWebScheduler::callCancelled(quint64 callId)
+{
+    QHash<quint64, Call>::iterator it = m_calls.find(callId);
+    if (it == m_calls.end())
+        return;
+
+    const QString key = it.value().host;
+    Host &h = host(key);
+    --h.inFlight;
+    --h.laneInFlight[it.value().lane];
+    m_calls.erase(it);
+    drain(key);
+}
+
+/*!
+    \internal
+
+    Adjusts limit of \a host after a call which took \a latency
+    microseconds, and which did (or did not) indicate \a overloaded
+    server. \a now is current time, in nanoseconds.
+  */
+void QWebScheduler::adjustLimit(const QString &key, qint64 latency, bool overloaded,
+                                qint64 now)
+{
+    Host &h = host(key);
+    h.lastLatency = latency;
+
+    if (!overloaded) {
+        if (h.minLatency == 0 || latency < h.minLatency)
+            h.minLatency = latency;
+
+        // Lowest latency is re-learned periodically, so that it can
+        // follow a server which became permanently slower.
+        if (h.windowMinLatency == 0 || latency < h.windowMinLatency)
+            h.windowMinLatency = latency;
+        if (++h.windowSamples >= LatencyWindow) {
+            h.minLatency = h.windowMinLatency;
+            h.windowMinLatency = 0;
+            h.windowSamples = 0;
+        }
+    }
+
+    const bool slow = (h.minLatency > 0 && latency > h.minLatency * LatencyTolerance);
+    if (overloaded || slow) {
+        // At most one decrease per round trip: replies of calls sent
+        // before the previous decrease do not count twice.
+        if (now - h.lastDecrease >= h.minLatency * 1000) {
+            h.limit = qMax(double(minLimit), h.limit * BackoffRatio);
+            h.lastDecrease = now;
+        }
+    } else if (h.queued() > 0 || (h.inFlight + 1) >= int(h.limit)) {
+        // Grow only when the limit is actually what holds calls back.
+        h.limit = qMin(double(maxLimit), h.limit + (1.0 / h.limit));
+    }
+}
+
+/*!
+    \internal
+
+    Forgets calls of \a method (which is being destroyed, or removed from
+    the service). Calls in progress give their slots back, queued ones are
+    dropped.
+  */
+void QWebScheduler::forgetMethod(QWebMethod *method)
+{
+    QStringList touched;
+    QHash<quint64, Call>::iterator it = m_calls.begin();
+    while (it != m_calls.end()) {
+        if (it.value().method == method) {
+            Host &h = host(it.value().host);
+            --h.inFlight;
+            --h.laneInFlight[it.value().lane];
+            touched.append(it.value().host);
+            it = m_calls.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    QHash<QString, Host>::iterator h = m_hosts.begin();
+    for (; h != m_hosts.end(); ++h) {
+        for (int priority = 0; priority < PriorityCount; ++priority) {
+            Host::LaneQueues &lanes = h.value().queues[priority];
+            Host::LaneQueues::iterator lane = lanes.begin();
+            while (lane != lanes.end()) {
+                QQueue<Pending> &queue = lane.value();
+                for (int i = queue.size() - 1; i >= 0; --i) {
+                    if (queue.at(i).method != method && queue.at(i).method)
+                        continue;
+
+                    Pending pending = queue.takeAt(i);
+                    queuedChanged(priority, -1);
+                    drop(pending);
+                }
+
+                if (queue.isEmpty())
+                    lane = lanes.erase(lane);
+                else
+                    ++lane;
+            }
+        }
+    }
+
+    touched.removeDuplicates();
+    foreach (const QString &key, touched)
+        drain(key);
+}
+
+/*!
+    \internal
+
+    Sends all queued calls at once (used when scheduling is switched off).
+  */
+void QWebScheduler::flush()
+{
+    foreach (const QString &key, m_hosts.keys()) {
+        for (int priority = 0; priority < PriorityCount; ++priority) {
+            Host::LaneQueues lanes;
+            lanes.swap(m_hosts[key].queues[priority]);
+            foreach (const QQueue<Pending> &queue, lanes) {
+                queuedChanged(priority, -queue.size());
+                foreach (Pending pending, queue) {
+                    if (pending.method)
+                        dispatch(QString(), pending);
+                    else
+                        drop(pending);
+                }
+            }
+        }
+    }
+}
+
+/*!
+    \internal
+
+    Returns statistics of host \a key.
+  */
+QWebHostStats QWebScheduler::stats(const QString &key) const
+{
+    QWebHostStats result;
+    result.host = key;
+
+    QHash<QString, Host>::const_iterator it = m_hosts.constFind(key);
+    if (it == m_hosts.constEnd()) {
+        result.limit = qBound(minLimit, initialLimit, maxLimit);
+        return result;
+    }
+
+    const Host &h = it.value();
+    result.limit = int(h.limit);
+    result.inFlight = h.inFlight;
+    result.queued = h.queued();
+    result.rejected = h.rejected;
+    result.completed = h.completed;
+    result.minLatency = h.minLatency;
+    result.lastLatency = h.lastLatency;
+    return result;
+}
+
+/*!
+    \internal
+
+    Returns statistics of all hosts seen so far.
+  */
+QList<QWebHostStats> QWebScheduler::stats() const
+{
+    QList<QWebHostStats> result;
+    foreach (const QString &key, m_hosts.keys())
+        result.append(stats(key));
+    return result;
+}
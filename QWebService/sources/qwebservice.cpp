@@ -16,6 +16,11 @@
 ****************************************************************************/
 
 #include "../headers/qwebservice_p.h"
+#include "../headers/qwebmethod_p.h"
+#include "../headers/qwebdispatcher_p.h"
+#include "../headers/qwebtrace_p.h"
+
+#include <QtCore/qthread.h>
 
 /*!
     \class QWebService
@@ -46,6 +51,12 @@
     When any of the web methods in QwebService receives a reply, replyReady() signal
     is emitted. It sends reply data and web method name, so that the sender can be easily
     determined.
+
+    To keep network traffic away from the GUI thread, or to spread many
+    concurrent calls across cores, set a QWebDispatcher (setDispatcher()).
+    Worker threads can use invokeMethodBlocking(), which is thread-safe
+    and does not need an event loop. setAdaptiveConcurrency() limits
+    the number of calls in flight per host, following observed latency.
   */
 
 /*!
@@ -81,10 +92,11 @@
     \sa setWsdl(), addMethod()
   */
 QWebService::QWebService(QObject *parent)
-    : QObject(parent), d_ptr(new QWebServicePrivate)
+    : QObject(parent), d_ptr(new QWebServicePrivate(this))
 {
     Q_D(QWebService);
     d->wsdl = new QWsdl(this);
+    d->watchWsdl(0);
     d->methods = new QMap<QString, QWebMethod *>();
     d->init();
 }
@@ -98,7 +110,7 @@ QWebService::QWebService(QObject *parent)
     \sa resetWsdl(), addMethod()
   */
 QWebService::QWebService(QWsdl *_wsdl, QObject *parent)
-    : QObject(parent), d_ptr(new QWebServicePrivate)
+    : QObject(parent), d_ptr(new QWebServicePrivate(this))
 {
     Q_D(QWebService);
     d->methods = new QMap<QString, QWebMethod *>();
@@ -116,7 +128,7 @@ QWebService::QWebService(QWsdl *_wsdl, QObject *parent)
     \sa setWsdl(), addMethod()
   */
 QWebService::QWebService(const QString &_hostname, QObject *parent)
-    : QObject(parent), d_ptr(new QWebServicePrivate)
+    : QObject(parent), d_ptr(new QWebServicePrivate(this))
 {
     Q_D(QWebService);
     d->m_hostUrl.setUrl(_hostname);
@@ -138,17 +150,20 @@ QWebService::QWebService(QWebServicePrivate &dd, QObject *parent) :
     QObject(parent), d_ptr(&dd)
 {
     Q_D(QWebService);
+    d->q_ptr = this;
     d->wsdl = new QWsdl(this);
+    d->watchWsdl(0);
     d->methods = new QMap<QString, QWebMethod *>();
     d->init();
 }
 
 /*!
-    Deletes wsdl pointer.
+    Deletes wsdl pointer. Mirrored calls still in flight are aborted.
   */
 QWebService::~QWebService()
 {
     Q_D(QWebService);
+    d->mirror.abort();
     delete d->wsdl;
 }
 
@@ -166,6 +181,34 @@ QWebService::~QWebService()
     that got the reply can be determined using \a methodName.
   */
 
+/*!
+    \fn QWebService::queueHighWatermark(QWebService::Priority priority)
+
+    Signal emitted when the number of queued calls of \a priority class
+    reaches the high watermark. Producers should slow down until
+    queueLowWatermark() is emitted.
+
+    \sa setQueueWatermarks()
+  */
+
+/*!
+    \fn QWebService::queueLowWatermark(QWebService::Priority priority)
+
+    Signal emitted when the queue of \a priority class, after reaching
+    the high watermark, drains down to the low watermark.
+
+    \sa setQueueWatermarks()
+  */
+
+/*!
+    \fn QWebService::repliesReady(const QList<QWebReply> &replies)
+
+    Signal emitted in batch delivery mode, carrying all \a replies
+    (in order of arrival) collected since the previous one.
+
+    \sa setBatchDelivery()
+  */
+
 /*!
     \fn QWebService::hostChanged()
 
@@ -225,13 +268,17 @@ void QWebService::setName(const QString &newWebServiceName)
 
 /*!
     Returns pointers to all QWebMethod objects held in QWebService,
-    useful for invoking web methods.
+    useful for invoking web methods. Creates all WSDL methods which
+    were not used yet; method() creates only the one requested.
+    Unlike other accessors, the returned map is not guarded: use it
+    in the thread of this object only.
 
     \sa method()
   */
 QMap<QString, QWebMethod *> *QWebService::methods()
 {
     Q_D(QWebService);
+    d->materializeMethods();
     return d->methods;
 }
 
@@ -239,23 +286,29 @@ QMap<QString, QWebMethod *> *QWebService::methods()
     Returns a pointer to a single web method object, specified by
     \a methodName. If no method with that name exists,
     a default-constructed value is returned (see QMap::value() documentation
-    for details).
+    for details). Methods read from WSDL are created on first use.
 
     \sa methods()
   */
 QWebMethod *QWebService::method(const QString &methodName)
 {
     Q_D(QWebService);
-    return d->methods->value(methodName);
+    return d->method(methodName);
 }
 
 /*!
-    Returns a list of methods' names.
+    Returns a list of methods' names. Does not create WSDL methods.
   */
 QStringList QWebService::methodNames() const
 {
     Q_D(const QWebService);
-    return (QStringList) d->methods->keys();
+    QMutexLocker locker(&d->methodsMutex);
+    QStringList result = d->methods->keys();
+    if (!d->pendingMethods.isEmpty()) {
+        result.append(d->pendingMethods.toList());
+        result.sort();
+    }
+    return result;
 }
 
 /*!
@@ -264,7 +317,7 @@ QStringList QWebService::methodNames() const
 QStringList QWebService::methodParameters(const QString &methodName) const
 {
     Q_D(const QWebService);
-    return d->methods->value(methodName)->parameterNames();
+    return d->method(methodName)->parameterNames();
 }
 
 /*!
@@ -273,7 +326,7 @@ QStringList QWebService::methodParameters(const QString &methodName) const
 QStringList QWebService::methodReturnValue(const QString &methodName) const
 {
     Q_D(const QWebService);
-    return d->methods->value(methodName)->returnValueName();
+    return d->method(methodName)->returnValueName();
 }
 
 /*!
@@ -284,7 +337,7 @@ QStringList QWebService::methodReturnValue(const QString &methodName) const
 QMap<QString, QVariant> QWebService::parameterNamesTypes(const QString &methodName) const
 {
     Q_D(const QWebService);
-    return d->methods->value(methodName)->parameterNamesTypes();
+    return d->method(methodName)->parameterNamesTypes();
 }
 
 /*!
@@ -295,7 +348,7 @@ QMap<QString, QVariant> QWebService::parameterNamesTypes(const QString &methodNa
 QMap<QString, QVariant> QWebService::returnValueNameType(const QString &methodName) const
 {
     Q_D(const QWebService);
-    return d->methods->value(methodName)->returnValueNameType();
+    return d->method(methodName)->returnValueNameType();
 }
 
 /*!
@@ -308,9 +361,13 @@ QMap<QString, QVariant> QWebService::returnValueNameType(const QString &methodNa
 void QWebService::addMethod(QWebMethod *newMethod)
 {
     Q_D(QWebService);
-    d->methods->insert(newMethod->methodName(), newMethod);
-    connect(newMethod, SIGNAL(replyReady(QByteArray)),
-            this, SLOT(receiveReply(QByteArray)));
+    {
+        QMutexLocker locker(&d->methodsMutex);
+        d->pendingMethods.remove(newMethod->methodName());
+        d->wsdlMethods.remove(newMethod->methodName());
+        d->methods->insert(newMethod->methodName(), newMethod);
+        d->adoptMethod(newMethod);
+    }
     emit methodNamesChanged();
 }
 
@@ -326,9 +383,13 @@ void QWebService::addMethod(QWebMethod *newMethod)
 void QWebService::addMethod(const QString &methodName, QWebMethod *newMethod)
 {
     Q_D(QWebService);
-    d->methods->insert(methodName, newMethod);
-    connect(newMethod, SIGNAL(replyReady(QByteArray)),
-            this, SLOT(receiveReply(QByteArray)));
+    {
+        QMutexLocker locker(&d->methodsMutex);
+        d->pendingMethods.remove(methodName);
+        d->wsdlMethods.remove(methodName);
+        d->methods->insert(methodName, newMethod);
+        d->adoptMethod(newMethod);
+    }
     emit methodNamesChanged();
 }
 
@@ -341,10 +402,15 @@ void QWebService::addMethod(const QString &methodName, QWebMethod *newMethod)
 void QWebService::removeMethod(const QString &methodName)
 {
     Q_D(QWebService);
-    disconnect(d->methods->value(methodName), SIGNAL(replyReady(QByteArray)),
-            this, SLOT(receiveReply(QByteArray)));
-    delete d->methods->value(methodName);
-    d->methods->remove(methodName);
+    QWebMethod *method = 0;
+    {
+        QMutexLocker locker(&d->methodsMutex);
+        d->pendingMethods.remove(methodName);
+        d->wsdlMethods.remove(methodName);
+        method = d->methods->take(methodName);
+    }
+    d->releaseMethod(method);
+    delete method;
     emit methodNamesChanged();
 }
 
@@ -357,11 +423,155 @@ void QWebService::removeMethod(const QString &methodName)
     \code
     QWebService::method("methodName")->invokeMethod(data);
     \endcode
+
+    With adaptive concurrency on, the call may be queued (in the queue of
+    its \a priority class) until its host has a free slot. Returns false
+    if the queue is full, or if there is no such method.
+
+    With load balancing on, the call is sent to one of endpoints(),
+    instead of URL of the method.
+
+    \sa setAdaptiveConcurrency(), setLoadBalancing()
+  */
+bool QWebService::invokeMethod(const QString &methodName, const QByteArray &data,
+                               Priority priority)
+{
+    return invokeMethod(methodName, data, QByteArray(), priority);
+}
+
+/*!
+    \overload invokeMethod()
+
+    Invokes web method \a methodName, passing \a data to it. With
+    ConsistentHashBalancing, all calls with the same \a balancingKey (for
+    example, a session or customer id) go to the same endpoint, as long
+    as it is healthy. Other policies ignore the key.
+  */
+bool QWebService::invokeMethod(const QString &methodName, const QByteArray &data,
+                               const QByteArray &balancingKey, Priority priority)
+{
+    Q_D(QWebService);
+    QWebMethod *method = d->method(methodName);
+    if (!method)
+        return false;
+
+    const QUrl endpoint = d->balancer.pick(balancingKey);
+    if (d->scheduler.enabled || !endpoint.isEmpty())
+        return d->scheduler.submit(method, data, priority, 0, endpoint);
+    return method->invokeMethod(data);
+}
+
+/*!
+    Invokes web method \a methodName, passing \a data to it, and returns
+    a future fulfilled with the reply. Fails with QWebReplyException if
+    there is no such method, or if the queue of \a priority class is full
+    (see invokeMethod()).
+
+    Similar to calling:
+    \code
+    QWebService::method("methodName")->invokeMethodAsync(data);
+    \endcode
+
+    \sa QWebMethod::invokeMethodAsync(), QWebReply
+  */
+QFuture<QWebReply> QWebService::invokeMethodAsync(const QString &methodName,
+                                                  const QByteArray &data,
+                                                  Priority priority)
+{
+    return invokeMethodAsync(methodName, data, QByteArray(), priority);
+}
+
+/*!
+    \overload invokeMethodAsync()
+
+    Invokes web method \a methodName, passing \a data to it, and returns
+    a future fulfilled with the reply. \a balancingKey is used as in
+    invokeMethod().
   */
-bool QWebService::invokeMethod(const QString &methodName, const QByteArray &data)
+QFuture<QWebReply> QWebService::invokeMethodAsync(const QString &methodName,
+                                                  const QByteArray &data,
+                                                  const QByteArray &balancingKey,
+                                                  Priority priority)
 {
     Q_D(QWebService);
-    return d->methods->value(methodName)->invokeMethod(data);
+    QWebMethod *method = d->method(methodName);
+    if (!method) {
+        return QWebMethodPrivate::failedCall(methodName,
+                                             QNetworkReply::ProtocolInvalidOperationError,
+                                             QLatin1String("No such method: ") + methodName);
+    }
+
+    const QUrl endpoint = d->balancer.pick(balancingKey);
+    if (!d->scheduler.enabled && endpoint.isEmpty())
+        return method->invokeMethodAsync(data);
+
+    QFutureInterface<QWebReply> promise;
+    promise.reportStarted();
+    if (!d->scheduler.submit(method, data, priority, &promise, endpoint)) {
+        return QWebMethodPrivate::failedCall(methodName, QNetworkReply::ServiceUnavailableError,
+                                             QLatin1String("Queue full"));
+    }
+    return promise.future();
+}
+
+/*!
+    Invokes web method \a methodName with \a params, and blocks the calling
+    thread until reply arrives or \a timeout milliseconds pass (negative
+    timeout means: wait forever). Returns the raw reply, or empty QByteArray
+    on error, in which case \a errorMessage (if not 0) is set.
+
+    Unlike invokeMethod(), this is thread-safe: it can be called from any
+    number of threads at once, including threads without an event loop.
+    Web method objects are only read (their parameters are not modified,
+    \a params are used instead), and request is sent from a network thread
+    of dispatcher() - or QWebDispatcher::globalInstance(), if none is set.
+    No events are processed while waiting. Methods and their settings must
+    not be changed while blocking calls are in progress. A WSDL method which
+    was not used yet is created by the first call, in the thread of this
+    object, which has to run an event loop meanwhile.
+
+    Must not be called from dispatcher's own network threads.
+
+    \sa invokeMethod(), setDispatcher()
+  */
+QByteArray QWebService::invokeMethodBlocking(const QString &methodName,
+                                             const QMap<QString, QVariant> &params,
+                                             int timeout,
+                                             QString *errorMessage) const
+{
+    Q_D(const QWebService);
+    QWebMethod *method = d->method(methodName);
+    if (!method) {
+        if (errorMessage)
+            *errorMessage = QLatin1String("No such method: ") + methodName;
+        return QByteArray();
+    }
+
+    QWebDispatcher *dispatcher = 0;
+    {
+        QMutexLocker locker(&d->methodsMutex);
+        dispatcher = d->dispatcher;
+    }
+    if (!dispatcher)
+        dispatcher = QWebDispatcher::globalInstance();
+
+    const QWebMethodPrivate *m = QWebMethodPrivate::get(method);
+    const quint64 callId = QWebMethodPrivate::nextCallId();
+    QWEBTRACE(Enqueue, callId, methodName);
+
+    QWebCallResult result = QWebDispatcherPrivate::get(dispatcher)->callBlocking(
+                m->makeCall(callId, m->requestData(params)), timeout);
+    QWEBTRACE(Deliver, callId, methodName);
+
+    if (result.error != QNetworkReply::NoError) {
+        if (errorMessage)
+            *errorMessage = result.errorString;
+        return QByteArray();
+    }
+
+    if (errorMessage)
+        errorMessage->clear();
+    return result.data;
 }
 
 /*!
@@ -377,7 +587,7 @@ bool QWebService::invokeMethod(const QString &methodName, const QByteArray &data
 QString QWebService::replyRead(const QString &methodName)
 {
     Q_D(QWebService);
-    return d->methods->value(methodName)->replyRead();
+    return d->method(methodName)->replyRead();
 }
 
 /*!
@@ -424,28 +634,465 @@ void QWebService::setHost(const QUrl &hostUrl)
     emit hostUrlChanged();
 }
 
+/*!
+    Returns dispatcher set with setDispatcher(), or 0.
+  */
+QWebDispatcher *QWebService::dispatcher() const
+{
+    Q_D(const QWebService);
+    return d->dispatcher;
+}
+
+/*!
+    Sets \a dispatcher on all web methods of this service, including ones
+    added later. Calls are then sent from dispatcher's network threads;
+    replyReady() is still emitted in this object's thread.
+    Passing 0 makes methods send calls from their own thread again.
+
+    \sa QWebMethod::setDispatcher(), QWebDispatcher
+  */
+void QWebService::setDispatcher(QWebDispatcher *dispatcher)
+{
+    Q_D(QWebService);
+    QMutexLocker locker(&d->methodsMutex);
+    d->dispatcher = dispatcher;
+    foreach (QWebMethod *method, *d->methods)
+        method->setDispatcher(dispatcher);
+}
+
+/*!
+    Returns decode pool set with setDecodePool(), or 0.
+  */
+QThreadPool *QWebService::decodePool() const
+{
+    Q_D(const QWebService);
+    return d->decodePool;
+}
+
+/*!
+    Sets decode \a pool on all web methods of this service, including ones
+    added later.
+
+    \sa QWebMethod::setDecodePool()
+  */
+void QWebService::setDecodePool(QThreadPool *pool)
+{
+    Q_D(QWebService);
+    QMutexLocker locker(&d->methodsMutex);
+    d->decodePool = pool;
+    foreach (QWebMethod *method, *d->methods)
+        method->setDecodePool(pool);
+}
+
+/*!
+    Returns connection pool set with setConnectionPool(), or 0.
+  */
+QWebConnectionPool *QWebService::connectionPool() const
+{
+    Q_D(const QWebService);
+    return d->connectionPool;
+}
+
+/*!
+    Makes all methods of the service (including ones added later) send
+    calls through connections of \a pool. Services sharing a pool share
+    connections, cookies and caches; give services which must not share
+    a session (for example, of different tenants) separate pools.
+
+    \sa QWebMethod::setConnectionPool(), QWebConnectionPool
+  */
+void QWebService::setConnectionPool(QWebConnectionPool *pool)
+{
+    Q_D(QWebService);
+    QMutexLocker locker(&d->methodsMutex);
+    d->connectionPool = pool;
+    foreach (QWebMethod *method, *d->methods)
+        method->setConnectionPool(pool);
+}
+
+/*!
+    Returns true if replies are delivered in batches.
+
+    \sa setBatchDelivery()
+  */
+bool QWebService::isBatchDelivery() const
+{
+    Q_D(const QWebService);
+    return d->batchDelivery;
+}
+
+/*!
+    Turns batch delivery on (\a enabled true) or off. In batch mode,
+    replies of all web methods of this service are collected, and
+    delivered together in a single repliesReady() signal, at most
+    \a maxLatency milliseconds after the first of them arrived. With
+    \a maxLatency 0 (default), all replies that arrived during one
+    event loop iteration are delivered together.
+
+    replyReady() of QWebService is not emitted in batch mode, which saves
+    a signal (and a sender() lookup) per call. Signals of web methods are
+    still emitted. When batch mode is turned off, pending replies are
+    delivered at once.
+
+    \sa repliesReady()
+  */
+void QWebService::setBatchDelivery(bool enabled, int maxLatency)
+{
+    Q_D(QWebService);
+    d->batchLatency = qMax(maxLatency, 0);
+    if (enabled == d->batchDelivery)
+        return;
+
+    if (!enabled)
+        deliverBatch();
+
+    QMutexLocker locker(&d->methodsMutex);
+    d->batchDelivery = enabled;
+    foreach (QWebMethod *method, *d->methods) {
+        if (enabled) {
+            disconnect(method, SIGNAL(replyReady(QByteArray)),
+                       this, SLOT(receiveReply(QByteArray)));
+        }
+        d->adoptMethod(method);
+    }
+}
+
+/*!
+    Returns true if calls are subject to adaptive concurrency limits.
+
+    \sa setAdaptiveConcurrency()
+  */
+bool QWebService::isAdaptiveConcurrency() const
+{
+    Q_D(const QWebService);
+    return d->scheduler.enabled;
+}
+
+/*!
+    Turns adaptive concurrency limiting on (\a enabled true) or off.
+
+    When on, invokeMethod() and invokeMethodAsync() keep at most a limited
+    number of calls in flight per host (scheme, host and port). Calls over
+    the limit wait in a queue (see setMaxQueueLength()). The limit starts
+    at the initial value of setConcurrencyLimits(), and follows observed
+    latency: it grows slowly while replies come back as fast as the fastest
+    ones recently seen, and is cut by 10% when they become more than twice
+    as slow, or when the server reports overload (HTTP 429, 503, 504,
+    refused or timed out connections). This keeps queueing in the client,
+    instead of in the server, when the server slows down.
+
+    Each call has a priority class (see invokeMethod()). Queued calls of
+    a more important class are always sent first, so that interactive
+    calls do not wait behind bulk traffic. Queues of each class can be
+    bounded (setMaxQueueLength()), and watched (setQueueWatermarks()).
+
+    When turned off, all queued calls are sent at once.
+
+    \sa hostStats()
+  */
+void QWebService::setAdaptiveConcurrency(bool enabled)
+{
+    Q_D(QWebService);
+    if (enabled == d->scheduler.enabled)
+        return;
+
+    d->scheduler.enabled = enabled;
+    if (!enabled)
+        d->scheduler.flush();
+}
+
+/*!
+    Sets \a initialLimit of calls in flight for hosts seen for the first
+    time, and bounds (\a minLimit, \a maxLimit) of adaptive limits.
+    Passing the same value for all three gives a fixed limit.
+  */
+void QWebService::setConcurrencyLimits(int initialLimit, int minLimit, int maxLimit)
+{
+    Q_D(QWebService);
+    d->scheduler.minLimit = qMax(minLimit, 1);
+    d->scheduler.maxLimit = qMax(maxLimit, d->scheduler.minLimit);
+    d->scheduler.initialLimit = qBound(d->scheduler.minLimit, initialLimit,
+                                       d->scheduler.maxLimit);
+}
+
+/*!
+    Returns maximum number of calls of \a priority class queued per host,
+    or -1 if unlimited (default).
+  */
+int QWebService::maxQueueLength(Priority priority) const
+{
+    Q_D(const QWebService);
+    return d->scheduler.maxQueueLength[priority];
+}
+
+/*!
+    Sets maximum number of calls queued per host, in each priority class,
+    to \a length (negative: unlimited). Calls above it are rejected:
+    invokeMethod() returns false, and futures of invokeMethodAsync() fail
+    with ServiceUnavailableError. Rejections are counted in hostStats().
+  */
+void QWebService::setMaxQueueLength(int length)
+{
+    Q_D(QWebService);
+    for (int i = 0; i < QWebScheduler::PriorityCount; ++i)
+        d->scheduler.maxQueueLength[i] = qMax(length, -1);
+}
+
+/*!
+    \overload setMaxQueueLength()
+
+    Sets maximum queue \a length of \a priority class only.
+  */
+void QWebService::setMaxQueueLength(Priority priority, int length)
+{
+    Q_D(QWebService);
+    d->scheduler.maxQueueLength[priority] = qMax(length, -1);
+}
+
+/*!
+    Enables backpressure signals. When the number of calls of a priority
+    class queued for all hosts reaches \a high, queueHighWatermark() is
+    emitted; when it then drops to \a low, queueLowWatermark() is emitted.
+    Producers can use them to pause and resume. Passing 0 as \a high
+    turns the signals off.
+
+    \sa queuedCalls()
+  */
+void QWebService::setQueueWatermarks(int low, int high)
+{
+    Q_D(QWebService);
+    d->scheduler.highWatermark = qMax(high, 0);
+    d->scheduler.lowWatermark = qBound(0, low, d->scheduler.highWatermark);
+}
+
+/*!
+    Returns number of calls of \a priority class waiting in queues.
+  */
+int QWebService::queuedCalls(Priority priority) const
+{
+    Q_D(const QWebService);
+    return d->scheduler.queued(priority);
+}
+
+/*!
+    Returns connection budget of \a lane, or -1 if it is unlimited.
+
+    \sa setLaneConnections()
+  */
+int QWebService::laneConnections(const QString &lane) const
+{
+    Q_D(const QWebService);
+    return d->scheduler.laneBudget(lane);
+}
+
+/*!
+    Allows at most \a connections calls of connection \a lane in flight
+    per host (0 or less: unlimited). Methods are assigned to lanes with
+    QWebMethod::setLane(); each lane uses its own connections, so a lane
+    for large transfers (e.g. "bulk", with a budget of 1 or 2) keeps them
+    from delaying small calls in the default lane. Calls over the budget
+    wait in the queue without holding back calls of other lanes.
+
+    Budgets are enforced together with adaptive concurrency
+    (setAdaptiveConcurrency()), and count against the host's limit too.
+    Note that QNetworkAccessManager opens at most 6 connections per host
+    and lane.
+  */
+void QWebService::setLaneConnections(const QString &lane, int connections)
+{
+    Q_D(QWebService);
+    d->scheduler.setLaneBudget(lane, connections);
+}
+
+/*!
+    Returns current limit, calls in flight, queue depth, rejected and
+    completed calls, and latencies of all hosts contacted with adaptive
+    concurrency on.
+  */
+QList<QWebHostStats> QWebService::hostStats() const
+{
+    Q_D(const QWebService);
+    return d->scheduler.stats();
+}
+
+/*!
+    \overload hostStats()
+
+    Returns statistics of the host of \a host URL.
+  */
+QWebHostStats QWebService::hostStats(const QUrl &host) const
+{
+    Q_D(const QWebService);
+    return d->scheduler.stats(QWebScheduler::hostKey(host));
+}
+
+/*!
+    Returns load balancing policy. Default is NoLoadBalancing.
+
+    \sa setLoadBalancing()
+  */
+QWebService::LoadBalancing QWebService::loadBalancing() const
+{
+    Q_D(const QWebService);
+    return d->balancer.policy;
+}
+
+/*!
+    Makes invokeMethod() and invokeMethodAsync() spread calls over
+    endpoints(), according to \a policy:
+    \list
+        \o NoLoadBalancing - calls go to URLs of their methods,
+        \o RoundRobinBalancing - endpoints are used in turn,
+        \o LeastOutstandingBalancing - endpoint with fewest calls in flight
+            is used,
+        \o ConsistentHashBalancing - endpoint is chosen by key of the call
+            (see invokeMethod()); calls without a key are sent in turn.
+    \endlist
+
+    Endpoints failing many calls in a row (connection errors, HTTP 502,
+    503 and 504) are ejected for a while, see setEndpointEjection().
+    Combined with adaptive concurrency, each endpoint has its own limit.
+    Calls made with invokeMethodBlocking() and directly through web
+    methods are not balanced.
+  */
+void QWebService::setLoadBalancing(LoadBalancing policy)
+{
+    Q_D(QWebService);
+    d->balancer.policy = policy;
+}
+
+/*!
+    Returns endpoints used by load balancing. By default, these are
+    addresses of all ports of the web service (QWsdl::endpoints()).
+  */
+QList<QUrl> QWebService::endpoints() const
+{
+    Q_D(const QWebService);
+    return d->balancer.endpoints();
+}
+
+/*!
+    Sets \a endpoints used by load balancing. Statistics and ejections of
+    endpoints which were already used are kept.
+
+    \sa setLoadBalancing()
+  */
+void QWebService::setEndpoints(const QList<QUrl> &endpoints)
+{
+    Q_D(QWebService);
+    d->balancer.setEndpoints(endpoints);
+}
+
+/*!
+    Makes load balancing eject an endpoint after \a consecutiveFailures
+    failed calls in a row (0: never), for \a ejectionTime milliseconds.
+    Each further ejection of the same endpoint lasts longer (up to 10 times
+    \a ejectionTime). The last healthy endpoint is never ejected.
+    Defaults are 5 failures and 30 seconds.
+  */
+void QWebService::setEndpointEjection(int consecutiveFailures, int ejectionTime)
+{
+    Q_D(QWebService);
+    d->balancer.ejectionFailures = qMax(consecutiveFailures, 0);
+    d->balancer.ejectionTime = qMax(ejectionTime, 0);
+}
+
+/*!
+    Returns calls in flight, completed and failed calls, and ejections
+    of all endpoints.
+  */
+QList<QWebEndpointStats> QWebService::endpointStats() const
+{
+    Q_D(const QWebService);
+    return d->balancer.stats();
+}
+
+/*!
+    Returns URL calls are mirrored to, or an empty URL, if mirroring
+    is off.
+
+    \sa setMirror()
+  */
+QUrl QWebService::mirrorUrl() const
+{
+    Q_D(const QWebService);
+    return d->mirror.target();
+}
+
+/*!
+    Sends copies of \a sampleRate (0.0 - 1.0) of calls made by methods
+    of this service to \a target, for example a new version of the web
+    service, which is to be tested with real traffic. Target without
+    a path gets path and query of each call. Empty \a target turns
+    mirroring off.
+
+    Mirrored calls are fire-and-forget: their replies are never delivered,
+    and they are not subject to adaptive concurrency nor load balancing.
+    At most \a maxInFlight of them are sent at a time; further sampled
+    calls are not mirrored, but counted as dropped. Once both replies of
+    a call are received, their latencies and outcomes are compared, see
+    mirrorStats().
+  */
+void QWebService::setMirror(const QUrl &target, double sampleRate, int maxInFlight)
+{
+    Q_D(QWebService);
+    d->mirror.setTarget(target, sampleRate, maxInFlight);
+}
+
+/*!
+    Returns, for each mirrored method, numbers of mirrored, dropped and
+    compared calls, mismatched outcomes (one of the calls failed, or
+    reply bodies differ), failed mirrored calls, and mean latencies of
+    original and mirrored calls.
+
+    \sa setMirror()
+  */
+QList<QWebMirrorStats> QWebService::mirrorStats() const
+{
+    Q_D(const QWebService);
+    return d->mirror.stats();
+}
+
 /*!
     Sets the WSDL (\a newWsdl) file to use. This does not override
     already present methods. If you want to override them, use resetWsdl().
 
+    When the WSDL file changes (QWsdl::wsdlFileChanged(), for example after
+    QWsdl::refresh()), methods of the service are updated: methods created
+    from the WSDL are released (objects obtained before stay valid, but are
+    no longer used by the service), and the methods of new WSDL model are
+    created on first use. Methods added with addMethod() are kept.
+
     \sa resetWsdl()
   */
 void QWebService::setWsdl(QWsdl *newWsdl)
 {
     Q_D(QWebService);
-    d->wsdl = newWsdl;
-    setName(d->wsdl->webServiceName());
-    foreach (QString s, d->wsdl->methods()->keys()) {
-        d->methods->insert(s, d->wsdl->methods()->value(s));
-        connect(d->methods->value(s), SIGNAL(replyReady(QByteArray)),
-                this, SLOT(receiveReply(QByteArray)));
+    // Pending methods belong to the previous WSDL.
+    d->materializeMethods();
+    QWsdl *previous = d->wsdl;
+    {
+        QMutexLocker locker(&d->methodsMutex);
+        d->wsdl = newWsdl;
+        // Methods of the previous WSDL are kept, as if they were added.
+        d->wsdlMethods.clear();
+        foreach (const QString &s, d->wsdl->methodNames()) {
+            d->methods->remove(s);
+            d->pendingMethods.insert(s);
+        }
     }
+    d->watchWsdl(previous);
+
+    if (!d->wsdl->endpoints().isEmpty())
+        d->balancer.setEndpoints(d->wsdl->endpoints());
+    setName(d->wsdl->webServiceName());
 }
 
 /*!
     Sets the WSDL (\a newWsdl) file to use. This does override already
     present methods.
     If you just want to add WSDL methods to existing ones, use setWsdl().
+    Methods are updated when the WSDL file changes, see setWsdl().
 
     \sa setWsdl()
   */
@@ -453,25 +1100,31 @@ void QWebService::resetWsdl(QWsdl *newWsdl)
 {
     Q_D(QWebService);
 
-    if (newWsdl == 0) {
-        foreach (QString s, d->methods->keys()) {
-            connect(d->methods->value(s), SIGNAL(replyReady(QByteArray)),
-                    this, SLOT(receiveReply(QByteArray)));
-        }
-        d->methods->clear();
-        d->wsdl = new QWsdl(this);
-        setName();
-    } else {
-        d->wsdl = newWsdl;
+    QWsdl *previous = d->wsdl;
+    {
+        QMutexLocker locker(&d->methodsMutex);
+        foreach (QWebMethod *method, *d->methods)
+            d->releaseMethod(method);
+        d->pendingMethods.clear();
+        d->wsdlMethods.clear();
         d->methods->clear();
-//        d->methods = d->wsdl->methods();
-        foreach (QString s, d->wsdl->methods()->keys()) {
-            d->methods->insert(s, d->wsdl->methods()->value(s));
-            connect(d->methods->value(s), SIGNAL(replyReady(QByteArray)),
-                    this, SLOT(receiveReply(QByteArray)));
+
+        if (newWsdl == 0) {
+            d->wsdl = new QWsdl(this);
+        } else {
+            d->wsdl = newWsdl;
+//            d->methods = d->wsdl->methods();
+            foreach (const QString &s, d->wsdl->methodNames())
+                d->pendingMethods.insert(s);
         }
-        setName(d->wsdl->webServiceName());
     }
+    d->watchWsdl(previous);
+
+    d->balancer.setEndpoints(d->wsdl->endpoints());
+    if (newWsdl == 0)
+        setName();
+    else
+        setName(d->wsdl->webServiceName());
 }
 
 /*!
@@ -504,7 +1157,19 @@ QString QWebService::errorInfo() const
   */
 void QWebServicePrivate::init()
 {
+    Q_Q(QWebService);
     errorState = false;
+    mirror.context = q;
+
+    // Queued, so that slots can call the service again.
+    scheduler.watermarkCrossed = [q](QWebService::Priority priority, bool high) {
+        QMetaObject::invokeMethod(q, [q, priority, high]() {
+            if (high)
+                emit q->queueHighWatermark(priority);
+            else
+                emit q->queueLowWatermark(priority);
+        }, Qt::QueuedConnection);
+    };
 
     if (wsdl->isErrorState())
         return;
@@ -524,6 +1189,176 @@ bool QWebServicePrivate::enterErrorState(const QString &errMessage)
     return false;
 }
 
+/*!
+    \internal
+
+    Applies dispatcher and decode pool of this service (if set) to
+    a newly added \a method, and connects it for reply delivery.
+  */
+void QWebServicePrivate::adoptMethod(QWebMethod *method) const
+{
+    QWebService *q = q_ptr;
+    if (dispatcher)
+        method->setDispatcher(dispatcher);
+    if (decodePool)
+        method->setDecodePool(decodePool);
+    if (connectionPool)
+        method->setConnectionPool(connectionPool);
+
+    QWebMethodPrivate::get(method)->service = q;
+    if (!batchDelivery) {
+        QObject::connect(method, SIGNAL(replyReady(QByteArray)),
+                         q, SLOT(receiveReply(QByteArray)), Qt::UniqueConnection);
+    }
+}
+
+/*!
+    \internal
+
+    Returns method called \a methodName. WSDL methods are created
+    (and adopted) on first use, always in the thread of this service, so
+    that they (and their network access managers) live there. Can be
+    called from any thread: other threads wait until the thread of this
+    service creates the method, so it has to run an event loop.
+  */
+QWebMethod *QWebServicePrivate::method(const QString &methodName) const
+{
+    {
+        QMutexLocker locker(&methodsMutex);
+        QWebMethod *result = methods->value(methodName);
+        if (result || !pendingMethods.contains(methodName))
+            return result;
+    }
+
+    if (QThread::currentThread() != q_ptr->thread()) {
+        QWebMethod *result = 0;
+        QMetaObject::invokeMethod(q_ptr, [this, &methodName, &result]() {
+            result = method(methodName);
+        }, Qt::BlockingQueuedConnection);
+        return result;
+    }
+
+    QMutexLocker locker(&methodsMutex);
+    if (!pendingMethods.remove(methodName))
+        return methods->value(methodName);
+
+    QWebMethod *result = wsdl->method(methodName);
+    if (!result)
+        return 0;
+
+    methods->insert(methodName, result);
+    wsdlMethods.insert(methodName);
+    adoptMethod(result);
+    return result;
+}
+
+/*!
+    \internal
+
+    Connects wsdlFileChanged() of current WSDL to wsdlChanged(), and
+    disconnects \a previous WSDL (if any).
+  */
+void QWebServicePrivate::watchWsdl(QWsdl *previous)
+{
+    Q_Q(QWebService);
+    if (previous == wsdl)
+        return;
+
+    if (previous)
+        QObject::disconnect(previous, SIGNAL(wsdlFileChanged()), q, 0);
+    QObject::connect(wsdl, &QWsdl::wsdlFileChanged, q, [this]() { wsdlChanged(); });
+}
+
+/*!
+    \internal
+
+    Updates methods after the WSDL file changed (for example, was refreshed).
+    Methods created from previous model are released, and all methods of
+    the new model become pending (unless a method of the same name was
+    added with addMethod()). Name and endpoints are taken from the new model.
+  */
+void QWebServicePrivate::wsdlChanged()
+{
+    Q_Q(QWebService);
+    {
+        QMutexLocker locker(&methodsMutex);
+        foreach (const QString &name, wsdlMethods)
+            releaseMethod(methods->take(name));
+        wsdlMethods.clear();
+        pendingMethods.clear();
+
+        foreach (const QString &name, wsdl->methodNames()) {
+            if (!methods->contains(name))
+                pendingMethods.insert(name);
+        }
+    }
+
+    if (!wsdl->endpoints().isEmpty())
+        balancer.setEndpoints(wsdl->endpoints());
+    q->setName(wsdl->webServiceName());
+    emit q->methodNamesChanged();
+}
+
+/*!
+    \internal
+
+    Creates all WSDL methods which were not used yet.
+  */
+void QWebServicePrivate::materializeMethods()
+{
+    QSet<QString> names;
+    {
+        QMutexLocker locker(&methodsMutex);
+        names = pendingMethods;
+    }
+
+    foreach (const QString &name, names)
+        method(name);
+}
+
+/*!
+    \internal
+
+    Detaches \a method, which is being removed from this service.
+    Its queued calls are dropped.
+  */
+void QWebServicePrivate::releaseMethod(QWebMethod *method)
+{
+    Q_Q(QWebService);
+    if (!method)
+        return;
+
+    QObject::disconnect(method, SIGNAL(replyReady(QByteArray)),
+                        q, SLOT(receiveReply(QByteArray)));
+    QWebMethodPrivate *m = QWebMethodPrivate::get(method);
+    if (m->service == q)
+        m->service = 0;
+    scheduler.forgetMethod(method);
+    balancer.forgetMethod(method);
+    mirror.forgetMethod(method);
+}
+
+/*!
+    \internal
+
+    Queues \a reply for the next repliesReady() signal, and makes sure
+    it will be sent within batch latency.
+  */
+void QWebServicePrivate::addToBatch(const QWebReply &reply)
+{
+    Q_Q(QWebService);
+    batch.append(reply);
+
+    if (!batchTimer) {
+        batchTimer = new QTimer(q);
+        batchTimer->setSingleShot(true);
+        QObject::connect(batchTimer, SIGNAL(timeout()), q, SLOT(deliverBatch()));
+    }
+
+    if (!batchTimer->isActive())
+        batchTimer->start(batchLatency);
+}
+
 /*!
     \internal
 
@@ -536,3 +1371,21 @@ void QWebService::receiveReply(const QByteArray &reply)
     QString sendingMethodName = sendingMethod->methodName();
     emit replyReady(reply, sendingMethodName);
 }
+
+/*!
+    \internal
+
+    Emits repliesReady() with all replies collected so far.
+  */
+void QWebService::deliverBatch()
+{
+    Q_D(QWebService);
+    if (d->batchTimer)
+        d->batchTimer->stop();
+    if (d->batch.isEmpty())
+        return;
+
+    QList<QWebReply> replies;
+    replies.swap(d->batch);
+    emit repliesReady(replies);
+}
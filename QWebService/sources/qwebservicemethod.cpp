@@ -16,6 +16,10 @@
 ****************************************************************************/
 
 #include "../headers/qwebservicemethod_p.h"
+#include "../headers/qwebdispatcher_p.h"
+
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qthread.h>
 
 /*!
     \class QWebServiceMethod
@@ -162,24 +166,48 @@ bool QWebServiceMethod::invokeMethod(const QMap<QString, QVariant> &params)
     as well as HTTP \a method (default is POST).
 
     Returns with web service reply, once it is received. This is a blocking method.
+    If no reply arrives within \a timeout milliseconds (default 30 seconds; -1
+    waits without limit), or the call fails, an empty array is returned.
+
+    In the application's main thread, events are processed while waiting.
+    In any other thread, the request is sent from a network thread of
+    QWebDispatcher::globalInstance(), and the calling thread simply sleeps
+    until the reply arrives (\a parent is not used then). This makes it safe
+    to call from worker threads, also from many of them at once.
+
+    \sa QWebService::invokeMethodBlocking()
   */
 QByteArray QWebServiceMethod::invokeMethod(const QUrl &url,
                                           const QString &methodName,
                                           const QString &targetNamespace,
                                           const QMap<QString, QVariant> &params,
                                           Protocol protocol, HttpMethod httpMethod,
-                                          QObject *parent)
+                                          QObject *parent, int timeout)
 {
+    if (QThread::currentThread() != qApp->thread()) {
+        QWebServiceMethod qsm(url.toString(), methodName, targetNamespace, params,
+                              protocol, httpMethod);
+        const QWebMethodPrivate *d = QWebMethodPrivate::get(&qsm);
+        QWebCallResult result = QWebDispatcherPrivate::get(
+                    QWebDispatcher::globalInstance())->callBlocking(
+                    d->makeCall(QWebMethodPrivate::nextCallId(),
+                                d->requestData(d->parameters)), timeout);
+        return result.data;
+    }
+
     QWebServiceMethod qsm(url.toString(), methodName, targetNamespace, params,
                           protocol, httpMethod, parent);
 
-    qsm.invokeMethod();
-    // TODO: ADD ERROR HANDLING!
+    QElapsedTimer timer;
+    timer.start();
+    if (!qsm.invokeMethod())
+        return QByteArray();
+
     forever {
-        if (qsm.isReplyReady()) {
+        if (qsm.isReplyReady())
             return qsm.d_func()->reply;
-        } else {
-            qApp->processEvents();
-        }
+        if (qsm.isErrorState() || (timeout >= 0 && timer.hasExpired(timeout)))
+            return QByteArray();
+        qApp->processEvents();
     }
 }
@@ -0,0 +1,363 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService library.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include "../headers/qwebtrace_p.h"
+
+#include <QtCore/qcoreapplication.h>
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qfile.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qthread.h>
+#include <QtCore/qvector.h>
+
+/*!
+    \class QWebTrace
+    \brief Records a bounded timeline of web method calls, and exports it
+           in Chrome trace-event format.
+
+    When enabled, every QWebMethod call records a short sequence of events:
+    \list
+        \o Enqueue - invokeMethod() was called,
+        \o Send - request was handed to the network stack,
+        \o Headers - reply headers arrived,
+        \o FirstByte - first chunk of reply body arrived,
+        \o Finish - reply was completely received,
+        \o Decode - reply was decoded by replyRead() or replyReadParsed(),
+        \o Deliver - replyReady() signal is being emitted.
+    \endlist
+
+    Each event carries a timestamp, the id of the thread that recorded it,
+    call id and method name. Events are stored in a ring buffer, so when
+    capacity() is reached, oldest events are overwritten.
+
+    Recording is switched off by default. When it is off, every hook in
+    the library costs a single atomic load. Example:
+    \code
+    QWebTrace::setEnabled(true);
+    ...
+    QWebTrace::dumpChromeTrace("calls.json");
+    \endcode
+    Resulting file can be opened in chrome://tracing or in Perfetto UI.
+  */
+
+/*!
+    \enum QWebTrace::Event
+
+    Type of event recorded in the trace.
+
+    \value Enqueue
+           Call was requested by invokeMethod().
+    \value Send
+           Request was passed to the network access manager.
+    \value Headers
+           Reply headers were received.
+    \value FirstByte
+           First part of reply body was received.
+    \value Finish
+           Reply was fully received.
+    \value Decode
+           Reply was decoded.
+    \value Deliver
+           Reply is being delivered (replyReady() is emitted).
+  */
+
+QBasicAtomicInt qwebtrace_enabled = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+struct QWebTraceEntry
+{
+    qint64 timestamp;
+    quint64 callId;
+    quintptr threadId;
+    QWebTrace::Event event;
+    QString name;
+};
+
+struct QWebTraceBuffer
+{
+    QWebTraceBuffer() : capacity(65536), next(0), wrapped(false)
+    {
+        clock.start();
+    }
+
+    QMutex mutex;
+    QElapsedTimer clock;
+    QVector<QWebTraceEntry> entries;
+    int capacity;
+    int next;
+    bool wrapped;
+};
+
+Q_GLOBAL_STATIC(QWebTraceBuffer, qwebtraceBuffer)
+
+static const char *qwebtraceEventName(QWebTrace::Event event)
+{
+    switch (event) {
+    case QWebTrace::Enqueue:
+        return "enqueue";
+    case QWebTrace::Send:
+        return "send";
+    case QWebTrace::Headers:
+        return "headers";
+    case QWebTrace::FirstByte:
+        return "first byte";
+    case QWebTrace::Finish:
+        return "finish";
+    case QWebTrace::Decode:
+        return "decode";
+    case QWebTrace::Deliver:
+        return "deliver";
+    }
+
+    return "unknown";
+}
+
+static void qwebtraceAppendEscaped(QByteArray &out, const QString &text)
+{
+    const QByteArray utf = text.toUtf8();
+
+    for (int i = 0; i < utf.size(); ++i) {
+        const char c = utf.at(i);
+
+        if (c == '"' || c == '\\') {
+            out.append('\\');
+            out.append(c);
+        } else if (uchar(c) < 0x20) {
+            out.append("\\u00");
+            out.append("0123456789abcdef"[(uchar(c) >> 4) & 0xf]);
+            out.append("0123456789abcdef"[uchar(c) & 0xf]);
+        } else {
+            out.append(c);
+        }
+    }
+}
+
+/*!
+    Switches recording on or off, depending on \a enabled. Events recorded
+    earlier are kept (use clear() to drop them).
+
+    \sa isEnabled()
+  */
+void QWebTrace::setEnabled(bool enabled)
+{
+    qwebtraceBuffer(); // Starts the clock.
+    qwebtrace_enabled.storeRelease(enabled ? 1 : 0);
+}
+
+/*!
+    Returns true if events are being recorded.
+
+    \sa setEnabled()
+  */
+bool QWebTrace::isEnabled()
+{
+    return QWEBTRACE_ENABLED();
+}
+
+/*!
+    Sets the maximum number of stored events to \a maxEvents (default is
+    65536). Changing capacity drops all recorded events.
+
+    \sa capacity()
+  */
+void QWebTrace::setCapacity(int maxEvents)
+{
+    QWebTraceBuffer *buffer = qwebtraceBuffer();
+    QMutexLocker locker(&buffer->mutex);
+    buffer->capacity = qMax(1, maxEvents);
+    buffer->entries.clear();
+    buffer->next = 0;
+    buffer->wrapped = false;
+}
+
+/*!
+    Returns the maximum number of stored events.
+
+    \sa setCapacity()
+  */
+int QWebTrace::capacity()
+{
+    QWebTraceBuffer *buffer = qwebtraceBuffer();
+    QMutexLocker locker(&buffer->mutex);
+    return buffer->capacity;
+}
+
+/*!
+    Returns the number of events currently stored.
+  */
+int QWebTrace::eventCount()
+{
+    QWebTraceBuffer *buffer = qwebtraceBuffer();
+    QMutexLocker locker(&buffer->mutex);
+    return buffer->entries.size();
+}
+
+/*!
+    Drops all recorded events.
+  */
+void QWebTrace::clear()
+{
+    QWebTraceBuffer *buffer = qwebtraceBuffer();
+    QMutexLocker locker(&buffer->mutex);
+    buffer->entries.clear();
+    buffer->next = 0;
+    buffer->wrapped = false;
+}
+
+/*!
+    Stores \a event for call \a callId of a web method \a name. Does nothing
+    when recording is disabled. Can be called from any thread.
+  */
+void QWebTrace::record(Event event, quint64 callId, const QString &name)
+{
+    if (!isEnabled())
+        return;
+
+    QWebTraceBuffer *buffer = qwebtraceBuffer();
+    QWebTraceEntry entry;
+    entry.event = event;
+    entry.callId = callId;
+    entry.name = name;
+    entry.threadId = reinterpret_cast<quintptr>(QThread::currentThreadId());
+
+    QMutexLocker locker(&buffer->mutex);
+    entry.timestamp = buffer->clock.nsecsElapsed();
+
+    if (buffer->entries.size() < buffer->capacity) {
+        buffer->entries.append(entry);
+    } else {
+        buffer->entries[buffer->next] = entry;
+        buffer->wrapped = true;
+    }
+
+    buffer->next = (buffer->next + 1) % buffer->capacity;
+}
+
+/*!
+    Returns recorded events as a Chrome trace-event JSON document.
+
+    Every call is exported as a nestable asynchronous slice (from Enqueue
+    to Deliver), with intermediate events shown as instants inside it.
+    Thread ids are kept in event arguments.
+
+    \sa dumpChromeTrace()
+  */
+QByteArray QWebTrace::toChromeTraceJson()
+{
+    QVector<QWebTraceEntry> entries;
+    int first = 0;
+    {
+        QWebTraceBuffer *buffer = qwebtraceBuffer();
+        QMutexLocker locker(&buffer->mutex);
+        entries = buffer->entries;
+        first = buffer->wrapped ? buffer->next : 0;
+    }
+
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    QByteArray result;
+    result.reserve(64 + entries.size() * 160);
+    result.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    for (int i = 0; i < entries.size(); ++i) {
+        const QWebTraceEntry &entry = entries.at((first + i) % entries.size());
+        const char *phase = "n";
+
+        if (entry.event == Enqueue)
+            phase = "b";
+        else if (entry.event == Deliver)
+            phase = "e";
+
+        if (i > 0)
+            result.append(',');
+
+        result.append("{\"cat\":\"qwebservice\",\"ph\":\"");
+        result.append(phase);
+        result.append("\",\"name\":\"");
+        if (entry.event == Enqueue || entry.event == Deliver)
+            qwebtraceAppendEscaped(result, entry.name);
+        else
+            result.append(qwebtraceEventName(entry.event));
+        result.append("\",\"id\":\"0x");
+        result.append(QByteArray::number(entry.callId, 16));
+        result.append("\",\"pid\":");
+        result.append(pid);
+        result.append(",\"tid\":");
+        result.append(QByteArray::number(quint64(entry.threadId)));
+        result.append(",\"ts\":");
+        result.append(QByteArray::number(entry.timestamp / 1000.0, 'f', 3));
+        result.append(",\"args\":{\"method\":\"");
+        qwebtraceAppendEscaped(result, entry.name);
+        result.append("\",\"event\":\"");
+        result.append(qwebtraceEventName(entry.event));
+        result.append("\"}}");
+    }
+
+    result.append("]}");
+    return result;
+}
+
+/*!
+    Writes recorded events into \a fileName, in Chrome trace-event JSON
+    format. Returns true on success.
+
+    \sa toChromeTraceJson()
+  */
+bool QWebTrace::dumpChromeTrace(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+
+    const QByteArray json = toChromeTraceJson();
+    return (file.write(json) == json.size());
+}
+
+/*!
+    \internal
+
+    Watches \a reply of call \a callId (method \a name) for headers
+    and first body bytes.
+  */
+QWebTraceReplyWatcher::QWebTraceReplyWatcher(QNetworkReply *reply,
+                                             quint64 callId,
+                                             const QString &name) :
+    QObject(reply), m_callId(callId), m_name(name), m_headersSeen(false)
+{
+    connect(reply, SIGNAL(metaDataChanged()), this, SLOT(metaDataChanged()));
+    connect(reply, SIGNAL(readyRead()), this, SLOT(readyRead()));
+}
+
+/*!
+    \internal
+  */
+void QWebTraceReplyWatcher::metaDataChanged()
+{
+    if (m_headersSeen)
+        return;
+
+    m_headersSeen = true;
+    QWebTrace::record(QWebTrace::Headers, m_callId, m_name);
+}
+
+/*!
+    \internal
+  */
+void QWebTraceReplyWatcher::readyRead()
+{
+    metaDataChanged();
+    QWebTrace::record(QWebTrace::FirstByte, m_callId, m_name);
+    disconnect(parent(), 0, this, 0);
+}
@@ -16,6 +16,20 @@
 ****************************************************************************/
 
 #include "../headers/qwsdl_p.h"
+#include "../headers/qwebconnectionpool_p.h"
+
+#include <QtCore/qbuffer.h>
+#include <QtCore/qcryptographichash.h>
+#include <QtCore/qdatastream.h>
+#include <QtCore/qdir.h>
+#include <QtCore/qeventloop.h>
+#include <QtCore/qfileinfo.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qsavefile.h>
+#include <QtCore/qscopedpointer.h>
+#include <QtCore/qset.h>
+#include <QtCore/qthreadpool.h>
+#include <QtCore/qtimer.h>
 
 /*!
     \class QWsdl
@@ -38,6 +52,37 @@
            targetNamespace() etc.)
     \endlist
 
+    Web method objects are created on first use: method() creates only
+    the requested one, methods() creates all of them. Names of all methods
+    are available from methodNames() without creating any.
+
+    When a cache directory is set (setCacheDirectory(), or for all
+    objects: setDefaultCacheDirectory()), parsed model is stored there in
+    a compact binary file, and later loaded instead of parsing the WSDL
+    again. Local files are parsed again only when their content (or
+    content of a local document they import) changes; remote files are
+    only requested conditionally, and parsed again if the server reports
+    a change.
+
+    Types may be split into separate documents: wsdl:import, xsd:import
+    and xsd:include are followed (relative locations are resolved against
+    the importing document). All documents referenced at one level are
+    fetched at once, each one only once, even if imports form a cycle.
+    Parsed documents are kept in a cache shared by all QWsdl objects in
+    the process (see clearSchemaCache()). Cached local documents are read
+    again when they are modified; cached remote ones are requested
+    conditionally (ETag/Last-Modified) when they are used again.
+
+    Parsed model is immutable, and shared by all QWsdl objects (and so,
+    QWebService objects) in the process reading the same file at the same
+    time: the second object neither downloads nor parses the WSDL again,
+    and memory grows with the number of distinct WSDL files only. Web
+    method objects are still separate for each QWsdl.
+
+    Long-running applications can keep the model up to date using
+    refresh() (or periodically, setRefreshInterval()): WSDL is only
+    downloaded and parsed again if the server reports it changed.
+
     Example snippet for that may be:
     \code
         QWsdl wsdl("../../../examples/wsdl/band_ws.asmx", this);
@@ -89,7 +134,7 @@
     \sa setWsdlFile(), resetWsdl()
   */
 QWsdl::QWsdl(QObject *parent) :
-    QObject(parent), d_ptr(new QWsdlPrivate)
+    QObject(parent), d_ptr(new QWsdlPrivate(this))
 {
     Q_D(QWsdl);
     d->init();
@@ -100,7 +145,7 @@ QWsdl::QWsdl(QObject *parent) :
     specified in \a wsdlFile to parse the WSDL file.
   */
 QWsdl::QWsdl(const QString &wsdlFile, QObject *parent) :
-    QObject(parent), d_ptr(new QWsdlPrivate)
+    QObject(parent), d_ptr(new QWsdlPrivate(this))
 {
     Q_D(QWsdl);
     d->m_wsdlFilePath = wsdlFile;
@@ -127,6 +172,7 @@ QWsdl::QWsdl(QWsdlPrivate &dd, QObject *parent) :
 QWsdl::~QWsdl()
 {
     Q_D(QWsdl);
+    d->cancelRefresh();
     delete d->methodsMap;
     delete d->workMethodList;
     delete d->workMethodParameters;
@@ -170,54 +216,191 @@ void QWsdl::setWsdlFile(const QString &wsdlFile) // == resetWsdl()
     Can be used to set or reset a WSDL file (or URL), using \a newWsdl.
     Cleans and reinitialises the object, parses the file.
 
+    If \a newWsdl is the remote file which is already loaded, and the
+    server gave validators for it (ETag or Last-Modified), it is only
+    read again if it changed (see refresh()).
+
     \sa setWsdlFile()
   */
 void QWsdl::resetWsdl(const QString &newWsdl)
 {
     Q_D(QWsdl);
-    d->m_wsdlFilePath = newWsdl;
+    d->cancelRefresh();
+    if (newWsdl == d->m_wsdlFilePath && !d->errorState && d->isRemote()
+            && !(d->model->eTag.isEmpty() && d->model->lastModified.isEmpty())) {
+        refresh();
+        return;
+    }
 
-    d->methodsMap->clear();
-    d->workMethodList->clear();
-    d->workMethodParameters->clear();
-    d->replyReceived = false;
+    d->m_wsdlFilePath = newWsdl;
+    d->clearModel();
     d->errorState = false;
     d->errorMessage = QString();
-    d->m_webServiceName = QString();
-    d->m_hostUrl.setUrl(QString());
-    d->m_targetNamespace = QString();
-    d->xmlReader.clear();
 
     parse();
     emit wsdlFileChanged();
 }
 
+/*!
+    Reads the WSDL file again, if it changed since it was last read.
+    Remote file is requested conditionally (with If-None-Match and
+    If-Modified-Since headers, using validators sent by the server); if
+    the server answers 304 Not Modified, current model is kept and
+    nothing is parsed. Local file is read again only if its modification
+    time or size changed. Cache (setCacheDirectory()) is updated, but
+    never used instead of the file being refreshed.
+
+    Emits wsdlFileChanged() if the file was read again. Returns false
+    on error; current model is then kept.
+
+    \sa setRefreshInterval(), resetWsdl()
+  */
+bool QWsdl::refresh()
+{
+    Q_D(QWsdl);
+    d->cancelRefresh();
+    if (d->m_wsdlFilePath.isEmpty())
+        return false;
+
+    const bool remote = d->isRemote();
+    if (!remote && !d->errorState) {
+        const QFileInfo info(d->m_wsdlFilePath);
+        if (info.lastModified() == d->model->fileModified
+                && info.size() == d->model->fileSize
+                && !QWsdlPrivate::importsChanged(d->model->imports))
+            return true;
+    } else if (remote && !d->errorState
+               && !(d->model->eTag.isEmpty() && d->model->lastModified.isEmpty())) {
+        QString reason;
+        const QWsdlPrivate::Revalidation result = d->revalidate(d->cacheKey(), &reason);
+        if (result == QWsdlPrivate::NotModified)
+            return true;
+
+        if (result == QWsdlPrivate::Unreachable) {
+            return d->enterErrorState(QString(QLatin1String("Error: cannot refresh WSDL file: ")
+                                              + d->m_wsdlFilePath
+                                              + QLatin1String(". Reason: ") + reason));
+        }
+
+        if (result != QWsdlPrivate::Reloaded)
+            return false;
+
+        emit wsdlFileChanged();
+        return true;
+    }
+
+    const QSharedPointer<const QWsdlModel> previous = d->model;
+    const QMap<QString, QWebMethod *> previousMethods = *d->methodsMap;
+    d->clearModel();
+    d->errorState = false;
+    d->errorMessage = QString();
+    if (!d->load(!remote)) {
+        d->restoreModel(previous, previousMethods);
+        return false;
+    }
+
+    emit wsdlFileChanged();
+    return true;
+}
+
+/*!
+    Returns interval of automatic refresh(), in milliseconds (0 if off).
+  */
+int QWsdl::refreshInterval() const
+{
+    Q_D(const QWsdl);
+    return d->refreshInterval;
+}
+
+/*!
+    Makes the object refresh the WSDL file every \a msecs milliseconds.
+    0 (default) turns automatic refresh off.
+
+    Unlike refresh(), automatic refresh of a remote file does not wait
+    for the server: conditional request is sent, and the reply is parsed
+    when it is finished (a refresh is skipped while the previous one is
+    still in progress). Remote documents it imports are still downloaded
+    (or revalidated, if cached) while it is parsed, running a local event
+    loop. Local file is checked (and read
+    again, if changed) at once. Emits wsdlFileChanged() if the file was
+    read again; if it can not be read, current model is kept.
+
+    \sa refresh()
+  */
+void QWsdl::setRefreshInterval(int msecs)
+{
+    Q_D(QWsdl);
+    d->refreshInterval = qMax(msecs, 0);
+
+    if (d->refreshInterval == 0) {
+        if (d->refreshTimer)
+            d->refreshTimer->stop();
+        return;
+    }
+
+    if (!d->refreshTimer) {
+        d->refreshTimer = new QTimer(this);
+        connect(d->refreshTimer, &QTimer::timeout, this, [d]() { d->startRefresh(); });
+    }
+    d->refreshTimer->start(d->refreshInterval);
+}
+
 /*!
     Returns a QMap<QString, QWebServiceMethod *> pointer.
     Keys are method names (just as in getMethodNames()), and values are
     QWebServiceMethods themselves (which means they can be used
     not only to get information, but also to send messages, set them up etc.).
 
-    \sa methodNames()
+    Creates all web methods which were not used yet. If only some of them
+    are needed, method() is cheaper.
+
+    \sa methodNames(), method()
   */
 QMap<QString, QWebMethod *> *QWsdl::methods()
 {
     Q_D(QWsdl);
+    const QVector<QWsdlModel::Operation> &operations = d->model->operations;
+    if (d->methodsMap->size() != operations.size()) {
+        for (int i = 0; i < operations.size(); i++) {
+            if (!d->methodsMap->contains(operations.at(i).name))
+                d->materializeMethod(i);
+        }
+    }
+
     return d->methodsMap;
 }
 
 /*!
-    Returns a QStringList of names of web service's methods.
+    Returns web method called \a methodName, creating it on first use,
+    or 0 if WSDL does not describe such method.
+
+    \sa methods(), methodNames()
+  */
+QWebMethod *QWsdl::method(const QString &methodName)
+{
+    Q_D(QWsdl);
+    QWebMethod *result = d->methodsMap->value(methodName);
+    if (result)
+        return result;
+
+    const int operation = d->model->operationIndexes.value(methodName, -1);
+    if (operation == -1)
+        return 0;
+
+    return d->materializeMethod(operation);
+}
+
+/*!
+    Returns a QStringList of names of web service's methods, sorted.
+    Does not create web method objects.
 
-    \sa methods()
+    \sa methods(), method()
   */
 QStringList QWsdl::methodNames() const
 {
     Q_D(const QWsdl);
-    QList<QString> tempMethods = d->methodsMap->keys();
-    QStringList result;
-    result.append(tempMethods);
-
+    QStringList result = d->model->operationIndexes.keys();
+    result.sort();
     return result;
 }
 
@@ -227,7 +410,7 @@ QStringList QWsdl::methodNames() const
 QString QWsdl::webServiceName() const
 {
     Q_D(const QWsdl);
-    return d->m_webServiceName;
+    return d->model->webServiceName;
 }
 
 /*!
@@ -239,34 +422,48 @@ QString QWsdl::webServiceName() const
 QString QWsdl::host() const
 {
     Q_D(const QWsdl);
-    if (!d->m_hostUrl.isEmpty())
-        return d->m_hostUrl.toString();
+    if (!d->model->hostUrl.isEmpty())
+        return d->model->hostUrl.toString();
     else
         return d->m_wsdlFilePath;
 }
 
 /*!
     Returns web service's URL. If there is no valid URL in WSDL file,
-    path to this file is returned.
+    path to this file is returned. If service has many ports, the address
+    of the first one is used.
 
-    \sa host()
+    \sa host(), endpoints()
   */
 QUrl QWsdl::hostUrl() const
 {
     Q_D(const QWsdl);
-    if (!d->m_hostUrl.isEmpty())
-        return d->m_hostUrl;
+    if (!d->model->hostUrl.isEmpty())
+        return d->model->hostUrl;
     else
         return QUrl(d->m_wsdlFilePath);
 }
 
+/*!
+    Returns addresses of all ports of the web service, in order of
+    appearance in WSDL file. Ports sharing an address (for example, SOAP
+    1.0 and 1.2 ports) are listed once.
+
+    \sa hostUrl(), QWebService::setLoadBalancing()
+  */
+QList<QUrl> QWsdl::endpoints() const
+{
+    Q_D(const QWsdl);
+    return d->model->endpoints;
+}
+
 /*!
     Returns target namespace specified in WSDL.
   */
 QString QWsdl::targetNamespace() const
 {
     Q_D(const QWsdl);
-    return d->m_targetNamespace;
+    return d->model->targetNamespace;
 }
 
 /*!
@@ -293,34 +490,176 @@ bool QWsdl::isErrorState() const
     return d->errorState;
 }
 
+static QMutex defaultCacheMutex;
+static QString defaultCache;
+
+/*!
+    Returns directory of binary model cache, or empty string, if cache
+    is not used.
+
+    \sa setCacheDirectory()
+  */
+QString QWsdl::cacheDirectory() const
+{
+    Q_D(const QWsdl);
+    return d->cacheDirectory;
+}
+
 /*!
-    Asynchronous public return slot. Reads WSDL reply (\a rply)
-    from server (used in case URL was specified in wsdl file path).
+    Makes parse() store parsed model in \a directory (created if needed),
+    and load it from there, when the same WSDL is read again. Cache files
+    are named after the WSDL path or URL; each one also holds the hash
+    of WSDL content, and modification times and hashes of local documents
+    it imports, so that changed local files are parsed again. Empty
+    \a directory turns the cache off.
+
+    Cached remote WSDL files younger than cacheMaxAge() are used without
+    asking the server, so that a warm cache loads without network. Older
+    ones are revalidated with the server (using ETag or Last-Modified, as
+    in refresh()), and only downloaded again if they changed. If the
+    server can not be reached, cached model is used. Older files sent
+    without validators are always downloaded again.
+
+    \sa setDefaultCacheDirectory(), isLoadedFromCache()
   */
-void QWsdl::fileReplyFinished(QNetworkReply *rply)
+void QWsdl::setCacheDirectory(const QString &directory)
 {
     Q_D(QWsdl);
-    QString replyString = d->convertReplyToUtf(QLatin1String(rply->readAll()));
-    QFile file(QLatin1String("tempWsdl.asmx~"));
-    d->m_wsdlFilePath = QLatin1String("tempWsdl.asmx~");
-
-    if (file.exists())
-        file.remove();
-
-    if (!file.open(QFile::WriteOnly)) {
-        d->enterErrorState(
-                    QString(QLatin1String("Error: cannot write WSDL file from "
-                                          "remote location. Reason: ")
-                            + file.errorString()));
-        return;
-    } else {
-        file.write(replyString.toUtf8());
+    d->cacheDirectory = directory;
+}
+
+/*!
+    Returns cache directory used by new QWsdl objects.
+  */
+QString QWsdl::defaultCacheDirectory()
+{
+    QMutexLocker locker(&defaultCacheMutex);
+    return defaultCache;
+}
+
+/*!
+    Sets cache \a directory used by QWsdl objects created later (including
+    ones created by QWebService). Empty by default: no cache is used.
+
+    \sa setCacheDirectory()
+  */
+void QWsdl::setDefaultCacheDirectory(const QString &directory)
+{
+    QMutexLocker locker(&defaultCacheMutex);
+    defaultCache = directory;
+}
+
+static int defaultMaxAge = 0;
+
+/*!
+    Returns number of seconds a cached remote model is used without
+    asking the server.
+
+    \sa setCacheMaxAge()
+  */
+int QWsdl::cacheMaxAge() const
+{
+    Q_D(const QWsdl);
+    return d->cacheMaxAge;
+}
+
+/*!
+    Makes parse() use cached remote model (setCacheDirectory()) without
+    asking the server for \a seconds after the server last sent or
+    confirmed it. 0 (default) revalidates it every time, negative value
+    never does (until refresh() is called). Local files are always
+    checked, as it costs no network.
+
+    \sa setDefaultCacheMaxAge()
+  */
+void QWsdl::setCacheMaxAge(int seconds)
+{
+    Q_D(QWsdl);
+    d->cacheMaxAge = seconds;
+}
+
+/*!
+    Returns cache max age used by new QWsdl objects.
+  */
+int QWsdl::defaultCacheMaxAge()
+{
+    QMutexLocker locker(&defaultCacheMutex);
+    return defaultMaxAge;
+}
+
+/*!
+    Sets cache max age (in \a seconds) used by QWsdl objects created later
+    (including ones created by QWebService). 0 by default.
+
+    \sa setCacheMaxAge()
+  */
+void QWsdl::setDefaultCacheMaxAge(int seconds)
+{
+    QMutexLocker locker(&defaultCacheMutex);
+    defaultMaxAge = seconds;
+}
+
+/*!
+    Returns true if the model was loaded from cache by the last parse().
+  */
+bool QWsdl::isLoadedFromCache() const
+{
+    Q_D(const QWsdl);
+    return d->loadedFromCache;
+}
+
+static const char xsdNamespace[] = "http://www.w3.org/2001/XMLSchema";
+static const char soapEncodingNamespace[] = "http://schemas.xmlsoap.org/soap/encoding/";
+
+static QMutex schemaCacheMutex;
+static QHash<QString, QSharedPointer<const QWsdlSchemaDocument> > schemaCache;
+
+static QMutex modelRegistryMutex;
+static QHash<QString, QWeakPointer<const QWsdlModel> > modelRegistry;
+
+/*!
+    Removes all imported documents (schemas and WSDLs) from the cache
+    shared by QWsdl objects, so that they are read again on next parse.
+    Models of existing objects are kept, but no longer shared with new
+    ones. Local files are read again anyway, when they change.
+  */
+void QWsdl::clearSchemaCache()
+{
+    {
+        QMutexLocker locker(&schemaCacheMutex);
+        schemaCache.clear();
+    }
+
+    QMutexLocker locker(&modelRegistryMutex);
+    modelRegistry.clear();
+}
+
+/*!
+    \internal
+
+    Returns cached document read from \a url, or null pointer if there
+    is none (or local file has changed since).
+  */
+static QSharedPointer<const QWsdlSchemaDocument> cachedSchema(const QUrl &url)
+{
+    QMutexLocker locker(&schemaCacheMutex);
+    QSharedPointer<const QWsdlSchemaDocument> document = schemaCache.value(url.toString());
+    if (document && url.isLocalFile()
+            && QFileInfo(url.toLocalFile()).lastModified() != document->modified) {
+        schemaCache.remove(url.toString());
+        return QSharedPointer<const QWsdlSchemaDocument>();
     }
+    return document;
+}
 
-    file.close();
-    d->replyReceived = true;
-    rply->deleteLater();
-//    emit replyReady(reply);
+/*!
+    \internal
+  */
+static void cacheSchema(const QUrl &url,
+                        const QSharedPointer<const QWsdlSchemaDocument> &document)
+{
+    QMutexLocker locker(&schemaCacheMutex);
+    schemaCache.insert(url.toString(), document);
 }
 
 /*!
@@ -330,8 +669,15 @@ void QWsdl::fileReplyFinished(QNetworkReply *rply)
   */
 void QWsdlPrivate::init()
 {
-    replyReceived = false;
     errorState = false;
+    loadedFromCache = false;
+    cacheDirectory = QWsdl::defaultCacheDirectory();
+    cacheMaxAge = QWsdl::defaultCacheMaxAge();
+    fileSize = -1;
+    refreshInterval = 0;
+    refreshTimer = 0;
+    pendingRefresh = 0;
+    model = QSharedPointer<const QWsdlModel>(new QWsdlModel);
 
     workMethodList = new QStringList();
     workMethodParameters = new QMap<int, QMap<QString, QVariant> >();
@@ -349,14 +695,16 @@ bool QWsdlPrivate::enterErrorState(const QString &errMessage)
     errorState = true;
     errorMessage += QString(errMessage + QLatin1String(" "));
 //    qDebug() << errMessage;
-    emit q->errorEncountered(errMessage);
+    // Parsers of imported documents have no public object.
+    if (q)
+        emit q->errorEncountered(errMessage);
     return false;
 }
 
 /*!
-    Central method of this class. Parses the WSDL file, creates all
-    QWebServiceMethods, reads all necessary data,
-    like web service's name etc.
+    Central method of this class. Parses the WSDL file, reads all
+    necessary data, like web service's name, operations etc. Web methods
+    are created later, on first use.
   */
 bool QWsdl::parse()
 {
@@ -372,75 +720,164 @@ bool QWsdl::parse()
         return false;
     }
 
-    prepareFile();
+    return d->load(true);
+}
+
+/*!
+    \internal
+
+    Clears the model: methods, types, names and addresses, and validators.
+    Shared model is not touched, only released.
+  */
+void QWsdlPrivate::clearModel()
+{
+    model = QSharedPointer<const QWsdlModel>(new QWsdlModel);
+    methodsMap->clear();
+    workMethodList->clear();
+    workMethodParameters->clear();
+    typeTable = QWsdlTypeTable();
+    operations.clear();
+    operationIndexes.clear();
+    loadedFromCache = false;
+    m_webServiceName = QString();
+    m_hostUrl.setUrl(QString());
+    m_endpoints.clear();
+    m_targetNamespace = QString();
+    imports.clear();
+    importStamps.clear();
+    eTag.clear();
+    lastModified.clear();
+    fileModified = QDateTime();
+    fileSize = -1;
+    xmlReader.clear();
+}
+
+/*!
+    \internal
+
+    Takes the model from another object which has read the same file
+    (if \a useCache is true), or reads it from cache (if it is there),
+    or from WSDL file. Remote file is parsed while it is downloaded.
+  */
+bool QWsdlPrivate::load(bool useCache)
+{
+    loadedFromCache = false;
+    const QString key = cacheKey();
+    if (useCache) {
+        const QSharedPointer<const QWsdlModel> shared = sharedModel(key);
+        if (shared) {
+            model = shared;
+            return true;
+        }
+
+        if (!cacheDirectory.isEmpty()
+                && loadCache(key, isRemote() ? QByteArray() : contentHash())) {
+            if (!isRemote() || isCacheFresh())
+                return true;
+
+            // Remote file is requested conditionally. Cached model is used
+            // also when the server can not be reached.
+            if (!(model->eTag.isEmpty() && model->lastModified.isEmpty())) {
+                QString reason;
+                return (revalidate(key, &reason) != ReloadFailed);
+            }
+
+            clearModel();
+        }
+    }
+
+    if (isRemote()) {
+        m_hostUrl.setUrl(m_wsdlFilePath);
+        QWsdlDownload download(m_hostUrl);
+        readDocument(&download);
+        return finishParse(&download, key);
+    }
 
-    QFile file(d->m_wsdlFilePath);
+    QFile file(m_wsdlFilePath);
     if (!file.open(QFile::ReadOnly | QFile::Text)) {
-        d->enterErrorState(QString(QLatin1String("Error: cannot read WSDL file: ")
-                                + d->m_wsdlFilePath
-                                + QLatin1String(". Reason: ")
-                                + file.errorString()));
-        return false;
+        return enterErrorState(QString(QLatin1String("Error: cannot read WSDL file: ")
+                                       + m_wsdlFilePath
+                                       + QLatin1String(". Reason: ")
+                                       + file.errorString()));
     }
 
-    d->xmlReader.setDevice(&file);
-    d->xmlReader.readNext();
+    readDocument(&file);
+    return finishParse(0, key);
+}
+
+/*!
+    \internal
+
+    Reads WSDL document from \a device.
+  */
+void QWsdlPrivate::readDocument(QIODevice *device)
+{
+    documentUrl = isRemote() ? QUrl(m_wsdlFilePath)
+                             : QUrl::fromLocalFile(QFileInfo(m_wsdlFilePath).absoluteFilePath());
+    imports.clear();
+    namespacePrefixes.clear();
+    xmlReader.setDevice(device);
+    xmlReader.readNext();
 
-    while (!d->xmlReader.atEnd()) {
-        if (d->xmlReader.isStartElement()) {
-            QString tempN = d->xmlReader.name().toString();
+    while (!xmlReader.atEnd()) {
+        if (xmlReader.isStartElement()) {
+            QString tempN = xmlReader.name().toString();
 
             if (tempN == QLatin1String("definitions")) {
-                d->m_targetNamespace = d->xmlReader.attributes().value(
+                m_targetNamespace = xmlReader.attributes().value(
                             QLatin1String("targetNamespace")).toString();
-                d->readDefinitions();
+                readDefinitions();
             } else {
-                d->enterErrorState(QLatin1String("Error: file does not have "
-                                                    "WSDL definitions inside!"));
-                return false;
+                enterErrorState(QLatin1String("Error: file does not have "
+                                              "WSDL definitions inside!"));
+                break;
             }
         } else {
-            d->xmlReader.readNext();
+            xmlReader.readNext();
         }
     }
 
-    d->prepareMethods();
-
-    if (!d->errorState)
-        return true;
-    else
-        return false;
+    xmlReader.setDevice(0);
 }
 
 /*!
     \internal
 
-    If the host path is not a local file, but URL, QWsdl will download
-    it into a temporary file, then read, and delete at exit.
+    Checks \a download (0 for local files), reads imported documents,
+    prepares methods, remembers validators of the file, and publishes the
+    model under \a cacheKey (storing it in cache, if it is on). Returns
+    true on success.
   */
-void QWsdl::prepareFile()
+bool QWsdlPrivate::finishParse(QWsdlDownload *download, const QString &cacheKey)
 {
-    Q_D(QWsdl);
-    QUrl filePath;
-    filePath.setUrl(d->m_wsdlFilePath);
-
-    if (!QFile::exists(d->m_wsdlFilePath) && filePath.isValid()) {
-        d->m_hostUrl = filePath;
-        QNetworkAccessManager *manager = new QNetworkAccessManager();
-        QObject::connect(manager, SIGNAL(finished(QNetworkReply*)),
-                this, SLOT(fileReplyFinished(QNetworkReply*)));
-        manager->get(QNetworkRequest(filePath));
-
-        forever {
-            if (d->replyReceived == true) {
-                return;
-            } else {
-                QCoreApplication::instance()->processEvents();
-            }
-        }
+    if (download && download->error() != QNetworkReply::NoError) {
+        return enterErrorState(QString(QLatin1String("Error: cannot download WSDL file: ")
+                                       + m_wsdlFilePath
+                                       + QLatin1String(". Reason: ")
+                                       + download->replyErrorString()));
+    }
+
+    if (errorState || !resolveImports())
+        return false;
+
+    buildParameters();
+    prepareMethods();
+    if (errorState)
+        return false;
 
-        delete manager;
+    if (download) {
+        eTag = download->eTag();
+        lastModified = download->lastModified();
+    } else {
+        const QFileInfo info(m_wsdlFilePath);
+        fileModified = info.lastModified();
+        fileSize = info.size();
     }
+
+    publishModel(cacheKey);
+    if (!cacheDirectory.isEmpty())
+        saveCache(cacheKey, download ? download->contentHash() : contentHash());
+    return true;
 }
 
 /*!
@@ -460,6 +897,7 @@ void QWsdlPrivate::readDefinitions()
     tagUsed.insert(QLatin1String("documentation"), false);
     //END of EXPERIMENTAL
 
+    declareNamespaces();
     xmlReader.readNext();
     QString tempName = xmlReader.name().toString();
 
@@ -504,6 +942,9 @@ void QWsdlPrivate::readDefinitions()
                 readDocumentation();
             tagUsed.insert(QLatin1String("documentation"), true);
             xmlReader.readNext();
+        } else if (tempName == QLatin1String("import")) {
+            addImport(xmlReader.attributes().value(QLatin1String("location")).toString());
+            xmlReader.readNext();
         } else {
             xmlReader.readNext();
         }
@@ -512,219 +953,728 @@ void QWsdlPrivate::readDefinitions()
 
 /*!
     \internal
+
+    Reads all schemas inside "types" tag.
   */
 void QWsdlPrivate::readTypes()
 {
+    bool schemaFound = false;
     xmlReader.readNext();
-    xmlReader.readNext();
-    QString tempName = xmlReader.name().toString();
-
-    if (xmlReader.name().toString() == QLatin1String("schema")) {
-        xmlReader.readNext();
-    } else {
-        enterErrorState(QLatin1String("Error: file does not have WSDL "
-                                            "schema tag inside!"));
-        return;
-    }
 
-    QString lastName;
-    tempName = QLatin1String("");
-    while(!xmlReader.atEnd()) {
-        if (tempName != QLatin1String(""))
-            lastName = tempName;
-        tempName = xmlReader.name().toString();
+    while (!xmlReader.atEnd()) {
+        QString tempName = xmlReader.name().toString();
 
-        if (tempName == QLatin1String("element")
-                && (xmlReader.attributes().count() == 1)) {
-            QString elementName = xmlReader.attributes().value(
-                        QLatin1String("name")).toString();
-            workMethodList->append(elementName);
-            readTypeSchemaElement();
-        } else if (xmlReader.isEndElement()
-                 && (tempName == QLatin1String("schema"))) {
-            xmlReader.readNext();
+        if (xmlReader.isEndElement()
+                && (tempName == QLatin1String("types"))) {
             break;
+        } else if (xmlReader.isStartElement()
+                   && (tempName == QLatin1String("schema"))) {
+            schemaFound = true;
+            readSchema();
         } else {
             xmlReader.readNext();
         }
     }
+
+    if (!schemaFound) {
+        enterErrorState(QLatin1String("Error: file does not have WSDL "
+                                            "schema tag inside!"));
+    }
 }
 
 /*!
     \internal
+
+    Reads elements of a schema (reader is on its start tag), and
+    remembers documents it imports or includes.
   */
-void QWsdlPrivate::readTypeSchemaElement()
+void QWsdlPrivate::readSchema()
 {
+    // Declarations of this schema are not seen by the next one.
+    const QHash<QString, QString> outerPrefixes = namespacePrefixes;
+    declareNamespaces();
+    schemaNamespace = xmlReader.attributes().value(
+                QLatin1String("targetNamespace")).toString();
     xmlReader.readNext();
-    QMap<QString, QVariant> params;
 
-    bool firstElem = true;
-    QString tempName; //xmlReader.name().toString();
-    QString lastName;
+    QString tempName;
     while(!xmlReader.atEnd()) {
-        if (tempName != QLatin1String(""))
-            lastName = tempName;
         tempName = xmlReader.name().toString();
 
         if (xmlReader.isEndElement()
-                && (xmlReader.name() == QLatin1String("element"))
-                && ((lastName == QLatin1String("complexType"))
-                    || (lastName == QLatin1String("sequence"))
-//                    || (lastName == QLatin1String("part"))
-                    )
-                && (firstElem == false)) {
-            int currentMethodIndex = workMethodList->length() - 1;
-            workMethodParameters->insert(currentMethodIndex, params);
+                && (tempName == QLatin1String("schema"))) {
             xmlReader.readNext();
             break;
-        }
-
-        if ((tempName == QLatin1String("complexType"))
-                || (tempName == QLatin1String("sequence"))) {
-            firstElem = false;
+        } else if (xmlReader.isStartElement()
+                   && ((tempName == QLatin1String("import"))
+                       || (tempName == QLatin1String("include")))) {
+            addImport(xmlReader.attributes().value(
+                          QLatin1String("schemaLocation")).toString());
             xmlReader.readNext();
-            continue;
-        }
-
-        if (tempName == QLatin1String("element")) {
-            firstElem = false;
-            // Min and max occurences are not taken into account!
-            QString elementName = xmlReader.attributes().value(
+        } else if (xmlReader.isStartElement()
+                   && (tempName == QLatin1String("element"))) {
+            // Only named elements can describe messages.
+            const QString elementName = xmlReader.attributes().value(
                         QLatin1String("name")).toString();
-            // Ommits namespace ("s:int" => "int")
-            QString elementType = xmlReader.attributes().value(
-                        QLatin1String("type")).toString();
-
-            if ((elementName == QLatin1String(""))
-                    || (elementType == QLatin1String(""))) {
-                xmlReader.readNext();
-                continue;
-            }
-
-            QVariant element;
-            // The int(1) looks very bad.
-            elementType = elementType.split(QChar(':')).at(1);
-            // NEEDS MANY MORE VALUE TYPES! VERY SHAKY IMPLEMENTATION!
-            // Prob'ly better to use schemas.
-            if (elementType == QLatin1String("int")) {
-                element.setValue(int());
-            } else if (elementType == QLatin1String("float")) {
-                element.setValue(float());
-            } else if (elementType == QLatin1String("double")) {
-                element.setValue(double());
-            } else if (elementType == QLatin1String("boolean")) {
-                element.setValue(true);
-            } else if (elementType == QLatin1String("dateTime")) {
-                element.setValue(QDateTime());
-            } else if (elementType == QLatin1String("string")) {
-                element.setValue(QString());
-            } else if (elementType == QLatin1String("char")) {
-                element.setValue(QChar());
-            } else if (elementType.startsWith(QLatin1String("ArrayOf"))) {
-                elementType = elementType.mid(7);
-
-                if (elementType == QLatin1String("String")) {
-                    element.setValue(QStringList());
-                } else {//if (elementType == "DateTime") {
-                    element.setValue(QList<QVariant>());
-                }
+            if (!elementName.isEmpty()) {
+                workMethodList->append(elementName);
+                readTypeSchemaElement();
             } else {
-                element.setValue(QString());
+                xmlReader.skipCurrentElement();
             }
-            // VERY SHAKY IMPLEMENTATION!
-
-            params.insert(elementName, element);
-            xmlReader.readNext();
-//        } else if (tempName == QLatin1String("part")) {
-//            firstElem = false;
-//            QString elementName = xmlReader.attributes().value(
-//                        QLatin1String("name")).toString();
-//            QVariant element = QString("XSD not supported yet");
-//            params.insert(elementName, element);
-//            xmlReader.readNext();
+        } else if (xmlReader.isStartElement()
+                   && ((tempName == QLatin1String("complexType"))
+                       || (tempName == QLatin1String("simpleType")))) {
+            const QString localName = xmlReader.attributes().value(
+                        QLatin1String("name")).toString();
+            const int name = localName.isEmpty() ? -1 : typeName(localName);
+            if (tempName == QLatin1String("complexType"))
+                readComplexType(name);
+            else
+                readSimpleType(name);
         } else {
             xmlReader.readNext();
         }
     }
+
+    namespacePrefixes = outerPrefixes;
+    schemaNamespace.clear();
 }
 
 /*!
     \internal
 
-    Analyses both "working" QList and QMap, and extracts methods data,
-    which is then put into 'methods' QMap.
- */
-void QWsdlPrivate::prepareMethods()
+    Reads top-level element (reader is on its start tag), which can
+    describe a request or response, and remembers its type: a named
+    one (type attribute), or an inline complex type.
+  */
+void QWsdlPrivate::readTypeSchemaElement()
 {
-    if (errorState)
+    const QString typeAttribute = xmlReader.attributes().value(
+                QLatin1String("type")).toString();
+    if (!typeAttribute.isEmpty()) {
+        typeTable.elementTypes.append(typeTable.reference(expandedTypeName(typeAttribute)));
+        xmlReader.skipCurrentElement();
         return;
+    }
 
-    QList<bool> methodsDone;//[workMethodList->length()];
-
-    for (int x = 0; x < workMethodList->length(); x++)
-        methodsDone.append(false);
+    int type = -1;
+    while (xmlReader.readNextStartElement()) {
+        if (xmlReader.name() == QLatin1String("complexType"))
+            type = readComplexType(-1);
+        else
+            xmlReader.skipCurrentElement();
+    }
 
+    typeTable.elementTypes.append(type);
+}
 
-    for (int i = 0; (i < workMethodList->length()); i++) {
-        if (methodsDone.at(i) == false) {
-            bool isMethodAndResponsePresent = false;
-            int methodMain = 0;
-            int methodReturn = 0;
-            QString methodName = workMethodList->at(i);
+/*!
+    \internal
 
-            if (methodName.contains(QLatin1String("Response"))) {
-                methodReturn = i;
-                methodsDone.insert(i, true);
-                QString tempMethodName = methodName;
-                tempMethodName.chop(8);
+    Reads complex type (reader is on its start tag), called \a name (index
+    of interned name, -1 if anonymous), and returns its index. Nested
+    types are read first, so that fields of each type stay together.
+  */
+int QWsdlPrivate::readComplexType(int name)
+{
+    QVector<QWsdlTypeTable::Field> fields;
+    int base = -1;
+    readComplexContent(&fields, &base);
+    return typeTable.addType(name, QWsdlTypeTable::Complex, fields, base);
+}
 
-                for (int j = 0; j < workMethodList->length(); j++) {
-                    if ((workMethodList->at(j) == tempMethodName)
-                            || (workMethodList->at(j) == (tempMethodName + "Request"))) {
-                        methodMain = j;
-                        methodsDone.insert(j, true);
-                        isMethodAndResponsePresent = true;
-                        methodName = tempMethodName;
-                        break;
-                    }
-                }
-            } else {
-                methodMain = i;
+/*!
+    \internal
 
-                for (int j = 0; j < workMethodList->length(); j++) {
-                    QString cleanMethodName = QString(methodName + QLatin1String("Response"));
-                    QString requestMethodName = methodName;
-                    requestMethodName.chop(7);
-                    requestMethodName += QLatin1String("Response");
-
-                    if ((workMethodList->at(j) == cleanMethodName)
-                        || workMethodList->at(j) == requestMethodName) {
-                        methodReturn = j;
-                        methodsDone.insert(j, true);
-                        isMethodAndResponsePresent = true;
-                        break;
-                    }
+    Reads \a fields of complex type, descending into model groups
+    (sequence, all, choice) and content extensions. Type extended by
+    the content is stored in \a base.
+  */
+void QWsdlPrivate::readComplexContent(QVector<QWsdlTypeTable::Field> *fields, int *base)
+{
+    while (xmlReader.readNextStartElement()) {
+        const QString tempName = xmlReader.name().toString();
+
+        if (tempName == QLatin1String("element")) {
+            fields->append(readField());
+        } else if (tempName == QLatin1String("extension")) {
+            const QString baseName = xmlReader.attributes().value(
+                        QLatin1String("base")).toString();
+            if (!baseName.isEmpty())
+                *base = typeTable.reference(expandedTypeName(baseName));
+            readComplexContent(fields, base);
+        } else if ((tempName == QLatin1String("sequence"))
+                   || (tempName == QLatin1String("all"))
+                   || (tempName == QLatin1String("choice"))
+                   || (tempName == QLatin1String("complexContent"))
+                   || (tempName == QLatin1String("restriction"))) {
+            readComplexContent(fields, base);
+        } else {
+            xmlReader.skipCurrentElement();
+        }
+    }
+}
+
+/*!
+    \internal
+
+    Reads element declared inside a complex type (reader is on its start
+    tag). Elements without type, or inline type, are of anyType.
+  */
+QWsdlTypeTable::Field QWsdlPrivate::readField()
+{
+    const QXmlStreamAttributes attributes = xmlReader.attributes();
+    const QString name = attributes.value(QLatin1String("name")).toString();
+    const QStringRef minOccurs = attributes.value(QLatin1String("minOccurs"));
+    const QStringRef maxOccurs = attributes.value(QLatin1String("maxOccurs"));
+    const QString type = attributes.value(QLatin1String("type")).toString();
+
+    QWsdlTypeTable::Field field;
+    field.name = name.isEmpty() ? -1 : typeTable.intern(name);
+    field.minOccurs = minOccurs.isEmpty() ? 1 : minOccurs.toInt();
+    if (maxOccurs.isEmpty())
+        field.maxOccurs = 1;
+    else if (maxOccurs == QLatin1String("unbounded"))
+        field.maxOccurs = -1;
+    else
+        field.maxOccurs = maxOccurs.toInt();
+
+    if (!type.isEmpty()) {
+        field.type = typeTable.reference(expandedTypeName(type));
+        xmlReader.skipCurrentElement();
+        return field;
+    }
+
+    field.type = 0;
+    while (xmlReader.readNextStartElement()) {
+        if (xmlReader.name() == QLatin1String("complexType"))
+            field.type = readComplexType(-1);
+        else if (xmlReader.name() == QLatin1String("simpleType"))
+            field.type = readSimpleType(-1);
+        else
+            xmlReader.skipCurrentElement();
+    }
+
+    return field;
+}
+
+/*!
+    \internal
+
+    Reads simple type (reader is on its start tag), called \a name (-1 if
+    anonymous), and returns its index. Simple types are of the kind of
+    their restriction base; lists and unions are strings. Anonymous types
+    are not stored, their base is returned instead.
+  */
+int QWsdlPrivate::readSimpleType(int name)
+{
+    int base = -1;
+    while (xmlReader.readNextStartElement()) {
+        if (xmlReader.name() == QLatin1String("restriction")) {
+            const QString baseName = xmlReader.attributes().value(
+                        QLatin1String("base")).toString();
+            if (!baseName.isEmpty())
+                base = typeTable.reference(expandedTypeName(baseName));
+        }
+        xmlReader.skipCurrentElement();
+    }
+
+    if (base == -1) {
+        base = typeTable.reference(QWsdlTypeTable::expandedName(
+                                       QLatin1String(xsdNamespace), QLatin1String("string")));
+    }
+    if (name == -1)
+        return base;
+    return typeTable.addType(name, QWsdlTypeTable::Kind(typeTable.types.at(base).kind));
+}
+
+/*!
+    \internal
+
+    Remembers namespace prefixes declared on current tag (definitions
+    or schema).
+  */
+void QWsdlPrivate::declareNamespaces()
+{
+    foreach (const QXmlStreamNamespaceDeclaration &declaration,
+             xmlReader.namespaceDeclarations()) {
+        namespacePrefixes.insert(declaration.prefix().toString(),
+                                 declaration.namespaceUri().toString());
+    }
+}
+
+/*!
+    \internal
+
+    Returns index of interned name of type called \a localName, declared
+    in the schema being read.
+  */
+int QWsdlPrivate::typeName(const QString &localName)
+{
+    return typeTable.intern(QWsdlTypeTable::expandedName(schemaNamespace, localName));
+}
+
+/*!
+    \internal
+
+    Returns expanded name of type referred to by \a qualifiedName (like
+    "tns:Order") on current tag. Prefix is looked up in declarations of
+    the tag, then of enclosing schema and definitions. SOAP encoding
+    types are the XSD ones. Built-in types with undeclared prefix (or
+    without prefix, and no default namespace) are taken from XSD, as
+    lenient parsers do.
+  */
+QString QWsdlPrivate::expandedTypeName(const QString &qualifiedName) const
+{
+    const int colon = qualifiedName.indexOf(QLatin1Char(':'));
+    const QString prefix = (colon == -1) ? QString() : qualifiedName.left(colon);
+    const QString localName = qualifiedName.mid(colon + 1);
+
+    QString namespaceUri;
+    bool declared = false;
+    foreach (const QXmlStreamNamespaceDeclaration &declaration,
+             xmlReader.namespaceDeclarations()) {
+        if (declaration.prefix() == prefix) {
+            namespaceUri = declaration.namespaceUri().toString();
+            declared = true;
+        }
+    }
+
+    if (!declared) {
+        QHash<QString, QString>::const_iterator it = namespacePrefixes.constFind(prefix);
+        if (it != namespacePrefixes.constEnd()) {
+            namespaceUri = it.value();
+            declared = true;
+        }
+    }
+
+    if ((namespaceUri == QLatin1String(soapEncodingNamespace))
+            || (!declared && QWsdlTypeTable::isBuiltIn(localName))) {
+        namespaceUri = QLatin1String(xsdNamespace);
+    }
+
+    return QWsdlTypeTable::expandedName(namespaceUri, localName);
+}
+
+/*!
+    \internal
+
+    Describes parameters of each element with QVariant markers of their
+    types, as expected by QWebMethod.
+  */
+void QWsdlPrivate::buildParameters()
+{
+    workMethodParameters->clear();
+    for (int i = 0; i < workMethodList->length(); i++)
+        workMethodParameters->insert(i, typeTable.parameters(typeTable.elementTypes.value(i, -1)));
+}
+
+/*!
+    \internal
+
+    Remembers document at \a location (relative to current document),
+    to be read after this one. Empty locations (imports of namespaces
+    defined elsewhere) are ignored.
+  */
+void QWsdlPrivate::addImport(const QString &location)
+{
+    if (location.isEmpty())
+        return;
+
+    const QUrl url = documentUrl.resolved(QUrl(location));
+    if (!imports.contains(url))
+        imports.append(url);
+}
+
+/*!
+    \internal
+
+    Reads all documents imported (directly or not) by the WSDL, and merges
+    their types into the model. Documents are read level by level; all
+    documents of a level are fetched at once. Each document is read only
+    once, so that cyclic imports end. Returns false on error.
+  */
+bool QWsdlPrivate::resolveImports()
+{
+    QSet<QString> visited;
+    visited.insert(documentUrl.toString());
+    importStamps.clear();
+
+    QList<QUrl> level;
+    foreach (const QUrl &url, imports) {
+        if (!visited.contains(url.toString())) {
+            visited.insert(url.toString());
+            level.append(url);
+        }
+    }
+
+    while (!level.isEmpty()) {
+        const QVector<QSharedPointer<const QWsdlSchemaDocument> > documents
+                = fetchImports(level);
+        if (errorState)
+            return false;
+
+        QList<QUrl> next;
+        for (int i = 0; i < documents.size(); ++i) {
+            const QSharedPointer<const QWsdlSchemaDocument> &document = documents.at(i);
+            mergeImport(*document);
+
+            QWsdlModel::Import stamp;
+            stamp.url = level.at(i);
+            stamp.modified = document->modified;
+            stamp.size = document->size;
+            stamp.hash = document->hash;
+            importStamps.append(stamp);
+
+            foreach (const QUrl &url, document->imports) {
+                if (!visited.contains(url.toString())) {
+                    visited.insert(url.toString());
+                    next.append(url);
+                }
+            }
+        }
+
+        level = next;
+    }
+
+    return true;
+}
+
+/*!
+    \internal
+
+    Returns documents read from \a urls, in the same order. Local files
+    are read and parsed in thread pool threads, while remote ones are all
+    downloaded at once (each one is parsed as soon as it arrives). Cached
+    local documents are reused until the file is modified. Cached remote
+    ones are requested conditionally, if the server gave validators, and
+    reused if it reports no change (or can not be reached). Newly parsed
+    documents are added to the cache. On error, enters error state and
+    aborts other downloads.
+  */
+QVector<QSharedPointer<const QWsdlSchemaDocument> > QWsdlPrivate::fetchImports(
+        const QList<QUrl> &urls)
+{
+    QVector<QSharedPointer<const QWsdlSchemaDocument> > result(urls.size());
+    QVector<QString> messages(urls.size());
+    QSemaphore localsDone;
+    int localCount = 0;
+    QHash<QNetworkReply *, int> replies;
+    QHash<int, QSharedPointer<const QWsdlSchemaDocument> > revalidated;
+    QWebConnectionPoolPrivate *pool = QWebConnectionPoolPrivate::get(
+                QWebConnectionPool::globalInstance());
+
+    for (int i = 0; i < urls.size(); ++i) {
+        const QUrl &url = urls.at(i);
+        const QSharedPointer<const QWsdlSchemaDocument> cached = cachedSchema(url);
+        if (cached && (url.isLocalFile()
+                       || (cached->eTag.isEmpty() && cached->lastModified.isEmpty()))) {
+            result[i] = cached;
+            continue;
+        }
+
+        // Tasks write to their own items only; result is not resized.
+        // Without a free thread (this may be a pool thread, too), the
+        // document is read here.
+        if (url.isLocalFile()) {
+            QWsdlImportTask *task = new QWsdlImportTask(url, &result[i], &messages[i],
+                                                        &localsDone);
+            if (!QThreadPool::globalInstance()->tryStart(task)) {
+                task->run();
+                delete task;
+            }
+            ++localCount;
+            continue;
+        }
+
+        QNetworkRequest request(url);
+        if (cached) {
+            if (!cached->eTag.isEmpty())
+                request.setRawHeader("If-None-Match", cached->eTag);
+            if (!cached->lastModified.isEmpty())
+                request.setRawHeader("If-Modified-Since", cached->lastModified);
+            revalidated.insert(i, cached);
+        }
+
+        QNetworkAccessManager *manager = pool->acquire(url, QString());
+        replies.insert(manager->get(request), i);
+    }
+
+    while (!replies.isEmpty()) {
+        QNetworkReply *reply = 0;
+        foreach (QNetworkReply *candidate, replies.keys()) {
+            if (candidate->isFinished() || errorState) {
+                reply = candidate;
+                break;
+            }
+        }
+
+        if (!reply) {
+            QEventLoop loop;
+            foreach (QNetworkReply *candidate, replies.keys())
+                QObject::connect(candidate, SIGNAL(finished()), &loop, SLOT(quit()));
+            loop.exec(QEventLoop::ExcludeUserInputEvents);
+            continue;
+        }
+
+        const int i = replies.take(reply);
+        pool->release(reply->manager());
+
+        if (!errorState) {
+            const QSharedPointer<const QWsdlSchemaDocument> previous = revalidated.value(i);
+            const int status = reply->attribute(
+                        QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            QString message;
+            if (previous && ((status == 304) || (reply->error() != QNetworkReply::NoError))) {
+                result[i] = previous;
+            } else if (reply->error() != QNetworkReply::NoError) {
+                message = reply->errorString();
+            } else {
+                result[i] = parseImport(urls.at(i), reply->readAll(), &message,
+                                        reply->rawHeader("ETag"),
+                                        reply->rawHeader("Last-Modified"));
+                if (result.at(i))
+                    cacheSchema(urls.at(i), result.at(i));
+            }
+
+            if (!result.at(i)) {
+                enterErrorState(QString(QLatin1String("Error: cannot read imported document: ")
+                                        + urls.at(i).toString() + QLatin1String(". Reason: ")
+                                        + message));
+            }
+        } else if (!reply->isFinished()) {
+            reply->abort();
+        }
+
+        delete reply;
+    }
+
+    localsDone.acquire(localCount);
+    for (int i = 0; i < urls.size() && !errorState; ++i) {
+        if (!result.at(i)) {
+            enterErrorState(QString(QLatin1String("Error: cannot read imported document: ")
+                                    + urls.at(i).toString() + QLatin1String(". Reason: ")
+                                    + messages.at(i)));
+        }
+    }
+
+    return result;
+}
+
+/*!
+    \internal
+
+    Appends elements and types of imported \a document to the model.
+    Types are unified by name, so that references between documents
+    are resolved.
+  */
+void QWsdlPrivate::mergeImport(const QWsdlSchemaDocument &document)
+{
+    workMethodList->append(document.elements);
+
+    QVector<int> typeMap;
+    typeTable.merge(document.types, &typeMap);
+    foreach (qint32 type, document.types.elementTypes)
+        typeTable.elementTypes.append((type == -1) ? -1 : typeMap.at(type));
+}
+
+/*!
+    \internal
+
+    Reads imported document: a schema, or WSDL (of which only types
+    and further imports are used).
+  */
+void QWsdlPrivate::readImportedDocument()
+{
+    while (!xmlReader.atEnd()) {
+        if (xmlReader.isStartElement()) {
+            QString tempN = xmlReader.name().toString();
+
+            if (tempN == QLatin1String("schema")) {
+                readSchema();
+            } else if (tempN == QLatin1String("definitions")) {
+                readDefinitions();
+            } else {
+                enterErrorState(QLatin1String("Error: imported document is "
+                                              "neither schema nor WSDL!"));
+            }
+            break;
+        }
+
+        xmlReader.readNext();
+    }
+
+    if (!errorState && xmlReader.hasError())
+        enterErrorState(xmlReader.errorString());
+}
+
+/*!
+    \internal
+
+    Parses imported document \a data, read from \a url. On error, returns
+    null pointer, and sets \a errorMessage. Validators of a remote document
+    (\a eTag, \a lastModified) are kept, to revalidate it later. Does not
+    touch any QWsdl object, so it can be run in any thread.
+  */
+QSharedPointer<const QWsdlSchemaDocument> QWsdlPrivate::parseImport(
+        const QUrl &url, const QByteArray &data, QString *errorMessage,
+        const QByteArray &eTag, const QByteArray &lastModified)
+{
+    QSharedPointer<QWsdlSchemaDocument> document(new QWsdlSchemaDocument);
+    if (url.isLocalFile())
+        document->modified = QFileInfo(url.toLocalFile()).lastModified();
+    document->size = data.size();
+    document->hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+    document->eTag = eTag;
+    document->lastModified = lastModified;
+
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+
+    QWsdlPrivate parser;
+    parser.workMethodList = &document->elements;
+    parser.documentUrl = url;
+    parser.xmlReader.setDevice(&buffer);
+    parser.readImportedDocument();
+
+    if (parser.errorState) {
+        *errorMessage = parser.errorMessage.trimmed();
+        return QSharedPointer<const QWsdlSchemaDocument>();
+    }
+
+    document->types.swap(parser.typeTable);
+    document->imports = parser.imports;
+    return document;
+}
+
+/*!
+    \internal
+
+    Analyses both "working" QList and QMap, and extracts methods data,
+    which is then put into operation table. Web methods are created
+    later, on first use (materializeMethod()).
+
+    Requests are paired with responses using a name index, so that
+    the cost grows linearly with the number of elements.
+ */
+void QWsdlPrivate::prepareMethods()
+{
+    operations.clear();
+    operationIndexes.clear();
+
+    if (errorState)
+        return;
+
+    const int count = workMethodList->length();
+    QVector<bool> methodsDone(count, false);
+
+    // First occurrence of each element name.
+    QHash<QString, int> indexes;
+    indexes.reserve(count);
+    for (int x = count - 1; x >= 0; x--)
+        indexes.insert(workMethodList->at(x), x);
+
+    for (int i = 0; i < count; i++) {
+        if (methodsDone.at(i) == false) {
+            bool isMethodAndResponsePresent = false;
+            int methodMain = 0;
+            int methodReturn = 0;
+            QString methodName = workMethodList->at(i);
+            methodsDone[i] = true;
+
+            if (methodName.contains(QLatin1String("Response"))) {
+                methodReturn = i;
+                QString tempMethodName = methodName;
+                tempMethodName.chop(8);
+
+                int j = firstIndexOf(indexes, tempMethodName,
+                                     tempMethodName + QLatin1String("Request"));
+                if (j != -1) {
+                    methodMain = j;
+                    methodsDone[j] = true;
+                    isMethodAndResponsePresent = true;
+                    methodName = tempMethodName;
+                }
+            } else {
+                methodMain = i;
+                QString requestMethodName = methodName;
+                requestMethodName.chop(7);
+
+                int j = firstIndexOf(indexes, methodName + QLatin1String("Response"),
+                                     requestMethodName + QLatin1String("Response"));
+                if (j != -1) {
+                    methodReturn = j;
+                    methodsDone[j] = true;
+                    isMethodAndResponsePresent = true;
                 }
             }
 
             if (isMethodAndResponsePresent == true) {
-                QString methodPath;
-                if (m_hostUrl.isEmpty())
-                    methodPath = m_wsdlFilePath;
-                else
-                    methodPath = m_hostUrl.path();
-
-                QWebMethod *m = new QWebMethod(methodPath);
-                m->setMethodName(methodName);
-                m->setTargetNamespace(m_targetNamespace);
-                m->setParameters(workMethodParameters->value(methodMain));
-                m->setReturnValue(workMethodParameters->value(methodReturn));
-                methodsMap->insert(methodName, m);
+                Operation operation;
+                operation.name = methodName;
+                operation.request = methodMain;
+                operation.response = methodReturn;
+
+                // Later operation with the same name replaces earlier one.
+                const int existing = operationIndexes.value(methodName, -1);
+                if (existing != -1) {
+                    operations[existing] = operation;
+                } else {
+                    operationIndexes.insert(methodName, operations.size());
+                    operations.append(operation);
+                }
             }
         }
     }
 }
 
+/*!
+    \internal
+
+    Creates web method for \a operation (index in operation table),
+    and remembers it in methods map.
+  */
+QWebMethod *QWsdlPrivate::materializeMethod(int operation)
+{
+    const Operation &op = model->operations.at(operation);
+
+    QString methodPath;
+    if (model->hostUrl.isEmpty())
+        methodPath = m_wsdlFilePath;
+    else
+        methodPath = model->hostUrl.path();
+
+    // Parameter maps are implicitly shared with the model.
+    QWebMethod *m = new QWebMethod(methodPath);
+    m->setMethodName(op.name);
+    m->setTargetNamespace(model->targetNamespace);
+    m->setParameters(model->parameters.value(op.request));
+    m->setReturnValue(model->parameters.value(op.response));
+    methodsMap->insert(op.name, m);
+    return m;
+}
+
+/*!
+    \internal
+
+    Returns lower of \a indexes of \a first and \a second name,
+    or -1 if none of them is present.
+  */
+int QWsdlPrivate::firstIndexOf(const QHash<QString, int> &indexes,
+                               const QString &first, const QString &second)
+{
+    int a = indexes.value(first, -1);
+    int b = indexes.value(second, -1);
+
+    if (a == -1)
+        return b;
+    if (b == -1)
+        return a;
+    return qMin(a, b);
+}
+
 /*!
     \internal
   */
@@ -758,7 +1708,6 @@ void QWsdlPrivate::readBindings()
 void QWsdlPrivate::readService()
 {
     // TODO: add different addresses for different message types.
-//    qDebug() << "WSDL :service tag not supported yet.";
     QString tempName;
 
     while (!xmlReader.atEnd()) {
@@ -781,8 +1730,13 @@ void QWsdlPrivate::readService()
         if ((tempName == QLatin1String("address"))
                 && xmlReader.attributes().hasAttribute(
                     QLatin1String("location"))) {
-            m_hostUrl.setUrl(xmlReader.attributes().value(
-                                 QLatin1String("location")).toString());
+            const QUrl location(xmlReader.attributes().value(
+                                    QLatin1String("location")).toString());
+            if (!m_endpoints.contains(location)) {
+                m_endpoints.append(location);
+                if (m_endpoints.size() == 1)
+                    m_hostUrl = location;
+            }
         }
 
         xmlReader.readNext();
@@ -800,13 +1754,1099 @@ void QWsdlPrivate::readDocumentation()
 
 /*!
     \internal
+
+    Returns true if WSDL path is not a local file, but URL.
   */
-QString QWsdlPrivate::convertReplyToUtf(const QString &textToConvert)
+bool QWsdlPrivate::isRemote() const
 {
-    QString result = textToConvert;
+    return !QFile::exists(m_wsdlFilePath) && QUrl(m_wsdlFilePath).isValid();
+}
 
-    result.replace(QLatin1String("&lt;"), QLatin1String("<"));
-    result.replace(QLatin1String("&gt;"), QLatin1String(">"));
+/*!
+    \internal
 
-    return result;
+    Returns cache key of current WSDL: its URL, or absolute path.
+  */
+QString QWsdlPrivate::cacheKey() const
+{
+    if (isRemote())
+        return m_wsdlFilePath;
+    return QFileInfo(m_wsdlFilePath).absoluteFilePath();
+}
+
+/*!
+    \internal
+
+    Returns path of cache file for \a key.
+  */
+QString QWsdlPrivate::cacheFilePath(const QString &key) const
+{
+    const QByteArray name = QCryptographicHash::hash(
+                key.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QDir(cacheDirectory).filePath(QLatin1String(name) + QLatin1String(".qwsdlc"));
+}
+
+/*!
+    \internal
+
+    Returns SHA-1 hash of local WSDL file content, or empty array if it
+    can not be read.
+  */
+QByteArray QWsdlPrivate::contentHash() const
+{
+    QFile file(m_wsdlFilePath);
+    if (!file.open(QFile::ReadOnly))
+        return QByteArray();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(&file);
+    return hash.result();
+}
+
+/*!
+    \internal
+
+    Returns true if any of local documents described by \a stamps changed
+    since it was read: it is gone, or has different content. Content is
+    only hashed again if modification time or size changed. Remote
+    documents are not checked.
+  */
+bool QWsdlPrivate::importsChanged(const QVector<QWsdlModel::Import> &stamps)
+{
+    foreach (const QWsdlModel::Import &stamp, stamps) {
+        if (!stamp.url.isLocalFile())
+            continue;
+
+        const QFileInfo info(stamp.url.toLocalFile());
+        if (!info.exists())
+            return true;
+        if (info.lastModified() == stamp.modified && info.size() == stamp.size)
+            continue;
+
+        QFile file(info.filePath());
+        if (!file.open(QFile::ReadOnly))
+            return true;
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(&file);
+        if (hash.result() != stamp.hash)
+            return true;
+    }
+
+    return false;
+}
+
+/*!
+    \internal
+
+    Requests remote WSDL conditionally, using validators of current model.
+    If the server reports a change, the reply is parsed, and the model
+    published under \a key. If the server can not be reached, current
+    model is kept, and \a reason is set. It is also kept if the reply
+    can not be parsed.
+  */
+QWsdlPrivate::Revalidation QWsdlPrivate::revalidate(const QString &key, QString *reason)
+{
+    const QUrl url(m_wsdlFilePath);
+    QWsdlDownload download(url, model->eTag, model->lastModified);
+    download.waitForHeaders();
+
+    if (download.error() != QNetworkReply::NoError) {
+        *reason = download.replyErrorString();
+        return Unreachable;
+    }
+
+    if (download.httpStatus() == 304) {
+        touchCache(key);
+        return NotModified;
+    }
+
+    return reload(&download, key) ? Reloaded : ReloadFailed;
+}
+
+/*!
+    \internal
+
+    Reads a new model from \a download, and publishes it under \a key.
+    If that fails, current model (and methods created from it) are kept.
+  */
+bool QWsdlPrivate::reload(QWsdlDownload *download, const QString &key)
+{
+    const QSharedPointer<const QWsdlModel> previous = model;
+    const QMap<QString, QWebMethod *> previousMethods = *methodsMap;
+    clearModel();
+    m_hostUrl = QUrl(m_wsdlFilePath);
+    readDocument(download);
+    if (finishParse(download, key))
+        return true;
+
+    restoreModel(previous, previousMethods);
+    return false;
+}
+
+/*!
+    \internal
+
+    Makes \a previous current model again (with its \a methods), after
+    a new one could not be read. Error state is kept.
+  */
+void QWsdlPrivate::restoreModel(const QSharedPointer<const QWsdlModel> &previous,
+                                const QMap<QString, QWebMethod *> &methods)
+{
+    model = previous;
+    *methodsMap = methods;
+}
+
+/*!
+    \internal
+
+    Starts automatic refresh. Remote file is requested (conditionally, if
+    the server gave validators), and finishRefresh() is called when the
+    reply is finished. Local file is checked by refresh(). Does nothing
+    if previous refresh is in progress.
+  */
+void QWsdlPrivate::startRefresh()
+{
+    Q_Q(QWsdl);
+    if (pendingRefresh || m_wsdlFilePath.isEmpty())
+        return;
+
+    if (!isRemote()) {
+        q->refresh();
+        return;
+    }
+
+    if (errorState)
+        pendingRefresh = new QWsdlDownload(QUrl(m_wsdlFilePath));
+    else
+        pendingRefresh = new QWsdlDownload(QUrl(m_wsdlFilePath), model->eTag, model->lastModified);
+
+    QObject::connect(pendingRefresh->reply(), &QNetworkReply::finished,
+                     q, [this]() { finishRefresh(); });
+}
+
+/*!
+    \internal
+
+    Finishes automatic refresh started by startRefresh(). All data of the
+    file has arrived already; remote imports not in the schema cache are
+    still downloaded by resolveImports(). Runs in the reply's finished()
+    signal, so the reply is only deleted later (see ~QWsdlDownload()).
+  */
+void QWsdlPrivate::finishRefresh()
+{
+    Q_Q(QWsdl);
+    QScopedPointer<QWsdlDownload> download(pendingRefresh);
+    pendingRefresh = 0;
+
+    if (download->error() != QNetworkReply::NoError) {
+        enterErrorState(QString(QLatin1String("Error: cannot refresh WSDL file: ")
+                                + m_wsdlFilePath
+                                + QLatin1String(". Reason: ") + download->replyErrorString()));
+        return;
+    }
+
+    if (download->httpStatus() == 304) {
+        touchCache(cacheKey());
+        return;
+    }
+
+    errorState = false;
+    errorMessage = QString();
+    if (reload(download.data(), cacheKey()))
+        emit q->wsdlFileChanged();
+}
+
+/*!
+    \internal
+
+    Aborts automatic refresh in progress, if any.
+  */
+void QWsdlPrivate::cancelRefresh()
+{
+    if (!pendingRefresh)
+        return;
+
+    // Aborting emits finished(), which must not reach finishRefresh().
+    QWsdlDownload *download = pendingRefresh;
+    pendingRefresh = 0;
+    QObject::disconnect(download->reply(), 0, q_ptr, 0);
+    delete download;
+}
+
+/*!
+    \internal
+
+    Loads model (and validators of remote file) from cache file of \a key,
+    if it exists, is valid, and was made from content with \a hash (any
+    content, if \a hash is empty). The file is memory-mapped, if possible.
+    Returns true on success.
+  */
+bool QWsdlPrivate::loadCache(const QString &key, const QByteArray &hash)
+{
+    QFile file(cacheFilePath(key));
+    if (!file.open(QFile::ReadOnly))
+        return false;
+
+    QByteArray bytes;
+    uchar *mapped = file.map(0, file.size());
+    if (mapped)
+        bytes = QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), int(file.size()));
+    else
+        bytes = file.readAll();
+
+    QDataStream stream(bytes);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic = 0;
+    quint16 version = 0;
+    qint64 validated = 0;
+    QString cachedKey;
+    QByteArray cachedHash;
+    stream >> magic >> version;
+    if (magic != CacheMagic || version != CacheVersion)
+        return false;
+
+    stream >> validated;
+
+    QByteArray cachedETag;
+    QByteArray cachedLastModified;
+    stream >> cachedKey >> cachedHash >> cachedETag >> cachedLastModified;
+    if (cachedKey != key || (!hash.isEmpty() && cachedHash != hash))
+        return false;
+
+    QString webServiceName;
+    QString targetNamespace;
+    QUrl hostUrl;
+    QList<QUrl> endpoints;
+    QStringList methodList;
+    QWsdlTypeTable types;
+    qint32 operationCount = 0;
+    stream >> webServiceName >> targetNamespace >> hostUrl >> endpoints >> methodList;
+    if (!types.load(stream))
+        return false;
+    stream >> operationCount;
+
+    QVector<Operation> cachedOperations;
+    for (qint32 i = 0; i < operationCount && stream.status() == QDataStream::Ok; i++) {
+        Operation operation;
+        qint32 request = 0;
+        qint32 response = 0;
+        stream >> operation.name >> request >> response;
+        operation.request = request;
+        operation.response = response;
+        cachedOperations.append(operation);
+    }
+
+    qint32 importCount = 0;
+    stream >> importCount;
+    QVector<QWsdlModel::Import> cachedImports;
+    for (qint32 i = 0; i < importCount && stream.status() == QDataStream::Ok; i++) {
+        QWsdlModel::Import import;
+        stream >> import.url >> import.modified >> import.size >> import.hash;
+        cachedImports.append(import);
+    }
+
+    // Model is made of imported documents, too.
+    if (stream.status() != QDataStream::Ok || importsChanged(cachedImports))
+        return false;
+
+    m_webServiceName = webServiceName;
+    m_targetNamespace = targetNamespace;
+    m_hostUrl = hostUrl;
+    m_endpoints = endpoints;
+    *workMethodList = methodList;
+    typeTable.swap(types);
+    buildParameters();
+    operations = cachedOperations;
+    importStamps = cachedImports;
+    operationIndexes.clear();
+    for (int i = 0; i < operations.size(); i++)
+        operationIndexes.insert(operations.at(i).name, i);
+
+    eTag = cachedETag;
+    lastModified = cachedLastModified;
+    cacheValidated = validated;
+    if (!isRemote()) {
+        const QFileInfo info(m_wsdlFilePath);
+        fileModified = info.lastModified();
+        fileSize = info.size();
+    }
+
+    publishModel(key);
+    loadedFromCache = true;
+    return true;
+}
+
+/*!
+    \internal
+
+    Writes current model to cache file of \a key, along with \a hash of WSDL
+    content, validators and current time (the model was just read, or
+    confirmed by the server). Failures are ignored: the cache is only
+    an optimization.
+  */
+void QWsdlPrivate::saveCache(const QString &key, const QByteArray &hash)
+{
+    if (!QDir().mkpath(cacheDirectory))
+        return;
+
+    QSaveFile file(cacheFilePath(key));
+    if (!file.open(QFile::WriteOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << quint32(CacheMagic) << quint16(CacheVersion)
+           << QDateTime::currentMSecsSinceEpoch() << key << hash
+           << model->eTag << model->lastModified;
+    stream << model->webServiceName << model->targetNamespace << model->hostUrl
+           << model->endpoints << model->elements;
+    model->types.save(stream);
+    stream << qint32(model->operations.size());
+
+    foreach (const Operation &operation, model->operations)
+        stream << operation.name << qint32(operation.request) << qint32(operation.response);
+
+    stream << qint32(model->imports.size());
+    foreach (const QWsdlModel::Import &import, model->imports)
+        stream << import.url << import.modified << import.size << import.hash;
+
+    if (stream.status() == QDataStream::Ok)
+        file.commit();
+}
+
+/*!
+    \internal
+
+    Returns true if the model loaded from cache was sent or confirmed by
+    the server less than cacheMaxAge seconds ago.
+  */
+bool QWsdlPrivate::isCacheFresh() const
+{
+    if (cacheMaxAge < 0)
+        return true;
+
+    const qint64 age = QDateTime::currentMSecsSinceEpoch() - cacheValidated;
+    return (age >= 0) && (age < qint64(cacheMaxAge) * 1000);
+}
+
+/*!
+    \internal
+
+    Records in cache file of \a key (if any) that the server has just
+    confirmed the model. Only the time, at the start of the file, is
+    written.
+  */
+void QWsdlPrivate::touchCache(const QString &key)
+{
+    if (cacheDirectory.isEmpty())
+        return;
+
+    QFile file(cacheFilePath(key));
+    if (!file.open(QFile::ReadWrite) || file.size() < 14)
+        return;
+
+    // Magic (quint32) and version (quint16) come first.
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+    quint32 magic = 0;
+    quint16 version = 0;
+    stream >> magic >> version;
+    if ((magic == CacheMagic) && (version == CacheVersion)
+            && file.seek(sizeof(quint32) + sizeof(quint16))) {
+        stream << QDateTime::currentMSecsSinceEpoch();
+    }
+}
+
+/*!
+    \internal
+
+    Returns model of WSDL \a key, used by another object, or null pointer
+    if there is none, or local file changed since it was read.
+  */
+QSharedPointer<const QWsdlModel> QWsdlPrivate::sharedModel(const QString &key) const
+{
+    QMutexLocker locker(&modelRegistryMutex);
+    const QSharedPointer<const QWsdlModel> shared = modelRegistry.value(key).toStrongRef();
+    if (!shared)
+        return shared;
+
+    if (!isRemote()) {
+        const QFileInfo info(m_wsdlFilePath);
+        if (info.lastModified() != shared->fileModified || info.size() != shared->fileSize)
+            return QSharedPointer<const QWsdlModel>();
+    }
+
+    if (importsChanged(shared->imports))
+        return QSharedPointer<const QWsdlModel>();
+    return shared;
+}
+
+/*!
+    \internal
+
+    Moves the model read so far into a new, immutable model, and makes
+    it available to other objects reading WSDL \a key.
+  */
+void QWsdlPrivate::publishModel(const QString &key)
+{
+    QWsdlModel *result = new QWsdlModel;
+    result->webServiceName.swap(m_webServiceName);
+    result->targetNamespace.swap(m_targetNamespace);
+    result->hostUrl.swap(m_hostUrl);
+    result->endpoints.swap(m_endpoints);
+    result->elements.swap(*workMethodList);
+    result->types.swap(typeTable);
+    result->parameters.swap(*workMethodParameters);
+    result->operations.swap(operations);
+    result->operationIndexes.swap(operationIndexes);
+    result->eTag.swap(eTag);
+    result->lastModified.swap(lastModified);
+    result->fileModified.swap(fileModified);
+    result->fileSize = fileSize;
+    fileSize = -1;
+    result->imports.swap(importStamps);
+    model = QSharedPointer<const QWsdlModel>(result);
+
+    QMutexLocker locker(&modelRegistryMutex);
+    // Forget models nobody uses any more.
+    QHash<QString, QWeakPointer<const QWsdlModel> >::iterator it = modelRegistry.begin();
+    while (it != modelRegistry.end()) {
+        if (it.value().isNull())
+            it = modelRegistry.erase(it);
+        else
+            ++it;
+    }
+    modelRegistry.insert(key, model);
+}
+
+/*!
+    \internal
+
+    Starts downloading \a url, through the shared connection pool. If
+    \a eTag or \a lastModified are given, the request is conditional.
+  */
+QWsdlDownload::QWsdlDownload(const QUrl &url, const QByteArray &eTag,
+                             const QByteArray &lastModified) :
+    QIODevice(), m_hash(QCryptographicHash::Sha1)
+{
+    QNetworkRequest request(url);
+    if (!eTag.isEmpty())
+        request.setRawHeader("If-None-Match", eTag);
+    if (!lastModified.isEmpty())
+        request.setRawHeader("If-Modified-Since", lastModified);
+
+    QNetworkAccessManager *manager = QWebConnectionPoolPrivate::get(
+                QWebConnectionPool::globalInstance())->acquire(url, QString());
+    m_reply = manager->get(request);
+    open(QIODevice::ReadOnly);
+}
+
+/*!
+    \internal
+
+    Waits until response headers arrive, or the download fails.
+  */
+void QWsdlDownload::waitForHeaders()
+{
+    while (!m_reply->isFinished()
+           && !m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).isValid()) {
+        QEventLoop loop;
+        QObject::connect(m_reply, SIGNAL(metaDataChanged()), &loop, SLOT(quit()));
+        QObject::connect(m_reply, SIGNAL(finished()), &loop, SLOT(quit()));
+        loop.exec(QEventLoop::ExcludeUserInputEvents);
+    }
+}
+
+/*!
+    \internal
+
+    Returns HTTP status code, or 0, if headers did not arrive yet.
+  */
+int QWsdlDownload::httpStatus() const
+{
+    return m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+}
+
+/*!
+    \internal
+
+    Returns validators sent by the server (ETag and Last-Modified headers).
+  */
+QByteArray QWsdlDownload::eTag() const
+{
+    return m_reply->rawHeader("ETag");
+}
+
+/*!
+    \internal
+  */
+QByteArray QWsdlDownload::lastModified() const
+{
+    return m_reply->rawHeader("Last-Modified");
+}
+
+/*!
+    \internal
+
+    Aborts the download, if it is not finished. The reply is deleted
+    later, as the download may be destroyed in its finished() signal.
+  */
+QWsdlDownload::~QWsdlDownload()
+{
+    QWebConnectionPoolPrivate::get(QWebConnectionPool::globalInstance())
+            ->release(m_reply->manager());
+    if (!m_reply->isFinished())
+        m_reply->abort();
+    m_reply->deleteLater();
+}
+
+/*!
+    \internal
+  */
+qint64 QWsdlDownload::bytesAvailable() const
+{
+    return m_pending.size() + QIODevice::bytesAvailable();
+}
+
+/*!
+    \internal
+
+    Returns error of the download (NoError while it is in progress).
+  */
+QNetworkReply::NetworkError QWsdlDownload::error() const
+{
+    return m_reply->error();
+}
+
+/*!
+    \internal
+  */
+QString QWsdlDownload::replyErrorString() const
+{
+    return m_reply->errorString();
+}
+
+/*!
+    \internal
+
+    Returns SHA-1 hash of data downloaded so far (as sent by the server).
+  */
+QByteArray QWsdlDownload::contentHash() const
+{
+    return m_hash.result();
+}
+
+/*!
+    \internal
+
+    Moves data which arrived to pending data, waiting for it first,
+    if needed. Returns false when there is no more data.
+  */
+bool QWsdlDownload::waitForData()
+{
+    while (m_pending.isEmpty()) {
+        if (m_reply->bytesAvailable() > 0) {
+            const QByteArray data = m_reply->readAll();
+            m_hash.addData(data);
+
+            QByteArray chunk = m_tail + data;
+            m_tail.clear();
+            const int escape = chunk.lastIndexOf('&');
+            if (escape != -1 && chunk.size() - escape < 4) {
+                m_tail = chunk.mid(escape);
+                chunk.truncate(escape);
+            }
+
+            chunk.replace("&lt;", "<");
+            chunk.replace("&gt;", ">");
+            m_pending = chunk;
+        } else if (m_reply->isFinished()) {
+            m_pending = m_tail;
+            m_tail.clear();
+            return !m_pending.isEmpty();
+        } else {
+            QEventLoop loop;
+            QObject::connect(m_reply, SIGNAL(readyRead()), &loop, SLOT(quit()));
+            QObject::connect(m_reply, SIGNAL(finished()), &loop, SLOT(quit()));
+            loop.exec(QEventLoop::ExcludeUserInputEvents);
+        }
+    }
+
+    return true;
+}
+
+/*!
+    \internal
+  */
+qint64 QWsdlDownload::readData(char *data, qint64 maxSize)
+{
+    if (!waitForData())
+        return -1;
+
+    const int size = int(qMin(maxSize, qint64(m_pending.size())));
+    memcpy(data, m_pending.constData(), size_t(size));
+    m_pending.remove(0, size);
+    return size;
+}
+
+/*!
+    \internal
+  */
+qint64 QWsdlDownload::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+namespace {
+struct BuiltInType
+{
+    const char *name;
+    QWsdlTypeTable::Kind kind;
+};
+
+// anyType has to come first.
+const BuiltInType builtInTypes[] = {
+    { "anyType", QWsdlTypeTable::AnyType },
+    { "anySimpleType", QWsdlTypeTable::AnyType },
+    { "string", QWsdlTypeTable::String },
+    { "normalizedString", QWsdlTypeTable::String },
+    { "token", QWsdlTypeTable::String },
+    { "anyURI", QWsdlTypeTable::String },
+    { "QName", QWsdlTypeTable::String },
+    { "boolean", QWsdlTypeTable::Boolean },
+    { "int", QWsdlTypeTable::Int },
+    { "integer", QWsdlTypeTable::Integer },
+    { "long", QWsdlTypeTable::Integer },
+    { "short", QWsdlTypeTable::Integer },
+    { "byte", QWsdlTypeTable::Integer },
+    { "unsignedLong", QWsdlTypeTable::Integer },
+    { "unsignedInt", QWsdlTypeTable::Integer },
+    { "unsignedShort", QWsdlTypeTable::Integer },
+    { "unsignedByte", QWsdlTypeTable::Integer },
+    { "negativeInteger", QWsdlTypeTable::Integer },
+    { "nonNegativeInteger", QWsdlTypeTable::Integer },
+    { "positiveInteger", QWsdlTypeTable::Integer },
+    { "nonPositiveInteger", QWsdlTypeTable::Integer },
+    { "float", QWsdlTypeTable::Float },
+    { "double", QWsdlTypeTable::Double },
+    { "decimal", QWsdlTypeTable::Decimal },
+    { "dateTime", QWsdlTypeTable::DateTime },
+    { "date", QWsdlTypeTable::Date },
+    { "time", QWsdlTypeTable::Time },
+    { "char", QWsdlTypeTable::Char },
+    { "base64Binary", QWsdlTypeTable::Binary },
+    { "hexBinary", QWsdlTypeTable::Binary }
+};
+}
+
+/*!
+    \internal
+
+    Constructs the table with built-in XSD types.
+  */
+QWsdlTypeTable::QWsdlTypeTable()
+{
+    const int count = int(sizeof(builtInTypes) / sizeof(builtInTypes[0]));
+    for (int i = 0; i < count; i++) {
+        addType(intern(expandedName(QLatin1String(xsdNamespace),
+                                    QLatin1String(builtInTypes[i].name))),
+                builtInTypes[i].kind);
+    }
+}
+
+/*!
+    \internal
+
+    Returns name of type called \a localName in \a namespaceUri, as stored
+    in the table: "{namespaceUri}localName".
+  */
+QString QWsdlTypeTable::expandedName(const QString &namespaceUri, const QString &localName)
+{
+    return QLatin1Char('{') + namespaceUri + QLatin1Char('}') + localName;
+}
+
+/*!
+    \internal
+
+    Returns local part of \a expandedName.
+  */
+QString QWsdlTypeTable::localName(const QString &expandedName)
+{
+    return expandedName.mid(expandedName.lastIndexOf(QLatin1Char('}')) + 1);
+}
+
+/*!
+    \internal
+
+    Returns true if \a localName is one of built-in XSD types.
+  */
+bool QWsdlTypeTable::isBuiltIn(const QString &localName)
+{
+    const int count = int(sizeof(builtInTypes) / sizeof(builtInTypes[0]));
+    for (int i = 0; i < count; i++) {
+        if (localName == QLatin1String(builtInTypes[i].name))
+            return true;
+    }
+    return false;
+}
+
+/*!
+    \internal
+
+    Returns index of \a name, adding it if it is new.
+  */
+int QWsdlTypeTable::intern(const QString &name)
+{
+    QHash<QString, int>::const_iterator it = nameIndexes.constFind(name);
+    if (it != nameIndexes.constEnd())
+        return it.value();
+
+    names.append(name);
+    nameIndexes.insert(name, names.size() - 1);
+    return names.size() - 1;
+}
+
+/*!
+    \internal
+
+    Returns index of type called \a expandedName (see expandedName()). If
+    it is not declared yet, an Unresolved placeholder is added, and filled
+    in by a later declaration.
+  */
+int QWsdlTypeTable::reference(const QString &expandedName)
+{
+    const int name = intern(expandedName);
+    QHash<int, int>::const_iterator it = namedTypes.constFind(name);
+    if (it != namedTypes.constEnd())
+        return it.value();
+
+    return appendType(name, Unresolved);
+}
+
+/*!
+    \internal
+
+    Declares type called \a name (-1 if anonymous), of \a kind, with
+    \a typeFields, extending \a base (-1 if none), and returns its index.
+    If a type of that name was already declared, the first declaration
+    is kept.
+  */
+int QWsdlTypeTable::addType(int name, Kind kind, const QVector<Field> &typeFields, int base)
+{
+    int index = (name == -1) ? -1 : namedTypes.value(name, -1);
+    if (index == -1)
+        index = appendType(name, kind);
+    else if (types.at(index).kind != Unresolved)
+        return index;
+
+    Type &type = types[index];
+    type.kind = kind;
+    type.firstField = fields.size();
+    type.fieldCount = typeFields.size();
+    type.base = base;
+    fields += typeFields;
+    return index;
+}
+
+/*!
+    \internal
+  */
+int QWsdlTypeTable::appendType(int name, Kind kind)
+{
+    Type type;
+    type.name = name;
+    type.kind = kind;
+    type.firstField = fields.size();
+    type.fieldCount = 0;
+    type.base = -1;
+    types.append(type);
+
+    if (name != -1)
+        namedTypes.insert(name, types.size() - 1);
+    return types.size() - 1;
+}
+
+/*!
+    \internal
+
+    Adds types of \a other table. Named types are unified by namespace
+    and name (first declaration wins), anonymous ones are appended. \a typeMap is filled
+    with new index of each type of \a other. Element types are not copied.
+  */
+void QWsdlTypeTable::merge(const QWsdlTypeTable &other, QVector<int> *typeMap)
+{
+    QVector<int> nameMap(other.names.size());
+    for (int i = 0; i < other.names.size(); i++)
+        nameMap[i] = intern(other.names.at(i));
+
+    typeMap->resize(other.types.size());
+    QVector<int> copied;
+    for (int i = 0; i < other.types.size(); i++) {
+        const Type &type = other.types.at(i);
+        const int name = (type.name == -1) ? -1 : nameMap.at(type.name);
+        int index = (name == -1) ? -1 : namedTypes.value(name, -1);
+        if (index == -1)
+            index = appendType(name, Unresolved);
+
+        (*typeMap)[i] = index;
+        if ((types.at(index).kind == Unresolved) && (type.kind != Unresolved))
+            copied.append(i);
+    }
+
+    // Fields are copied once all types are mapped, as they can refer
+    // to types declared later.
+    foreach (int i, copied) {
+        const Type &type = other.types.at(i);
+        Type &target = types[typeMap->at(i)];
+        target.kind = type.kind;
+        target.firstField = fields.size();
+        target.fieldCount = type.fieldCount;
+        target.base = (type.base == -1) ? -1 : typeMap->at(type.base);
+
+        for (int j = 0; j < type.fieldCount; j++) {
+            Field field = other.fields.at(type.firstField + j);
+            if (field.name != -1)
+                field.name = nameMap.at(field.name);
+            field.type = typeMap->at(field.type);
+            fields.append(field);
+        }
+    }
+}
+
+/*!
+    \internal
+  */
+void QWsdlTypeTable::swap(QWsdlTypeTable &other)
+{
+    names.swap(other.names);
+    types.swap(other.types);
+    fields.swap(other.fields);
+    elementTypes.swap(other.elementTypes);
+    nameIndexes.swap(other.nameIndexes);
+    namedTypes.swap(other.namedTypes);
+}
+
+/*!
+    \internal
+
+    Writes the table to \a stream. Indexes are not written, load()
+    rebuilds them.
+  */
+void QWsdlTypeTable::save(QDataStream &stream) const
+{
+    stream << names << qint32(types.size());
+    foreach (const Type &type, types)
+        stream << type.name << type.kind << type.firstField << type.fieldCount << type.base;
+
+    stream << qint32(fields.size());
+    foreach (const Field &field, fields)
+        stream << field.name << field.type << field.minOccurs << field.maxOccurs;
+
+    stream << elementTypes;
+}
+
+/*!
+    \internal
+
+    Reads the table from \a stream. Returns false if data is broken.
+  */
+bool QWsdlTypeTable::load(QDataStream &stream)
+{
+    QStringList loadedNames;
+    QVector<Type> loadedTypes;
+    QVector<Field> loadedFields;
+    QVector<qint32> loadedElementTypes;
+    qint32 count = 0;
+
+    stream >> loadedNames >> count;
+    for (qint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        Type type;
+        stream >> type.name >> type.kind >> type.firstField >> type.fieldCount >> type.base;
+        if ((type.name < -1) || (type.name >= loadedNames.size()))
+            return false;
+        loadedTypes.append(type);
+    }
+
+    stream >> count;
+    for (qint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        Field field;
+        stream >> field.name >> field.type >> field.minOccurs >> field.maxOccurs;
+        if ((field.name < -1) || (field.name >= loadedNames.size()) || (field.type < 0)
+                || (field.type >= loadedTypes.size()))
+            return false;
+        loadedFields.append(field);
+    }
+
+    stream >> loadedElementTypes;
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    foreach (const Type &type, loadedTypes) {
+        if ((type.firstField < 0) || (type.fieldCount < 0)
+                || (type.firstField + type.fieldCount > loadedFields.size())
+                || (type.base < -1) || (type.base >= loadedTypes.size()))
+            return false;
+    }
+
+    foreach (qint32 type, loadedElementTypes) {
+        if ((type < -1) || (type >= loadedTypes.size()))
+            return false;
+    }
+
+    names = loadedNames;
+    types = loadedTypes;
+    fields = loadedFields;
+    elementTypes = loadedElementTypes;
+
+    nameIndexes.clear();
+    for (int i = 0; i < names.size(); i++)
+        nameIndexes.insert(names.at(i), i);
+
+    namedTypes.clear();
+    for (int i = 0; i < types.size(); i++) {
+        if ((types.at(i).name != -1) && !namedTypes.contains(types.at(i).name))
+            namedTypes.insert(types.at(i).name, i);
+    }
+
+    return true;
+}
+
+/*!
+    \internal
+
+    Returns fields of \a type, preceded by those inherited from the
+    types it extends.
+  */
+QVector<QWsdlTypeTable::Field> QWsdlTypeTable::allFields(int type) const
+{
+    // Broken documents can extend types in a cycle.
+    QVector<int> chain;
+    for (int t = type; (t >= 0) && (t < types.size()) && !chain.contains(t);
+         t = types.at(t).base) {
+        chain.prepend(t);
+    }
+
+    QVector<Field> result;
+    foreach (int t, chain)
+        result += fields.mid(types.at(t).firstField, types.at(t).fieldCount);
+    return result;
+}
+
+/*!
+    \internal
+
+    Returns true if \a type is a complex type wrapping a single,
+    repeated element (like ArrayOfString in .NET services).
+  */
+bool QWsdlTypeTable::isArray(int type) const
+{
+    if ((type < 0) || (type >= types.size()) || (types.at(type).kind != Complex))
+        return false;
+
+    const QVector<Field> typeFields = allFields(type);
+    if (typeFields.size() != 1)
+        return false;
+
+    const int maxOccurs = typeFields.first().maxOccurs;
+    return (maxOccurs == -1) || (maxOccurs > 1);
+}
+
+/*!
+    \internal
+
+    Returns QVariant marker of \a type, as expected by QWebMethod:
+    an empty value of matching Qt type. Arrays of strings are QStringList,
+    other arrays are QVariantList. Types QWebMethod does not convert
+    (including other complex types) are QString.
+  */
+QVariant QWsdlTypeTable::marker(int type) const
+{
+    if ((type < 0) || (type >= types.size()))
+        return QVariant(QString());
+
+    switch (types.at(type).kind) {
+    case Int:
+        return QVariant(int());
+    case Float:
+        return QVariant(float());
+    case Double:
+        return QVariant(double());
+    case Boolean:
+        return QVariant(true);
+    case DateTime:
+        return QVariant(QDateTime());
+    case Char:
+        return QVariant(QChar());
+    case Complex:
+        if (isArray(type)) {
+            const int item = allFields(type).first().type;
+            if (types.at(item).kind == String)
+                return QVariant(QStringList());
+            return QVariant(QVariantList());
+        }
+        return QVariant(QString());
+    case Unresolved: {
+        // Never declared: guess from the name, like .NET services do.
+        if (types.at(type).name == -1)
+            return QVariant(QString());
+        const QString name = localName(names.at(types.at(type).name));
+        if (name == QLatin1String("ArrayOfString"))
+            return QVariant(QStringList());
+        if (name.startsWith(QLatin1String("ArrayOf")))
+            return QVariant(QVariantList());
+        return QVariant(QString());
+    }
+    default:
+        return QVariant(QString());
+    }
+}
+
+/*!
+    \internal
+
+    Returns markers (see marker()) of named fields of \a type (including
+    inherited ones), by name. Empty if \a type is not complex (or is -1).
+  */
+QMap<QString, QVariant> QWsdlTypeTable::parameters(int type) const
+{
+    QMap<QString, QVariant> result;
+    if ((type < 0) || (type >= types.size()) || (types.at(type).kind != Complex))
+        return result;
+
+    foreach (const Field &field, allFields(type)) {
+        if (field.name != -1)
+            result.insert(names.at(field.name), marker(field.type));
+    }
+
+    return result;
+}
+
+/*!
+    \internal
+  */
+QWsdlImportTask::QWsdlImportTask(const QUrl &url,
+                                 QSharedPointer<const QWsdlSchemaDocument> *document,
+                                 QString *errorMessage, QSemaphore *done) :
+    m_url(url), m_document(document), m_errorMessage(errorMessage), m_done(done)
+{
+}
+
+/*!
+    \internal
+  */
+void QWsdlImportTask::run()
+{
+    QFile file(m_url.toLocalFile());
+    if (!file.open(QFile::ReadOnly)) {
+        *m_errorMessage = file.errorString();
+    } else {
+        *m_document = QWsdlPrivate::parseImport(m_url, file.readAll(), m_errorMessage);
+        if (*m_document)
+            cacheSchema(m_url, *m_document);
+    }
+
+    m_done->release();
 }
@@ -11,4 +11,5 @@ SUBDIRS += \
     QWebService \
     qtwsdlconvert \
     tests \
+    benchmarks \
     examples
@@ -0,0 +1,14 @@
+include(../../buildInfo.pri)
+
+QT += testlib
+CONFIG += console
+
+include(../../libraryIncludes.pri)
+include(../common/common.pri)
+
+TARGET = bench_qwebmethod
+DESTDIR = $${BENCHMARKS_DIRECTORY}/QWebMethod
+OBJECTS_DIR = $${BENCHMARKS_DIRECTORY}/QWebMethod
+MOC_DIR = $${BENCHMARKS_DIRECTORY}/QWebMethod
+
+SOURCES += bench_qwebmethod.cpp
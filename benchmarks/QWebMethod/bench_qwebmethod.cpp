@@ -0,0 +1,154 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService benchmark suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <qwebmethod.h>
+#include <qwebmethod_p.h>
+#include "benchmarkdata.h"
+
+Q_DECLARE_METATYPE(QWebMethod::Protocol)
+
+/*
+  Measures QWebMethod hot paths: request serialization for every protocol,
+  and reply conversion and parsing. No network connection is used -
+  reply data is injected directly.
+  */
+class BenchQWebMethod : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void prepareRequestData_data();
+    void prepareRequestData();
+    void replyRead_data();
+    void replyRead();
+    void replyReadParsed_data();
+    void replyReadParsed();
+
+private:
+    void sizeRows(const QByteArray &prefix, QWebMethod::Protocol protocol);
+};
+
+void BenchQWebMethod::sizeRows(const QByteArray &prefix,
+                               QWebMethod::Protocol protocol)
+{
+    QTest::newRow((prefix + "-small").constData()) << protocol << int(BenchmarkData::Small);
+    QTest::newRow((prefix + "-medium").constData()) << protocol << int(BenchmarkData::Medium);
+    QTest::newRow((prefix + "-large").constData()) << protocol << int(BenchmarkData::Large);
+}
+
+void BenchQWebMethod::prepareRequestData_data()
+{
+    QTest::addColumn<QWebMethod::Protocol>("protocol");
+    QTest::addColumn<int>("size");
+
+    sizeRows("soap12", QWebMethod::Soap12);
+    sizeRows("soap10", QWebMethod::Soap10);
+    sizeRows("http", QWebMethod::Http);
+    sizeRows("json", QWebMethod::Json);
+    sizeRows("xml", QWebMethod::Xml);
+}
+
+/*
+  Serialization of parameters into request body.
+  */
+void BenchQWebMethod::prepareRequestData()
+{
+    QFETCH(QWebMethod::Protocol, protocol);
+    QFETCH(int, size);
+
+    QWebMethod method(0, protocol, QWebMethod::Post);
+    method.setMethodName("benchmarkMethod");
+    method.setTargetNamespace("http://tempuri.org/");
+    method.setParameters(BenchmarkData::parameters(size));
+    QCOMPARE(method.protocol(), protocol);
+
+    QWebMethodPrivate *d = QWebMethodPrivate::get(&method);
+
+    QBENCHMARK {
+        d->prepareRequestData();
+    }
+
+    QVERIFY(!d->data.isEmpty());
+}
+
+void BenchQWebMethod::replyRead_data()
+{
+    QTest::addColumn<QWebMethod::Protocol>("protocol");
+    QTest::addColumn<int>("size");
+
+    sizeRows("soap12", QWebMethod::Soap12);
+}
+
+/*
+  Reply conversion (replyRead() and convertReplyToUtf()).
+  */
+void BenchQWebMethod::replyRead()
+{
+    QFETCH(QWebMethod::Protocol, protocol);
+    QFETCH(int, size);
+
+    QWebMethod method(0, protocol, QWebMethod::Post);
+    method.setMethodName("benchmarkMethod");
+    QWebMethodPrivate *d = QWebMethodPrivate::get(&method);
+    d->reply = BenchmarkData::soapReply(method.methodName(),
+                                        BenchmarkData::returnValues(size));
+
+    QString result;
+    QBENCHMARK {
+        result = method.replyRead();
+    }
+
+    QVERIFY(!result.isEmpty());
+    QVERIFY(!result.contains("&lt;"));
+}
+
+void BenchQWebMethod::replyReadParsed_data()
+{
+    QTest::addColumn<QWebMethod::Protocol>("protocol");
+    QTest::addColumn<int>("size");
+
+    sizeRows("soap12", QWebMethod::Soap12);
+    sizeRows("xml", QWebMethod::Xml);
+    sizeRows("http", QWebMethod::Http);
+}
+
+/*
+  Reply parsing into typed values (replyReadParsed()).
+  */
+void BenchQWebMethod::replyReadParsed()
+{
+    QFETCH(QWebMethod::Protocol, protocol);
+    QFETCH(int, size);
+
+    QWebMethod method(0, protocol, QWebMethod::Post);
+    method.setMethodName("benchmarkMethod");
+    QMap<QString, QVariant> returns = BenchmarkData::returnValues(size);
+    method.setReturnValue(returns);
+    QWebMethodPrivate *d = QWebMethodPrivate::get(&method);
+    d->reply = BenchmarkData::soapReply(method.methodName(), returns);
+
+    QVariant result;
+    QBENCHMARK {
+        result = method.replyReadParsed();
+    }
+
+    QVERIFY(result.isValid());
+}
+
+QTEST_MAIN(BenchQWebMethod)
+#include "bench_qwebmethod.moc"
@@ -0,0 +1,14 @@
+include(../../buildInfo.pri)
+
+QT += testlib
+CONFIG += console
+
+include(../../libraryIncludes.pri)
+include(../common/common.pri)
+
+TARGET = bench_qwebscheduler
+DESTDIR = $${BENCHMARKS_DIRECTORY}/QWebScheduler
+OBJECTS_DIR = $${BENCHMARKS_DIRECTORY}/QWebScheduler
+MOC_DIR = $${BENCHMARKS_DIRECTORY}/QWebScheduler
+
+SOURCES += bench_qwebscheduler.cpp
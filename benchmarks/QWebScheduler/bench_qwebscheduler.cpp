@@ -0,0 +1,188 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService benchmark suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <qwebmethod.h>
+#include <qwebservice.h>
+#include <qwebreply.h>
+#include "benchmarkdata.h"
+#include "networkconditionproxy.h"
+#include "soapstandinserver.h"
+
+#include <algorithm>
+
+/*
+  Measures latency of interactive calls made while the same QWebService
+  is saturated with bulk calls (a backlog of queued calls is kept at all
+  times). Reported result is p99 latency of interactive calls, in
+  milliseconds; p50 and bulk throughput are printed, too.
+
+  Rows compare a single FIFO queue (all calls with normal priority) with
+  priority scheduling (interactive calls in their own class). A stand-in
+  server behind a proxy adding 2 ms latency is used, in a separate
+  thread; no network connection is needed.
+  */
+class BenchQWebScheduler : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void interactiveLatency_data();
+    void interactiveLatency();
+
+private:
+    QWebMethod *method(const QString &name, QObject *parent);
+
+    QThread m_networkThread;
+    QUrl m_target;
+};
+
+void BenchQWebScheduler::initTestCase()
+{
+    SoapStandInServer *server = new SoapStandInServer;
+    QMap<QString, QVariant> returns;
+    returns.insert("bulkResult", QString(1024, QLatin1Char('x')));
+    server->addResponse("bulk", BenchmarkData::soapReply("bulk", returns));
+    returns.clear();
+    returns.insert("interactiveResult", QString("ok"));
+    server->addResponse("interactive", BenchmarkData::soapReply("interactive", returns));
+
+    NetworkConditions conditions;
+    conditions.latency = 2;
+    NetworkConditionProxy *proxy = new NetworkConditionProxy;
+    proxy->setConditions(conditions);
+
+    server->moveToThread(&m_networkThread);
+    proxy->moveToThread(&m_networkThread);
+    connect(&m_networkThread, SIGNAL(finished()), server, SLOT(deleteLater()));
+    connect(&m_networkThread, SIGNAL(finished()), proxy, SLOT(deleteLater()));
+    m_networkThread.start();
+
+    bool listening = false;
+    QMetaObject::invokeMethod(server, "start", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, listening), Q_ARG(quint16, 0));
+    QVERIFY(listening);
+
+    proxy->setTarget(server->url());
+    QMetaObject::invokeMethod(proxy, "start", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, listening), Q_ARG(quint16, 0));
+    QVERIFY(listening);
+    m_target = proxy->url();
+}
+
+void BenchQWebScheduler::cleanupTestCase()
+{
+    m_networkThread.quit();
+    m_networkThread.wait();
+}
+
+QWebMethod *BenchQWebScheduler::method(const QString &name, QObject *parent)
+{
+    QWebMethod *result = new QWebMethod(m_target, QWebMethod::Soap12,
+                                        QWebMethod::Post, parent);
+    result->setMethodName(name);
+    result->setTargetNamespace("http://tempuri.org/");
+    return result;
+}
+
+void BenchQWebScheduler::interactiveLatency_data()
+{
+    QTest::addColumn<bool>("priorities");
+
+    QTest::newRow("fifo") << false;
+    QTest::newRow("priority") << true;
+}
+
+void BenchQWebScheduler::interactiveLatency()
+{
+    QFETCH(bool, priorities);
+
+    const int concurrency = 4;
+    const int bulkBacklog = 200;
+    const int interactiveInterval = 10;
+    const int duration = 3000;
+
+    const QWebService::Priority bulkPriority =
+            priorities ? QWebService::BulkPriority : QWebService::NormalPriority;
+    const QWebService::Priority interactivePriority =
+            priorities ? QWebService::InteractivePriority : QWebService::NormalPriority;
+
+    QWebService service;
+    service.addMethod(method("bulk", &service));
+    service.addMethod(method("interactive", &service));
+    service.setAdaptiveConcurrency(true);
+    service.setConcurrencyLimits(concurrency, concurrency, concurrency);
+
+    bool running = true;
+    qint64 bulkCalls = 0;
+    connect(&service, &QWebService::replyReady,
+            [&](const QByteArray &, const QString &methodName) {
+        if (methodName != QLatin1String("bulk"))
+            return;
+        bulkCalls++;
+        if (running)
+            service.invokeMethod("bulk", QByteArray(), bulkPriority);
+    });
+
+    for (int i = 0; i < bulkBacklog; i++)
+        QVERIFY(service.invokeMethod("bulk", QByteArray(), bulkPriority));
+
+    QElapsedTimer clock;
+    clock.start();
+    QVector<qint64> latencies;
+    int outstanding = 0;
+
+    QTimer interactiveTimer;
+    connect(&interactiveTimer, &QTimer::timeout, [&]() {
+        const qint64 started = clock.nsecsElapsed();
+        QFutureWatcher<QWebReply> *watcher = new QFutureWatcher<QWebReply>(&service);
+        connect(watcher, &QFutureWatcher<QWebReply>::finished, [&, watcher, started]() {
+            latencies.append((clock.nsecsElapsed() - started) / 1000);
+            outstanding--;
+            watcher->deleteLater();
+        });
+        outstanding++;
+        watcher->setFuture(service.invokeMethodAsync("interactive", QByteArray(),
+                                                     interactivePriority));
+    });
+    interactiveTimer.start(interactiveInterval);
+
+    QTest::qWait(duration);
+    interactiveTimer.stop();
+    running = false;
+    const double seconds = double(clock.nsecsElapsed()) / 1e9;
+    const qint64 bulkDone = bulkCalls;
+
+    QTRY_COMPARE_WITH_TIMEOUT(outstanding, int(0), 60000);
+    QTRY_COMPARE_WITH_TIMEOUT(service.hostStats(m_target).inFlight, int(0), 60000);
+    QVERIFY(!latencies.isEmpty());
+
+    std::sort(latencies.begin(), latencies.end());
+    const qint64 p50 = latencies.at(latencies.size() / 2);
+    const qint64 p99 = latencies.at(qMin(latencies.size() - 1,
+                                         int(latencies.size() * 0.99)));
+
+    qDebug("%s: %d interactive calls, p50 %.2f ms, p99 %.2f ms; %.0f bulk calls/s",
+           priorities ? "priority" : "fifo", latencies.size(),
+           p50 / 1000.0, p99 / 1000.0, bulkDone / seconds);
+    QTest::setBenchmarkResult(qreal(p99) / 1000.0, QTest::WalltimeMilliseconds);
+}
+
+QTEST_MAIN(BenchQWebScheduler)
+#include "bench_qwebscheduler.moc"
@@ -0,0 +1,14 @@
+include(../../buildInfo.pri)
+
+QT += testlib
+CONFIG += console
+
+include(../../libraryIncludes.pri)
+include(../common/common.pri)
+
+TARGET = bench_qwsdl
+DESTDIR = $${BENCHMARKS_DIRECTORY}/QWsdl
+OBJECTS_DIR = $${BENCHMARKS_DIRECTORY}/QWsdl
+MOC_DIR = $${BENCHMARKS_DIRECTORY}/QWsdl
+
+SOURCES += bench_qwsdl.cpp
@@ -0,0 +1,327 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService benchmark suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <qwsdl.h>
+#include <qwsdl_p.h>
+#include "benchmarkdata.h"
+#include "processstats.h"
+
+/*
+  Measures QWsdl::parse() on synthetic WSDL files of growing size
+  (number of operations) and complexity (depth of nested types).
+  Files are written to system's temporary directory, no network
+  connection is used.
+  */
+class BenchQWsdl : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void parse_data();
+    void parse();
+    void cachedParse_data();
+    void cachedParse();
+    void sharedParse_data();
+    void sharedParse();
+    void prepareMethods_data();
+    void prepareMethods();
+    void materializeMethods_data();
+    void materializeMethods();
+    void peakMemory_data();
+    void peakMemory();
+    void scaling();
+
+private:
+    static QString wsdlFile(int operations, int depth);
+    static qint64 bestParseTime(const QString &path);
+    static void deleteMethods(QWsdl *wsdl);
+};
+
+/*
+  Writes (or reuses) synthetic WSDL file and returns its path.
+  */
+QString BenchQWsdl::wsdlFile(int operations, int depth)
+{
+    return BenchmarkData::writeTempFile(
+                QString("bench_qwsdl_%1_%2.asmx").arg(operations).arg(depth),
+                BenchmarkData::wsdl(operations, depth));
+}
+
+/*
+  Deletes web methods created so far (QWsdl does not own them).
+  */
+void BenchQWsdl::deleteMethods(QWsdl *wsdl)
+{
+    QWsdlPrivate *d = QWsdlPrivate::get(wsdl);
+    qDeleteAll(*d->methodsMap);
+    d->methodsMap->clear();
+}
+
+/*
+  Returns shortest of three full parse times of file at \a path,
+  in nanoseconds.
+  */
+qint64 BenchQWsdl::bestParseTime(const QString &path)
+{
+    qint64 best = -1;
+    QWsdl wsdl;
+    QElapsedTimer timer;
+
+    for (int i = 0; i < 3; i++) {
+        deleteMethods(&wsdl);
+        timer.start();
+        wsdl.resetWsdl(path);
+        qint64 elapsed = timer.nsecsElapsed();
+
+        if (best == -1 || elapsed < best)
+            best = elapsed;
+    }
+
+    deleteMethods(&wsdl);
+    return best;
+}
+
+void BenchQWsdl::parse_data()
+{
+    QTest::addColumn<int>("operations");
+    QTest::addColumn<int>("depth");
+
+    QTest::newRow("small") << int(5) << int(0);
+    QTest::newRow("medium") << int(100) << int(0);
+    QTest::newRow("large") << int(2000) << int(0);
+    QTest::newRow("huge") << int(10000) << int(0);
+    QTest::newRow("medium-deep") << int(100) << int(8);
+    QTest::newRow("large-deep") << int(2000) << int(8);
+}
+
+/*
+  Whole parse. Web method objects are created on first use, so none
+  are created here.
+  */
+void BenchQWsdl::parse()
+{
+    QFETCH(int, operations);
+    QFETCH(int, depth);
+
+    QString path = wsdlFile(operations, depth);
+    QVERIFY(!path.isEmpty());
+
+    QWsdl wsdl;
+    QBENCHMARK {
+        wsdl.resetWsdl(path);
+    }
+
+    QCOMPARE(wsdl.isErrorState(), bool(false));
+    QCOMPARE(wsdl.methodNames().size(), operations);
+    QFile::remove(path);
+}
+
+void BenchQWsdl::cachedParse_data()
+{
+    parse_data();
+}
+
+/*
+  Loading the model from binary cache (QWsdl::setCacheDirectory()),
+  instead of parsing. Includes hashing WSDL content, which is needed
+  to detect changes.
+  */
+void BenchQWsdl::cachedParse()
+{
+    QFETCH(int, operations);
+    QFETCH(int, depth);
+
+    QString path = wsdlFile(operations, depth);
+    QVERIFY(!path.isEmpty());
+    QTemporaryDir cache;
+    QVERIFY(cache.isValid());
+
+    QWsdl wsdl;
+    wsdl.setCacheDirectory(cache.path());
+    wsdl.resetWsdl(path);
+    QCOMPARE(wsdl.isLoadedFromCache(), bool(false));
+
+    QBENCHMARK {
+        wsdl.resetWsdl(path);
+    }
+
+    QCOMPARE(wsdl.isLoadedFromCache(), bool(true));
+    QCOMPARE(wsdl.methodNames().size(), operations);
+    QFile::remove(path);
+}
+
+void BenchQWsdl::sharedParse_data()
+{
+    parse_data();
+}
+
+/*
+  Reading WSDL which another object has already read: the model
+  is shared, not parsed again.
+  */
+void BenchQWsdl::sharedParse()
+{
+    QFETCH(int, operations);
+    QFETCH(int, depth);
+
+    QString path = wsdlFile(operations, depth);
+    QVERIFY(!path.isEmpty());
+
+    QWsdl first(path);
+    QCOMPARE(first.isErrorState(), bool(false));
+
+    QWsdl wsdl;
+    QBENCHMARK {
+        wsdl.resetWsdl(path);
+    }
+
+    QVERIFY(QWsdlPrivate::get(&wsdl)->model == QWsdlPrivate::get(&first)->model);
+    QCOMPARE(wsdl.methodNames().size(), operations);
+    QFile::remove(path);
+}
+
+void BenchQWsdl::prepareMethods_data()
+{
+    QTest::addColumn<int>("operations");
+    QTest::addColumn<int>("depth");
+
+    QTest::newRow("medium") << int(100) << int(0);
+    QTest::newRow("large") << int(2000) << int(0);
+    QTest::newRow("huge") << int(10000) << int(0);
+}
+
+/*
+  Pairing requests with responses into the operation table.
+  */
+void BenchQWsdl::prepareMethods()
+{
+    QFETCH(int, operations);
+    QFETCH(int, depth);
+
+    QString path = wsdlFile(operations, depth);
+    QVERIFY(!path.isEmpty());
+
+    QWsdl wsdl(path);
+    QCOMPARE(wsdl.isErrorState(), bool(false));
+    QWsdlPrivate *d = QWsdlPrivate::get(&wsdl);
+    // Parsed elements were moved to the shared model.
+    *d->workMethodList = d->model->elements;
+    *d->workMethodParameters = d->model->parameters;
+
+    QBENCHMARK {
+        d->prepareMethods();
+    }
+
+    QCOMPARE(wsdl.methodNames().size(), operations);
+    QFile::remove(path);
+}
+
+void BenchQWsdl::materializeMethods_data()
+{
+    prepareMethods_data();
+}
+
+/*
+  Creating QWebMethod objects of all operations (QWsdl::methods()).
+  */
+void BenchQWsdl::materializeMethods()
+{
+    QFETCH(int, operations);
+    QFETCH(int, depth);
+
+    QString path = wsdlFile(operations, depth);
+    QVERIFY(!path.isEmpty());
+
+    QWsdl wsdl(path);
+    QCOMPARE(wsdl.isErrorState(), bool(false));
+
+    QBENCHMARK {
+        deleteMethods(&wsdl);
+        wsdl.methods();
+    }
+
+    QCOMPARE(wsdl.methods()->size(), operations);
+    deleteMethods(&wsdl);
+    QFile::remove(path);
+}
+
+void BenchQWsdl::peakMemory_data()
+{
+    parse_data();
+}
+
+/*
+  Peak resident memory growth during a single parse, reported
+  in bytes. Where peak can not be reset (or read), growth of
+  current resident memory is used instead.
+  */
+void BenchQWsdl::peakMemory()
+{
+    QFETCH(int, operations);
+    QFETCH(int, depth);
+
+    QString path = wsdlFile(operations, depth);
+    QVERIFY(!path.isEmpty());
+
+    const bool peakAvailable = ProcessStats::resetPeakResidentSetSize();
+    const qint64 before = ProcessStats::residentSetSize();
+
+    QWsdl *wsdl = new QWsdl(path);
+    qint64 growth = peakAvailable ? ProcessStats::peakResidentSetSize() - before
+                                  : ProcessStats::residentSetSize() - before;
+
+    QCOMPARE(wsdl->isErrorState(), bool(false));
+    delete wsdl;
+    QFile::remove(path);
+
+    QTest::setBenchmarkResult(qreal(qMax(growth, qint64(0)) * 1024),
+                              QTest::BytesAllocated);
+}
+
+/*
+  Growth of time needed per operation, as the number of operations grows
+  eight times. Should stay (roughly) flat: quadratic pairing made it grow
+  linearly. The result is the ratio in percent (100: linear scaling);
+  compare results of two commits (run_benchmarks.sh). Fails only if time
+  per operation grows four times, far above the noise of loaded CI
+  machines, and still half way to quadratic growth (800).
+  */
+void BenchQWsdl::scaling()
+{
+    const int smallCount = 500;
+    const int largeCount = 4000;
+
+    QString smallPath = wsdlFile(smallCount, 2);
+    QString largePath = wsdlFile(largeCount, 2);
+    QVERIFY(!smallPath.isEmpty());
+    QVERIFY(!largePath.isEmpty());
+
+    const double smallPerOperation = double(bestParseTime(smallPath)) / smallCount;
+    const double largePerOperation = double(bestParseTime(largePath)) / largeCount;
+    const double ratio = largePerOperation / smallPerOperation;
+
+    QFile::remove(smallPath);
+    QFile::remove(largePath);
+
+    // QTestLib has no unitless metric.
+    QTest::setBenchmarkResult(qreal(100.0 * ratio), QTest::Events);
+    QVERIFY2(ratio < 4.0, "QWsdl::parse() scales superlinearly");
+}
+
+QTEST_MAIN(BenchQWsdl)
+#include "bench_qwsdl.moc"
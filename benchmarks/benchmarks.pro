@@ -0,0 +1,11 @@
+include(../buildInfo.pri)
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    QWebMethod \
+    QWsdl \
+    QWebScheduler \
+    soapserver \
+    netcondition \
+    loadgenerator
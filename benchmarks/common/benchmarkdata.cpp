@@ -0,0 +1,260 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService benchmark suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include "benchmarkdata.h"
+
+#include <QtCore/qdir.h>
+#include <QtCore/qfile.h>
+
+/*!
+    \class BenchmarkData
+    \brief Builds deterministic, synthetic payloads for benchmarks.
+
+    All data depends only on arguments, so results of different runs
+    (and different commits) can be compared.
+  */
+
+/*!
+    \enum BenchmarkData::Size
+
+    Standard payload sizes (number of parameters or return values).
+
+    \value Small
+           Single value.
+    \value Medium
+           A hundred values.
+    \value Large
+           Ten thousand values (a few megabytes of XML).
+  */
+
+/*!
+    Returns \a count parameters, with alternating int, double and
+    string values.
+  */
+QMap<QString, QVariant> BenchmarkData::parameters(int count)
+{
+    QMap<QString, QVariant> result;
+
+    for (int i = 0; i < count; i++) {
+        QString name = QLatin1String("param") + QString::number(i);
+
+        if (i % 3 == 0)
+            result.insert(name, QVariant(i * 7));
+        else if (i % 3 == 1)
+            result.insert(name, QVariant(i * 0.5));
+        else
+            result.insert(name, QVariant(QString(QLatin1String("value ")
+                                                 + QString::number(i))));
+    }
+
+    return result;
+}
+
+/*!
+    Returns \a count return value descriptions (names and type markers),
+    in the same form QWsdl produces them.
+  */
+QMap<QString, QVariant> BenchmarkData::returnValues(int count)
+{
+    QMap<QString, QVariant> result;
+
+    for (int i = 0; i < count; i++) {
+        QString name = QLatin1String("result") + QString::number(i);
+
+        if (i % 3 == 0)
+            result.insert(name, QVariant(int()));
+        else if (i % 3 == 1)
+            result.insert(name, QVariant(double()));
+        else
+            result.insert(name, QVariant(QString()));
+    }
+
+    return result;
+}
+
+/*!
+    Returns a SOAP 1.2 reply envelope for \a methodName, holding one element
+    for each of \a returnValues. String values contain escaped entities, so
+    that reply conversion has work to do.
+  */
+QByteArray BenchmarkData::soapReply(const QString &methodName,
+                                    const QMap<QString, QVariant> &returnValues)
+{
+    QByteArray result;
+    result.reserve(256 + returnValues.size() * 48);
+    result.append("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n"
+                  "<soap12:Envelope "
+                  "xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
+                  "xmlns:xsd=\"http://www.w3.org/2001/XMLSchema\" "
+                  "xmlns:soap12=\"http://www.w3.org/2003/05/soap-envelope\">\r\n"
+                  "  <soap12:Body>\r\n    <");
+    result.append(methodName.toUtf8());
+    result.append("Response xmlns=\"http://tempuri.org/\">\r\n");
+
+    int i = 0;
+    QMap<QString, QVariant>::const_iterator it = returnValues.constBegin();
+    for (; it != returnValues.constEnd(); ++it, ++i) {
+        const QByteArray name = it.key().toUtf8();
+        result.append("      <");
+        result.append(name);
+        result.append('>');
+
+        if (it.value().type() == QVariant::Int)
+            result.append(QByteArray::number(i * 7));
+        else if (it.value().type() == QVariant::Double)
+            result.append(QByteArray::number(i * 0.5));
+        else
+            result.append("value &lt;" + QByteArray::number(i) + "&gt;");
+
+        result.append("</");
+        result.append(name);
+        result.append(">\r\n");
+    }
+
+    result.append("    </");
+    result.append(methodName.toUtf8());
+    result.append("Response>\r\n  </soap12:Body>\r\n</soap12:Envelope>");
+    return result;
+}
+
+/*!
+    Returns a WSDL document with \a operationCount operations
+    (named "operation0", "operation1"...), each taking three parameters
+    and returning one value. Service address is set to \a hostUrl.
+
+    If \a typeDepth is greater than 0, every operation takes a fourth,
+    "payload" parameter of its own complex type, nested \a typeDepth
+    levels deep (each level holds two simple fields and the next level).
+
+    Layout follows documents generated by ASP.NET, which QWsdl is tested
+    against (see examples/wsdl).
+  */
+QByteArray BenchmarkData::wsdl(int operationCount, int typeDepth,
+                                const QString &hostUrl)
+{
+    QByteArray types, complexTypes, messages, ports, bindings;
+
+    for (int i = 0; i < operationCount; i++) {
+        const QByteArray op = "operation" + QByteArray::number(i);
+
+        types.append("      <s:element name=\"" + op + "\">\n"
+                     "        <s:complexType>\n"
+                     "          <s:sequence>\n"
+                     "            <s:element minOccurs=\"1\" maxOccurs=\"1\" name=\"id\" type=\"s:int\" />\n"
+                     "            <s:element minOccurs=\"0\" maxOccurs=\"1\" name=\"name\" type=\"s:string\" />\n"
+                     "            <s:element minOccurs=\"1\" maxOccurs=\"1\" name=\"price\" type=\"s:double\" />\n");
+        if (typeDepth > 0)
+            types.append("            <s:element minOccurs=\"0\" maxOccurs=\"1\" name=\"payload\" type=\"tns:" + op + "Type1\" />\n");
+        types.append("          </s:sequence>\n"
+                     "        </s:complexType>\n"
+                     "      </s:element>\n"
+                     "      <s:element name=\"" + op + "Response\">\n"
+                     "        <s:complexType>\n"
+                     "          <s:sequence>\n"
+                     "            <s:element minOccurs=\"0\" maxOccurs=\"1\" name=\"" + op + "Result\" type=\"s:string\" />\n"
+                     "          </s:sequence>\n"
+                     "        </s:complexType>\n"
+                     "      </s:element>\n");
+
+        for (int level = 1; level <= typeDepth; level++) {
+            complexTypes.append("      <s:complexType name=\"" + op + "Type" + QByteArray::number(level) + "\">\n"
+                                "        <s:sequence>\n"
+                                "          <s:element minOccurs=\"1\" maxOccurs=\"1\" name=\"id\" type=\"s:int\" />\n"
+                                "          <s:element minOccurs=\"0\" maxOccurs=\"1\" name=\"label\" type=\"s:string\" />\n");
+            if (level < typeDepth)
+                complexTypes.append("          <s:element minOccurs=\"0\" maxOccurs=\"1\" name=\"child\" type=\"tns:" + op + "Type" + QByteArray::number(level + 1) + "\" />\n");
+            complexTypes.append("        </s:sequence>\n"
+                                "      </s:complexType>\n");
+        }
+
+        messages.append("  <wsdl:message name=\"" + op + "SoapIn\">\n"
+                        "    <wsdl:part name=\"parameters\" element=\"tns:" + op + "\" />\n"
+                        "  </wsdl:message>\n"
+                        "  <wsdl:message name=\"" + op + "SoapOut\">\n"
+                        "    <wsdl:part name=\"parameters\" element=\"tns:" + op + "Response\" />\n"
+                        "  </wsdl:message>\n");
+        ports.append("    <wsdl:operation name=\"" + op + "\">\n"
+                     "      <wsdl:input message=\"tns:" + op + "SoapIn\" />\n"
+                     "      <wsdl:output message=\"tns:" + op + "SoapOut\" />\n"
+                     "    </wsdl:operation>\n");
+        bindings.append("    <wsdl:operation name=\"" + op + "\">\n"
+                        "      <soap12:operation soapAction=\"http://tempuri.org/" + op + "\" style=\"document\" />\n"
+                        "      <wsdl:input>\n"
+                        "        <soap12:body use=\"literal\" />\n"
+                        "      </wsdl:input>\n"
+                        "      <wsdl:output>\n"
+                        "        <soap12:body use=\"literal\" />\n"
+                        "      </wsdl:output>\n"
+                        "    </wsdl:operation>\n");
+    }
+
+    QByteArray result;
+    result.reserve(types.size() + complexTypes.size() + messages.size()
+                   + ports.size() + bindings.size() + 2048);
+    result.append("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                  "<wsdl:definitions "
+                  "xmlns:soap=\"http://schemas.xmlsoap.org/wsdl/soap/\" "
+                  "xmlns:tns=\"http://tempuri.org/\" "
+                  "xmlns:s=\"http://www.w3.org/2001/XMLSchema\" "
+                  "xmlns:soap12=\"http://schemas.xmlsoap.org/wsdl/soap12/\" "
+                  "targetNamespace=\"http://tempuri.org/\" "
+                  "xmlns:wsdl=\"http://schemas.xmlsoap.org/wsdl/\">\n"
+                  "  <wsdl:types>\n"
+                  "    <s:schema elementFormDefault=\"qualified\" "
+                  "targetNamespace=\"http://tempuri.org/\">\n");
+    result.append(types);
+    result.append(complexTypes);
+    result.append("    </s:schema>\n"
+                  "  </wsdl:types>\n");
+    result.append(messages);
+    result.append("  <wsdl:portType name=\"syntheticSoap12\">\n");
+    result.append(ports);
+    result.append("  </wsdl:portType>\n"
+                  "  <wsdl:binding name=\"syntheticSoap12\" type=\"tns:syntheticSoap12\">\n"
+                  "    <soap12:binding transport=\"http://schemas.xmlsoap.org/soap/http\" />\n");
+    result.append(bindings);
+    result.append("  </wsdl:binding>\n"
+                  "  <wsdl:service name=\"synthetic\">\n"
+                  "    <wsdl:port name=\"syntheticSoap12\" binding=\"tns:syntheticSoap12\">\n"
+                  "      <soap12:address location=\"");
+    result.append(hostUrl.toUtf8());
+    result.append("\" />\n"
+                  "    </wsdl:port>\n"
+                  "  </wsdl:service>\n"
+                  "</wsdl:definitions>\n");
+    return result;
+}
+
+/*!
+    Writes \a contents into a file called \a fileName in system's temporary
+    directory. Returns the absolute path of that file, or empty string
+    on failure.
+  */
+QString BenchmarkData::writeTempFile(const QString &fileName,
+                                     const QByteArray &contents)
+{
+    QString path = QDir::temp().absoluteFilePath(fileName);
+    QFile file(path);
+
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+        return QString();
+
+    if (file.write(contents) != contents.size())
+        return QString();
+
+    return path;
+}
@@ -0,0 +1,50 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService benchmark suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#ifndef BENCHMARKDATA_H
+#define BENCHMARKDATA_H
+
+#include <QtCore/qbytearray.h>
+#include <QtCore/qmap.h>
+#include <QtCore/qstring.h>
+#include <QtCore/qvariant.h>
+
+class BenchmarkData
+{
+public:
+    enum Size
+    {
+        Small   = 1,
+        Medium  = 100,
+        Large   = 10000
+    };
+
+    static QMap<QString, QVariant> parameters(int count);
+    static QMap<QString, QVariant> returnValues(int count);
+    static QByteArray soapReply(const QString &methodName,
+                                const QMap<QString, QVariant> &returnValues);
+    static QByteArray wsdl(int operationCount, int typeDepth = 0,
+                           const QString &hostUrl
+                           = QLatin1String("http://127.0.0.1:8080/synthetic.asmx"));
+    static QString writeTempFile(const QString &fileName,
+                                 const QByteArray &contents);
+
+private:
+    BenchmarkData() {}
+};
+
+#endif // BENCHMARKDATA_H
@@ -0,0 +1,15 @@
+# Helpers shared by benchmarks (and usable by tests): synthetic payloads
+# and WSDL documents, process statistics, stand-in SOAP server and network
+# condition simulating proxy.
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+SOURCES += $$PWD/benchmarkdata.cpp \
+    $$PWD/networkconditionproxy.cpp \
+    $$PWD/processstats.cpp \
+    $$PWD/soapstandinserver.cpp
+
+HEADERS += $$PWD/benchmarkdata.h \
+    $$PWD/networkconditionproxy.h \
+    $$PWD/processstats.h \
+    $$PWD/soapstandinserver.h
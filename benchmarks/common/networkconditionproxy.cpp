@@ -0,0 +1,445 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService benchmark suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#include "networkconditionproxy.h"
+
+#include <QtCore/qcommandlineparser.h>
+
+/*!
+    \class NetworkConditions
+    \brief Describes network conditions simulated by NetworkConditionProxy.
+
+    Default values describe a perfect network (no delay, no limits).
+  */
+
+NetworkConditions::NetworkConditions() :
+    latency(0), jitter(0), bandwidth(0), resetProbability(0),
+    dripBytes(0), dripInterval(0), seed(1)
+{
+}
+
+/*!
+    Returns true if these conditions do not alter the traffic.
+  */
+bool NetworkConditions::isNeutral() const
+{
+    return (latency == 0) && (jitter == 0) && (bandwidth == 0)
+            && (resetProbability <= 0) && (dripBytes == 0);
+}
+
+/*!
+    Returns a short, human readable description.
+  */
+QString NetworkConditions::toString() const
+{
+    return QString::fromLatin1("latency %1 ms, jitter %2 ms, bandwidth %3, "
+                               "reset probability %4, drip %5 B / %6 ms")
+            .arg(latency).arg(jitter)
+            .arg(bandwidth > 0 ? QString::number(bandwidth / 1024)
+                                 + QLatin1String(" kB/s")
+                               : QString::fromLatin1("unlimited"))
+            .arg(resetProbability).arg(dripBytes).arg(dripInterval);
+}
+
+/*!
+    Adds options describing network conditions to \a parser, so that
+    all tools using the proxy accept the same arguments.
+
+    \sa fromCommandLine()
+  */
+void NetworkConditions::addCommandLineOptions(QCommandLineParser *parser)
+{
+    parser->addOption(QCommandLineOption(QLatin1String("latency"),
+        QLatin1String("Delay added in each direction, in milliseconds."),
+        QLatin1String("ms"), QLatin1String("0")));
+    parser->addOption(QCommandLineOption(QLatin1String("jitter"),
+        QLatin1String("Maximum random deviation from latency, in milliseconds."),
+        QLatin1String("ms"), QLatin1String("0")));
+    parser->addOption(QCommandLineOption(QLatin1String("bandwidth"),
+        QLatin1String("Bandwidth limit per connection and direction, in kB/s (0: unlimited)."),
+        QLatin1String("kBps"), QLatin1String("0")));
+    parser->addOption(QCommandLineOption(QLatin1String("reset-probability"),
+        QLatin1String("Probability (0-1) of resetting connection on each piece of reply data."),
+        QLatin1String("p"), QLatin1String("0")));
+    parser->addOption(QCommandLineOption(QLatin1String("drip-bytes"),
+        QLatin1String("Deliver replies this many bytes at a time (0: off)."),
+        QLatin1String("bytes"), QLatin1String("0")));
+    parser->addOption(QCommandLineOption(QLatin1String("drip-interval"),
+        QLatin1String("Interval between reply pieces when dripping, in milliseconds."),
+        QLatin1String("ms"), QLatin1String("10")));
+    parser->addOption(QCommandLineOption(QLatin1String("seed"),
+        QLatin1String("Seed of random jitter and resets."),
+        QLatin1String("seed"), QLatin1String("1")));
+}
+
+/*!
+    Reads conditions from \a parser, which has to be prepared with
+    addCommandLineOptions() and processed.
+  */
+NetworkConditions NetworkConditions::fromCommandLine(const QCommandLineParser &parser)
+{
+    NetworkConditions result;
+    result.latency = parser.value(QLatin1String("latency")).toInt();
+    result.jitter = parser.value(QLatin1String("jitter")).toInt();
+    result.bandwidth = parser.value(QLatin1String("bandwidth")).toLongLong() * 1024;
+    result.resetProbability = parser.value(QLatin1String("reset-probability")).toDouble();
+    result.dripBytes = parser.value(QLatin1String("drip-bytes")).toInt();
+    result.dripInterval = parser.value(QLatin1String("drip-interval")).toInt();
+    result.seed = parser.value(QLatin1String("seed")).toUInt();
+    return result;
+}
+
+/*!
+    \class NetworkConditionProxy
+    \brief TCP proxy simulating a slow or unreliable network.
+
+    Every accepted connection is forwarded to target(). Data travelling
+    in both directions is delayed by latency (plus random jitter, without
+    reordering) and limited to given bandwidth. Replies (data coming from
+    the target) can additionally be dripped in small pieces, or
+    the connection can be reset at random.
+
+    Like SoapStandInServer, the proxy can be moved to another thread,
+    provided that start() is invoked in that thread.
+  */
+
+/*!
+    Constructs the proxy using \a parent.
+  */
+NetworkConditionProxy::NetworkConditionProxy(QObject *parent) :
+    QTcpServer(parent), m_random(1), m_connectionCount(0), m_resetCount(0)
+{
+}
+
+/*!
+    Sets the address (host and port) connections are forwarded to.
+  */
+void NetworkConditionProxy::setTarget(const QUrl &target)
+{
+    m_target = target;
+}
+
+/*!
+    Returns the address connections are forwarded to.
+  */
+QUrl NetworkConditionProxy::target() const
+{
+    return m_target;
+}
+
+/*!
+    Returns target() URL, with host and port replaced by those
+    of the proxy. Valid after start().
+  */
+QUrl NetworkConditionProxy::url() const
+{
+    QUrl result = m_target;
+    result.setHost(QLatin1String("127.0.0.1"));
+    result.setPort(serverPort());
+    return result;
+}
+
+/*!
+    Sets \a conditions for connections accepted from now on.
+  */
+void NetworkConditionProxy::setConditions(const NetworkConditions &conditions)
+{
+    m_conditions = conditions;
+    m_random.seed(conditions.seed);
+}
+
+/*!
+    Returns current conditions.
+  */
+NetworkConditions NetworkConditionProxy::conditions() const
+{
+    return m_conditions;
+}
+
+/*!
+    Returns number of connections accepted so far. Thread-safe.
+  */
+int NetworkConditionProxy::connectionCount() const
+{
+    return m_connectionCount.loadAcquire();
+}
+
+/*!
+    Returns number of connections reset on purpose so far. Thread-safe.
+  */
+int NetworkConditionProxy::resetCount() const
+{
+    return m_resetCount.loadAcquire();
+}
+
+/*!
+    Starts listening on loopback interface, on \a port (0 means: any free
+    port). Returns true on success.
+  */
+bool NetworkConditionProxy::start(quint16 port)
+{
+    return listen(QHostAddress::LocalHost, port);
+}
+
+/*!
+    \internal
+  */
+void NetworkConditionProxy::incomingConnection(qintptr socketDescriptor)
+{
+    QTcpSocket *client = new QTcpSocket;
+    if (!client->setSocketDescriptor(socketDescriptor)) {
+        delete client;
+        return;
+    }
+
+    m_connectionCount.fetchAndAddRelaxed(1);
+    new ConditionedConnection(client, this);
+}
+
+/*!
+    \internal
+
+    Takes ownership of \a client, and connects to target of \a proxy.
+  */
+ConditionedConnection::ConditionedConnection(QTcpSocket *client,
+                                             NetworkConditionProxy *proxy) :
+    QObject(proxy), m_proxy(proxy), m_conditions(proxy->conditions()),
+    m_client(client), m_server(new QTcpSocket(this)), m_reset(false)
+{
+    m_clock.start();
+    m_client->setParent(this);
+    m_client->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+    m_up.source = m_client;
+    m_up.sink = m_server;
+    m_down.source = m_server;
+    m_down.sink = m_client;
+    m_down.drip = (m_conditions.dripBytes > 0);
+
+    m_up.timer.setSingleShot(true);
+    m_up.timer.setTimerType(Qt::PreciseTimer);
+    m_down.timer.setSingleShot(true);
+    m_down.timer.setTimerType(Qt::PreciseTimer);
+
+    connect(&m_up.timer, SIGNAL(timeout()), this, SLOT(sendToServer()));
+    connect(&m_down.timer, SIGNAL(timeout()), this, SLOT(sendToClient()));
+    connect(m_client, SIGNAL(readyRead()), this, SLOT(readClient()));
+    connect(m_server, SIGNAL(readyRead()), this, SLOT(readServer()));
+    connect(m_client, SIGNAL(disconnected()), this, SLOT(sourceClosed()));
+    connect(m_server, SIGNAL(disconnected()), this, SLOT(sourceClosed()));
+    connect(m_server, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SLOT(sourceClosed()));
+
+    m_server->connectToHost(m_proxy->target().host(),
+                            quint16(m_proxy->target().port(80)));
+    m_server->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+    // Data might have arrived before the connection was wrapped.
+    if (m_client->bytesAvailable() > 0)
+        readClient();
+}
+
+/*!
+    \internal
+  */
+void ConditionedConnection::readClient()
+{
+    enqueue(m_up);
+}
+
+/*!
+    \internal
+
+    Resets the connection at random, or queues reply data.
+  */
+void ConditionedConnection::readServer()
+{
+    if (m_reset)
+        return;
+
+    if (m_conditions.resetProbability > 0
+            && m_proxy->m_random.generateDouble() < m_conditions.resetProbability) {
+        reset();
+        return;
+    }
+
+    enqueue(m_down);
+}
+
+/*!
+    \internal
+  */
+void ConditionedConnection::sendToServer()
+{
+    pump(m_up);
+}
+
+/*!
+    \internal
+  */
+void ConditionedConnection::sendToClient()
+{
+    pump(m_down);
+}
+
+/*!
+    \internal
+
+    Called when either socket is closed (or fails to connect). Data
+    already read from it is still delivered, then the other side is
+    closed, too. Data travelling towards closed socket is dropped.
+  */
+void ConditionedConnection::sourceClosed()
+{
+    if (m_reset)
+        return;
+
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    Direction &from = (socket == m_client) ? m_up : m_down;
+    Direction &to = (socket == m_client) ? m_down : m_up;
+
+    if (!from.sourceClosed) {
+        from.sourceClosed = true;
+        enqueue(from);
+        to.queue.clear();
+        to.timer.stop();
+        pump(from);
+    }
+
+    deleteIfClosed();
+}
+
+/*!
+    \internal
+
+    Reads available data from \a direction's source, and schedules its
+    delivery.
+  */
+void ConditionedConnection::enqueue(Direction &direction)
+{
+    if (m_reset)
+        return;
+
+    Chunk chunk;
+    chunk.data = direction.source->readAll();
+    if (chunk.data.isEmpty())
+        return;
+
+    qint64 delay = m_conditions.latency;
+    if (m_conditions.jitter > 0) {
+        delay += int(m_proxy->m_random.bounded(2 * m_conditions.jitter + 1))
+                - m_conditions.jitter;
+    }
+
+    // Never reorder: a chunk is not due before the previous one.
+    chunk.due = qMax(direction.lastDue, m_clock.elapsed() + qMax(delay, qint64(0)));
+    direction.lastDue = chunk.due;
+    direction.queue.enqueue(chunk);
+
+    if (!direction.timer.isActive())
+        pump(direction);
+}
+
+/*!
+    \internal
+
+    Writes all due data allowed by bandwidth and drip settings to
+    \a direction's sink, and schedules next delivery.
+  */
+void ConditionedConnection::pump(Direction &direction)
+{
+    const qint64 now = m_clock.elapsed();
+    const qint64 bandwidth = m_conditions.bandwidth;
+    qint64 wakeUp = -1;
+
+    if (bandwidth > 0) {
+        // Bursts are limited to 100 ms worth of data.
+        const double burst = qMax(bandwidth / 10.0, 1.0);
+        direction.tokens = qMin(burst, direction.tokens
+                                + (now - direction.lastRefill) * bandwidth / 1000.0);
+        direction.lastRefill = now;
+    }
+
+    while (!direction.queue.isEmpty()) {
+        Chunk &chunk = direction.queue.head();
+        const qint64 due = direction.drip ? qMax(chunk.due, direction.nextDrip)
+                                          : chunk.due;
+        if (due > now) {
+            wakeUp = due;
+            break;
+        }
+
+        int size = chunk.data.size();
+        if (direction.drip)
+            size = qMin(size, m_conditions.dripBytes);
+
+        if (bandwidth > 0) {
+            // Avoid writing tiny pieces: wait for 10 ms worth of data.
+            const double needed = qMin(double(size), qMax(bandwidth / 100.0, 1.0));
+            if (direction.tokens < needed) {
+                wakeUp = now + qMax(qint64(1), qint64((needed - direction.tokens)
+                                                      * 1000 / bandwidth));
+                break;
+            }
+            size = qMin(size, int(direction.tokens));
+            direction.tokens -= size;
+        }
+
+        direction.sink->write(chunk.data.constData(), size);
+
+        if (size == chunk.data.size())
+            direction.queue.dequeue();
+        else
+            chunk.data.remove(0, size);
+
+        if (direction.drip)
+            direction.nextDrip = now + m_conditions.dripInterval;
+    }
+
+    if (wakeUp != -1)
+        direction.timer.start(int(wakeUp - now));
+    else if (direction.sourceClosed
+             && direction.sink->state() != QAbstractSocket::UnconnectedState)
+        direction.sink->disconnectFromHost();
+}
+
+/*!
+    \internal
+
+    Drops both sockets, as a broken network would.
+  */
+void ConditionedConnection::reset()
+{
+    m_reset = true;
+    m_up.timer.stop();
+    m_down.timer.stop();
+    m_proxy->m_resetCount.fetchAndAddRelaxed(1);
+    m_client->abort();
+    m_server->abort();
+    deleteLater();
+}
+
+/*!
+    \internal
+  */
+void ConditionedConnection::deleteIfClosed()
+{
+    if (m_client->state() == QAbstractSocket::UnconnectedState
+            && m_server->state() == QAbstractSocket::UnconnectedState)
+        deleteLater();
+}
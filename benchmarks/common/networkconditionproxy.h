@@ -0,0 +1,150 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService benchmark suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#ifndef NETWORKCONDITIONPROXY_H
+#define NETWORKCONDITIONPROXY_H
+
+#include <QtCore/qatomic.h>
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qqueue.h>
+#include <QtCore/qrandom.h>
+#include <QtCore/qtimer.h>
+#include <QtCore/qurl.h>
+#include <QtNetwork/qtcpserver.h>
+#include <QtNetwork/qtcpsocket.h>
+
+class QCommandLineParser;
+
+struct NetworkConditions
+{
+    NetworkConditions();
+
+    bool isNeutral() const;
+    QString toString() const;
+
+    static void addCommandLineOptions(QCommandLineParser *parser);
+    static NetworkConditions fromCommandLine(const QCommandLineParser &parser);
+
+    // Delay added in each direction, in milliseconds.
+    int latency;
+    // Maximum random deviation from latency, in milliseconds.
+    int jitter;
+    // Bytes per second, in each direction of each connection. 0: unlimited.
+    qint64 bandwidth;
+    // Probability (0..1) of resetting the connection, checked
+    // whenever a piece of reply data arrives from the server.
+    double resetProbability;
+    // If set, replies are delivered dripBytes at a time,
+    // every dripInterval milliseconds.
+    int dripBytes;
+    int dripInterval;
+    quint32 seed;
+};
+
+class ConditionedConnection;
+
+class NetworkConditionProxy : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    explicit NetworkConditionProxy(QObject *parent = 0);
+
+    void setTarget(const QUrl &target);
+    QUrl target() const;
+    QUrl url() const;
+
+    void setConditions(const NetworkConditions &conditions);
+    NetworkConditions conditions() const;
+
+    int connectionCount() const;
+    int resetCount() const;
+
+    Q_INVOKABLE bool start(quint16 port = 0);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor);
+
+private:
+    friend class ConditionedConnection;
+
+    QUrl m_target;
+    NetworkConditions m_conditions;
+    QRandomGenerator m_random;
+    QAtomicInt m_connectionCount;
+    QAtomicInt m_resetCount;
+};
+
+/*
+  Internal: one proxied connection (client socket and server socket),
+  with a delivery queue for each direction.
+  */
+class ConditionedConnection : public QObject
+{
+    Q_OBJECT
+
+public:
+    ConditionedConnection(QTcpSocket *client, NetworkConditionProxy *proxy);
+
+private slots:
+    void readClient();
+    void readServer();
+    void sendToServer();
+    void sendToClient();
+    void sourceClosed();
+
+private:
+    struct Chunk
+    {
+        qint64 due;
+        QByteArray data;
+    };
+
+    struct Direction
+    {
+        Direction() : source(0), sink(0), tokens(0), lastRefill(0),
+            lastDue(0), nextDrip(0), drip(false), sourceClosed(false) {}
+
+        QTcpSocket *source;
+        QTcpSocket *sink;
+        QQueue<Chunk> queue;
+        QTimer timer;
+        double tokens;
+        qint64 lastRefill;
+        qint64 lastDue;
+        qint64 nextDrip;
+        bool drip;
+        bool sourceClosed;
+    };
+
+    void enqueue(Direction &direction);
+    void pump(Direction &direction);
+    void reset();
+    void deleteIfClosed();
+
+    NetworkConditionProxy *m_proxy;
+    NetworkConditions m_conditions;
+    QElapsedTimer m_clock;
+    QTcpSocket *m_client;
+    QTcpSocket *m_server;
+    Direction m_up;
+    Direction m_down;
+    bool m_reset;
+};
+
+#endif // NETWORKCONDITIONPROXY_H
@@ -0,0 +1,133 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService benchmark suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#include "processstats.h"
+
+#include <QtCore/qfile.h>
+#include <QtCore/qlist.h>
+
+#ifdef Q_OS_UNIX
+#include <pthread.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+/*!
+    \class ProcessStats
+    \brief Reads memory and CPU usage of current process.
+
+    Memory is reported in kilobytes, CPU time in microseconds.
+    On platforms where a value can not be determined, 0 is returned.
+    Memory functions are currently implemented for Linux only.
+  */
+
+/*!
+    Returns current resident set size.
+  */
+qint64 ProcessStats::residentSetSize()
+{
+#ifdef Q_OS_LINUX
+    QFile statm(QLatin1String("/proc/self/statm"));
+    if (!statm.open(QFile::ReadOnly))
+        return 0;
+
+    QList<QByteArray> fields = statm.readAll().split(' ');
+    return fields.value(1).toLongLong() * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+    return 0;
+#endif
+}
+
+/*!
+    Returns peak resident set size ("high water mark") since the start
+    of the process, or since last resetPeakResidentSetSize().
+  */
+qint64 ProcessStats::peakResidentSetSize()
+{
+#ifdef Q_OS_LINUX
+    QFile status(QLatin1String("/proc/self/status"));
+    if (!status.open(QFile::ReadOnly))
+        return 0;
+
+    foreach (const QByteArray &line, status.readAll().split('\n')) {
+        if (line.startsWith("VmHWM:"))
+            return line.mid(6).trimmed().split(' ').value(0).toLongLong();
+    }
+    return 0;
+#else
+    return 0;
+#endif
+}
+
+/*!
+    Resets peak resident set size to current one. Returns false if that
+    is not supported (in that case, peak is measured since the start
+    of the process).
+  */
+bool ProcessStats::resetPeakResidentSetSize()
+{
+#ifdef Q_OS_LINUX
+    QFile clearRefs(QLatin1String("/proc/self/clear_refs"));
+    if (!clearRefs.open(QFile::WriteOnly))
+        return false;
+
+    return clearRefs.write("5") == 1;
+#else
+    return false;
+#endif
+}
+
+/*!
+    Returns CPU time (user and system) used by this process so far.
+  */
+qint64 ProcessStats::cpuTime()
+{
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+    return qint64(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+            + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#else
+    return 0;
+#endif
+}
+
+/*!
+    Returns CPU time used so far by \a thread (as returned by
+    QThread::currentThreadId()) of this process.
+  */
+qint64 ProcessStats::threadCpuTime(Qt::HANDLE thread)
+{
+#if defined(Q_OS_UNIX) && defined(_POSIX_THREAD_CPUTIME) && (_POSIX_THREAD_CPUTIME >= 0)
+    clockid_t clock;
+    if (pthread_getcpuclockid(reinterpret_cast<pthread_t>(thread), &clock) != 0)
+        return 0;
+
+    struct timespec time;
+    if (clock_gettime(clock, &time) != 0)
+        return 0;
+
+    return qint64(time.tv_sec) * 1000000 + time.tv_nsec / 1000;
+#else
+    Q_UNUSED(thread);
+    return 0;
+#endif
+}
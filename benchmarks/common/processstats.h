@@ -0,0 +1,37 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService benchmark suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#ifndef PROCESSSTATS_H
+#define PROCESSSTATS_H
+
+#include <QtCore/qglobal.h>
+
+class ProcessStats
+{
+public:
+    static qint64 residentSetSize();
+    static qint64 peakResidentSetSize();
+    static bool resetPeakResidentSetSize();
+    static qint64 cpuTime();
+    static qint64 threadCpuTime(Qt::HANDLE thread);
+
+private:
+    ProcessStats() {}
+};
+
+#endif // PROCESSSTATS_H
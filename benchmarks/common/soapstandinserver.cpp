@@ -0,0 +1,361 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService benchmark suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include "soapstandinserver.h"
+#include "benchmarkdata.h"
+
+#include <QtCore/qcryptographichash.h>
+#include <QtCore/qfile.h>
+#include <qwsdl.h>
+
+/*!
+    \class SoapStandInServer
+    \brief Minimal HTTP/1.1 server answering SOAP calls with canned replies.
+
+    Stands in for a real web service in end-to-end benchmarks and tests.
+    Replies are generated from WSDL files (addWsdl()) - every operation
+    gets a SOAP 1.2 envelope holding its return values - or can be set
+    manually using addResponse(). Keep-alive connections and pipelined
+    requests are supported. GET requests ending with "?wsdl" are answered
+    with the last WSDL document added, along with its ETag; conditional
+    requests (If-None-Match) for unchanged WSDL get 304 Not Modified.
+    Other documents (for example, imported schemas) can be served with
+    addDocument(), the same way.
+
+    Server can be moved to a separate thread. In that case, start() has
+    to be invoked in that thread, for example:
+    \code
+    QMetaObject::invokeMethod(server, "start", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, ok));
+    \endcode
+  */
+
+/*!
+    Constructs the server using \a parent. Server does not listen until
+    start() is called.
+  */
+SoapStandInServer::SoapStandInServer(QObject *parent) :
+    QTcpServer(parent), m_requestCount(0)
+{
+}
+
+/*!
+    Reads \a wsdlFile and prepares canned replies for all its operations.
+    Returns false if the file could not be parsed.
+  */
+bool SoapStandInServer::addWsdl(const QString &wsdlFile)
+{
+    QWsdl wsdl(wsdlFile);
+    if (wsdl.isErrorState())
+        return false;
+
+    QMap<QString, QWebMethod *> *methods = wsdl.methods();
+    foreach (const QString &name, methods->keys()) {
+        addResponse(name, BenchmarkData::soapReply(
+                        name, methods->value(name)->returnValueNameType()));
+    }
+    qDeleteAll(*methods);
+
+    QFile file(wsdlFile);
+    if (file.open(QFile::ReadOnly)) {
+        m_wsdl = file.readAll();
+        m_wsdlETag = entityTag(m_wsdl);
+    }
+
+    return true;
+}
+
+/*!
+    Makes GET requests for \a path (for example, "/types.xsd") return
+    \a content. Adding other content for the same path replaces it (and
+    changes its ETag).
+  */
+void SoapStandInServer::addDocument(const QString &path, const QByteArray &content)
+{
+    m_documents.insert(path.toLatin1().toLower(), content);
+}
+
+/*!
+    Sets SOAP reply \a body for calls to \a methodName.
+  */
+void SoapStandInServer::addResponse(const QString &methodName,
+                                    const QByteArray &body)
+{
+    m_responses.insert(methodName.toUtf8(), body);
+}
+
+/*!
+    Returns names of methods this server can answer.
+  */
+QStringList SoapStandInServer::methodNames() const
+{
+    QStringList result;
+    foreach (const QByteArray &name, m_responses.keys())
+        result.append(QString::fromUtf8(name));
+    result.sort();
+    return result;
+}
+
+/*!
+    Returns URL of the server (valid after start()).
+  */
+QUrl SoapStandInServer::url() const
+{
+    QUrl result;
+    result.setScheme(QLatin1String("http"));
+    result.setHost(QLatin1String("127.0.0.1"));
+    result.setPort(serverPort());
+    result.setPath(QLatin1String("/standin.asmx"));
+    return result;
+}
+
+/*!
+    Returns number of requests answered so far. Thread-safe.
+  */
+int SoapStandInServer::requestCount() const
+{
+    return m_requestCount.loadAcquire();
+}
+
+/*!
+    Starts listening on loopback interface, on \a port (0 means: any free
+    port). Returns true on success.
+  */
+bool SoapStandInServer::start(quint16 port)
+{
+    return listen(QHostAddress::LocalHost, port);
+}
+
+/*!
+    \internal
+  */
+void SoapStandInServer::incomingConnection(qintptr socketDescriptor)
+{
+    QTcpSocket *socket = new QTcpSocket(this);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        delete socket;
+        return;
+    }
+
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    m_buffers.insert(socket, QByteArray());
+    connect(socket, SIGNAL(readyRead()), this, SLOT(readClient()));
+    connect(socket, SIGNAL(disconnected()), this, SLOT(discardClient()));
+}
+
+/*!
+    \internal
+
+    Reads all complete requests available on the sending socket,
+    and answers them in order.
+  */
+void SoapStandInServer::readClient()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket)
+        return;
+
+    QByteArray &buffer = m_buffers[socket];
+    buffer.append(socket->readAll());
+
+    forever {
+        int headerEnd = buffer.indexOf("\r\n\r\n");
+        if (headerEnd == -1)
+            return;
+
+        QList<QByteArray> headerLines = buffer.left(headerEnd).split('\n');
+        QByteArray requestLine = headerLines.takeFirst().trimmed();
+        QByteArray ifNoneMatch;
+        int contentLength = 0;
+        bool closeAfter = false;
+
+        foreach (const QByteArray &line, headerLines) {
+            int colon = line.indexOf(':');
+            if (colon == -1)
+                continue;
+
+            QByteArray name = line.left(colon).trimmed().toLower();
+            QByteArray value = line.mid(colon + 1).trimmed();
+
+            if (name == "content-length")
+                contentLength = value.toInt();
+            else if (name == "connection" && value.toLower() == "close")
+                closeAfter = true;
+            else if (name == "if-none-match")
+                ifNoneMatch = value;
+        }
+
+        int requestSize = headerEnd + 4 + contentLength;
+        if (buffer.size() < requestSize)
+            return;
+
+        QByteArray body = buffer.mid(headerEnd + 4, contentLength);
+        buffer.remove(0, requestSize);
+
+        socket->write(handleRequest(requestLine, ifNoneMatch, body));
+        m_requestCount.fetchAndAddRelaxed(1);
+
+        if (closeAfter) {
+            socket->disconnectFromHost();
+            return;
+        }
+    }
+}
+
+/*!
+    \internal
+  */
+void SoapStandInServer::discardClient()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket)
+        return;
+
+    m_buffers.remove(socket);
+    socket->deleteLater();
+}
+
+/*!
+    \internal
+
+    Returns ETag of \a content.
+  */
+QByteArray SoapStandInServer::entityTag(const QByteArray &content)
+{
+    return '"' + QCryptographicHash::hash(content, QCryptographicHash::Sha1)
+            .toHex().left(16) + '"';
+}
+
+/*!
+    \internal
+
+    Returns complete HTTP response for request with \a requestLine,
+    \a ifNoneMatch header (empty, if there was none) and \a body.
+  */
+QByteArray SoapStandInServer::handleRequest(const QByteArray &requestLine,
+                                            const QByteArray &ifNoneMatch,
+                                            const QByteArray &body) const
+{
+    if (requestLine.startsWith("GET ")) {
+        QByteArray target = requestLine.split(' ').value(1).toLower();
+        if (target.endsWith("?wsdl") && !m_wsdl.isEmpty()) {
+            if (ifNoneMatch == m_wsdlETag)
+                return httpResponse(304, QByteArray(), QByteArray(), m_wsdlETag);
+            return httpResponse(200, "text/xml; charset=utf-8", m_wsdl, m_wsdlETag);
+        }
+
+        QHash<QByteArray, QByteArray>::const_iterator document = m_documents.constFind(target);
+        if (document != m_documents.constEnd()) {
+            const QByteArray eTag = entityTag(document.value());
+            if (ifNoneMatch == eTag)
+                return httpResponse(304, QByteArray(), QByteArray(), eTag);
+            return httpResponse(200, "text/xml; charset=utf-8", document.value(), eTag);
+        }
+        return httpResponse(404, "text/plain", "Not found");
+    }
+
+    QByteArray method = methodFromBody(body);
+    QHash<QByteArray, QByteArray>::const_iterator it = m_responses.constFind(method);
+
+    if (it == m_responses.constEnd()) {
+        return httpResponse(500, "application/soap+xml; charset=utf-8",
+                            "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+                            "<soap12:Envelope xmlns:soap12="
+                            "\"http://www.w3.org/2003/05/soap-envelope\">"
+                            "<soap12:Body><soap12:Fault><soap12:Code>"
+                            "<soap12:Value>soap12:Sender</soap12:Value>"
+                            "</soap12:Code><soap12:Reason><soap12:Text "
+                            "xml:lang=\"en\">Unknown method: " + method
+                            + "</soap12:Text></soap12:Reason></soap12:Fault>"
+                            "</soap12:Body></soap12:Envelope>");
+    }
+
+    return httpResponse(200, "application/soap+xml; charset=utf-8", it.value());
+}
+
+/*!
+    \internal
+
+    Returns name of the first element inside SOAP Body (without namespace
+    prefix), or name of the first element, if there is no Body.
+  */
+QByteArray SoapStandInServer::methodFromBody(const QByteArray &body)
+{
+    int from = body.indexOf("Body");
+    from = (from == -1) ? 0 : body.indexOf('>', from) + 1;
+
+    forever {
+        int start = body.indexOf('<', from);
+        if (start == -1 || start + 1 >= body.size())
+            return QByteArray();
+
+        // Skip processing instructions, comments and closing tags.
+        char next = body.at(start + 1);
+        if (next == '?' || next == '!' || next == '/') {
+            from = start + 1;
+            continue;
+        }
+
+        int end = start + 1;
+        while (end < body.size()) {
+            char c = body.at(end);
+            if (c == ' ' || c == '>' || c == '/' || c == '\t'
+                    || c == '\r' || c == '\n')
+                break;
+            end++;
+        }
+
+        QByteArray name = body.mid(start + 1, end - start - 1);
+        int colon = name.indexOf(':');
+        return (colon == -1) ? name : name.mid(colon + 1);
+    }
+}
+
+/*!
+    \internal
+  */
+QByteArray SoapStandInServer::httpResponse(int status,
+                                           const QByteArray &contentType,
+                                           const QByteArray &body,
+                                           const QByteArray &eTag)
+{
+    QByteArray result;
+    result.reserve(body.size() + 160);
+    result.append("HTTP/1.1 ");
+    result.append(QByteArray::number(status));
+    if (status == 200)
+        result.append(" OK");
+    else if (status == 304)
+        result.append(" Not Modified");
+    else if (status == 404)
+        result.append(" Not Found");
+    else
+        result.append(" Internal Server Error");
+    if (!contentType.isEmpty()) {
+        result.append("\r\nContent-Type: ");
+        result.append(contentType);
+    }
+    if (!eTag.isEmpty()) {
+        result.append("\r\nETag: ");
+        result.append(eTag);
+    }
+    result.append("\r\nContent-Length: ");
+    result.append(QByteArray::number(body.size()));
+    result.append("\r\nConnection: keep-alive\r\n\r\n");
+    result.append(body);
+    return result;
+}
@@ -0,0 +1,70 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService benchmark suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#ifndef SOAPSTANDINSERVER_H
+#define SOAPSTANDINSERVER_H
+
+#include <QtCore/qatomic.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qstringlist.h>
+#include <QtCore/qurl.h>
+#include <QtNetwork/qtcpserver.h>
+#include <QtNetwork/qtcpsocket.h>
+
+class SoapStandInServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    explicit SoapStandInServer(QObject *parent = 0);
+
+    bool addWsdl(const QString &wsdlFile);
+    void addResponse(const QString &methodName, const QByteArray &body);
+    void addDocument(const QString &path, const QByteArray &content);
+    QStringList methodNames() const;
+
+    QUrl url() const;
+    int requestCount() const;
+
+    Q_INVOKABLE bool start(quint16 port = 0);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor);
+
+private slots:
+    void readClient();
+    void discardClient();
+
+private:
+    QByteArray handleRequest(const QByteArray &requestLine,
+                             const QByteArray &ifNoneMatch,
+                             const QByteArray &body) const;
+    static QByteArray methodFromBody(const QByteArray &body);
+    static QByteArray entityTag(const QByteArray &content);
+    static QByteArray httpResponse(int status, const QByteArray &contentType,
+                                   const QByteArray &body,
+                                   const QByteArray &eTag = QByteArray());
+
+    QHash<QByteArray, QByteArray> m_responses;
+    QByteArray m_wsdl;
+    QByteArray m_wsdlETag;
+    QHash<QByteArray, QByteArray> m_documents;
+    QHash<QTcpSocket *, QByteArray> m_buffers;
+    QAtomicInt m_requestCount;
+};
+
+#endif // SOAPSTANDINSERVER_H
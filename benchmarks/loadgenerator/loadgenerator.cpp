@@ -0,0 +1,316 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService benchmark suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#include "loadgenerator.h"
+#include "processstats.h"
+
+#include <QtCore/qjsonarray.h>
+#include <QtCore/qjsondocument.h>
+#include <QtCore/qjsonobject.h>
+#include <QtCore/qmath.h>
+#include <qwebconnectionpool.h>
+#include <qwebdispatcher.h>
+#include <qwebservice.h>
+#include <qwsdl.h>
+
+#include <algorithm>
+
+/*!
+    \class LoadGenerator
+    \brief Drives QWebService with a fixed number of concurrent calls.
+
+    Every concurrency slot gets its own QWebService (parsed from the same
+    WSDL file), and keeps exactly one call in flight: as soon as a reply
+    arrives, next call is invoked. Method addresses are redirected to
+    target URL, so WSDL files describing remote services can be used
+    against a local stand-in server.
+
+    Connection setup is included in the measurement, so short runs
+    favour low concurrency.
+  */
+
+LoadGenerator::Result::Result() :
+    concurrency(0), calls(0), errors(0), seconds(0), callsPerSecond(0),
+    p50(0), p90(0), p99(0), p999(0), max(0), cpuPerCall(0), rssGrowth(0)
+{
+}
+
+/*!
+    Constructs the generator. Calls will be made to \a methodName
+    (or the first method found in \a wsdlFile, if empty), at \a target.
+  */
+LoadGenerator::LoadGenerator(const QString &wsdlFile, const QUrl &target,
+                             const QString &methodName, QObject *parent) :
+    QObject(parent), m_wsdlFile(wsdlFile), m_target(target),
+    m_methodName(methodName), m_dispatcher(0), m_connectionPool(0), m_serverThread(0),
+    m_deadline(0), m_outstanding(0), m_errors(0)
+{
+}
+
+/*!
+    Makes services send their calls through \a dispatcher (0, the default,
+    means: from the generator's thread). Applies to subsequent runs.
+  */
+void LoadGenerator::setDispatcher(QWebDispatcher *dispatcher)
+{
+    m_dispatcher = dispatcher;
+}
+
+/*!
+    Makes services share connections of \a pool (0, the default, means:
+    each service opens its own). Applies to subsequent runs.
+  */
+void LoadGenerator::setConnectionPool(QWebConnectionPool *pool)
+{
+    m_connectionPool = pool;
+}
+
+/*!
+    Sets \a thread (QThread::currentThreadId() of it) running an
+    in-process server, whose CPU time is not counted as client's.
+  */
+void LoadGenerator::setServerThread(Qt::HANDLE thread)
+{
+    m_serverThread = thread;
+}
+
+/*!
+    Runs \a concurrency parallel call loops for \a durationMs milliseconds
+    and returns the measurements. Calls in flight when time runs out are
+    allowed to finish, and are counted.
+  */
+LoadGenerator::Result LoadGenerator::run(int concurrency, int durationMs)
+{
+    Result result;
+    result.concurrency = concurrency;
+
+    for (int i = 0; i < concurrency; ++i) {
+        QWebService *service = createService();
+        if (!service)
+            break;
+        m_slots.insert(service, i);
+        m_services.append(service);
+    }
+
+    if (m_services.size() == concurrency) {
+        m_startTimes.fill(0, concurrency);
+        m_latencies.clear();
+        m_latencies.reserve(durationMs * concurrency);
+        m_errors = 0;
+        m_outstanding = concurrency;
+
+        const qint64 rssBefore = ProcessStats::residentSetSize();
+        const qint64 cpuBefore = clientCpuTime();
+        m_clock.start();
+        m_deadline = qint64(durationMs) * 1000000;
+
+        for (int i = 0; i < concurrency; ++i)
+            invoke(i);
+
+        if (m_outstanding > 0)
+            m_loop.exec();
+
+        result.seconds = m_clock.nsecsElapsed() / 1e9;
+        const qint64 cpu = clientCpuTime() - cpuBefore;
+        result.rssGrowth = ProcessStats::residentSetSize() - rssBefore;
+
+        std::sort(m_latencies.begin(), m_latencies.end());
+        result.calls = m_latencies.size();
+        result.errors = m_errors;
+
+        if (result.calls > 0) {
+            result.callsPerSecond = result.calls / result.seconds;
+            result.cpuPerCall = double(cpu) / result.calls;
+            result.p50 = percentile(m_latencies, 0.5);
+            result.p90 = percentile(m_latencies, 0.9);
+            result.p99 = percentile(m_latencies, 0.99);
+            result.p999 = percentile(m_latencies, 0.999);
+            result.max = m_latencies.last();
+        }
+    } else {
+        qWarning("Could not create web service from %s",
+                 qPrintable(m_wsdlFile));
+    }
+
+    foreach (QWebService *service, m_services) {
+        qDeleteAll(*service->methods());
+        delete service;
+    }
+    m_services.clear();
+    m_slots.clear();
+
+    return result;
+}
+
+/*!
+    Returns column names matching resultLine().
+  */
+QString LoadGenerator::resultHeader()
+{
+    return QLatin1String("concurrency      calls   errors     calls/s"
+                         "    p50[us]    p90[us]    p99[us]   p999[us]"
+                         "    max[us]  cpu/call[us]  rss+[kB]");
+}
+
+/*!
+    Returns \a result as a single, human readable table row.
+  */
+QString LoadGenerator::resultLine(const Result &result)
+{
+    return QString::fromLatin1("%1 %2 %3 %4 %5 %6 %7 %8 %9 %10 %11")
+            .arg(result.concurrency, 11)
+            .arg(result.calls, 10)
+            .arg(result.errors, 8)
+            .arg(result.callsPerSecond, 11, 'f', 1)
+            .arg(result.p50, 10)
+            .arg(result.p90, 10)
+            .arg(result.p99, 10)
+            .arg(result.p999, 10)
+            .arg(result.max, 10)
+            .arg(result.cpuPerCall, 13, 'f', 1)
+            .arg(result.rssGrowth, 9);
+}
+
+/*!
+    Returns \a results as a JSON array, one object per run.
+  */
+QByteArray LoadGenerator::toJson(const QList<Result> &results)
+{
+    QJsonArray array;
+
+    foreach (const Result &result, results) {
+        QJsonObject object;
+        object.insert(QLatin1String("concurrency"), result.concurrency);
+        object.insert(QLatin1String("calls"), double(result.calls));
+        object.insert(QLatin1String("errors"), double(result.errors));
+        object.insert(QLatin1String("seconds"), result.seconds);
+        object.insert(QLatin1String("callsPerSecond"), result.callsPerSecond);
+        object.insert(QLatin1String("p50Us"), double(result.p50));
+        object.insert(QLatin1String("p90Us"), double(result.p90));
+        object.insert(QLatin1String("p99Us"), double(result.p99));
+        object.insert(QLatin1String("p999Us"), double(result.p999));
+        object.insert(QLatin1String("maxUs"), double(result.max));
+        object.insert(QLatin1String("cpuPerCallUs"), result.cpuPerCall);
+        object.insert(QLatin1String("rssGrowthKb"), double(result.rssGrowth));
+        array.append(object);
+    }
+
+    return QJsonDocument(array).toJson();
+}
+
+/*!
+    \internal
+
+    Records latency of the call that has just finished, and invokes
+    the next one, unless the run is over.
+  */
+void LoadGenerator::callFinished(const QByteArray &reply, const QString &methodName)
+{
+    Q_UNUSED(methodName);
+    QWebService *service = qobject_cast<QWebService *>(sender());
+    if (!service || !m_slots.contains(service))
+        return;
+
+    const int slot = m_slots.value(service);
+    const qint64 now = m_clock.nsecsElapsed();
+    m_latencies.append((now - m_startTimes.at(slot)) / 1000);
+
+    if (reply.isEmpty() || reply.contains("Fault>"))
+        ++m_errors;
+
+    if (now < m_deadline)
+        invoke(slot);
+    else if (--m_outstanding == 0)
+        m_loop.quit();
+}
+
+/*!
+    \internal
+
+    Creates a web service from WSDL file, redirected to target URL.
+    Returns 0 on error.
+  */
+QWebService *LoadGenerator::createService()
+{
+    QWebService *service = new QWebService(this);
+    service->setWsdl(new QWsdl(m_wsdlFile, service));
+
+    if (service->isErrorState() || service->methodNames().isEmpty()) {
+        delete service;
+        return 0;
+    }
+
+    if (m_methodName.isEmpty())
+        m_methodName = service->methodNames().first();
+
+    foreach (QWebMethod *method, service->methods()->values()) {
+        method->setHost(m_target);
+        method->setParameters(method->parameterNamesTypes());
+    }
+
+    if (m_dispatcher)
+        service->setDispatcher(m_dispatcher);
+    if (m_connectionPool)
+        service->setConnectionPool(m_connectionPool);
+
+    connect(service, SIGNAL(replyReady(QByteArray,QString)),
+            this, SLOT(callFinished(QByteArray,QString)));
+    return service;
+}
+
+/*!
+    \internal
+
+    Returns CPU time used by the process so far, without the server
+    thread (if any).
+  */
+qint64 LoadGenerator::clientCpuTime() const
+{
+    qint64 cpu = ProcessStats::cpuTime();
+    if (m_serverThread)
+        cpu -= ProcessStats::threadCpuTime(m_serverThread);
+    return cpu;
+}
+
+/*!
+    \internal
+  */
+void LoadGenerator::invoke(int slot)
+{
+    m_startTimes[slot] = m_clock.nsecsElapsed();
+
+    if (!m_services.at(slot)->invokeMethod(m_methodName)) {
+        ++m_errors;
+        if (--m_outstanding == 0)
+            m_loop.quit();
+    }
+}
+
+/*!
+    \internal
+
+    Returns value at \a fraction (0..1) of \a sorted samples.
+  */
+qint64 LoadGenerator::percentile(const QVector<qint64> &sorted, double fraction)
+{
+    if (sorted.isEmpty())
+        return 0;
+
+    int index = qCeil(fraction * sorted.size()) - 1;
+    return sorted.at(qBound(0, index, sorted.size() - 1));
+}
@@ -0,0 +1,100 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService benchmark suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qeventloop.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qobject.h>
+#include <QtCore/qstring.h>
+#include <QtCore/qurl.h>
+#include <QtCore/qvector.h>
+
+class QWebConnectionPool;
+class QWebDispatcher;
+class QWebService;
+
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Result
+    {
+        Result();
+
+        int concurrency;
+        qint64 calls;
+        qint64 errors;
+        double seconds;
+        double callsPerSecond;
+        // Latencies, in microseconds.
+        qint64 p50;
+        qint64 p90;
+        qint64 p99;
+        qint64 p999;
+        qint64 max;
+        // CPU time (user + system) of the client per call, in
+        // microseconds: process CPU time without the server thread.
+        double cpuPerCall;
+        // Resident set size change during the run, in kilobytes.
+        qint64 rssGrowth;
+    };
+
+    LoadGenerator(const QString &wsdlFile, const QUrl &target,
+                  const QString &methodName, QObject *parent = 0);
+
+    void setDispatcher(QWebDispatcher *dispatcher);
+    void setConnectionPool(QWebConnectionPool *pool);
+    void setServerThread(Qt::HANDLE thread);
+    Result run(int concurrency, int durationMs);
+
+    static QString resultHeader();
+    static QString resultLine(const Result &result);
+    static QByteArray toJson(const QList<Result> &results);
+
+private slots:
+    void callFinished(const QByteArray &reply, const QString &methodName);
+
+private:
+    QWebService *createService();
+    void invoke(int slot);
+    qint64 clientCpuTime() const;
+    static qint64 percentile(const QVector<qint64> &sorted, double fraction);
+
+    QString m_wsdlFile;
+    QUrl m_target;
+    QString m_methodName;
+    QWebDispatcher *m_dispatcher;
+    QWebConnectionPool *m_connectionPool;
+    Qt::HANDLE m_serverThread;
+
+    QEventLoop m_loop;
+    QElapsedTimer m_clock;
+    qint64 m_deadline;
+    int m_outstanding;
+    qint64 m_errors;
+    QList<QWebService *> m_services;
+    QHash<QWebService *, int> m_slots;
+    QVector<qint64> m_startTimes;
+    QVector<qint64> m_latencies;
+};
+
+#endif // LOADGENERATOR_H
@@ -0,0 +1,17 @@
+include(../../buildInfo.pri)
+
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../../libraryIncludes.pri)
+include(../common/common.pri)
+
+TARGET = loadgenerator
+DESTDIR = $${BENCHMARKS_DIRECTORY}/loadgenerator
+OBJECTS_DIR = $${BENCHMARKS_DIRECTORY}/loadgenerator
+MOC_DIR = $${BENCHMARKS_DIRECTORY}/loadgenerator
+
+SOURCES += main.cpp \
+    loadgenerator.cpp
+
+HEADERS += loadgenerator.h
@@ -0,0 +1,208 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService benchmark suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#include <QtCore/qcommandlineparser.h>
+#include <QtCore/qcoreapplication.h>
+#include <QtCore/qfile.h>
+#include <QtCore/qstringlist.h>
+#include <QtCore/qtextstream.h>
+#include <QtCore/qthread.h>
+#include "loadgenerator.h"
+#include "networkconditionproxy.h"
+#include "soapstandinserver.h"
+#include <qwebconnectionpool.h>
+#include <qwebdispatcher.h>
+
+/*
+  End-to-end throughput test. Drives QWebService against a SOAP server
+  (by default, an in-process stand-in running in its own thread), for
+  each concurrency level given, and prints throughput, latency
+  percentiles, CPU time per call and memory growth. When network
+  conditions are given, calls go through NetworkConditionProxy
+  (running in the same thread as the stand-in server). CPU time of
+  that thread is not counted. With --dispatcher-threads, calls are
+  sent through QWebDispatcher. Services share connections of the
+  global QWebConnectionPool, unless --no-connection-pool is given.
+  */
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(QLatin1String("loadgenerator"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QLatin1String(
+        "Measures QWebService call throughput and latency."));
+    parser.addHelpOption();
+
+    QCommandLineOption wsdlOption(QLatin1String("wsdl"),
+        QLatin1String("WSDL file describing the service."), QLatin1String("file"),
+        app.applicationDirPath() + QLatin1String("/../../../examples/wsdl/band_ws.asmx"));
+    QCommandLineOption urlOption(QLatin1String("url"),
+        QLatin1String("Service address. If not set, a local stand-in server is started."),
+        QLatin1String("url"));
+    QCommandLineOption methodOption(QLatin1String("method"),
+        QLatin1String("Method to call (default: first method in WSDL)."),
+        QLatin1String("name"));
+    QCommandLineOption concurrencyOption(QLatin1String("concurrency"),
+        QLatin1String("Comma separated list of concurrency levels."),
+        QLatin1String("list"), QLatin1String("1,4,16,64"));
+    QCommandLineOption durationOption(QLatin1String("duration"),
+        QLatin1String("Duration of each run, in milliseconds."),
+        QLatin1String("ms"), QLatin1String("5000"));
+    QCommandLineOption dispatcherOption(QLatin1String("dispatcher-threads"),
+        QLatin1String("Send calls through QWebDispatcher with given number of "
+                      "network threads (0: do not use dispatcher)."),
+        QLatin1String("count"), QLatin1String("0"));
+    QCommandLineOption noPoolOption(QLatin1String("no-connection-pool"),
+        QLatin1String("Do not share connections between services."));
+    QCommandLineOption jsonOption(QLatin1String("json"),
+        QLatin1String("Write results as JSON to file."), QLatin1String("file"));
+
+    parser.addOption(wsdlOption);
+    parser.addOption(urlOption);
+    parser.addOption(methodOption);
+    parser.addOption(concurrencyOption);
+    parser.addOption(durationOption);
+    parser.addOption(dispatcherOption);
+    parser.addOption(noPoolOption);
+    parser.addOption(jsonOption);
+    NetworkConditions::addCommandLineOptions(&parser);
+    parser.process(app);
+
+    QTextStream out(stdout);
+    const QString wsdlFile = parser.value(wsdlOption);
+    const int duration = parser.value(durationOption).toInt();
+
+    const NetworkConditions conditions = NetworkConditions::fromCommandLine(parser);
+    QThread networkThread;
+    // Set from the thread when it starts, before it runs any event.
+    Qt::HANDLE networkThreadId = 0;
+    QObject::connect(&networkThread, &QThread::started, [&networkThreadId]() {
+        networkThreadId = QThread::currentThreadId();
+    });
+    SoapStandInServer *server = 0;
+    NetworkConditionProxy *proxy = 0;
+    QUrl target(parser.value(urlOption));
+
+    if (!parser.isSet(urlOption)) {
+        server = new SoapStandInServer;
+        if (!server->addWsdl(wsdlFile)) {
+            qCritical("Could not read WSDL file: %s", qPrintable(wsdlFile));
+            delete server;
+            return 1;
+        }
+
+        server->moveToThread(&networkThread);
+        QObject::connect(&networkThread, SIGNAL(finished()),
+                         server, SLOT(deleteLater()));
+        networkThread.start();
+
+        bool listening = false;
+        QMetaObject::invokeMethod(server, "start", Qt::BlockingQueuedConnection,
+                                  Q_RETURN_ARG(bool, listening),
+                                  Q_ARG(quint16, 0));
+        if (!listening) {
+            qCritical("Could not start stand-in server");
+            networkThread.quit();
+            networkThread.wait();
+            return 1;
+        }
+
+        target = server->url();
+        out << "Stand-in server listening on " << target.toString() << endl;
+    }
+
+    if (!conditions.isNeutral()) {
+        proxy = new NetworkConditionProxy;
+        proxy->setTarget(target);
+        proxy->setConditions(conditions);
+        proxy->moveToThread(&networkThread);
+        QObject::connect(&networkThread, SIGNAL(finished()),
+                         proxy, SLOT(deleteLater()));
+        if (!networkThread.isRunning())
+            networkThread.start();
+
+        bool listening = false;
+        QMetaObject::invokeMethod(proxy, "start", Qt::BlockingQueuedConnection,
+                                  Q_RETURN_ARG(bool, listening),
+                                  Q_ARG(quint16, 0));
+        if (!listening) {
+            qCritical("Could not start network condition proxy");
+            networkThread.quit();
+            networkThread.wait();
+            return 1;
+        }
+
+        target = proxy->url();
+        out << "Network conditions: " << conditions.toString() << endl;
+    }
+
+    LoadGenerator generator(wsdlFile, target, parser.value(methodOption));
+    QWebDispatcher *dispatcher = 0;
+    const int dispatcherThreads = parser.value(dispatcherOption).toInt();
+    if (dispatcherThreads > 0) {
+        dispatcher = new QWebDispatcher(dispatcherThreads, &generator);
+        generator.setDispatcher(dispatcher);
+        out << "Dispatcher threads: " << dispatcher->threadCount() << endl;
+    }
+    if (!parser.isSet(noPoolOption))
+        generator.setConnectionPool(QWebConnectionPool::globalInstance());
+    if (networkThread.isRunning())
+        generator.setServerThread(networkThreadId);
+    QList<LoadGenerator::Result> results;
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    const QStringList levels = parser.value(concurrencyOption)
+            .split(QLatin1Char(','), Qt::SkipEmptyParts);
+#else
+    const QStringList levels = parser.value(concurrencyOption)
+            .split(QLatin1Char(','), QString::SkipEmptyParts);
+#endif
+
+    out << LoadGenerator::resultHeader() << endl;
+    foreach (const QString &level, levels) {
+        const int concurrency = level.trimmed().toInt();
+        if (concurrency <= 0)
+            continue;
+
+        LoadGenerator::Result result = generator.run(concurrency, duration);
+        results.append(result);
+        out << LoadGenerator::resultLine(result) << endl;
+    }
+
+    if (server)
+        out << "Requests served: " << server->requestCount() << endl;
+    if (proxy) {
+        out << "Proxied connections: " << proxy->connectionCount()
+            << ", reset: " << proxy->resetCount() << endl;
+    }
+
+    networkThread.quit();
+    networkThread.wait();
+
+    if (parser.isSet(jsonOption)) {
+        QFile json(parser.value(jsonOption));
+        if (!json.open(QFile::WriteOnly | QFile::Truncate)) {
+            qCritical("Could not write %s", qPrintable(json.fileName()));
+            return 1;
+        }
+        json.write(LoadGenerator::toJson(results));
+    }
+
+    return 0;
+}
@@ -0,0 +1,65 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService benchmark suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#include <QtCore/qcommandlineparser.h>
+#include <QtCore/qcoreapplication.h>
+#include <QtCore/qtextstream.h>
+#include "networkconditionproxy.h"
+
+/*
+  Stand-alone network condition simulator: a TCP proxy adding latency,
+  jitter, bandwidth limits, random resets and slow-drip replies to
+  connections forwarded to --target.
+  */
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(QLatin1String("netcondition"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QLatin1String(
+        "TCP proxy simulating latency, limited bandwidth and unreliable connections."));
+    parser.addHelpOption();
+
+    QCommandLineOption portOption(QLatin1String("port"),
+        QLatin1String("Port to listen on."), QLatin1String("port"),
+        QLatin1String("8081"));
+    QCommandLineOption targetOption(QLatin1String("target"),
+        QLatin1String("Address connections are forwarded to."), QLatin1String("url"),
+        QLatin1String("http://127.0.0.1:8080"));
+    parser.addOption(portOption);
+    parser.addOption(targetOption);
+    NetworkConditions::addCommandLineOptions(&parser);
+    parser.process(app);
+
+    NetworkConditionProxy proxy;
+    proxy.setTarget(QUrl(parser.value(targetOption)));
+    proxy.setConditions(NetworkConditions::fromCommandLine(parser));
+
+    if (!proxy.start(parser.value(portOption).toUShort())) {
+        qCritical("Could not listen: %s", qPrintable(proxy.errorString()));
+        return 1;
+    }
+
+    QTextStream out(stdout);
+    out << "Forwarding " << proxy.url().toString() << " to "
+        << proxy.target().toString() << endl;
+    out << "Conditions: " << proxy.conditions().toString() << endl;
+
+    return app.exec();
+}
@@ -0,0 +1,14 @@
+include(../../buildInfo.pri)
+
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../../libraryIncludes.pri)
+include(../common/common.pri)
+
+TARGET = netcondition
+DESTDIR = $${BENCHMARKS_DIRECTORY}/netcondition
+OBJECTS_DIR = $${BENCHMARKS_DIRECTORY}/netcondition
+MOC_DIR = $${BENCHMARKS_DIRECTORY}/netcondition
+
+SOURCES += main.cpp
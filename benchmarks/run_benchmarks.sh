@@ -0,0 +1,27 @@
+#!/bin/sh
+# Runs all QBENCHMARK executables and stores their results as QTestLib XML,
+# one file per benchmark, in a directory named after the current commit.
+# Results of two commits can then be compared file by file.
+#
+# Usage: run_benchmarks.sh [results directory] [extra QTestLib arguments]
+# Example: run_benchmarks.sh results -iterations 10
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD="$ROOT/build/benchmarks"
+COMMIT=$(git -C "$ROOT" rev-parse --short HEAD 2>/dev/null || echo unknown)
+RESULTS=${1:-"$ROOT/build/benchmark-results"}/$COMMIT
+[ $# -gt 0 ] && shift
+
+mkdir -p "$RESULTS" || exit 1
+export LD_LIBRARY_PATH="$ROOT/lib:$LD_LIBRARY_PATH"
+
+STATUS=0
+for BENCH in "$BUILD"/*/bench_*; do
+    [ -x "$BENCH" ] || continue
+    NAME=$(basename "$BENCH")
+    echo "Running $NAME"
+    (cd "$(dirname "$BENCH")" && "$BENCH" -o "$RESULTS/$NAME.xml,xml" -o -,txt "$@") || STATUS=1
+done
+
+echo "Results stored in $RESULTS"
+exit $STATUS
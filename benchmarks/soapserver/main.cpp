@@ -0,0 +1,74 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebService benchmark suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+
+#include <QtCore/qcommandlineparser.h>
+#include <QtCore/qcoreapplication.h>
+#include <QtCore/qtextstream.h>
+#include "soapstandinserver.h"
+
+/*
+  Stand-alone stand-in SOAP server. Answers every operation found in
+  given WSDL files with a canned reply. Useful for running loadgenerator
+  (or any other client) against a separate process.
+  */
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(QLatin1String("soapstandin"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QLatin1String(
+        "Serves canned SOAP replies for operations described in WSDL files."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QLatin1String("wsdl"),
+        QLatin1String("WSDL files (default: band_ws.asmx and stockquote.asmx from examples)."),
+        QLatin1String("[wsdl...]"));
+
+    QCommandLineOption portOption(QLatin1String("port"),
+        QLatin1String("Port to listen on."), QLatin1String("port"),
+        QLatin1String("8080"));
+    parser.addOption(portOption);
+    parser.process(app);
+
+    QStringList wsdlFiles = parser.positionalArguments();
+    if (wsdlFiles.isEmpty()) {
+        const QString examples = app.applicationDirPath()
+                + QLatin1String("/../../../examples/wsdl/");
+        wsdlFiles << examples + QLatin1String("band_ws.asmx")
+                  << examples + QLatin1String("stockquote.asmx");
+    }
+
+    SoapStandInServer server;
+    foreach (const QString &wsdlFile, wsdlFiles) {
+        if (!server.addWsdl(wsdlFile)) {
+            qCritical("Could not read WSDL file: %s", qPrintable(wsdlFile));
+            return 1;
+        }
+    }
+
+    if (!server.start(parser.value(portOption).toUShort())) {
+        qCritical("Could not listen: %s", qPrintable(server.errorString()));
+        return 1;
+    }
+
+    QTextStream out(stdout);
+    out << "Listening on " << server.url().toString() << endl;
+    out << "Methods: " << server.methodNames().join(QLatin1String(", ")) << endl;
+
+    return app.exec();
+}
@@ -0,0 +1,14 @@
+include(../../buildInfo.pri)
+
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../../libraryIncludes.pri)
+include(../common/common.pri)
+
+TARGET = soapstandin
+DESTDIR = $${BENCHMARKS_DIRECTORY}/soapserver
+OBJECTS_DIR = $${BENCHMARKS_DIRECTORY}/soapserver
+MOC_DIR = $${BENCHMARKS_DIRECTORY}/soapserver
+
+SOURCES += main.cpp
@@ -0,0 +1,12 @@
+include(../../buildInfo.pri)
+
+QT += testlib
+
+include(../../libraryIncludes.pri)
+include(../../benchmarks/common/common.pri)
+
+DESTDIR = $${TESTS_DIRECTORY}/QWebBalancer
+OBJECTS_DIR = $${TESTS_DIRECTORY}/QWebBalancer
+MOC_DIR = $${TESTS_DIRECTORY}/QWebBalancer
+
+SOURCES += tst_qwebbalancer.cpp
@@ -0,0 +1,341 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebBalancer test suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <qwebmethod.h>
+#include <qwebservice.h>
+#include <qwebreply.h>
+#include <qwebbalancer_p.h>
+#include "benchmarkdata.h"
+#include "soapstandinserver.h"
+
+/*
+  This test checks load balancing of QWebService over many endpoints:
+  balancing policies, consistent hashing and ejection of failing
+  endpoints.
+  */
+class TestQWebBalancer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void initialTest();
+    void roundRobinTest();
+    void leastOutstandingTest();
+    void consistentHashTest();
+    void ejectionTest();
+    void ejectionExpiryTest();
+    void serviceTest();
+    void serviceUnknownMethodTest();
+    void serviceEjectionTest();
+
+private:
+    QWebMethod *method(QObject *parent);
+    static QList<QUrl> urls(int count);
+    static QUrl deadUrl();
+
+    SoapStandInServer first;
+    SoapStandInServer second;
+};
+
+void TestQWebBalancer::initTestCase()
+{
+    QMap<QString, QVariant> returns;
+    returns.insert("pingResult", QString("pong"));
+    first.addResponse("ping", BenchmarkData::soapReply("ping", returns));
+    second.addResponse("ping", BenchmarkData::soapReply("ping", returns));
+    QVERIFY(first.start());
+    QVERIFY(second.start());
+}
+
+QWebMethod *TestQWebBalancer::method(QObject *parent)
+{
+    QWebMethod *result = new QWebMethod(first.url(), QWebMethod::Soap12,
+                                        QWebMethod::Post, parent);
+    result->setMethodName("ping");
+    result->setTargetNamespace("http://tempuri.org/");
+    return result;
+}
+
+QList<QUrl> TestQWebBalancer::urls(int count)
+{
+    QList<QUrl> result;
+    for (int i = 0; i < count; i++)
+        result.append(QUrl(QString("http://node%1:8080/service.asmx").arg(i)));
+    return result;
+}
+
+/*
+  Returns URL of a local port nobody listens on.
+  */
+QUrl TestQWebBalancer::deadUrl()
+{
+    QTcpServer server;
+    server.listen(QHostAddress::LocalHost);
+    const quint16 port = server.serverPort();
+    server.close();
+    return QUrl(QString("http://127.0.0.1:%1/").arg(port));
+}
+
+/*
+  Performs basic checks of a balancer and a service without balancing.
+  */
+void TestQWebBalancer::initialTest()
+{
+    QWebBalancer balancer;
+    QCOMPARE(balancer.pick(), QUrl());
+    balancer.setEndpoints(urls(2));
+    QCOMPARE(balancer.pick(), QUrl());
+    QCOMPARE(balancer.endpoints().size(), int(2));
+
+    balancer.setEndpoints(urls(2) + urls(2));
+    QCOMPARE(balancer.endpoints().size(), int(2));
+
+    QWebService service;
+    QCOMPARE(service.loadBalancing(), QWebService::NoLoadBalancing);
+    QVERIFY(service.endpoints().isEmpty());
+    QVERIFY(service.endpointStats().isEmpty());
+}
+
+/*
+  Round robin has to use endpoints in turn.
+  */
+void TestQWebBalancer::roundRobinTest()
+{
+    QWebBalancer balancer;
+    balancer.policy = QWebService::RoundRobinBalancing;
+    balancer.setEndpoints(urls(3));
+
+    for (int i = 0; i < 6; i++)
+        QCOMPARE(balancer.pick(), urls(3).at(i % 3));
+}
+
+/*
+  Least outstanding has to prefer endpoints with fewer calls in flight.
+  */
+void TestQWebBalancer::leastOutstandingTest()
+{
+    QWebBalancer balancer;
+    balancer.policy = QWebService::LeastOutstandingBalancing;
+    balancer.setEndpoints(urls(3));
+
+    balancer.callStarted(1, urls(3).at(0), 0);
+    balancer.callStarted(2, urls(3).at(0), 0);
+    balancer.callStarted(3, urls(3).at(1), 0);
+    QCOMPARE(balancer.pick(), urls(3).at(2));
+    QCOMPARE(balancer.pick(), urls(3).at(2));
+
+    balancer.callStarted(4, urls(3).at(2), 0);
+    balancer.callStarted(5, urls(3).at(2), 0);
+    QCOMPARE(balancer.pick(), urls(3).at(1));
+
+    balancer.callFinished(1, QNetworkReply::NoError, 200);
+    balancer.callFinished(2, QNetworkReply::NoError, 200);
+    QCOMPARE(balancer.pick(), urls(3).at(0));
+    QCOMPARE(balancer.stats().at(0).completed, qint64(2));
+    QCOMPARE(balancer.stats().at(2).outstanding, int(2));
+}
+
+/*
+  Same keys have to go to the same endpoints, keys have to be spread
+  evenly, and removing an endpoint can only move its own keys.
+  */
+void TestQWebBalancer::consistentHashTest()
+{
+    const int keyCount = 3000;
+
+    QWebBalancer balancer;
+    balancer.policy = QWebService::ConsistentHashBalancing;
+    balancer.setEndpoints(urls(3));
+
+    QHash<QByteArray, QUrl> placement;
+    QHash<QUrl, int> counts;
+    for (int i = 0; i < keyCount; i++) {
+        const QByteArray key = "customer-" + QByteArray::number(i);
+        const QUrl endpoint = balancer.pick(key);
+        QCOMPARE(balancer.pick(key), endpoint);
+        placement.insert(key, endpoint);
+        counts[endpoint]++;
+    }
+
+    QCOMPARE(counts.size(), int(3));
+    foreach (int count, counts)
+        QVERIFY2(count > keyCount / 6, qPrintable(QString::number(count)));
+
+    QList<QUrl> remaining = urls(3);
+    const QUrl removed = remaining.takeAt(1);
+    balancer.setEndpoints(remaining);
+    QHash<QByteArray, QUrl>::const_iterator it = placement.constBegin();
+    for (; it != placement.constEnd(); ++it) {
+        if (it.value() != removed)
+            QCOMPARE(balancer.pick(it.key()), it.value());
+    }
+}
+
+/*
+  Endpoint failing too many calls in a row has to be ejected, but the
+  last healthy one never is.
+  */
+void TestQWebBalancer::ejectionTest()
+{
+    QWebBalancer balancer;
+    balancer.policy = QWebService::RoundRobinBalancing;
+    balancer.ejectionFailures = 3;
+    balancer.setEndpoints(urls(2));
+
+    quint64 callId = 0;
+    for (int i = 0; i < 2; i++) {
+        balancer.callStarted(++callId, urls(2).at(0), 0);
+        balancer.callFinished(callId, QNetworkReply::ConnectionRefusedError, 0);
+    }
+
+    // Success resets the count, SOAP faults do not count.
+    balancer.callStarted(++callId, urls(2).at(0), 0);
+    balancer.callFinished(callId, QNetworkReply::NoError, 200);
+    balancer.callStarted(++callId, urls(2).at(0), 0);
+    balancer.callFinished(callId, QNetworkReply::InternalServerError, 500);
+    QCOMPARE(balancer.stats().at(0).ejected, bool(false));
+
+    for (int i = 0; i < 3; i++) {
+        balancer.callStarted(++callId, urls(2).at(0), 0);
+        balancer.callFinished(callId, QNetworkReply::NoError, 503);
+    }
+
+    QCOMPARE(balancer.stats().at(0).ejected, bool(true));
+    QCOMPARE(balancer.stats().at(0).ejections, int(1));
+    QCOMPARE(balancer.stats().at(0).failed, qint64(5));
+    for (int i = 0; i < 4; i++)
+        QCOMPARE(balancer.pick(), urls(2).at(1));
+
+    for (int i = 0; i < 3; i++) {
+        balancer.callStarted(++callId, urls(2).at(1), 0);
+        balancer.callFinished(callId, QNetworkReply::TimeoutError, 0);
+    }
+    QCOMPARE(balancer.stats().at(1).ejected, bool(false));
+}
+
+/*
+  Ejected endpoint has to come back after ejection time.
+  */
+void TestQWebBalancer::ejectionExpiryTest()
+{
+    QWebBalancer balancer;
+    balancer.policy = QWebService::RoundRobinBalancing;
+    balancer.ejectionFailures = 1;
+    balancer.ejectionTime = 50;
+    balancer.setEndpoints(urls(2));
+
+    balancer.callStarted(1, urls(2).at(0), 0);
+    balancer.callFinished(1, QNetworkReply::RemoteHostClosedError, 0);
+    QCOMPARE(balancer.stats().at(0).ejected, bool(true));
+
+    QTRY_COMPARE_WITH_TIMEOUT(balancer.stats().at(0).ejected, bool(false), 5000);
+    QSet<QUrl> picked;
+    picked.insert(balancer.pick());
+    picked.insert(balancer.pick());
+    QCOMPARE(picked.size(), int(2));
+}
+
+/*
+  Service has to spread calls over endpoints, instead of sending
+  them to URL of the method.
+  */
+void TestQWebBalancer::serviceTest()
+{
+    const int callCount = 10;
+
+    QWebService service;
+    service.addMethod(method(&service));
+    service.setEndpoints(QList<QUrl>() << first.url() << second.url());
+    service.setLoadBalancing(QWebService::RoundRobinBalancing);
+    QCOMPARE(service.endpoints().size(), int(2));
+
+    const int firstBefore = first.requestCount();
+    const int secondBefore = second.requestCount();
+
+    QList<QFuture<QWebReply> > futures;
+    for (int i = 0; i < callCount; i++)
+        futures.append(service.invokeMethodAsync("ping"));
+    foreach (QFuture<QWebReply> future, futures)
+        QTRY_VERIFY_WITH_TIMEOUT(future.isFinished(), 10000);
+
+    QCOMPARE(first.requestCount() - firstBefore, int(callCount / 2));
+    QCOMPARE(second.requestCount() - secondBefore, int(callCount / 2));
+
+    QList<QWebEndpointStats> stats = service.endpointStats();
+    QCOMPARE(stats.size(), int(2));
+    QCOMPARE(stats.at(0).completed, qint64(callCount / 2));
+    QCOMPARE(stats.at(1).outstanding, int(0));
+
+    // Calls with the same key stay on one endpoint.
+    service.setLoadBalancing(QWebService::ConsistentHashBalancing);
+    const int total = first.requestCount() + second.requestCount();
+    const int secondAfter = second.requestCount();
+    for (int i = 0; i < 4; i++) {
+        QFuture<QWebReply> future = service.invokeMethodAsync("ping", QByteArray(), "key");
+        QTRY_VERIFY_WITH_TIMEOUT(future.isFinished(), 10000);
+    }
+    QCOMPARE(first.requestCount() + second.requestCount(), total + 4);
+    QVERIFY(second.requestCount() == secondAfter || second.requestCount() == secondAfter + 4);
+}
+
+/*
+  Unknown method has to be refused before an endpoint is picked for it.
+  */
+void TestQWebBalancer::serviceUnknownMethodTest()
+{
+    QWebService service;
+    service.addMethod(method(&service));
+    service.setEndpoints(QList<QUrl>() << first.url() << second.url());
+    service.setLoadBalancing(QWebService::LeastOutstandingBalancing);
+
+    QCOMPARE(service.invokeMethod("noSuchMethod"), bool(false));
+    QCOMPARE(service.invokeMethod("noSuchMethod", QByteArray(), "key"), bool(false));
+
+    foreach (const QWebEndpointStats &stats, service.endpointStats())
+        QCOMPARE(stats.outstanding, int(0));
+}
+
+/*
+  Service has to stop using an endpoint which refuses connections.
+  */
+void TestQWebBalancer::serviceEjectionTest()
+{
+    const QUrl dead = deadUrl();
+
+    QWebService service;
+    service.addMethod(method(&service));
+    service.setEndpoints(QList<QUrl>() << dead << second.url());
+    service.setLoadBalancing(QWebService::RoundRobinBalancing);
+    service.setEndpointEjection(2, 60000);
+
+    for (int i = 0; i < 10; i++) {
+        QFuture<QWebReply> future = service.invokeMethodAsync("ping");
+        QTRY_VERIFY_WITH_TIMEOUT(future.isFinished(), 10000);
+    }
+
+    QList<QWebEndpointStats> stats = service.endpointStats();
+    QCOMPARE(stats.at(0).url, dead);
+    QCOMPARE(stats.at(0).ejected, bool(true));
+    QCOMPARE(stats.at(0).failed, qint64(2));
+    QCOMPARE(stats.at(1).completed, qint64(8));
+    QCOMPARE(stats.at(1).failed, qint64(0));
+}
+
+QTEST_MAIN(TestQWebBalancer)
+#include "tst_qwebbalancer.moc"
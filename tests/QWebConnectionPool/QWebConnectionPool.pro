@@ -0,0 +1,12 @@
+include(../../buildInfo.pri)
+
+QT += testlib
+
+include(../../libraryIncludes.pri)
+include(../../benchmarks/common/common.pri)
+
+DESTDIR = $${TESTS_DIRECTORY}/QWebConnectionPool
+OBJECTS_DIR = $${TESTS_DIRECTORY}/QWebConnectionPool
+MOC_DIR = $${TESTS_DIRECTORY}/QWebConnectionPool
+
+SOURCES += tst_qwebconnectionpool.cpp
@@ -0,0 +1,258 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebConnectionPool test suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <qwebmethod.h>
+#include <qwebconnectionpool.h>
+#include "benchmarkdata.h"
+#include "networkconditionproxy.h"
+#include "soapstandinserver.h"
+
+/*
+  This test checks connection sharing, socket budget and idle connection
+  eviction of QWebConnectionPool. Each proxy is a separate host.
+  */
+class TestQWebConnectionPool : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanup();
+    void initialTest();
+    void sharedConnectionTest();
+    void separatePoolsTest();
+    void evictIdleTest();
+    void socketBudgetTest();
+    void minimumConnectionsTest();
+    void idleTimeoutTest();
+
+private:
+    bool ping(const QUrl &url, QWebConnectionPool *pool = QWebConnectionPool::globalInstance());
+
+    SoapStandInServer server;
+};
+
+void TestQWebConnectionPool::initTestCase()
+{
+    QMap<QString, QVariant> returns;
+    returns.insert("pingResult", QString("pong"));
+    server.addResponse("ping", BenchmarkData::soapReply("ping", returns));
+    QVERIFY(server.start());
+}
+
+/*
+  Restores default settings of the global pool.
+  */
+void TestQWebConnectionPool::cleanup()
+{
+    QWebConnectionPool *pool = QWebConnectionPool::globalInstance();
+    pool->setMaxSockets(0);
+    pool->setIdleTimeout(0);
+    pool->evictIdle();
+}
+
+/*
+  Sends a single call to \a url through \a pool, and waits for the reply.
+  */
+bool TestQWebConnectionPool::ping(const QUrl &url, QWebConnectionPool *pool)
+{
+    QWebMethod method(url, QWebMethod::Soap12, QWebMethod::Post);
+    method.setConnectionPool(pool);
+    method.setMethodName("ping");
+    method.setTargetNamespace("http://tempuri.org/");
+    QSignalSpy spy(&method, SIGNAL(replyReady(QByteArray)));
+
+    return method.invokeMethod() && spy.wait(10000)
+            && !method.isErrorState();
+}
+
+/*
+  Performs basic checks of a new pool.
+  */
+void TestQWebConnectionPool::initialTest()
+{
+    QWebConnectionPool pool;
+    QCOMPARE(pool.maxSockets(), int(0));
+    QCOMPARE(pool.idleTimeout(), int(0));
+    QCOMPARE(pool.minimumConnections(server.url()), int(0));
+
+    QWebConnectionStats stats = pool.stats();
+    QCOMPARE(stats.endpoints, int(0));
+    QCOMPARE(stats.open, int(0));
+    QCOMPARE(stats.evicted, qint64(0));
+
+    pool.setMaxSockets(10);
+    pool.setIdleTimeout(500);
+    pool.setMinimumConnections(server.url(), 2);
+    QCOMPARE(pool.maxSockets(), int(10));
+    QCOMPARE(pool.idleTimeout(), int(500));
+    QCOMPARE(pool.minimumConnections(server.url()), int(2));
+    pool.setMinimumConnections(server.url(), 0);
+    QCOMPARE(pool.minimumConnections(server.url()), int(0));
+}
+
+/*
+  Separate web methods calling the same host have to share
+  a connection.
+  */
+void TestQWebConnectionPool::sharedConnectionTest()
+{
+    NetworkConditionProxy proxy;
+    proxy.setTarget(server.url());
+    QVERIFY(proxy.start());
+
+    QVERIFY(ping(proxy.url()));
+    QVERIFY(ping(proxy.url()));
+    QVERIFY(ping(proxy.url()));
+    QCOMPARE(proxy.connectionCount(), int(1));
+
+    QWebConnectionStats stats = QWebConnectionPool::globalInstance()->stats();
+    QVERIFY(stats.endpoints >= 1);
+    QVERIFY(stats.open >= 1);
+    QCOMPARE(stats.inFlight, int(0));
+    QCOMPARE(stats.idle, stats.open);
+}
+
+/*
+  Methods without a pool, and methods of different pools, must not
+  share connections (and sessions).
+  */
+void TestQWebConnectionPool::separatePoolsTest()
+{
+    NetworkConditionProxy proxy;
+    proxy.setTarget(server.url());
+    QVERIFY(proxy.start());
+
+    QWebMethod method(proxy.url(), QWebMethod::Soap12, QWebMethod::Post);
+    QVERIFY(method.connectionPool() == 0);
+    QVERIFY(ping(proxy.url(), 0));
+    QVERIFY(ping(proxy.url(), 0));
+    QCOMPARE(proxy.connectionCount(), int(2));
+
+    QWebConnectionPool first;
+    QWebConnectionPool second;
+    QVERIFY(ping(proxy.url(), &first));
+    QVERIFY(ping(proxy.url(), &second));
+    QVERIFY(ping(proxy.url(), &first));
+    QCOMPARE(proxy.connectionCount(), int(4));
+    QCOMPARE(first.stats().endpoints, int(1));
+    QCOMPARE(second.stats().endpoints, int(1));
+}
+
+/*
+  Evicted connections have to be counted, and opened again
+  by the next call.
+  */
+void TestQWebConnectionPool::evictIdleTest()
+{
+    NetworkConditionProxy proxy;
+    proxy.setTarget(server.url());
+    QVERIFY(proxy.start());
+    QWebConnectionPool *pool = QWebConnectionPool::globalInstance();
+
+    QVERIFY(ping(proxy.url()));
+    const qint64 evicted = pool->stats().evicted;
+
+    pool->evictIdle();
+    QWebConnectionStats stats = pool->stats();
+    QCOMPARE(stats.open, int(0));
+    QCOMPARE(stats.idle, int(0));
+    QVERIFY(stats.evicted > evicted);
+
+    QVERIFY(ping(proxy.url()));
+    QCOMPARE(proxy.connectionCount(), int(2));
+}
+
+/*
+  Above the socket budget, connections of the least recently used
+  host have to be closed.
+  */
+void TestQWebConnectionPool::socketBudgetTest()
+{
+    NetworkConditionProxy first;
+    first.setTarget(server.url());
+    QVERIFY(first.start());
+    NetworkConditionProxy second;
+    second.setTarget(server.url());
+    QVERIFY(second.start());
+
+    QWebConnectionPool *pool = QWebConnectionPool::globalInstance();
+    pool->evictIdle();
+    pool->setMaxSockets(1);
+
+    QVERIFY(ping(first.url()));
+    QVERIFY(ping(second.url()));
+    QCOMPARE(pool->stats().open, int(1));
+
+    // Second host is kept, first one has to reconnect.
+    QVERIFY(ping(second.url()));
+    QCOMPARE(second.connectionCount(), int(1));
+    QVERIFY(ping(first.url()));
+    QCOMPARE(first.connectionCount(), int(2));
+}
+
+/*
+  Connections of a host with a minimum have to survive
+  the socket budget.
+  */
+void TestQWebConnectionPool::minimumConnectionsTest()
+{
+    NetworkConditionProxy first;
+    first.setTarget(server.url());
+    QVERIFY(first.start());
+    NetworkConditionProxy second;
+    second.setTarget(server.url());
+    QVERIFY(second.start());
+
+    QWebConnectionPool *pool = QWebConnectionPool::globalInstance();
+    pool->evictIdle();
+    pool->setMaxSockets(1);
+    pool->setMinimumConnections(first.url(), 1);
+
+    QVERIFY(ping(first.url()));
+    QVERIFY(ping(second.url()));
+    QVERIFY(ping(first.url()));
+    QCOMPARE(first.connectionCount(), int(1));
+
+    pool->setMinimumConnections(first.url(), 0);
+}
+
+/*
+  Connections not used for idle timeout have to be closed.
+  */
+void TestQWebConnectionPool::idleTimeoutTest()
+{
+    NetworkConditionProxy proxy;
+    proxy.setTarget(server.url());
+    QVERIFY(proxy.start());
+
+    QWebConnectionPool *pool = QWebConnectionPool::globalInstance();
+    pool->setIdleTimeout(100);
+
+    QVERIFY(ping(proxy.url()));
+    const qint64 evicted = pool->stats().evicted;
+    QTRY_VERIFY_WITH_TIMEOUT(pool->stats().evicted > evicted, 5000);
+    QCOMPARE(pool->stats().open, int(0));
+    QCOMPARE(pool->stats().endpoints, int(0));
+
+    QVERIFY(ping(proxy.url()));
+    QCOMPARE(proxy.connectionCount(), int(2));
+}
+
+QTEST_MAIN(TestQWebConnectionPool)
+#include "tst_qwebconnectionpool.moc"
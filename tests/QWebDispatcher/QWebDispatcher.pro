@@ -0,0 +1,12 @@
+include(../../buildInfo.pri)
+
+QT += testlib
+
+include(../../libraryIncludes.pri)
+include(../../benchmarks/common/common.pri)
+
+DESTDIR = $${TESTS_DIRECTORY}/QWebDispatcher
+OBJECTS_DIR = $${TESTS_DIRECTORY}/QWebDispatcher
+MOC_DIR = $${TESTS_DIRECTORY}/QWebDispatcher
+
+SOURCES += tst_qwebdispatcher.cpp
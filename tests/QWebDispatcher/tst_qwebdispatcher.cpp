@@ -0,0 +1,360 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebDispatcher test suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QTcpServer>
+#include <qwebconnectionpool.h>
+#include <qwebdispatcher.h>
+#include <qwebmethod.h>
+#include <qwebservice.h>
+#include <qwsdl.h>
+#include "benchmarkdata.h"
+#include "soapstandinserver.h"
+
+/*
+  This test checks QWebDispatcher: calls sent from network threads,
+  with replies delivered in the thread of the calling object.
+  */
+class TestQWebDispatcher : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void initialTest();
+    void callTest();
+    void manyCallsTest();
+    void spreadTest();
+    void cancelTest();
+    void serviceTest();
+    void blockingTest();
+    void blockingWsdlMethodTest();
+    void blockingTimeoutTest();
+
+private:
+    QWebMethod *pingMethod(QObject *parent = 0);
+
+    SoapStandInServer server;
+};
+
+void TestQWebDispatcher::initTestCase()
+{
+    QMap<QString, QVariant> returns;
+    returns.insert("pingResult", QString("pong"));
+    server.addResponse("ping", BenchmarkData::soapReply("ping", returns));
+
+    QMap<QString, QVariant> operationReturns;
+    operationReturns.insert("operation0Result", QString("pong"));
+    server.addResponse("operation0", BenchmarkData::soapReply("operation0", operationReturns));
+    QVERIFY(server.start());
+}
+
+QWebMethod *TestQWebDispatcher::pingMethod(QObject *parent)
+{
+    QWebMethod *result = new QWebMethod(server.url(), QWebMethod::Soap12,
+                                        QWebMethod::Post, parent);
+    result->setMethodName("ping");
+    result->setTargetNamespace("http://tempuri.org/");
+    return result;
+}
+
+/*
+  Performs basic checks of a freshly constructed dispatcher.
+  */
+void TestQWebDispatcher::initialTest()
+{
+    QWebDispatcher dispatcher(3);
+    QCOMPARE(dispatcher.threadCount(), int(3));
+    QCOMPARE(dispatcher.pendingCalls(), int(0));
+
+    QWebDispatcher defaultDispatcher;
+    QVERIFY(defaultDispatcher.threadCount() >= 1);
+
+    QVERIFY(QWebDispatcher::globalInstance() != 0);
+    QCOMPARE(QWebDispatcher::globalInstance(), QWebDispatcher::globalInstance());
+}
+
+/*
+  Sends a single call through the dispatcher. Reply has to arrive
+  in the main thread.
+  */
+void TestQWebDispatcher::callTest()
+{
+    QWebDispatcher dispatcher(2);
+    QWebMethod *method = pingMethod(this);
+    method->setDispatcher(&dispatcher);
+    QCOMPARE(method->dispatcher(), &dispatcher);
+
+    QThread *deliveryThread = 0;
+    connect(method, &QWebMethod::replyReady, [&deliveryThread]() {
+        deliveryThread = QThread::currentThread();
+    });
+
+    QSignalSpy spy(method, SIGNAL(replyReady(QByteArray)));
+    QCOMPARE(method->invokeMethod(), bool(true));
+    QVERIFY(spy.wait(10000));
+
+    QCOMPARE(spy.count(), int(1));
+    QCOMPARE(deliveryThread, QThread::currentThread());
+    QVERIFY(method->replyRead().contains("pong"));
+    QCOMPARE(dispatcher.pendingCalls(), int(0));
+    delete method;
+}
+
+/*
+  Sends many concurrent calls from different methods. All of them
+  have to be answered.
+  */
+void TestQWebDispatcher::manyCallsTest()
+{
+    const int methodCount = 32;
+    const int requestsBefore = server.requestCount();
+
+    QWebDispatcher dispatcher(4);
+    QList<QWebMethod *> methods;
+    QSignalSpy *spies[methodCount];
+
+    for (int i = 0; i < methodCount; i++) {
+        QWebMethod *method = pingMethod(this);
+        method->setDispatcher(&dispatcher);
+        spies[i] = new QSignalSpy(method, SIGNAL(replyReady(QByteArray)));
+        methods.append(method);
+    }
+
+    foreach (QWebMethod *method, methods)
+        QCOMPARE(method->invokeMethod(), bool(true));
+
+    for (int i = 0; i < methodCount; i++)
+        QTRY_COMPARE_WITH_TIMEOUT(spies[i]->count(), int(1), 10000);
+
+    QCOMPARE(server.requestCount() - requestsBefore, methodCount);
+    QCOMPARE(dispatcher.pendingCalls(), int(0));
+
+    for (int i = 0; i < methodCount; i++)
+        delete spies[i];
+    qDeleteAll(methods);
+}
+
+/*
+  Sends concurrent calls to a single host. They have to be spread over
+  more than one network thread, each with its own connections.
+  */
+void TestQWebDispatcher::spreadTest()
+{
+    const int methodCount = 16;
+    QWebConnectionPool *pool = QWebConnectionPool::globalInstance();
+    const int endpointsBefore = pool->stats().endpoints;
+
+    QWebDispatcher dispatcher(4);
+    QList<QWebMethod *> methods;
+    QSignalSpy *spies[methodCount];
+
+    for (int i = 0; i < methodCount; i++) {
+        QWebMethod *method = pingMethod(this);
+        method->setDispatcher(&dispatcher);
+        spies[i] = new QSignalSpy(method, SIGNAL(replyReady(QByteArray)));
+        methods.append(method);
+    }
+
+    foreach (QWebMethod *method, methods)
+        QCOMPARE(method->invokeMethod(), bool(true));
+
+    for (int i = 0; i < methodCount; i++)
+        QTRY_COMPARE_WITH_TIMEOUT(spies[i]->count(), int(1), 10000);
+
+    QVERIFY(pool->stats().endpoints - endpointsBefore > 1);
+
+    for (int i = 0; i < methodCount; i++)
+        delete spies[i];
+    qDeleteAll(methods);
+}
+
+/*
+  Deletes a method while its call is in progress. Nothing may be
+  delivered to the deleted object.
+  */
+void TestQWebDispatcher::cancelTest()
+{
+    QWebDispatcher dispatcher(1);
+    QWebMethod *method = pingMethod();
+    method->setDispatcher(&dispatcher);
+
+    QCOMPARE(method->invokeMethod(), bool(true));
+    QCOMPARE(dispatcher.pendingCalls(), int(1));
+    delete method;
+    QCOMPARE(dispatcher.pendingCalls(), int(0));
+
+    // Let the network thread finish (or abort) the request.
+    QTest::qWait(200);
+    QCOMPARE(dispatcher.pendingCalls(), int(0));
+}
+
+/*
+  Checks that QWebService applies its dispatcher to all methods,
+  including those added later.
+  */
+void TestQWebDispatcher::serviceTest()
+{
+    QWebDispatcher dispatcher(1);
+    QWebService service;
+    QWebMethod *before = pingMethod();
+    service.addMethod(before);
+
+    service.setDispatcher(&dispatcher);
+    QCOMPARE(service.dispatcher(), &dispatcher);
+    QCOMPARE(before->dispatcher(), &dispatcher);
+
+    QWebMethod *after = pingMethod();
+    service.addMethod("pingAgain", after);
+    QCOMPARE(after->dispatcher(), &dispatcher);
+
+    QSignalSpy spy(&service, SIGNAL(replyReady(QByteArray,QString)));
+    QCOMPARE(service.invokeMethod("pingAgain"), bool(true));
+    QVERIFY(spy.wait(10000));
+    QCOMPARE(spy.count(), int(1));
+
+    service.setDispatcher(0);
+    QVERIFY(before->dispatcher() == 0);
+    QVERIFY(after->dispatcher() == 0);
+
+    delete before;
+    delete after;
+}
+
+/*
+  Issues blocking calls from several threads without event loops at
+  once. Main thread keeps running the stand-in server meanwhile.
+  */
+void TestQWebDispatcher::blockingTest()
+{
+    const int threadCount = 8;
+    const int callsPerThread = 10;
+
+    QWebDispatcher dispatcher(2);
+    QWebService service;
+    QWebMethod *method = pingMethod(&service);
+    service.addMethod(method);
+    service.setDispatcher(&dispatcher);
+
+    QAtomicInt replies;
+    QList<QThread *> threads;
+    for (int i = 0; i < threadCount; i++) {
+        threads.append(QThread::create([&service, &replies]() {
+            for (int j = 0; j < callsPerThread; j++) {
+                QString error;
+                QByteArray reply = service.invokeMethodBlocking(
+                            "ping", QMap<QString, QVariant>(), 10000, &error);
+                if (reply.contains("pong") && error.isEmpty())
+                    replies.ref();
+            }
+        }));
+        threads.last()->start();
+    }
+
+    foreach (QThread *thread, threads)
+        QTRY_VERIFY_WITH_TIMEOUT(thread->isFinished(), 20000);
+    qDeleteAll(threads);
+
+    QCOMPARE(replies.loadAcquire(), threadCount * callsPerThread);
+    QCOMPARE(dispatcher.pendingCalls(), int(0));
+
+    QString error;
+    QCOMPARE(service.invokeMethodBlocking("noSuchMethod", QMap<QString, QVariant>(),
+                                          1000, &error), QByteArray());
+    QVERIFY(!error.isEmpty());
+}
+
+/*
+  Issues blocking calls to a WSDL method which was not used yet, from
+  several threads at once. The method has to be created in the thread
+  of the service, together with its network access managers.
+  */
+void TestQWebDispatcher::blockingWsdlMethodTest()
+{
+    const int threadCount = 4;
+
+    QString path = BenchmarkData::writeTempFile(
+                "dispatcher_blocking.asmx",
+                BenchmarkData::wsdl(3, 0, server.url().toString()));
+    QVERIFY(!path.isEmpty());
+
+    QWebDispatcher dispatcher(2);
+    QWebService service;
+    service.resetWsdl(new QWsdl(path, &service));
+    service.setDispatcher(&dispatcher);
+    QVERIFY(service.methodNames().contains("operation0"));
+
+    QAtomicInt replies;
+    QList<QThread *> threads;
+    for (int i = 0; i < threadCount; i++) {
+        threads.append(QThread::create([&service, &replies]() {
+            QString error;
+            QByteArray reply = service.invokeMethodBlocking(
+                        "operation0", QMap<QString, QVariant>(), 10000, &error);
+            if (reply.contains("pong") && error.isEmpty())
+                replies.ref();
+        }));
+        threads.last()->start();
+    }
+
+    foreach (QThread *thread, threads)
+        QTRY_VERIFY_WITH_TIMEOUT(thread->isFinished(), 20000);
+    qDeleteAll(threads);
+
+    QCOMPARE(replies.loadAcquire(), threadCount);
+    QWebMethod *method = service.method("operation0");
+    QVERIFY(method != 0);
+    QCOMPARE(method->thread(), service.thread());
+    foreach (QNetworkAccessManager *manager, method->findChildren<QNetworkAccessManager *>())
+        QCOMPARE(manager->thread(), service.thread());
+    QVERIFY(!method->findChildren<QNetworkAccessManager *>().isEmpty());
+
+    QFile::remove(path);
+}
+
+/*
+  Blocking call to a server that never answers has to time out.
+  */
+void TestQWebDispatcher::blockingTimeoutTest()
+{
+    QTcpServer silent;
+    QVERIFY(silent.listen(QHostAddress::LocalHost));
+
+    QWebDispatcher dispatcher(1);
+    QWebService service;
+    QUrl url(QString("http://127.0.0.1:%1/silent.asmx").arg(silent.serverPort()));
+    QWebMethod *method = new QWebMethod(url, QWebMethod::Soap12,
+                                        QWebMethod::Post, &service);
+    method->setMethodName("ping");
+    service.addMethod(method);
+    service.setDispatcher(&dispatcher);
+
+    QElapsedTimer timer;
+    timer.start();
+    QString error;
+    QByteArray reply = service.invokeMethodBlocking("ping", QMap<QString, QVariant>(),
+                                                    300, &error);
+
+    QCOMPARE(reply, QByteArray());
+    QVERIFY(!error.isEmpty());
+    QVERIFY(timer.elapsed() >= 250);
+    QCOMPARE(dispatcher.pendingCalls(), int(0));
+}
+
+QTEST_MAIN(TestQWebDispatcher)
+#include "tst_qwebdispatcher.moc"
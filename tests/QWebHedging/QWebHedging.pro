@@ -0,0 +1,12 @@
+include(../../buildInfo.pri)
+
+QT += testlib
+
+include(../../libraryIncludes.pri)
+include(../../benchmarks/common/common.pri)
+
+DESTDIR = $${TESTS_DIRECTORY}/QWebHedging
+OBJECTS_DIR = $${TESTS_DIRECTORY}/QWebHedging
+MOC_DIR = $${TESTS_DIRECTORY}/QWebHedging
+
+SOURCES += tst_qwebhedging.cpp
@@ -0,0 +1,211 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebHedging test suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <qwebmethod.h>
+#include <qwebservice.h>
+#include <qwebreply.h>
+#include "benchmarkdata.h"
+#include "networkconditionproxy.h"
+#include "soapstandinserver.h"
+
+/*
+  This test checks hedged calls of QWebMethod (setHedging()). Slow
+  endpoint is a proxy adding latency.
+  */
+class TestQWebHedging : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void initialTest();
+    void hedgeTest();
+    void budgetTest();
+    void concurrencyTest();
+    void percentileTest();
+
+private:
+    QWebMethod *method(const QUrl &url, QObject *parent);
+    bool call(QWebService *service);
+
+    SoapStandInServer server;
+    NetworkConditionProxy slow;
+};
+
+void TestQWebHedging::initTestCase()
+{
+    QMap<QString, QVariant> returns;
+    returns.insert("pingResult", QString("pong"));
+    server.addResponse("ping", BenchmarkData::soapReply("ping", returns));
+    QVERIFY(server.start());
+
+    NetworkConditions conditions;
+    conditions.latency = 400;
+    slow.setTarget(server.url());
+    slow.setConditions(conditions);
+    QVERIFY(slow.start());
+}
+
+QWebMethod *TestQWebHedging::method(const QUrl &url, QObject *parent)
+{
+    QWebMethod *result = new QWebMethod(url, QWebMethod::Soap12,
+                                        QWebMethod::Post, parent);
+    result->setMethodName("ping");
+    result->setTargetNamespace("http://tempuri.org/");
+    return result;
+}
+
+/*
+  Makes a single call through \a service, and returns true if it
+  succeeded.
+  */
+bool TestQWebHedging::call(QWebService *service)
+{
+    QFuture<QWebReply> future = service->invokeMethodAsync("ping");
+    QElapsedTimer timer;
+    timer.start();
+    while (!future.isFinished() && timer.elapsed() < 10000)
+        QTest::qWait(5);
+
+    return future.isFinished() && !future.result().isError();
+}
+
+/*
+  Performs basic checks of a method without hedging.
+  */
+void TestQWebHedging::initialTest()
+{
+    QWebMethod *ping = method(server.url(), this);
+    QCOMPARE(ping->isHedging(), bool(false));
+    QCOMPARE(ping->hedgingStats().calls, qint64(0));
+    QCOMPARE(ping->hedgingStats().delay, int(-1));
+
+    ping->setHedging(50);
+    QCOMPARE(ping->isHedging(), bool(true));
+    QCOMPARE(ping->hedgingStats().delay, int(50));
+
+    ping->setHedging(0, 10, 0);
+    QCOMPARE(ping->isHedging(), bool(false));
+    delete ping;
+}
+
+/*
+  Calls to the slow endpoint have to be answered by duplicates sent
+  to the fast one.
+  */
+void TestQWebHedging::hedgeTest()
+{
+    const int callCount = 6;
+
+    QWebService service;
+    QWebMethod *ping = method(slow.url(), &service);
+    service.addMethod(ping);
+    service.setEndpoints(QList<QUrl>() << slow.url() << server.url());
+    service.setLoadBalancing(QWebService::RoundRobinBalancing);
+    ping->setHedging(50, 100);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < callCount; i++)
+        QVERIFY(call(&service));
+
+    // Without hedging, each call to the slow endpoint takes at least
+    // two times its latency.
+    QVERIFY2(timer.elapsed() < 800, qPrintable(QString::number(timer.elapsed())));
+
+    QWebHedgingStats stats = ping->hedgingStats();
+    QCOMPARE(stats.calls, qint64(callCount));
+    QVERIFY(stats.hedged >= callCount / 2);
+    QVERIFY(stats.wins >= callCount / 2);
+
+    // Winning duplicates count for the fast endpoint, cancelled calls
+    // for none.
+    QList<QWebEndpointStats> endpoints = service.endpointStats();
+    QCOMPARE(endpoints.at(0).outstanding, int(0));
+    QCOMPARE(endpoints.at(1).outstanding, int(0));
+    QCOMPARE(endpoints.at(1).completed, qint64(callCount / 2) + stats.wins);
+    QCOMPARE(endpoints.at(0).completed + stats.wins, qint64(callCount / 2));
+    QCOMPARE(endpoints.at(0).failed + endpoints.at(1).failed, qint64(0));
+}
+
+/*
+  Duplicates must not exceed extra load budget.
+  */
+void TestQWebHedging::budgetTest()
+{
+    const int callCount = 20;
+
+    QWebMethod *ping = method(slow.url(), this);
+    ping->setHedging(20, 25);
+
+    QList<QFuture<QWebReply> > futures;
+    for (int i = 0; i < callCount; i++)
+        futures.append(ping->invokeMethodAsync());
+    foreach (QFuture<QWebReply> future, futures) {
+        QTRY_VERIFY_WITH_TIMEOUT(future.isFinished(), 10000);
+        QCOMPARE(future.result().isError(), bool(false));
+    }
+
+    QWebHedgingStats stats = ping->hedgingStats();
+    QCOMPARE(stats.calls, qint64(callCount));
+    QVERIFY(stats.hedged > 0);
+    QVERIFY(stats.hedged <= callCount / 4);
+    delete ping;
+}
+
+/*
+  Duplicates must not exceed concurrency limit of the host.
+  */
+void TestQWebHedging::concurrencyTest()
+{
+    QWebService service;
+    QWebMethod *ping = method(slow.url(), &service);
+    service.addMethod(ping);
+    service.setAdaptiveConcurrency(true);
+    service.setConcurrencyLimits(1, 1, 1);
+    ping->setHedging(50, 100);
+
+    QVERIFY(call(&service));
+    QCOMPARE(ping->hedgingStats().calls, qint64(1));
+    QCOMPARE(ping->hedgingStats().hedged, qint64(0));
+    QCOMPARE(service.hostStats(slow.url()).inFlight, int(0));
+}
+
+/*
+  With a percentile, delay has to follow observed latency.
+  */
+void TestQWebHedging::percentileTest()
+{
+    QWebService service;
+    QWebMethod *ping = method(server.url(), &service);
+    service.addMethod(ping);
+    ping->setHedging(0, 10, 90);
+    QCOMPARE(ping->isHedging(), bool(true));
+    QCOMPARE(ping->hedgingStats().delay, int(-1));
+
+    for (int i = 0; i < 25; i++)
+        QVERIFY(call(&service));
+
+    QWebHedgingStats stats = ping->hedgingStats();
+    QVERIFY(stats.delay >= 1);
+    QVERIFY(stats.delay < 400);
+    QCOMPARE(stats.calls, qint64(25));
+}
+
+QTEST_MAIN(TestQWebHedging)
+#include "tst_qwebhedging.moc"
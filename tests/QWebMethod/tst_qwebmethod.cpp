@@ -81,6 +81,13 @@ void TestQWebMethod::settersTest()
     QCOMPARE(method->protocolString(), QString("Json"));
     QCOMPARE(method->protocolString(true), QString("Json"));
 
+    // "Soap" aggregator means SOAP 1.2, but SOAP 1.0 is kept as requested.
+    method->setProtocol(QWebMethod::Soap);
+    QCOMPARE(method->protocol(), QWebMethod::Soap12);
+    method->setProtocol(QWebMethod::Soap10);
+    QCOMPARE(method->protocol(), QWebMethod::Soap10);
+    method->setProtocol(QWebMethod::Json);
+
     method->setHttpMethod(QWebMethod::Delete);
     QCOMPARE(method->httpMethod(), QWebMethod::Delete);
     QCOMPARE(method->httpMethodString(), QString("Delete"));
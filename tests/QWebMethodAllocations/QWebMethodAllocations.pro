@@ -0,0 +1,11 @@
+include(../../buildInfo.pri)
+
+QT += testlib
+
+include(../../libraryIncludes.pri)
+
+DESTDIR = $${TESTS_DIRECTORY}/QWebMethodAllocations
+OBJECTS_DIR = $${TESTS_DIRECTORY}/QWebMethodAllocations
+MOC_DIR = $${TESTS_DIRECTORY}/QWebMethodAllocations
+
+SOURCES += tst_qwebmethodallocations.cpp
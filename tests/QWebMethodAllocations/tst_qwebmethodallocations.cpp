@@ -0,0 +1,405 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebMethod test suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <cstdlib>
+#include <QtTest/QtTest>
+#include <qwebmethod.h>
+#include <qwebmethod_p.h>
+
+/*
+  Counting allocator. On glibc, malloc() family is replaced for the whole
+  process (including Qt and QWebService libraries, and operator new,
+  which uses malloc()). Only allocations made by the thread that enabled
+  counting are recorded.
+  */
+#if defined(__GLIBC__)
+#define COUNT_ALLOCATIONS
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void __libc_free(void *pointer);
+}
+
+static __thread bool countingEnabled = false;
+static __thread quint64 allocationCount = 0;
+static __thread quint64 allocatedBytes = 0;
+
+static inline void countAllocation(size_t size)
+{
+    if (countingEnabled) {
+        ++allocationCount;
+        allocatedBytes += size;
+    }
+}
+
+extern "C" void *malloc(size_t size) __THROW
+{
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) __THROW
+{
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size) __THROW
+{
+    countAllocation(size);
+    return __libc_realloc(pointer, size);
+}
+
+extern "C" void free(void *pointer) __THROW
+{
+    __libc_free(pointer);
+}
+#endif
+
+Q_DECLARE_METATYPE(QWebMethod::Protocol)
+
+// Calls measured (after a warm-up call), and number of parameters
+// or return values used.
+static const int calls = 20;
+static const int valueCount = 12;
+
+/*
+  This test guards the per-call hot path of QWebMethod against allocation
+  regressions: number of heap allocations and bytes allocated per call
+  must stay under given bounds, for every protocol. Bounds have some
+  headroom, to accommodate differences between Qt versions.
+  It does not require Internet connection.
+  */
+class TestQWebMethodAllocations : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Operation {
+        PrepareRequestData,
+        ReplyRead,
+        ReplyReadParsed,
+        ParameterNamesTypes
+    };
+
+private slots:
+    void initTestCase();
+    void serializationTest_data();
+    void serializationTest();
+    void prepareRequestDataTest_data();
+    void prepareRequestDataTest();
+    void replyReadTest();
+    void replyReadParsedTest_data();
+    void replyReadParsedTest();
+    void parameterNamesTypesTest();
+
+private:
+    struct Allocations {
+        quint64 count;
+        quint64 bytes;
+    };
+
+    Allocations measure(QWebMethod *method, Operation operation);
+    static QMap<QString, QVariant> testParameters(int count);
+    static QMap<QString, QVariant> testReturnValues(int count);
+    static QByteArray testReply(const QString &methodName, int count);
+};
+
+void TestQWebMethodAllocations::initTestCase()
+{
+#ifndef COUNT_ALLOCATIONS
+    QSKIP("Allocation counting is only implemented for glibc.");
+#endif
+}
+
+/*
+  Runs \a operation once (so that lazily initialised data does not
+  count), then returns average allocations of a single call.
+  */
+TestQWebMethodAllocations::Allocations TestQWebMethodAllocations::measure(
+        QWebMethod *method, Operation operation)
+{
+    QWebMethodPrivate *d = QWebMethodPrivate::get(method);
+    QMap<QString, QVariant> map;
+    QVariant variant;
+    QString string;
+    Allocations result = { 0, 0 };
+
+    for (int i = 0; i <= calls; ++i) {
+#ifdef COUNT_ALLOCATIONS
+        // First call is a warm-up.
+        countingEnabled = (i > 0);
+#endif
+        switch (operation) {
+        case PrepareRequestData:
+            d->prepareRequestData();
+            break;
+        case ReplyRead:
+            string = method->replyRead();
+            break;
+        case ReplyReadParsed:
+            variant = method->replyReadParsed();
+            break;
+        case ParameterNamesTypes:
+            map = method->parameterNamesTypes();
+            break;
+        }
+    }
+
+#ifdef COUNT_ALLOCATIONS
+    countingEnabled = false;
+    result.count = allocationCount / calls;
+    result.bytes = allocatedBytes / calls;
+    allocationCount = 0;
+    allocatedBytes = 0;
+#endif
+
+    return result;
+}
+
+/*
+  Returns \a count parameters: ints, doubles and strings, in turns.
+  */
+QMap<QString, QVariant> TestQWebMethodAllocations::testParameters(int count)
+{
+    QMap<QString, QVariant> result;
+
+    for (int i = 0; i < count; ++i) {
+        QString name = QLatin1String("param") + QString::number(i);
+
+        if (i % 3 == 0)
+            result.insert(name, QVariant(i * 7));
+        else if (i % 3 == 1)
+            result.insert(name, QVariant(i * 0.5));
+        else
+            result.insert(name, QVariant(QString(QLatin1String("text ")
+                                                 + QString::number(i))));
+    }
+
+    return result;
+}
+
+/*
+  Returns \a count return value types: ints, doubles and strings, in turns.
+  */
+QMap<QString, QVariant> TestQWebMethodAllocations::testReturnValues(int count)
+{
+    QMap<QString, QVariant> result;
+
+    for (int i = 0; i < count; ++i) {
+        QString name = QLatin1String("result") + QString::number(i);
+
+        if (i % 3 == 0)
+            result.insert(name, QVariant(int()));
+        else if (i % 3 == 1)
+            result.insert(name, QVariant(double()));
+        else
+            result.insert(name, QVariant(QString()));
+    }
+
+    return result;
+}
+
+/*
+  Returns SOAP 1.2 reply of \a methodName, with \a count return values
+  (matching testReturnValues()).
+  */
+QByteArray TestQWebMethodAllocations::testReply(const QString &methodName, int count)
+{
+    QByteArray result("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n"
+                      "<soap12:Envelope xmlns:soap12=\"http://www.w3.org/2003/05/soap-envelope\">\r\n"
+                      "  <soap12:Body>\r\n    <");
+    result.append(methodName.toUtf8() + "Response xmlns=\"http://tempuri.org/\">\r\n");
+
+    for (int i = 0; i < count; ++i) {
+        QByteArray name = "result" + QByteArray::number(i);
+        result.append("      <" + name + ">");
+        if (i % 3 == 2)
+            result.append("text &lt;" + QByteArray::number(i) + "&gt;");
+        else
+            result.append(QByteArray::number(i));
+        result.append("</" + name + ">\r\n");
+    }
+
+    result.append("    </" + methodName.toUtf8() + "Response>\r\n"
+                  "  </soap12:Body>\r\n</soap12:Envelope>");
+    return result;
+}
+
+void TestQWebMethodAllocations::serializationTest_data()
+{
+    QTest::addColumn<QWebMethod::Protocol>("protocol");
+    QTest::addColumn<QByteArray>("expected");
+
+    const QByteArray envelope =
+            "<?xml version=\"1.0\" encoding=\"utf-8\"?> \r\n"
+            " <%1:Envelope xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
+            "xmlns:xsd=\"http://www.w3.org/2001/XMLSchema\" "
+            "xmlns:%1=\"http://www.w3.org/2003/05/soap-envelope\"> \r\n"
+            " <%1:Body> \r\n"
+            "\t<testMethod xmlns=\"http://tempuri.org/\"> \r\n"
+            "\t\t<a>1</a> \r\n"
+            "\t\t<b>text</b> \r\n"
+            "\t</testMethod> \r\n"
+            "</%1:Body> \r\n"
+            "</%1:Envelope>";
+
+    QTest::newRow("soap12") << QWebMethod::Soap12
+                            << QByteArray(envelope).replace("%1", "soap12");
+    QTest::newRow("soap10") << QWebMethod::Soap10
+                            << QByteArray(envelope).replace("%1", "soap");
+    QTest::newRow("http") << QWebMethod::Http << QByteArray("a=1&b=text");
+    QTest::newRow("json") << QWebMethod::Json
+                          << QByteArray("{\r\n{\r\n\t\"a\" : \"1\"\r\n"
+                                        "{\r\n\t\"b\" : \"text\"\r\n}");
+    QTest::newRow("xml") << QWebMethod::Xml
+                         << QByteArray("\t\t<a>1</a> \r\n\t\t<b>text</b> \r\n");
+}
+
+/*
+  Makes sure that request data is exactly the same as it used to be,
+  before allocations were reduced.
+  */
+void TestQWebMethodAllocations::serializationTest()
+{
+    QFETCH(QWebMethod::Protocol, protocol);
+    QFETCH(QByteArray, expected);
+
+    QWebMethod method(0, protocol, QWebMethod::Post);
+    method.setMethodName("testMethod");
+    method.setTargetNamespace("http://tempuri.org/");
+    QMap<QString, QVariant> parameters;
+    parameters.insert("a", QVariant(1));
+    parameters.insert("b", QVariant(QString("text")));
+    method.setParameters(parameters);
+
+    QWebMethodPrivate *d = QWebMethodPrivate::get(&method);
+    d->prepareRequestData();
+    QCOMPARE(d->data, expected);
+}
+
+void TestQWebMethodAllocations::prepareRequestDataTest_data()
+{
+    QTest::addColumn<QWebMethod::Protocol>("protocol");
+
+    QTest::newRow("soap12") << QWebMethod::Soap12;
+    QTest::newRow("soap10") << QWebMethod::Soap10;
+    QTest::newRow("http") << QWebMethod::Http;
+    QTest::newRow("json") << QWebMethod::Json;
+    QTest::newRow("xml") << QWebMethod::Xml;
+}
+
+/*
+  Request serialization. Apart from the request buffer, only conversion
+  of non-string parameters (two thirds of them here) may allocate.
+  */
+void TestQWebMethodAllocations::prepareRequestDataTest()
+{
+    QFETCH(QWebMethod::Protocol, protocol);
+
+    QWebMethod method(0, protocol, QWebMethod::Post);
+    method.setMethodName("testMethod");
+    method.setTargetNamespace("http://tempuri.org/");
+    method.setParameters(testParameters(valueCount));
+
+    Allocations allocations = measure(&method, PrepareRequestData);
+    const quint64 size = QWebMethodPrivate::get(&method)->data.size();
+    const quint64 nonStringParameters = valueCount - (valueCount / 3);
+
+    QVERIFY(size > 0);
+    QVERIFY2(allocations.count <= 6 + (4 * nonStringParameters),
+             qPrintable(QString("%1 allocations per call").arg(allocations.count)));
+    QVERIFY2(allocations.bytes <= (4 * size) + 2048,
+             qPrintable(QString("%1 bytes per call").arg(allocations.bytes)));
+}
+
+/*
+  Reply conversion: a copy of the reply, and entity replacement.
+  */
+void TestQWebMethodAllocations::replyReadTest()
+{
+    QWebMethod method(0, QWebMethod::Soap12, QWebMethod::Post);
+    method.setMethodName("testMethod");
+    QWebMethodPrivate *d = QWebMethodPrivate::get(&method);
+    d->reply = testReply(method.methodName(), valueCount);
+
+    Allocations allocations = measure(&method, ReplyRead);
+    const quint64 size = d->reply.size();
+
+    QVERIFY2(allocations.count <= 6,
+             qPrintable(QString("%1 allocations per call").arg(allocations.count)));
+    QVERIFY2(allocations.bytes <= (5 * size) + 1024,
+             qPrintable(QString("%1 bytes per call").arg(allocations.bytes)));
+}
+
+void TestQWebMethodAllocations::replyReadParsedTest_data()
+{
+    QTest::addColumn<QWebMethod::Protocol>("protocol");
+
+    QTest::newRow("soap12") << QWebMethod::Soap12;
+    QTest::newRow("xml") << QWebMethod::Xml;
+    QTest::newRow("http") << QWebMethod::Http;
+}
+
+/*
+  Reply parsing: reply conversion, and a few allocations for each
+  return value (value string and list node). Bytes must not depend on
+  the number of values multiplied by reply size.
+  */
+void TestQWebMethodAllocations::replyReadParsedTest()
+{
+    QFETCH(QWebMethod::Protocol, protocol);
+
+    QWebMethod method(0, protocol, QWebMethod::Post);
+    method.setMethodName("testMethod");
+    method.setReturnValue(testReturnValues(valueCount));
+    QWebMethodPrivate *d = QWebMethodPrivate::get(&method);
+    d->reply = testReply(method.methodName(), valueCount);
+
+    QVariant parsed = method.replyReadParsed();
+    if (protocol != QWebMethod::Http) {
+        QCOMPARE(parsed.toList().size(), valueCount);
+        QCOMPARE(parsed.toList().at(0), QVariant(0));
+        // Map order: result0, result1, result10, result11, result2...
+        QCOMPARE(parsed.toList().at(4), QVariant(QString("text <2>")));
+    }
+
+    Allocations allocations = measure(&method, ReplyReadParsed);
+    const quint64 size = d->reply.size();
+
+    QVERIFY2(allocations.count <= 8 + (4 * valueCount),
+             qPrintable(QString("%1 allocations per call").arg(allocations.count)));
+    QVERIFY2(allocations.bytes <= (6 * size) + 2048,
+             qPrintable(QString("%1 bytes per call").arg(allocations.bytes)));
+}
+
+/*
+  Parameter map is returned as an implicitly shared copy.
+  */
+void TestQWebMethodAllocations::parameterNamesTypesTest()
+{
+    QWebMethod method(0, QWebMethod::Soap12, QWebMethod::Post);
+    method.setParameters(testParameters(valueCount));
+
+    Allocations allocations = measure(&method, ParameterNamesTypes);
+    QCOMPARE(allocations.count, quint64(0));
+}
+
+QTEST_MAIN(TestQWebMethodAllocations)
+#include "tst_qwebmethodallocations.moc"
@@ -0,0 +1,12 @@
+include(../../buildInfo.pri)
+
+QT += testlib
+
+include(../../libraryIncludes.pri)
+include(../../benchmarks/common/common.pri)
+
+DESTDIR = $${TESTS_DIRECTORY}/QWebMirror
+OBJECTS_DIR = $${TESTS_DIRECTORY}/QWebMirror
+MOC_DIR = $${TESTS_DIRECTORY}/QWebMirror
+
+SOURCES += tst_qwebmirror.cpp
@@ -0,0 +1,228 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebMirror test suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+#include <QtTest/QtTest>
+#include <qwebmethod.h>
+#include <qwebservice.h>
+#include <qwebreply.h>
+#include "benchmarkdata.h"
+#include "networkconditionproxy.h"
+#include "soapstandinserver.h"
+
+/*
+  This test checks mirroring of QWebService calls to a shadow endpoint:
+  comparison of replies, sampling, limit of mirrored calls in flight
+  and failing mirrors.
+  */
+class TestQWebMirror : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void initialTest();
+    void mirrorTest();
+    void mismatchTest();
+    void samplingTest();
+    void maxInFlightTest();
+    void mirrorErrorTest();
+
+private:
+    QWebMethod *method(QObject *parent);
+    void callAll(QWebService *service, int count);
+
+    SoapStandInServer primary;
+    SoapStandInServer shadow;
+    SoapStandInServer changed;
+};
+
+void TestQWebMirror::initTestCase()
+{
+    QMap<QString, QVariant> returns;
+    returns.insert("pingResult", QString("pong"));
+    primary.addResponse("ping", BenchmarkData::soapReply("ping", returns));
+    shadow.addResponse("ping", BenchmarkData::soapReply("ping", returns));
+
+    QMap<QString, QVariant> changedReturns;
+    changedReturns.insert("pingResult", QString("pong, version 2"));
+    changed.addResponse("ping", BenchmarkData::soapReply("ping", changedReturns));
+
+    QVERIFY(primary.start());
+    QVERIFY(shadow.start());
+    QVERIFY(changed.start());
+}
+
+QWebMethod *TestQWebMirror::method(QObject *parent)
+{
+    QWebMethod *result = new QWebMethod(primary.url(), QWebMethod::Soap12,
+                                        QWebMethod::Post, parent);
+    result->setMethodName("ping");
+    result->setTargetNamespace("http://tempuri.org/");
+    return result;
+}
+
+/*
+  Makes \a count calls at once, and waits for all of them.
+  */
+void TestQWebMirror::callAll(QWebService *service, int count)
+{
+    QList<QFuture<QWebReply> > futures;
+    for (int i = 0; i < count; i++)
+        futures.append(service->invokeMethodAsync("ping"));
+    foreach (QFuture<QWebReply> future, futures)
+        QTRY_VERIFY_WITH_TIMEOUT(future.isFinished(), 10000);
+}
+
+/*
+  Performs basic checks of a service without mirroring.
+  */
+void TestQWebMirror::initialTest()
+{
+    QWebService service;
+    QCOMPARE(service.mirrorUrl(), QUrl());
+    QVERIFY(service.mirrorStats().isEmpty());
+
+    service.setMirror(shadow.url());
+    QCOMPARE(service.mirrorUrl(), shadow.url());
+    service.setMirror(QUrl());
+    QCOMPARE(service.mirrorUrl(), QUrl());
+}
+
+/*
+  All calls have to be copied to the mirror, and both replies
+  compared, without mismatches.
+  */
+void TestQWebMirror::mirrorTest()
+{
+    const int callCount = 10;
+
+    QWebService service;
+    service.addMethod(method(&service));
+    service.setMirror(shadow.url());
+
+    const int primaryBefore = primary.requestCount();
+    const int shadowBefore = shadow.requestCount();
+    callAll(&service, callCount);
+
+    QTRY_COMPARE_WITH_TIMEOUT(service.mirrorStats().value(0).compared,
+                              qint64(callCount), 10000);
+    QCOMPARE(primary.requestCount() - primaryBefore, int(callCount));
+    QCOMPARE(shadow.requestCount() - shadowBefore, int(callCount));
+
+    const QWebMirrorStats stats = service.mirrorStats().at(0);
+    QCOMPARE(stats.methodName, QString("ping"));
+    QCOMPARE(stats.mirrored, qint64(callCount));
+    QCOMPARE(stats.dropped, qint64(0));
+    QCOMPARE(stats.mismatches, qint64(0));
+    QCOMPARE(stats.mirrorErrors, qint64(0));
+    QVERIFY(stats.primaryLatency > 0);
+    QVERIFY(stats.mirrorLatency > 0);
+}
+
+/*
+  Mirror replying differently has to be reported.
+  */
+void TestQWebMirror::mismatchTest()
+{
+    const int callCount = 4;
+
+    QWebService service;
+    service.addMethod(method(&service));
+    service.setMirror(changed.url());
+    callAll(&service, callCount);
+
+    QTRY_COMPARE_WITH_TIMEOUT(service.mirrorStats().value(0).compared,
+                              qint64(callCount), 10000);
+    QCOMPARE(service.mirrorStats().at(0).mismatches, qint64(callCount));
+    QCOMPARE(service.mirrorStats().at(0).mirrorErrors, qint64(0));
+}
+
+/*
+  Calls which are not sampled must not be mirrored, nor counted.
+  */
+void TestQWebMirror::samplingTest()
+{
+    QWebService service;
+    service.addMethod(method(&service));
+    service.setMirror(shadow.url(), 0.0);
+
+    const int shadowBefore = shadow.requestCount();
+    callAll(&service, 5);
+
+    QCOMPARE(shadow.requestCount(), shadowBefore);
+    QVERIFY(service.mirrorStats().isEmpty());
+}
+
+/*
+  Slow mirror must not get more calls than allowed. Calls above the
+  limit are dropped, and original calls are not delayed.
+  */
+void TestQWebMirror::maxInFlightTest()
+{
+    const int callCount = 6;
+    const int maxInFlight = 2;
+
+    NetworkConditions conditions;
+    conditions.latency = 500;
+    NetworkConditionProxy slowShadow;
+    slowShadow.setTarget(shadow.url());
+    slowShadow.setConditions(conditions);
+    QVERIFY(slowShadow.start());
+
+    QWebService service;
+    service.addMethod(method(&service));
+    service.setMirror(slowShadow.url(), 1.0, maxInFlight);
+
+    QElapsedTimer timer;
+    timer.start();
+    callAll(&service, callCount);
+    QVERIFY2(timer.elapsed() < 500, qPrintable(QString::number(timer.elapsed())));
+
+    QWebMirrorStats stats = service.mirrorStats().at(0);
+    QCOMPARE(stats.mirrored, qint64(maxInFlight));
+    QCOMPARE(stats.dropped, qint64(callCount - maxInFlight));
+
+    QTRY_COMPARE_WITH_TIMEOUT(service.mirrorStats().at(0).compared,
+                              qint64(maxInFlight), 10000);
+    stats = service.mirrorStats().at(0);
+    QCOMPARE(stats.mismatches, qint64(0));
+    QVERIFY(stats.mirrorLatency > stats.primaryLatency);
+}
+
+/*
+  Mirror which can not be reached has to be counted as failing,
+  and its calls as mismatched.
+  */
+void TestQWebMirror::mirrorErrorTest()
+{
+    QTcpServer server;
+    server.listen(QHostAddress::LocalHost);
+    const QUrl dead(QString("http://127.0.0.1:%1/").arg(server.serverPort()));
+    server.close();
+
+    QWebService service;
+    service.addMethod(method(&service));
+    service.setMirror(dead);
+    callAll(&service, 3);
+
+    QTRY_COMPARE_WITH_TIMEOUT(service.mirrorStats().value(0).compared,
+                              qint64(3), 10000);
+    QCOMPARE(service.mirrorStats().at(0).mirrorErrors, qint64(3));
+    QCOMPARE(service.mirrorStats().at(0).mismatches, qint64(3));
+}
+
+QTEST_MAIN(TestQWebMirror)
+#include "tst_qwebmirror.moc"
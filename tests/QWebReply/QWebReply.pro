@@ -0,0 +1,12 @@
+include(../../buildInfo.pri)
+
+QT += testlib
+
+include(../../libraryIncludes.pri)
+include(../../benchmarks/common/common.pri)
+
+DESTDIR = $${TESTS_DIRECTORY}/QWebReply
+OBJECTS_DIR = $${TESTS_DIRECTORY}/QWebReply
+MOC_DIR = $${TESTS_DIRECTORY}/QWebReply
+
+SOURCES += tst_qwebreply.cpp
@@ -0,0 +1,283 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebReply test suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <qwebmethod.h>
+#include <qwebservice.h>
+#include <qwebreply.h>
+#include <qwebmethod_p.h>
+#include "benchmarkdata.h"
+#include "soapstandinserver.h"
+
+/*
+  This test checks QWebReply, future-based calls
+  (QWebMethod::invokeMethodAsync()) and batch delivery.
+  */
+class TestQWebReply : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void initialTest();
+    void futureTest();
+    void concurrentFuturesTest();
+    void errorTest();
+    void deletedMethodTest();
+    void decodePoolTest();
+    void decodeOrderTest();
+    void batchDeliveryTest();
+
+private:
+    QWebMethod *method(const QString &name, QObject *parent = 0);
+
+    SoapStandInServer server;
+};
+
+void TestQWebReply::initTestCase()
+{
+    QMap<QString, QVariant> returns;
+    returns.insert("pingResult", QString("pong"));
+    server.addResponse("ping", BenchmarkData::soapReply("ping", returns));
+    QVERIFY(server.start());
+}
+
+QWebMethod *TestQWebReply::method(const QString &name, QObject *parent)
+{
+    QWebMethod *result = new QWebMethod(server.url(), QWebMethod::Soap12,
+                                        QWebMethod::Post, parent);
+    result->setMethodName(name);
+    result->setTargetNamespace("http://tempuri.org/");
+    return result;
+}
+
+/*
+  Performs basic checks of an empty reply.
+  */
+void TestQWebReply::initialTest()
+{
+    QWebReply reply;
+    QCOMPARE(reply.isError(), bool(false));
+    QCOMPARE(reply.error(), QNetworkReply::NoError);
+    QCOMPARE(reply.httpStatus(), int(0));
+    QVERIFY(reply.data().isEmpty());
+    QVERIFY(reply.text().isEmpty());
+    QVERIFY(!reply.value().isValid());
+}
+
+/*
+  Future has to be fulfilled with raw, text and parsed reply.
+  */
+void TestQWebReply::futureTest()
+{
+    QWebMethod *ping = method("ping", this);
+    QMap<QString, QVariant> returns;
+    returns.insert("pingResult", QString());
+    ping->setReturnValue(returns);
+
+    QFuture<QWebReply> future = ping->invokeMethodAsync();
+    QCOMPARE(future.isFinished(), bool(false));
+    QTRY_VERIFY_WITH_TIMEOUT(future.isFinished(), 10000);
+
+    QWebReply reply = future.result();
+    QCOMPARE(reply.isError(), bool(false));
+    QCOMPARE(reply.httpStatus(), int(200));
+    QCOMPARE(reply.methodName(), QString("ping"));
+    QVERIFY(reply.data().contains("pong"));
+    QVERIFY(reply.text().contains("pong"));
+    QCOMPARE(reply.value().toString(), QString("pong"));
+    delete ping;
+}
+
+/*
+  Several calls of the same method in flight: each future gets
+  its own reply.
+  */
+void TestQWebReply::concurrentFuturesTest()
+{
+    QWebMethod *ping = method("ping", this);
+    QList<QFuture<QWebReply> > futures;
+    for (int i = 0; i < 5; i++)
+        futures.append(ping->invokeMethodAsync());
+
+    foreach (const QFuture<QWebReply> &future, futures) {
+        QTRY_VERIFY_WITH_TIMEOUT(future.isFinished(), 10000);
+        QVERIFY(future.result().data().contains("pong"));
+    }
+    delete ping;
+}
+
+/*
+  Server error (SOAP fault), and calls to unknown methods, have to
+  fail the future.
+  */
+void TestQWebReply::errorTest()
+{
+    QWebMethod *unknown = method("unknown", this);
+    QFuture<QWebReply> future = unknown->invokeMethodAsync();
+    QTRY_VERIFY_WITH_TIMEOUT(future.isFinished(), 10000);
+
+    bool thrown = false;
+    try {
+        future.waitForFinished();
+    } catch (const QWebReplyException &e) {
+        thrown = true;
+        QCOMPARE(e.reply().isError(), bool(true));
+        QCOMPARE(e.reply().httpStatus(), int(500));
+        QVERIFY(e.reply().data().contains("Fault"));
+    }
+    QCOMPARE(thrown, bool(true));
+    delete unknown;
+
+    QWebService service;
+    future = service.invokeMethodAsync("noSuchMethod");
+    QCOMPARE(future.isFinished(), bool(true));
+    QVERIFY_EXCEPTION_THROWN(future.waitForFinished(), QWebReplyException);
+}
+
+/*
+  Deleting a method must not leave its futures pending forever.
+  */
+void TestQWebReply::deletedMethodTest()
+{
+    QWebMethod *ping = method("ping");
+    QFuture<QWebReply> future = ping->invokeMethodAsync();
+    delete ping;
+
+    QCOMPARE(future.isFinished(), bool(true));
+    QVERIFY_EXCEPTION_THROWN(future.waitForFinished(), QWebReplyException);
+}
+
+/*
+  Replies decoded in a thread pool have to be the same as
+  replies decoded in place.
+  */
+void TestQWebReply::decodePoolTest()
+{
+    QThreadPool pool;
+    pool.setMaxThreadCount(2);
+
+    QWebMethod *ping = method("ping", this);
+    QMap<QString, QVariant> returns;
+    returns.insert("pingResult", QString());
+    ping->setReturnValue(returns);
+    ping->setDecodePool(&pool);
+    QCOMPARE(ping->decodePool(), &pool);
+
+    QList<QFuture<QWebReply> > futures;
+    for (int i = 0; i < 8; i++)
+        futures.append(ping->invokeMethodAsync());
+
+    foreach (const QFuture<QWebReply> &future, futures) {
+        QTRY_VERIFY_WITH_TIMEOUT(future.isFinished(), 10000);
+        QCOMPARE(future.result().value().toString(), QString("pong"));
+    }
+
+    delete ping;
+    pool.waitForDone();
+}
+
+/*
+  Futures decoded in a pool are completed in the order in which their
+  calls finished, even if a later reply is decoded first.
+  */
+void TestQWebReply::decodeOrderTest()
+{
+    QThreadPool pool;
+    pool.setMaxThreadCount(4);
+
+    QWebMethod *ping = method("ping", this);
+    ping->setDecodePool(&pool);
+    QWebMethodPrivate *d = QWebMethodPrivate::get(ping);
+
+    const int count = 6;
+    QList<int> completionOrder;
+    QList<QFutureWatcher<QWebReply> *> watchers;
+
+    for (int i = 0; i < count; i++) {
+        QFutureInterface<QWebReply> promise;
+        promise.reportStarted();
+        d->promises.insert(quint64(i + 1), promise);
+
+        QFutureWatcher<QWebReply> *watcher = new QFutureWatcher<QWebReply>(this);
+        connect(watcher, &QFutureWatcherBase::finished, [i, &completionOrder]() {
+            completionOrder.append(i);
+        });
+        watcher->setFuture(promise.future());
+        watchers.append(watcher);
+    }
+
+    // First reply is large, so it takes longest to decode.
+    QMap<QString, QVariant> large = BenchmarkData::returnValues(BenchmarkData::Large);
+    for (int i = 0; i < count; i++) {
+        d->reply = BenchmarkData::soapReply("ping", (i == 0) ? large
+                                                            : QMap<QString, QVariant>());
+        d->finishCall(quint64(i + 1), QNetworkReply::NoError, QString(), 200);
+    }
+
+    QTRY_COMPARE_WITH_TIMEOUT(completionOrder.size(), count, 10000);
+    for (int i = 0; i < count; i++)
+        QCOMPARE(completionOrder.at(i), i);
+
+    qDeleteAll(watchers);
+    delete ping;
+    pool.waitForDone();
+}
+
+/*
+  In batch mode, QWebService delivers replies through repliesReady()
+  only, several at once.
+  */
+void TestQWebReply::batchDeliveryTest()
+{
+    const int callCount = 5;
+
+    QWebService service;
+    QWebMethod *ping = method("ping", &service);
+    service.addMethod(ping);
+    service.setBatchDelivery(true, 100);
+    QCOMPARE(service.isBatchDelivery(), bool(true));
+
+    int batches = 0;
+    QList<QWebReply> replies;
+    connect(&service, &QWebService::repliesReady,
+            [&batches, &replies](const QList<QWebReply> &batch) {
+        batches++;
+        replies += batch;
+    });
+    QSignalSpy singleSpy(&service, SIGNAL(replyReady(QByteArray,QString)));
+
+    for (int i = 0; i < callCount; i++)
+        QCOMPARE(service.invokeMethod("ping"), bool(true));
+
+    QTRY_COMPARE_WITH_TIMEOUT(replies.size(), callCount, 10000);
+    QVERIFY(batches < callCount);
+    QCOMPARE(singleSpy.count(), int(0));
+    foreach (const QWebReply &reply, replies) {
+        QCOMPARE(reply.methodName(), QString("ping"));
+        QVERIFY(reply.text().contains("pong"));
+    }
+
+    service.setBatchDelivery(false);
+    QCOMPARE(service.isBatchDelivery(), bool(false));
+    QCOMPARE(service.invokeMethod("ping"), bool(true));
+    QVERIFY(singleSpy.wait(10000));
+    QCOMPARE(replies.size(), callCount);
+}
+
+QTEST_MAIN(TestQWebReply)
+#include "tst_qwebreply.moc"
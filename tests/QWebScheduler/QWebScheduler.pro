@@ -0,0 +1,12 @@
+include(../../buildInfo.pri)
+
+QT += testlib
+
+include(../../libraryIncludes.pri)
+include(../../benchmarks/common/common.pri)
+
+DESTDIR = $${TESTS_DIRECTORY}/QWebScheduler
+OBJECTS_DIR = $${TESTS_DIRECTORY}/QWebScheduler
+MOC_DIR = $${TESTS_DIRECTORY}/QWebScheduler
+
+SOURCES += tst_qwebscheduler.cpp
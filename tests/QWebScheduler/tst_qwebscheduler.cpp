@@ -0,0 +1,361 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebScheduler test suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <qwebmethod.h>
+#include <qwebservice.h>
+#include <qwebreply.h>
+#include <qwebscheduler_p.h>
+#include "benchmarkdata.h"
+#include "networkconditionproxy.h"
+#include "soapstandinserver.h"
+
+/*
+  This test checks per-host concurrency limiting of QWebService
+  (setAdaptiveConcurrency()), priorities and connection lanes.
+  */
+class TestQWebScheduler : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void initialTest();
+    void fixedLimitTest();
+    void rejectTest();
+    void unknownMethodTest();
+    void aimdTest();
+    void priorityTest();
+    void priorityQueueLengthTest();
+    void watermarkTest();
+    void laneTest();
+    void laneConnectionTest();
+
+private:
+    QWebMethod *method(const QString &name, QObject *parent = 0);
+
+    SoapStandInServer server;
+};
+
+void TestQWebScheduler::initTestCase()
+{
+    QMap<QString, QVariant> returns;
+    returns.insert("pingResult", QString("pong"));
+    server.addResponse("ping", BenchmarkData::soapReply("ping", returns));
+    returns.clear();
+    returns.insert("urgentResult", QString("done"));
+    server.addResponse("urgent", BenchmarkData::soapReply("urgent", returns));
+    QVERIFY(server.start());
+}
+
+QWebMethod *TestQWebScheduler::method(const QString &name, QObject *parent)
+{
+    QWebMethod *result = new QWebMethod(server.url(), QWebMethod::Soap12,
+                                        QWebMethod::Post, parent);
+    result->setMethodName(name);
+    result->setTargetNamespace("http://tempuri.org/");
+    return result;
+}
+
+/*
+  Performs basic checks of a service without adaptive concurrency.
+  */
+void TestQWebScheduler::initialTest()
+{
+    QWebService service;
+    QCOMPARE(service.isAdaptiveConcurrency(), bool(false));
+    QCOMPARE(service.maxQueueLength(), int(-1));
+    QVERIFY(service.hostStats().isEmpty());
+
+    QWebHostStats stats = service.hostStats(server.url());
+    QCOMPARE(stats.inFlight, int(0));
+    QCOMPARE(stats.queued, int(0));
+    QCOMPARE(stats.rejected, qint64(0));
+    QVERIFY(stats.limit > 0);
+}
+
+/*
+  With a fixed limit, calls above it have to wait in the queue,
+  and all of them have to be sent eventually.
+  */
+void TestQWebScheduler::fixedLimitTest()
+{
+    const int callCount = 10;
+
+    QWebService service;
+    service.addMethod(method("ping", &service));
+    service.setAdaptiveConcurrency(true);
+    service.setConcurrencyLimits(2, 2, 2);
+    QCOMPARE(service.isAdaptiveConcurrency(), bool(true));
+
+    QSignalSpy spy(&service, SIGNAL(replyReady(QByteArray,QString)));
+    for (int i = 0; i < callCount; i++)
+        QCOMPARE(service.invokeMethod("ping"), bool(true));
+
+    QWebHostStats stats = service.hostStats(server.url());
+    QCOMPARE(stats.limit, int(2));
+    QCOMPARE(stats.inFlight, int(2));
+    QCOMPARE(stats.queued, int(callCount - 2));
+    QCOMPARE(service.hostStats().size(), int(1));
+
+    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), callCount, 10000);
+    stats = service.hostStats(server.url());
+    QCOMPARE(stats.inFlight, int(0));
+    QCOMPARE(stats.queued, int(0));
+    QCOMPARE(stats.completed, qint64(callCount));
+    QVERIFY(stats.lastLatency > 0);
+    QCOMPARE(server.requestCount() >= callCount, bool(true));
+}
+
+/*
+  Calls above queue length have to be rejected, and counted.
+  */
+void TestQWebScheduler::rejectTest()
+{
+    QWebService service;
+    service.addMethod(method("ping", &service));
+    service.setAdaptiveConcurrency(true);
+    service.setConcurrencyLimits(1, 1, 1);
+    service.setMaxQueueLength(2);
+
+    QCOMPARE(service.invokeMethod("ping"), bool(true));
+    QFuture<QWebReply> queued = service.invokeMethodAsync("ping");
+    QCOMPARE(service.invokeMethod("ping"), bool(true));
+    QCOMPARE(service.invokeMethod("ping"), bool(false));
+
+    QFuture<QWebReply> rejected = service.invokeMethodAsync("ping");
+    QCOMPARE(rejected.isFinished(), bool(true));
+    QVERIFY_EXCEPTION_THROWN(rejected.waitForFinished(), QWebReplyException);
+
+    QWebHostStats stats = service.hostStats(server.url());
+    QCOMPARE(stats.rejected, qint64(2));
+    QCOMPARE(stats.queued, int(2));
+
+    QTRY_VERIFY_WITH_TIMEOUT(queued.isFinished(), 10000);
+    QVERIFY(queued.result().data().contains("pong"));
+    QTRY_COMPARE_WITH_TIMEOUT(service.hostStats(server.url()).completed, qint64(3), 10000);
+}
+
+/*
+  Unknown method has to be refused before it reaches the scheduler.
+  */
+void TestQWebScheduler::unknownMethodTest()
+{
+    QWebService service;
+    service.addMethod(method("ping", &service));
+    service.setAdaptiveConcurrency(true);
+
+    QCOMPARE(service.invokeMethod("noSuchMethod"), bool(false));
+    QFuture<QWebReply> future = service.invokeMethodAsync("noSuchMethod");
+    QCOMPARE(future.isFinished(), bool(true));
+    QVERIFY_EXCEPTION_THROWN(future.waitForFinished(), QWebReplyException);
+    QCOMPARE(service.hostStats(server.url()).queued, int(0));
+}
+
+/*
+  Limit has to grow slowly on fast replies (only while it is used),
+  and shrink multiplicatively - once per round trip - on slow replies
+  and overload errors.
+  */
+void TestQWebScheduler::aimdTest()
+{
+    QWebScheduler scheduler;
+    scheduler.enabled = true;
+    scheduler.minLimit = 1;
+    scheduler.maxLimit = 100;
+
+    // Limit in use: grows by 1/limit.
+    scheduler.initialLimit = 1;
+    scheduler.adjustLimit("a", 1000, false, 0);
+    QCOMPARE(scheduler.stats("a").limit, int(2));
+    QCOMPARE(scheduler.stats("a").minLatency, qint64(1000));
+
+    // Limit not in use: stays.
+    scheduler.adjustLimit("a", 1000, false, 0);
+    QCOMPARE(scheduler.stats("a").limit, int(2));
+
+    scheduler.initialLimit = 10;
+    scheduler.adjustLimit("b", 1000, false, 0);
+    QCOMPARE(scheduler.stats("b").limit, int(10));
+
+    // Overload: 10 * 0.9.
+    scheduler.adjustLimit("b", 1000, true, 10000000);
+    QCOMPARE(scheduler.stats("b").limit, int(9));
+
+    // Within the same round trip: no second decrease.
+    scheduler.adjustLimit("b", 1000, true, 10000001);
+    QCOMPARE(scheduler.stats("b").limit, int(9));
+
+    // Slow reply (more than twice the lowest latency).
+    scheduler.adjustLimit("b", 5000, false, 20000000);
+    QCOMPARE(scheduler.stats("b").limit, int(8));
+    QCOMPARE(scheduler.stats("b").lastLatency, qint64(5000));
+
+    // Never below minimum.
+    for (int i = 0; i < 100; i++)
+        scheduler.adjustLimit("b", 1000, true, 30000000 + i * 10000000LL);
+    QCOMPARE(scheduler.stats("b").limit, int(1));
+
+    QCOMPARE(QWebScheduler::isOverload(QNetworkReply::NoError, 503), bool(true));
+    QCOMPARE(QWebScheduler::isOverload(QNetworkReply::NoError, 200), bool(false));
+    QCOMPARE(QWebScheduler::isOverload(QNetworkReply::ContentNotFoundError, 404), bool(false));
+}
+
+/*
+  Queued interactive calls have to be sent before queued bulk calls,
+  even if they were made later.
+  */
+void TestQWebScheduler::priorityTest()
+{
+    QWebService service;
+    service.addMethod(method("ping", &service));
+    service.addMethod(method("urgent", &service));
+    service.setAdaptiveConcurrency(true);
+    service.setConcurrencyLimits(1, 1, 1);
+
+    QSignalSpy spy(&service, SIGNAL(replyReady(QByteArray,QString)));
+    for (int i = 0; i < 3; i++)
+        QCOMPARE(service.invokeMethod("ping", QByteArray(), QWebService::BulkPriority), bool(true));
+    QCOMPARE(service.invokeMethod("urgent", QByteArray(), QWebService::InteractivePriority),
+             bool(true));
+
+    QCOMPARE(service.queuedCalls(QWebService::BulkPriority), int(2));
+    QCOMPARE(service.queuedCalls(QWebService::InteractivePriority), int(1));
+    QCOMPARE(service.hostStats(server.url()).queued, int(3));
+
+    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), int(4), 10000);
+    QCOMPARE(spy.at(0).at(1).toString(), QString("ping"));
+    QCOMPARE(spy.at(1).at(1).toString(), QString("urgent"));
+    QCOMPARE(spy.at(2).at(1).toString(), QString("ping"));
+    QCOMPARE(service.queuedCalls(QWebService::BulkPriority), int(0));
+}
+
+/*
+  Each priority class has its own queue bound: a full bulk queue
+  must not reject interactive calls.
+  */
+void TestQWebScheduler::priorityQueueLengthTest()
+{
+    QWebService service;
+    service.addMethod(method("ping", &service));
+    service.addMethod(method("urgent", &service));
+    service.setAdaptiveConcurrency(true);
+    service.setConcurrencyLimits(1, 1, 1);
+    service.setMaxQueueLength(QWebService::BulkPriority, 1);
+    QCOMPARE(service.maxQueueLength(QWebService::BulkPriority), int(1));
+    QCOMPARE(service.maxQueueLength(QWebService::InteractivePriority), int(-1));
+
+    QCOMPARE(service.invokeMethod("ping", QByteArray(), QWebService::BulkPriority), bool(true));
+    QCOMPARE(service.invokeMethod("ping", QByteArray(), QWebService::BulkPriority), bool(true));
+    QCOMPARE(service.invokeMethod("ping", QByteArray(), QWebService::BulkPriority), bool(false));
+    QFuture<QWebReply> urgent = service.invokeMethodAsync("urgent", QByteArray(),
+                                                          QWebService::InteractivePriority);
+    QCOMPARE(urgent.isFinished(), bool(false));
+    QCOMPARE(service.hostStats(server.url()).rejected, qint64(1));
+
+    QTRY_VERIFY_WITH_TIMEOUT(urgent.isFinished(), 10000);
+    QVERIFY(urgent.result().data().contains("done"));
+}
+
+/*
+  Backpressure signals have to be emitted once when the queue reaches
+  the high watermark, and once when it drains to the low one.
+  */
+void TestQWebScheduler::watermarkTest()
+{
+    QWebService service;
+    service.addMethod(method("ping", &service));
+    service.setAdaptiveConcurrency(true);
+    service.setConcurrencyLimits(1, 1, 1);
+    service.setQueueWatermarks(1, 3);
+
+    QSignalSpy highSpy(&service, SIGNAL(queueHighWatermark(QWebService::Priority)));
+    QSignalSpy lowSpy(&service, SIGNAL(queueLowWatermark(QWebService::Priority)));
+    QSignalSpy replySpy(&service, SIGNAL(replyReady(QByteArray,QString)));
+
+    for (int i = 0; i < 4; i++)
+        QCOMPARE(service.invokeMethod("ping", QByteArray(), QWebService::BulkPriority), bool(true));
+    QCOMPARE(service.queuedCalls(QWebService::BulkPriority), int(3));
+
+    QTRY_COMPARE_WITH_TIMEOUT(replySpy.count(), int(4), 10000);
+    QCOMPARE(highSpy.count(), int(1));
+    QCOMPARE(lowSpy.count(), int(1));
+    QCOMPARE(highSpy.at(0).at(0).value<QWebService::Priority>(), QWebService::BulkPriority);
+    QCOMPARE(lowSpy.at(0).at(0).value<QWebService::Priority>(), QWebService::BulkPriority);
+}
+
+/*
+  Calls of a lane at its connection budget have to wait, without
+  holding back calls of other lanes.
+  */
+void TestQWebScheduler::laneTest()
+{
+    QWebService service;
+    QWebMethod *ping = method("ping", &service);
+    ping->setLane("bulk");
+    QCOMPARE(ping->lane(), QString("bulk"));
+    service.addMethod(ping);
+    service.addMethod(method("urgent", &service));
+    service.setAdaptiveConcurrency(true);
+    service.setConcurrencyLimits(10, 10, 10);
+    service.setLaneConnections("bulk", 1);
+    QCOMPARE(service.laneConnections("bulk"), int(1));
+    QCOMPARE(service.laneConnections(QString()), int(-1));
+
+    QSignalSpy spy(&service, SIGNAL(replyReady(QByteArray,QString)));
+    for (int i = 0; i < 3; i++)
+        QCOMPARE(service.invokeMethod("ping"), bool(true));
+    QCOMPARE(service.hostStats(server.url()).inFlight, int(1));
+    QCOMPARE(service.hostStats(server.url()).queued, int(2));
+
+    QCOMPARE(service.invokeMethod("urgent"), bool(true));
+    QCOMPARE(service.hostStats(server.url()).inFlight, int(2));
+    QCOMPARE(service.hostStats(server.url()).queued, int(2));
+
+    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), int(4), 10000);
+    QVERIFY(spy.at(0).at(1).toString() == QString("urgent")
+            || spy.at(1).at(1).toString() == QString("urgent"));
+}
+
+/*
+  Calls in different lanes must not share a connection.
+  */
+void TestQWebScheduler::laneConnectionTest()
+{
+    NetworkConditionProxy proxy;
+    proxy.setTarget(server.url());
+    QVERIFY(proxy.start());
+
+    QWebMethod ping(proxy.url(), QWebMethod::Soap12, QWebMethod::Post);
+    ping.setMethodName("ping");
+    ping.setTargetNamespace("http://tempuri.org/");
+    QSignalSpy spy(&ping, SIGNAL(replyReady(QByteArray)));
+
+    QCOMPARE(ping.invokeMethod(), bool(true));
+    QVERIFY(spy.wait(10000));
+    QCOMPARE(ping.invokeMethod(), bool(true));
+    QVERIFY(spy.wait(10000));
+    QCOMPARE(proxy.connectionCount(), int(1));
+
+    ping.setLane("bulk");
+    QCOMPARE(ping.invokeMethod(), bool(true));
+    QVERIFY(spy.wait(10000));
+    QCOMPARE(proxy.connectionCount(), int(2));
+}
+
+QTEST_MAIN(TestQWebScheduler)
+#include "tst_qwebscheduler.moc"
@@ -17,6 +17,7 @@
 
 #include <QtTest>
 #include <qwebservice.h>
+#include <qwsdl_p.h>
 
 /**
   This test case checks both QWebService (and QWebService) functionality.
@@ -32,6 +33,9 @@ private slots:
     void settersTest();
     void qpropertyTest();
     void methodManagementTest();
+    void lazyMethodsTest();
+    void sharedModelTest();
+    void wsdlChangedTest();
 };
 
 /*
@@ -186,5 +190,96 @@ void TestQWebService::methodManagementTest()
     delete reader;
 }
 
+/*
+  WSDL methods have to be created only when they are used.
+  */
+void TestQWebService::lazyMethodsTest()
+{
+    QWebService service;
+    QWsdl *wsdl = new QWsdl("../../../examples/wsdl/band_ws.asmx", &service);
+    service.setWsdl(wsdl);
+    QMap<QString, QWebMethod *> *created = QWsdlPrivate::get(wsdl)->methodsMap;
+
+    QCOMPARE(service.methodNames().size(), int(13));
+    QCOMPARE(created->size(), int(0));
+
+    QWebMethod *method = service.method("getBandName");
+    QVERIFY(method != 0);
+    QCOMPARE(service.method("getBandName"), method);
+    QCOMPARE(service.methodParameters("getBandName").size(), int(1));
+    QCOMPARE(created->size(), int(1));
+
+    // Removing a method which was not used does not create it.
+    service.removeMethod("getBandsList");
+    QCOMPARE(service.methodNames().size(), int(12));
+    QVERIFY(service.method("getBandsList") == 0);
+    QCOMPARE(created->size(), int(1));
+
+    QCOMPARE(service.methods()->size(), int(12));
+    QCOMPARE(created->size(), int(12));
+    QCOMPARE(service.methods()->value("getBandName"), method);
+}
+
+/*
+  Services using the same WSDL have to share its parsed model,
+  but not web methods.
+  */
+void TestQWebService::sharedModelTest()
+{
+    QWebService first("../../../examples/wsdl/band_ws.asmx");
+    QWebService second("../../../examples/wsdl/band_ws.asmx");
+    QWsdl *firstWsdl = first.findChild<QWsdl *>();
+    QWsdl *secondWsdl = second.findChild<QWsdl *>();
+    QVERIFY(firstWsdl != 0);
+    QVERIFY(secondWsdl != 0);
+    QVERIFY(QWsdlPrivate::get(firstWsdl)->model == QWsdlPrivate::get(secondWsdl)->model);
+
+    QCOMPARE(second.methodNames(), first.methodNames());
+    QVERIFY(first.method("getBandName") != second.method("getBandName"));
+    QCOMPARE(second.methodParameters("getBandName"), first.methodParameters("getBandName"));
+}
+
+/*
+  Methods of the service have to follow changes of its WSDL file.
+  */
+void TestQWebService::wsdlChangedTest()
+{
+    QFile source("../../../examples/wsdl/band_ws.asmx");
+    QVERIFY(source.open(QFile::ReadOnly));
+    QByteArray content = source.readAll();
+
+    QTemporaryFile file(QDir::tempPath() + "/XXXXXX.asmx");
+    QVERIFY(file.open());
+    file.write(content);
+    file.close();
+
+    QWebService service;
+    QWsdl *wsdl = new QWsdl(file.fileName(), &service);
+    service.setWsdl(wsdl);
+    QWebMethod *custom = new QWebMethod(&service);
+    custom->setMethodName("customMethod");
+    service.addMethod(custom);
+    QWebMethod *method = service.method("getBandName");
+    QVERIFY(method != 0);
+    QCOMPARE(service.methodNames().size(), int(14));
+
+    QSignalSpy spy(&service, SIGNAL(methodNamesChanged()));
+    content.replace("getBandName", "getBandTitle");
+    QVERIFY(file.open());
+    file.resize(0);
+    file.write(content);
+    file.close();
+
+    QCOMPARE(wsdl->refresh(), bool(true));
+    QCOMPARE(spy.count(), int(1));
+    QCOMPARE(service.methodNames().size(), int(14));
+    QVERIFY(!service.methodNames().contains("getBandName"));
+    QVERIFY(service.method("getBandName") == 0);
+    QVERIFY(service.method("getBandTitle") != 0);
+    QVERIFY(service.method("getBandsList") != 0);
+    QCOMPARE(service.method("customMethod"), custom);
+    QCOMPARE(method->methodName(), QString("getBandName"));
+}
+
 QTEST_MAIN(TestQWebService)
 #include "tst_qwebservice.moc"
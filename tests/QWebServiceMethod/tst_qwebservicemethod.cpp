@@ -16,6 +16,7 @@
 ****************************************************************************/
 
 #include <QtTest/QtTest>
+#include <QtNetwork/QTcpServer>
 #include <qwebservicemethod.h>
 
 /**
@@ -32,6 +33,7 @@ private slots:
     void settersTest();
     void asynchronousTest();
     void synchronousTest();
+    void synchronousTimeoutTest();
 
 private:
     void defaultGettersTest(QWebServiceMethod *msg);
@@ -162,6 +164,55 @@ void TestQWebServiceMethod::synchronousTest()
     QCOMPARE(result, bool(true));
 }
 
+/*
+  Static synchronous call, from a worker thread, to a server which never
+  replies. It has to give up after the timeout.
+  */
+class SilentCallThread : public QThread
+{
+public:
+    SilentCallThread(const QUrl &url) : url(url), elapsed(-1) {}
+
+    QUrl url;
+    QByteArray reply;
+    qint64 elapsed;
+
+protected:
+    void run()
+    {
+        QElapsedTimer timer;
+        timer.start();
+        reply = QWebServiceMethod::invokeMethod(url, "ping", "http://tempuri.org/",
+                                                QMap<QString, QVariant>(),
+                                                QWebMethod::Soap12, QWebMethod::Post,
+                                                0, 300);
+        elapsed = timer.elapsed();
+    }
+};
+
+void TestQWebServiceMethod::synchronousTimeoutTest()
+{
+    QTcpServer silent;
+    QVERIFY(silent.listen(QHostAddress::LocalHost));
+    QUrl url(QString("http://127.0.0.1:%1/silent.asmx").arg(silent.serverPort()));
+
+    SilentCallThread thread(url);
+    thread.start();
+    QTRY_VERIFY_WITH_TIMEOUT(thread.isFinished(), 10000);
+    QVERIFY(thread.reply.isEmpty());
+    QVERIFY(thread.elapsed < 5000);
+
+    // Same in the main thread.
+    QElapsedTimer timer;
+    timer.start();
+    QByteArray reply = QWebServiceMethod::invokeMethod(url, "ping", "http://tempuri.org/",
+                                                       QMap<QString, QVariant>(),
+                                                       QWebMethod::Soap12, QWebMethod::Post,
+                                                       this, 300);
+    QVERIFY(reply.isEmpty());
+    QVERIFY(timer.elapsed() < 5000);
+}
+
 void TestQWebServiceMethod::defaultGettersTest(QWebServiceMethod *method)
 {
     QCOMPARE(method->isErrorState(), bool(false));
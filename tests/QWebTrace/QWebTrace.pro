@@ -0,0 +1,11 @@
+include(../../buildInfo.pri)
+
+QT += testlib
+
+include(../../libraryIncludes.pri)
+
+DESTDIR = $${TESTS_DIRECTORY}/QWebTrace
+OBJECTS_DIR = $${TESTS_DIRECTORY}/QWebTrace
+MOC_DIR = $${TESTS_DIRECTORY}/QWebTrace
+
+SOURCES += tst_qwebtrace.cpp
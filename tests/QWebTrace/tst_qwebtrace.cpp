@@ -0,0 +1,132 @@
+/****************************************************************************
+**
+** Copyright (C) 2011 Tomasz Siekierda
+** All rights reserved.
+** Contact: Tomasz Siekierda (sierdzio@gmail.com)
+**
+** This file is part of the QWebTrace test suite.
+**
+** This file may be used under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation and
+** appearing in the file LICENSE.txt included in the packaging of this
+** file. Please review the following information to ensure the GNU Lesser
+** General Public License version 2.1 requirements will be met:
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QJsonArray>
+#include <qwebtrace.h>
+
+/*
+  This test checks QWebTrace recording and export. It does not require
+  Internet connection.
+  */
+class TestQWebTrace : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void initialTest();
+    void recordingTest();
+    void capacityTest();
+    void chromeJsonTest();
+};
+
+void TestQWebTrace::init()
+{
+    QWebTrace::setEnabled(false);
+    QWebTrace::setCapacity(65536);
+    QWebTrace::clear();
+}
+
+/*
+  Performs basic checks of default state.
+  */
+void TestQWebTrace::initialTest()
+{
+    QCOMPARE(QWebTrace::isEnabled(), bool(false));
+    QCOMPARE(QWebTrace::eventCount(), int(0));
+    QCOMPARE(QWebTrace::capacity(), int(65536));
+}
+
+/*
+  Checks that events are recorded only when recording is switched on.
+  */
+void TestQWebTrace::recordingTest()
+{
+    QWebTrace::record(QWebTrace::Enqueue, 1, QString("getBandName"));
+    QCOMPARE(QWebTrace::eventCount(), int(0));
+
+    QWebTrace::setEnabled(true);
+    QWebTrace::record(QWebTrace::Enqueue, 1, QString("getBandName"));
+    QWebTrace::record(QWebTrace::Send, 1, QString("getBandName"));
+    QWebTrace::record(QWebTrace::Deliver, 1, QString("getBandName"));
+    QCOMPARE(QWebTrace::eventCount(), int(3));
+
+    QWebTrace::setEnabled(false);
+    QWebTrace::record(QWebTrace::Decode, 1, QString("getBandName"));
+    QCOMPARE(QWebTrace::eventCount(), int(3));
+
+    QWebTrace::clear();
+    QCOMPARE(QWebTrace::eventCount(), int(0));
+}
+
+/*
+  Checks that the ring buffer does not grow above capacity.
+  */
+void TestQWebTrace::capacityTest()
+{
+    QWebTrace::setCapacity(10);
+    QWebTrace::setEnabled(true);
+
+    for (int i = 0; i < 25; i++)
+        QWebTrace::record(QWebTrace::Finish, i, QString("getBandName"));
+
+    QCOMPARE(QWebTrace::eventCount(), int(10));
+
+    QJsonDocument doc = QJsonDocument::fromJson(QWebTrace::toChromeTraceJson());
+    QJsonArray events = doc.object().value("traceEvents").toArray();
+    QCOMPARE(events.size(), int(10));
+    // Oldest events were overwritten.
+    QCOMPARE(events.first().toObject().value("id").toString(), QString("0xf"));
+    QCOMPARE(events.last().toObject().value("id").toString(), QString("0x18"));
+}
+
+/*
+  Checks the exported Chrome trace-event document.
+  */
+void TestQWebTrace::chromeJsonTest()
+{
+    QWebTrace::setEnabled(true);
+    QWebTrace::record(QWebTrace::Enqueue, 7, QString("get\"Quote\""));
+    QWebTrace::record(QWebTrace::FirstByte, 7, QString("get\"Quote\""));
+    QWebTrace::record(QWebTrace::Deliver, 7, QString("get\"Quote\""));
+
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(QWebTrace::toChromeTraceJson(), &error);
+    QCOMPARE(error.error, QJsonParseError::NoError);
+
+    QJsonArray events = doc.object().value("traceEvents").toArray();
+    QCOMPARE(events.size(), int(3));
+    QCOMPARE(events.at(0).toObject().value("ph").toString(), QString("b"));
+    QCOMPARE(events.at(0).toObject().value("name").toString(), QString("get\"Quote\""));
+    QCOMPARE(events.at(1).toObject().value("ph").toString(), QString("n"));
+    QCOMPARE(events.at(1).toObject().value("name").toString(), QString("first byte"));
+    QCOMPARE(events.at(2).toObject().value("ph").toString(), QString("e"));
+    QVERIFY(events.at(2).toObject().value("ts").toDouble()
+            >= events.at(0).toObject().value("ts").toDouble());
+    QVERIFY(events.at(0).toObject().contains("tid"));
+
+    QString fileName = QDir::temp().filePath("tst_qwebtrace.json");
+    QVERIFY(QWebTrace::dumpChromeTrace(fileName));
+    QVERIFY(QFile::exists(fileName));
+    QFile::remove(fileName);
+}
+
+QTEST_MAIN(TestQWebTrace)
+#include "tst_qwebtrace.moc"
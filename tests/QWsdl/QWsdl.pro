@@ -3,6 +3,7 @@ include(../../buildInfo.pri)
 QT += testlib
 
 include(../../libraryIncludes.pri)
+include(../../benchmarks/common/common.pri)
 
 DESTDIR = $${TESTS_DIRECTORY}/QWsdl
 OBJECTS_DIR = $${TESTS_DIRECTORY}/QWsdl
@@ -17,12 +17,16 @@
 
 #include <QtTest/QtTest>
 #include <qwsdl.h>
+#include <qwsdl_p.h>
+#include "networkconditionproxy.h"
+#include "soapstandinserver.h"
 
 /*
     This test tests QWsdl operation.
 
     It does not require Internet connection - you can check a physical WSDL file
-    if you want to, or specify address to where a remote WSDL resides.
+    if you want to, or specify address to where a remote WSDL resides. Remote
+    files are served by a local stand-in server.
   */
 class TestQWsdl : public QObject
 {
@@ -33,8 +37,183 @@ private slots:
     void gettersTest();
     void settersTest();
     void qpropertyTest();
+    void endpointsTest();
+    void lazyMethodsTest();
+    void cacheTest();
+    void remoteTest();
+    void remoteStreamTest();
+    void refreshTest();
+    void importTest();
+    void remoteImportTest();
+    void sharedModelTest();
+    void typesTest();
+    void schemaTypesTest();
+
+private:
+    static bool writeImportDocuments(const QString &directory);
 };
 
+/*
+  WSDL spreading its types over imported documents: more.wsdl (wsdl:import),
+  orders.xsd (xsd:import) and common.xsd, which includes orders.xsd back.
+  */
+static const char importsWsdl[] =
+        "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+        "<wsdl:definitions xmlns:wsdl=\"http://schemas.xmlsoap.org/wsdl/\"\n"
+        "    xmlns:s=\"http://www.w3.org/2001/XMLSchema\"\n"
+        "    xmlns:soap12=\"http://schemas.xmlsoap.org/wsdl/soap12/\"\n"
+        "    targetNamespace=\"urn:imports\">\n"
+        "  <wsdl:import namespace=\"urn:more\" location=\"more.wsdl\"/>\n"
+        "  <wsdl:types>\n"
+        "    <s:schema targetNamespace=\"urn:imports\">\n"
+        "      <s:import namespace=\"urn:orders\" schemaLocation=\"orders.xsd\"/>\n"
+        "      <s:element name=\"ping\"><s:complexType><s:sequence>\n"
+        "        <s:element minOccurs=\"0\" maxOccurs=\"1\" name=\"text\" type=\"s:string\"/>\n"
+        "      </s:sequence></s:complexType></s:element>\n"
+        "      <s:element name=\"pingResponse\"><s:complexType><s:sequence>\n"
+        "        <s:element minOccurs=\"0\" maxOccurs=\"1\" name=\"pingResult\" type=\"s:string\"/>\n"
+        "      </s:sequence></s:complexType></s:element>\n"
+        "    </s:schema>\n"
+        "  </wsdl:types>\n"
+        "  <wsdl:service name=\"Imports\">\n"
+        "    <wsdl:port name=\"ImportsSoap12\" binding=\"ImportsSoap12\">\n"
+        "      <soap12:address location=\"http://localhost:1304/imports.asmx\"/>\n"
+        "    </wsdl:port>\n"
+        "  </wsdl:service>\n"
+        "</wsdl:definitions>\n";
+
+static const char moreWsdl[] =
+        "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+        "<wsdl:definitions xmlns:wsdl=\"http://schemas.xmlsoap.org/wsdl/\"\n"
+        "    xmlns:s=\"http://www.w3.org/2001/XMLSchema\" targetNamespace=\"urn:more\">\n"
+        "  <wsdl:types>\n"
+        "    <s:schema targetNamespace=\"urn:more\">\n"
+        "      <s:import namespace=\"urn:orders\" schemaLocation=\"common.xsd\"/>\n"
+        "      <s:element name=\"getPrice\"><s:complexType><s:sequence>\n"
+        "        <s:element name=\"item\" type=\"s:string\"/>\n"
+        "      </s:sequence></s:complexType></s:element>\n"
+        "      <s:element name=\"getPriceResponse\"><s:complexType><s:sequence>\n"
+        "        <s:element name=\"getPriceResult\" type=\"s:double\"/>\n"
+        "      </s:sequence></s:complexType></s:element>\n"
+        "    </s:schema>\n"
+        "  </wsdl:types>\n"
+        "</wsdl:definitions>\n";
+
+static const char ordersXsd[] =
+        "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+        "<s:schema xmlns:s=\"http://www.w3.org/2001/XMLSchema\" targetNamespace=\"urn:orders\">\n"
+        "  <s:include schemaLocation=\"common.xsd\"/>\n"
+        "  <s:element name=\"placeOrder\"><s:complexType><s:sequence>\n"
+        "    <s:element name=\"item\" type=\"s:string\"/>\n"
+        "    <s:element name=\"count\" type=\"s:int\"/>\n"
+        "  </s:sequence></s:complexType></s:element>\n"
+        "  <s:element name=\"placeOrderResponse\"><s:complexType><s:sequence>\n"
+        "    <s:element name=\"placeOrderResult\" type=\"s:boolean\"/>\n"
+        "  </s:sequence></s:complexType></s:element>\n"
+        "</s:schema>\n";
+
+static const char commonXsd[] =
+        "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+        "<s:schema xmlns:s=\"http://www.w3.org/2001/XMLSchema\" targetNamespace=\"urn:orders\">\n"
+        "  <s:include schemaLocation=\"orders.xsd\"/>\n"
+        "  <s:element name=\"getStatus\"><s:complexType><s:sequence>\n"
+        "    <s:element name=\"order\" type=\"s:int\"/>\n"
+        "  </s:sequence></s:complexType></s:element>\n"
+        "  <s:element name=\"getStatusResponse\"><s:complexType><s:sequence>\n"
+        "    <s:element name=\"getStatusResult\" type=\"s:string\"/>\n"
+        "  </s:sequence></s:complexType></s:element>\n"
+        "</s:schema>\n";
+
+/*
+  Nested, anonymous and forward-referenced types. Type names are used
+  with, and without namespace prefix.
+  */
+static const char typesWsdl[] =
+        "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+        "<wsdl:definitions xmlns:wsdl=\"http://schemas.xmlsoap.org/wsdl/\"\n"
+        "    xmlns:s=\"http://www.w3.org/2001/XMLSchema\"\n"
+        "    xmlns:soap12=\"http://schemas.xmlsoap.org/wsdl/soap12/\"\n"
+        "    xmlns:tns=\"urn:types\" targetNamespace=\"urn:types\">\n"
+        "  <wsdl:types>\n"
+        "    <s:schema targetNamespace=\"urn:types\">\n"
+        "      <s:element name=\"sendOrder\"><s:complexType><s:sequence>\n"
+        "        <s:element name=\"customer\"><s:complexType><s:sequence>\n"
+        "          <s:element name=\"name\" type=\"string\"/>\n"
+        "          <s:element name=\"tags\" maxOccurs=\"unbounded\" type=\"s:string\"/>\n"
+        "        </s:sequence></s:complexType></s:element>\n"
+        "        <s:element name=\"lines\" type=\"tns:ArrayOfLine\"/>\n"
+        "        <s:element name=\"count\" minOccurs=\"0\" type=\"tns:Count\"/>\n"
+        "      </s:sequence></s:complexType></s:element>\n"
+        "      <s:element name=\"sendOrderResponse\"><s:complexType><s:sequence>\n"
+        "        <s:element name=\"sendOrderResult\" type=\"s:boolean\"/>\n"
+        "      </s:sequence></s:complexType></s:element>\n"
+        "      <s:complexType name=\"ArrayOfLine\"><s:sequence>\n"
+        "        <s:element name=\"Line\" maxOccurs=\"unbounded\" type=\"tns:Line\"/>\n"
+        "      </s:sequence></s:complexType>\n"
+        "      <s:complexType name=\"Line\"><s:sequence>\n"
+        "        <s:element name=\"item\" type=\"s:string\"/>\n"
+        "        <s:element name=\"price\" type=\"s:double\"/>\n"
+        "      </s:sequence></s:complexType>\n"
+        "      <s:simpleType name=\"Count\">\n"
+        "        <s:restriction base=\"s:int\"><s:minInclusive value=\"1\"/></s:restriction>\n"
+        "      </s:simpleType>\n"
+        "    </s:schema>\n"
+        "  </wsdl:types>\n"
+        "  <wsdl:service name=\"Types\">\n"
+        "    <wsdl:port name=\"TypesSoap12\" binding=\"TypesSoap12\">\n"
+        "      <soap12:address location=\"http://localhost:1304/types.asmx\"/>\n"
+        "    </wsdl:port>\n"
+        "  </wsdl:service>\n"
+        "</wsdl:definitions>\n";
+
+static const char schemaTypesWsdl[] =
+        "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+        "<wsdl:definitions xmlns:wsdl=\"http://schemas.xmlsoap.org/wsdl/\"\n"
+        "    xmlns:s=\"http://www.w3.org/2001/XMLSchema\"\n"
+        "    xmlns:soap12=\"http://schemas.xmlsoap.org/wsdl/soap12/\"\n"
+        "    xmlns:tns=\"urn:users\" targetNamespace=\"urn:users\">\n"
+        "  <wsdl:types>\n"
+        "    <s:schema targetNamespace=\"urn:users\" elementFormDefault=\"qualified\">\n"
+        "      <s:element name=\"addAdmin\" nillable=\"true\" type=\"tns:Admin\"/>\n"
+        "      <s:element name=\"addAdminResponse\" type=\"tns:date\"/>\n"
+        "      <s:complexType name=\"Admin\"><s:complexContent>\n"
+        "        <s:extension base=\"tns:User\"><s:sequence>\n"
+        "          <s:element name=\"level\" type=\"s:int\"/>\n"
+        "        </s:sequence></s:extension>\n"
+        "      </s:complexContent></s:complexType>\n"
+        "      <s:complexType name=\"User\"><s:sequence>\n"
+        "        <s:element name=\"name\" type=\"s:string\"/>\n"
+        "        <s:element name=\"since\" type=\"tns:date\"/>\n"
+        "      </s:sequence></s:complexType>\n"
+        "      <s:complexType name=\"date\"><s:sequence>\n"
+        "        <s:element name=\"day\" type=\"s:int\"/>\n"
+        "        <s:element name=\"created\" type=\"s:dateTime\"/>\n"
+        "      </s:sequence></s:complexType>\n"
+        "    </s:schema>\n"
+        "  </wsdl:types>\n"
+        "  <wsdl:service name=\"Users\">\n"
+        "    <wsdl:port name=\"UsersSoap12\" binding=\"UsersSoap12\">\n"
+        "      <soap12:address location=\"http://localhost:1304/users.asmx\"/>\n"
+        "    </wsdl:port>\n"
+        "  </wsdl:service>\n"
+        "</wsdl:definitions>\n";
+
+/*
+  Writes imports.wsdl and all documents it imports into \a directory.
+  */
+bool TestQWsdl::writeImportDocuments(const QString &directory)
+{
+    const char *names[] = { "imports.wsdl", "more.wsdl", "orders.xsd", "common.xsd" };
+    const char *contents[] = { importsWsdl, moreWsdl, ordersXsd, commonXsd };
+
+    for (int i = 0; i < 4; ++i) {
+        QFile file(QDir(directory).filePath(QLatin1String(names[i])));
+        if (!file.open(QFile::WriteOnly) || file.write(contents[i]) == -1)
+            return false;
+    }
+    return true;
+}
+
 /*
   Performs basic checks of constructor and basic methods.
   */
@@ -68,6 +247,7 @@ void TestQWsdl::gettersTest()
     QCOMPARE(wsdl.isErrorState(), bool(false));
     QCOMPARE(wsdl.errorInfo(), QString(""));
     QCOMPARE(wsdl.methodNames().size(), int(13));
+    QCOMPARE(wsdl.endpoints().size(), int(1));
 
     QStringList tempList = wsdl.methodNames();
     QMap<QString, QWebMethod *> *methods = wsdl.methods();
@@ -173,6 +353,573 @@ void TestQWsdl::qpropertyTest()
     delete wsdl;
 }
 
+/*
+  All port addresses have to be kept, first one being the host URL.
+  */
+void TestQWsdl::endpointsTest()
+{
+    QFile source("../../../examples/wsdl/band_ws.asmx");
+    QVERIFY(source.open(QFile::ReadOnly));
+    QByteArray content = source.readAll();
+    const QByteArray soap12 = "<soap12:address location=\"http://localhost:1304/band_ws.asmx\" />";
+    QVERIFY(content.contains(soap12));
+    content.replace(soap12, "<soap12:address location=\"http://backup:1305/band_ws.asmx\" />");
+
+    QTemporaryFile file(QDir::tempPath() + "/XXXXXX.asmx");
+    QVERIFY(file.open());
+    file.write(content);
+    file.close();
+
+    QWsdl wsdl(file.fileName(), this);
+    QCOMPARE(wsdl.isErrorState(), bool(false));
+    QCOMPARE(wsdl.hostUrl(), QUrl("http://localhost:1304/band_ws.asmx"));
+    QCOMPARE(wsdl.endpoints().size(), int(2));
+    QCOMPARE(wsdl.endpoints().at(0), QUrl("http://localhost:1304/band_ws.asmx"));
+    QCOMPARE(wsdl.endpoints().at(1), QUrl("http://backup:1305/band_ws.asmx"));
+}
+
+/*
+  Web methods have to be created on first use only, one at a time.
+  */
+void TestQWsdl::lazyMethodsTest()
+{
+    QWsdl wsdl(QString("../../../examples/wsdl/band_ws.asmx"), this);
+    QWsdlPrivate *d = QWsdlPrivate::get(&wsdl);
+    QCOMPARE(wsdl.isErrorState(), bool(false));
+    QCOMPARE(wsdl.methodNames().size(), int(13));
+    QCOMPARE(d->methodsMap->size(), int(0));
+
+    QWebMethod *method = wsdl.method("getBandsListForGenreAndDate");
+    QVERIFY(method != 0);
+    QCOMPARE(method->methodName(), QString("getBandsListForGenreAndDate"));
+    QCOMPARE(method->targetNamespace(), QString("http://tempuri.org/"));
+    QCOMPARE(method->parameterNamesTypes().size(), int(2));
+    QCOMPARE(method->returnValueNameType().size(), int(1));
+    QCOMPARE(wsdl.method("getBandsListForGenreAndDate"), method);
+    QCOMPARE(d->methodsMap->size(), int(1));
+    QVERIFY(wsdl.method("noSuchMethod") == 0);
+
+    QCOMPARE(wsdl.methods()->size(), int(13));
+    QCOMPARE(wsdl.methods()->value("getBandsListForGenreAndDate"), method);
+    QCOMPARE(wsdl.methods()->keys(), wsdl.methodNames());
+}
+
+/*
+  Parsed model has to be stored in, and loaded from cache, as long
+  as WSDL content does not change.
+  */
+void TestQWsdl::cacheTest()
+{
+    QTemporaryDir cache;
+    QVERIFY(cache.isValid());
+
+    QFile source("../../../examples/wsdl/band_ws.asmx");
+    QVERIFY(source.open(QFile::ReadOnly));
+    QByteArray content = source.readAll();
+
+    QTemporaryFile file(QDir::tempPath() + "/XXXXXX.asmx");
+    QVERIFY(file.open());
+    file.write(content);
+    file.close();
+
+    QWsdl first;
+    QCOMPARE(first.cacheDirectory(), QString());
+    first.setCacheDirectory(cache.path());
+    first.setWsdlFile(file.fileName());
+    QCOMPARE(first.isErrorState(), bool(false));
+    QCOMPARE(first.isLoadedFromCache(), bool(false));
+    QCOMPARE(QDir(cache.path()).entryList(QDir::Files).size(), int(1));
+
+    // Otherwise, model of the first object would be shared.
+    QWsdl::clearSchemaCache();
+    QWsdl::setDefaultCacheDirectory(cache.path());
+    QWsdl second(file.fileName(), this);
+    QWsdl::setDefaultCacheDirectory(QString());
+    QCOMPARE(second.cacheDirectory(), cache.path());
+    QCOMPARE(second.isErrorState(), bool(false));
+    QCOMPARE(second.isLoadedFromCache(), bool(true));
+    QCOMPARE(second.webServiceName(), first.webServiceName());
+    QCOMPARE(second.targetNamespace(), first.targetNamespace());
+    QCOMPARE(second.hostUrl(), first.hostUrl());
+    QCOMPARE(second.endpoints(), first.endpoints());
+    QCOMPARE(second.methodNames(), first.methodNames());
+
+    QWebMethod *method = second.method("getBandsListForGenreAndDate");
+    QVERIFY(method != 0);
+    QCOMPARE(method->parameterNamesTypes(),
+             first.method("getBandsListForGenreAndDate")->parameterNamesTypes());
+    QCOMPARE(method->returnValueNameType(),
+             first.method("getBandsListForGenreAndDate")->returnValueNameType());
+
+    // Changed content has to be parsed again.
+    content.replace("band_ws", "band_ws2");
+    QVERIFY(file.open());
+    file.resize(0);
+    file.write(content);
+    file.close();
+
+    QWsdl third;
+    third.setCacheDirectory(cache.path());
+    third.setWsdlFile(file.fileName());
+    QCOMPARE(third.isLoadedFromCache(), bool(false));
+    QCOMPARE(third.webServiceName(), QString("band_ws2"));
+    QCOMPARE(QDir(cache.path()).entryList(QDir::Files).size(), int(1));
+}
+
+/*
+  Remote WSDL has to be read without a temporary file, also by many
+  objects at once, and from cache afterwards.
+  */
+void TestQWsdl::remoteTest()
+{
+    SoapStandInServer server;
+    QVERIFY(server.addWsdl("../../../examples/wsdl/band_ws.asmx"));
+    QVERIFY(server.start());
+    QUrl url = server.url();
+    url.setQuery("wsdl");
+
+    QWsdl first(url.toString(), this);
+    QWsdl second(url.toString(), this);
+    QCOMPARE(first.isErrorState(), bool(false));
+    QCOMPARE(second.isErrorState(), bool(false));
+    QCOMPARE(first.wsdlFile(), url.toString());
+    QCOMPARE(first.webServiceName(), QString("band_ws"));
+    QCOMPARE(first.hostUrl(), QUrl("http://localhost:1304/band_ws.asmx"));
+    QCOMPARE(first.methodNames().size(), int(13));
+    QCOMPARE(second.methodNames(), first.methodNames());
+    QCOMPARE(QFile::exists("tempWsdl.asmx~"), bool(false));
+
+    QTemporaryDir cache;
+    QVERIFY(cache.isValid());
+    QWsdl::clearSchemaCache();
+    QWsdl cached;
+    cached.setCacheDirectory(cache.path());
+    cached.setWsdlFile(url.toString());
+    QCOMPARE(cached.isLoadedFromCache(), bool(false));
+
+    const int requests = server.requestCount();
+    QWsdl::clearSchemaCache();
+    QWsdl cachedAgain;
+    cachedAgain.setCacheDirectory(cache.path());
+    cachedAgain.setWsdlFile(url.toString());
+    QCOMPARE(cachedAgain.isLoadedFromCache(), bool(true));
+    QCOMPARE(cachedAgain.methodNames().size(), int(13));
+    // Cached file is revalidated: one conditional request, answered with
+    // 304 Not Modified.
+    QCOMPARE(server.requestCount(), requests + 1);
+
+    url.setQuery(QString());
+    QWsdl missing(url.toString(), this);
+    QCOMPARE(missing.isErrorState(), bool(true));
+
+    // Within max age, cached model is used without asking the server,
+    // also when it is gone.
+    url.setQuery("wsdl");
+    server.close();
+    QWsdl::clearSchemaCache();
+    QWsdl offline;
+    offline.setCacheDirectory(cache.path());
+    offline.setCacheMaxAge(3600);
+    QCOMPARE(offline.cacheMaxAge(), int(3600));
+    offline.setWsdlFile(url.toString());
+    QCOMPARE(offline.isErrorState(), bool(false));
+    QCOMPARE(offline.isLoadedFromCache(), bool(true));
+    QCOMPARE(offline.methodNames().size(), int(13));
+}
+
+/*
+  WSDL arriving in small pieces has to be parsed as it arrives.
+  */
+void TestQWsdl::remoteStreamTest()
+{
+    SoapStandInServer server;
+    QVERIFY(server.addWsdl("../../../examples/wsdl/band_ws.asmx"));
+    QVERIFY(server.start());
+
+    NetworkConditions conditions;
+    conditions.dripBytes = 101;
+    conditions.dripInterval = 1;
+    NetworkConditionProxy proxy;
+    proxy.setTarget(server.url());
+    proxy.setConditions(conditions);
+    QVERIFY(proxy.start());
+
+    QUrl url = proxy.url();
+    url.setQuery("wsdl");
+
+    QWsdl wsdl(url.toString(), this);
+    QCOMPARE(wsdl.isErrorState(), bool(false));
+    QCOMPARE(wsdl.webServiceName(), QString("band_ws"));
+    QCOMPARE(wsdl.methodNames().size(), int(13));
+    QCOMPARE(wsdl.method("bookABand")->parameterNamesTypes().size(), int(11));
+}
+
+/*
+  Unchanged WSDL must not be read again on refresh: remote one gets
+  304 Not Modified, local one is checked by modification time and size.
+  */
+void TestQWsdl::refreshTest()
+{
+    SoapStandInServer server;
+    QVERIFY(server.addWsdl("../../../examples/wsdl/band_ws.asmx"));
+    QVERIFY(server.start());
+    QUrl url = server.url();
+    url.setQuery("wsdl");
+
+    QWsdl wsdl(url.toString(), this);
+    QCOMPARE(wsdl.isErrorState(), bool(false));
+    QWebMethod *method = wsdl.method("bookABand");
+    QVERIFY(method != 0);
+
+    QSignalSpy spy(&wsdl, SIGNAL(wsdlFileChanged()));
+    int requests = server.requestCount();
+    QCOMPARE(wsdl.refresh(), bool(true));
+    wsdl.resetWsdl(url.toString());
+    QCOMPARE(server.requestCount(), requests + 2);
+    QCOMPARE(spy.count(), int(0));
+    QCOMPARE(wsdl.isErrorState(), bool(false));
+    QCOMPARE(wsdl.method("bookABand"), method);
+
+    // Changed WSDL has to be read again.
+    QVERIFY(server.addWsdl("../../../examples/wsdl/stockquote.asmx"));
+    QCOMPARE(wsdl.refresh(), bool(true));
+    QCOMPARE(spy.count(), int(1));
+    QCOMPARE(wsdl.webServiceName(), QString("StockQuote"));
+    QCOMPARE(wsdl.methodNames().size(), int(7));
+
+    requests = server.requestCount();
+    QCOMPARE(wsdl.refreshInterval(), int(0));
+    wsdl.setRefreshInterval(50);
+    QCOMPARE(wsdl.refreshInterval(), int(50));
+    QTRY_VERIFY(server.requestCount() >= requests + 2);
+    QCOMPARE(spy.count(), int(1));
+
+    // Automatic refresh does not block: the change is read when the
+    // reply is finished, in the event loop.
+    QVERIFY(server.addWsdl("../../../examples/wsdl/band_ws.asmx"));
+    QTRY_COMPARE(spy.count(), int(2));
+    wsdl.setRefreshInterval(0);
+    QCOMPARE(wsdl.isErrorState(), bool(false));
+    QCOMPARE(wsdl.webServiceName(), QString("band_ws"));
+    QVERIFY(wsdl.method("bookABand") != 0);
+
+    // Local file.
+    QFile source("../../../examples/wsdl/band_ws.asmx");
+    QVERIFY(source.open(QFile::ReadOnly));
+    QByteArray content = source.readAll();
+
+    QTemporaryFile file(QDir::tempPath() + "/XXXXXX.asmx");
+    QVERIFY(file.open());
+    file.write(content);
+    file.close();
+
+    QWsdl local(file.fileName(), this);
+    QSignalSpy localSpy(&local, SIGNAL(wsdlFileChanged()));
+    QCOMPARE(local.refresh(), bool(true));
+    QCOMPARE(localSpy.count(), int(0));
+
+    content.replace("band_ws", "band_ws_changed");
+    QVERIFY(file.open());
+    file.resize(0);
+    file.write(content);
+    file.close();
+
+    QCOMPARE(local.refresh(), bool(true));
+    QCOMPARE(localSpy.count(), int(1));
+    QCOMPARE(local.webServiceName(), QString("band_ws_changed"));
+
+    // File which can not be parsed must not replace current model.
+    QWebMethod *localMethod = local.method("bookABand");
+    QVERIFY(localMethod != 0);
+    QVERIFY(file.open());
+    file.resize(0);
+    file.write("<definitions><broken");
+    file.close();
+
+    QCOMPARE(local.refresh(), bool(false));
+    QCOMPARE(localSpy.count(), int(1));
+    QCOMPARE(local.webServiceName(), QString("band_ws_changed"));
+    QCOMPARE(local.method("bookABand"), localMethod);
+}
+
+/*
+  Types from imported documents have to be read, also when imports
+  form a cycle.
+  */
+void TestQWsdl::importTest()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QVERIFY(writeImportDocuments(dir.path()));
+    QWsdl::clearSchemaCache();
+
+    QWsdl wsdl(dir.path() + "/imports.wsdl", this);
+    QCOMPARE(wsdl.isErrorState(), bool(false));
+    QCOMPARE(wsdl.webServiceName(), QString("Imports"));
+    QCOMPARE(wsdl.methodNames(), QStringList() << "getPrice" << "getStatus"
+             << "ping" << "placeOrder");
+
+    QWebMethod *method = wsdl.method("placeOrder");
+    QVERIFY(method != 0);
+    QCOMPARE(method->parameterNamesTypes().size(), int(2));
+    QCOMPARE(method->parameterNamesTypes().value("count").type(), QVariant::Int);
+    QCOMPARE(method->returnValueNameType().value("placeOrderResult").type(),
+             QVariant::Bool);
+    QCOMPARE(wsdl.method("getPrice")->returnValueNameType()
+             .value("getPriceResult").type(), QVariant::Double);
+
+    // Cached (and shared) model has to be dropped when an imported
+    // document changes, even if the WSDL itself does not.
+    QTemporaryDir cache;
+    QVERIFY(cache.isValid());
+    QWsdl::clearSchemaCache();
+    QWsdl cached;
+    cached.setCacheDirectory(cache.path());
+    cached.setWsdlFile(dir.path() + "/imports.wsdl");
+    QCOMPARE(cached.isErrorState(), bool(false));
+
+    QWsdl::clearSchemaCache();
+    QWsdl cachedAgain;
+    cachedAgain.setCacheDirectory(cache.path());
+    cachedAgain.setWsdlFile(dir.path() + "/imports.wsdl");
+    QCOMPARE(cachedAgain.isLoadedFromCache(), bool(true));
+
+    QFile orders(dir.path() + "/orders.xsd");
+    QVERIFY(orders.open(QFile::WriteOnly));
+    orders.write(QByteArray(ordersXsd).replace("placeOrder", "cancelOrder"));
+    orders.close();
+
+    QWsdl changed;
+    changed.setCacheDirectory(cache.path());
+    changed.setWsdlFile(dir.path() + "/imports.wsdl");
+    QCOMPARE(changed.isErrorState(), bool(false));
+    QCOMPARE(changed.isLoadedFromCache(), bool(false));
+    QVERIFY(QWsdlPrivate::get(&changed)->model != QWsdlPrivate::get(&cached)->model);
+    QVERIFY(changed.methodNames().contains("cancelOrder"));
+    QVERIFY(!changed.methodNames().contains("placeOrder"));
+
+    // Missing document is an error.
+    QVERIFY(QFile::remove(dir.path() + "/common.xsd"));
+    QWsdl::clearSchemaCache();
+    QWsdl broken(dir.path() + "/imports.wsdl", this);
+    QCOMPARE(broken.isErrorState(), bool(true));
+    QVERIFY(broken.errorInfo().contains("common.xsd"));
+}
+
+/*
+  Remote imported documents have to be downloaded once each, and
+  reused by other QWsdl objects while the server reports no change.
+  */
+void TestQWsdl::remoteImportTest()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QVERIFY(writeImportDocuments(dir.path()));
+
+    SoapStandInServer server;
+    QVERIFY(server.addWsdl(dir.path() + "/imports.wsdl"));
+    server.addDocument("/more.wsdl", moreWsdl);
+    server.addDocument("/orders.xsd", ordersXsd);
+    server.addDocument("/common.xsd", commonXsd);
+    QVERIFY(server.start());
+    QUrl url = server.url();
+    url.setQuery("wsdl");
+
+    QWsdl::clearSchemaCache();
+    const int requests = server.requestCount();
+    QStringList names;
+    {
+        QWsdl first(url.toString(), this);
+        QCOMPARE(first.isErrorState(), bool(false));
+        QCOMPARE(first.methodNames().size(), int(4));
+        QCOMPARE(server.requestCount(), requests + 4);
+        names = first.methodNames();
+    }
+
+    // Model is not shared any more, but imported documents are: they are
+    // only requested conditionally.
+    QWsdl second(url.toString(), this);
+    QCOMPARE(second.isErrorState(), bool(false));
+    QCOMPARE(second.methodNames(), names);
+    QCOMPARE(server.requestCount(), requests + 8);
+
+    // Changed document is downloaded again.
+    QByteArray changed(commonXsd);
+    changed.replace("getStatus", "getState");
+    server.addDocument("/common.xsd", changed);
+    QWsdl third(url.toString(), this);
+    QCOMPARE(third.isErrorState(), bool(false));
+    QVERIFY(third.methodNames().contains("getState"));
+    QVERIFY(!third.methodNames().contains("getStatus"));
+    QWsdl::clearSchemaCache();
+}
+
+/*
+  Objects reading the same WSDL have to share one model, until
+  the file changes.
+  */
+void TestQWsdl::sharedModelTest()
+{
+    QFile source("../../../examples/wsdl/band_ws.asmx");
+    QVERIFY(source.open(QFile::ReadOnly));
+    QByteArray content = source.readAll();
+
+    QTemporaryFile file(QDir::tempPath() + "/XXXXXX.asmx");
+    QVERIFY(file.open());
+    file.write(content);
+    file.close();
+
+    QWsdl first(file.fileName(), this);
+    QWsdl second(file.fileName(), this);
+    QCOMPARE(second.isErrorState(), bool(false));
+    QVERIFY(QWsdlPrivate::get(&first)->model == QWsdlPrivate::get(&second)->model);
+    QCOMPARE(second.methodNames(), first.methodNames());
+
+    // Web methods are not shared.
+    QVERIFY(first.method("getBandName") != 0);
+    QVERIFY(first.method("getBandName") != second.method("getBandName"));
+    QCOMPARE(first.method("getBandName")->parameterNamesTypes(),
+             second.method("getBandName")->parameterNamesTypes());
+
+    content.replace("band_ws", "band_ws_changed");
+    QVERIFY(file.open());
+    file.resize(0);
+    file.write(content);
+    file.close();
+
+    QWsdl third(file.fileName(), this);
+    QCOMPARE(third.webServiceName(), QString("band_ws_changed"));
+    QVERIFY(QWsdlPrivate::get(&third)->model != QWsdlPrivate::get(&first)->model);
+    QCOMPARE(first.webServiceName(), QString("band_ws"));
+
+    QWsdl::clearSchemaCache();
+    QWsdl fourth(file.fileName(), this);
+    QVERIFY(QWsdlPrivate::get(&fourth)->model != QWsdlPrivate::get(&third)->model);
+    QCOMPARE(fourth.methodNames(), third.methodNames());
+}
+
+/*
+  Schema types are kept in flat tables, with fields in order of
+  declaration, and names interned.
+  */
+void TestQWsdl::typesTest()
+{
+    QWsdl wsdl("../../../examples/wsdl/band_ws.asmx", this);
+    QCOMPARE(wsdl.isErrorState(), bool(false));
+
+    const QWsdlModel *model = QWsdlPrivate::get(&wsdl)->model.data();
+    const QWsdlTypeTable &table = model->types;
+    QCOMPARE(table.elementTypes.size(), model->elements.size());
+
+    int type = table.elementTypes.at(model->elements.indexOf("getBandsListForGenreAndDate"));
+    QCOMPARE(table.types.at(type).kind, qint32(QWsdlTypeTable::Complex));
+    QCOMPARE(table.types.at(type).fieldCount, qint32(2));
+    const QWsdlTypeTable::Field &genre = table.fields.at(table.types.at(type).firstField);
+    const QWsdlTypeTable::Field &date = table.fields.at(table.types.at(type).firstField + 1);
+    QCOMPARE(table.names.at(genre.name), QString("genreName"));
+    QCOMPARE(genre.minOccurs, qint32(0));
+    QCOMPARE(table.names.at(date.name), QString("date"));
+    QCOMPARE(table.types.at(date.type).kind, qint32(QWsdlTypeTable::DateTime));
+
+    // ArrayOfString is declared after it is first used. Type names carry
+    // their namespace, so "string" is only the name of its field.
+    type = table.elementTypes.at(model->elements.indexOf("getBandsListResponse"));
+    const int arrayType = table.fields.at(table.types.at(type).firstField).type;
+    QVERIFY(table.isArray(arrayType));
+    QCOMPARE(table.names.count("string"), int(1));
+    QCOMPARE(wsdl.method("getBandsList")->returnValueNameType()
+             .value("getBandsListResult").type(), QVariant::StringList);
+
+    QTemporaryFile file(QDir::tempPath() + "/XXXXXX.wsdl");
+    QVERIFY(file.open());
+    file.write(typesWsdl);
+    file.close();
+
+    QWsdl nested(file.fileName(), this);
+    QCOMPARE(nested.isErrorState(), bool(false));
+    QCOMPARE(nested.methodNames(), QStringList() << "sendOrder");
+
+    QWebMethod *method = nested.method("sendOrder");
+    QVERIFY(method != 0);
+    QMap<QString, QVariant> parameters = method->parameterNamesTypes();
+    QCOMPARE(parameters.size(), int(3));
+    QCOMPARE(parameters.value("customer").type(), QVariant::String);
+    QCOMPARE(parameters.value("lines").type(), QVariant::List);
+    QCOMPARE(parameters.value("count").type(), QVariant::Int);
+
+    const QWsdlModel *nestedModel = QWsdlPrivate::get(&nested)->model.data();
+    const QWsdlTypeTable &nestedTable = nestedModel->types;
+    type = nestedTable.elementTypes.at(nestedModel->elements.indexOf("sendOrder"));
+    const QWsdlTypeTable::Field &customer = nestedTable.fields.at(
+                nestedTable.types.at(type).firstField);
+    QCOMPARE(nestedTable.names.at(customer.name), QString("customer"));
+
+    // Nested type keeps its fields in order, prefix-less types resolve.
+    const QWsdlTypeTable::Type &customerType = nestedTable.types.at(customer.type);
+    QCOMPARE(customerType.name, qint32(-1));
+    QCOMPARE(customerType.fieldCount, qint32(2));
+    const QWsdlTypeTable::Field &name = nestedTable.fields.at(customerType.firstField);
+    const QWsdlTypeTable::Field &tags = nestedTable.fields.at(customerType.firstField + 1);
+    QCOMPARE(nestedTable.names.at(name.name), QString("name"));
+    QCOMPARE(nestedTable.types.at(name.type).kind, qint32(QWsdlTypeTable::String));
+    QCOMPARE(nestedTable.names.at(tags.name), QString("tags"));
+    QCOMPARE(tags.maxOccurs, qint32(-1));
+
+    // Forward references are resolved once the type is declared.
+    const QWsdlTypeTable::Field &lines = nestedTable.fields.at(
+                nestedTable.types.at(type).firstField + 1);
+    QVERIFY(nestedTable.isArray(lines.type));
+    const int lineType = nestedTable.fields.at(
+                nestedTable.types.at(lines.type).firstField).type;
+    QCOMPARE(nestedTable.types.at(lineType).kind, qint32(QWsdlTypeTable::Complex));
+    QCOMPARE(nestedTable.parameters(lineType).value("price").type(), QVariant::Double);
+}
+
+/*
+  Top-level elements can refer to named types, types are told apart by
+  namespace (a user type called "date" is not the XSD one), and fields
+  of extended types are inherited.
+  */
+void TestQWsdl::schemaTypesTest()
+{
+    QTemporaryFile file(QDir::tempPath() + "/XXXXXX.wsdl");
+    QVERIFY(file.open());
+    file.write(schemaTypesWsdl);
+    file.close();
+
+    QWsdl wsdl(file.fileName(), this);
+    QCOMPARE(wsdl.isErrorState(), bool(false));
+    QCOMPARE(wsdl.methodNames(), QStringList() << "addAdmin");
+
+    QWebMethod *method = wsdl.method("addAdmin");
+    QVERIFY(method != 0);
+    QMap<QString, QVariant> parameters = method->parameterNamesTypes();
+    QCOMPARE(parameters.size(), int(3));
+    QCOMPARE(parameters.value("name").type(), QVariant::String);
+    QCOMPARE(parameters.value("since").type(), QVariant::String);
+    QCOMPARE(parameters.value("level").type(), QVariant::Int);
+
+    QMap<QString, QVariant> returns = method->returnValueNameType();
+    QCOMPARE(returns.size(), int(2));
+    QCOMPARE(returns.value("day").type(), QVariant::Int);
+    QCOMPARE(returns.value("created").type(), QVariant::DateTime);
+
+    const QWsdlModel *model = QWsdlPrivate::get(&wsdl)->model.data();
+    const QWsdlTypeTable &table = model->types;
+    const int admin = table.elementTypes.at(model->elements.indexOf("addAdmin"));
+    QCOMPARE(table.names.at(table.types.at(admin).name),
+             QWsdlTypeTable::expandedName("urn:users", "Admin"));
+    QCOMPARE(table.types.at(admin).fieldCount, qint32(1));
+    QCOMPARE(table.allFields(admin).size(), int(3));
+
+    const int date = table.elementTypes.at(model->elements.indexOf("addAdminResponse"));
+    QCOMPARE(table.types.at(date).kind, qint32(QWsdlTypeTable::Complex));
+    const int xsdDate = table.namedTypes.value(table.nameIndexes.value(
+            QWsdlTypeTable::expandedName("http://www.w3.org/2001/XMLSchema", "date")));
+    QVERIFY(xsdDate != date);
+    QCOMPARE(table.types.at(xsdDate).kind, qint32(QWsdlTypeTable::Date));
+}
+
 QTEST_MAIN(TestQWsdl)
 #include "tst_qwsdl.moc"
 
@@ -7,5 +7,14 @@ SUBDIRS += \
     QWebMethod \
     QWebServiceMethod \
     QWsdl \
+    QWebTrace \
+    QWebMethodAllocations \
+    QWebDispatcher \
+    QWebReply \
+    QWebScheduler \
+    QWebConnectionPool \
+    QWebBalancer \
+    QWebHedging \
+    QWebMirror \
     qtwsdlconvert
 